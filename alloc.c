@@ -15,6 +15,7 @@
 #include "commit.h"
 #include "tag.h"
 #include "alloc.h"
+#include "thread-utils.h"
 
 #define BLOCKING 1024
 
@@ -50,10 +51,40 @@ void clear_alloc_state(struct alloc_state *s)
 	FREE_AND_NULL(s->slabs);
 }
 
+static int alloc_concurrent;
+static pthread_mutex_t alloc_mutex;
+
+void alloc_begin_concurrent(void)
+{
+	if (!alloc_concurrent++)
+		pthread_mutex_init(&alloc_mutex, NULL);
+}
+
+void alloc_end_concurrent(void)
+{
+	if (!alloc_concurrent)
+		BUG("alloc_end_concurrent() without alloc_begin_concurrent()");
+	if (!--alloc_concurrent)
+		pthread_mutex_destroy(&alloc_mutex);
+}
+
+static inline void alloc_lock(void)
+{
+	if (alloc_concurrent)
+		pthread_mutex_lock(&alloc_mutex);
+}
+
+static inline void alloc_unlock(void)
+{
+	if (alloc_concurrent)
+		pthread_mutex_unlock(&alloc_mutex);
+}
+
 static inline void *alloc_node(struct alloc_state *s, size_t node_size)
 {
 	void *ret;
 
+	alloc_lock();
 	if (!s->nr) {
 		s->nr = BLOCKING;
 		s->p = xmalloc(BLOCKING * node_size);
@@ -64,6 +95,7 @@ static inline void *alloc_node(struct alloc_state *s, size_t node_size)
 	s->nr--;
 	ret = s->p;
 	s->p = (char *)s->p + node_size;
+	alloc_unlock();
 	memset(ret, 0, node_size);
 
 	return ret;
@@ -105,7 +137,12 @@ void *alloc_object_node(struct repository *r)
 static unsigned int alloc_commit_index(void)
 {
 	static unsigned int parsed_commits_count;
-	return parsed_commits_count++;
+	unsigned int index;
+
+	alloc_lock();
+	index = parsed_commits_count++;
+	alloc_unlock();
+	return index;
 }
 
 void init_commit_node(struct commit *c)
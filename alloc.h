@@ -17,4 +17,11 @@ void *alloc_object_node(struct repository *r);
 struct alloc_state *allocate_alloc_state(void);
 void clear_alloc_state(struct alloc_state *s);
 
+/*
+ * Make the node allocators above safe to call from multiple threads,
+ * until a matching alloc_end_concurrent(). Calls may nest.
+ */
+void alloc_begin_concurrent(void);
+void alloc_end_concurrent(void);
+
 #endif
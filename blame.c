@@ -11,6 +11,14 @@
 #include "commit-slab.h"
 #include "bloom.h"
 #include "commit-graph.h"
+#include "notes-cache.h"
+#include "userdiff.h"
+#include "thread-utils.h"
+#include "tree-walk.h"
+#include "list.h"
+#include "strmap.h"
+#include "replace-object.h"
+#include "shallow.h"
 
 define_commit_slab(blame_suspects, struct blame_origin *);
 static struct blame_suspects blame_suspects;
@@ -1927,6 +1935,178 @@ static int blame_chunk_cb(long start_a, long count_a,
 	return 0;
 }
 
+/*
+ * With "blame.threads", the diffs that pass_blame_to_parent() is
+ * going to need are computed ahead of time by worker threads, while
+ * the main thread keeps digging through the commits in order. To find
+ * work for them, the main thread follows the path being blamed into
+ * the history ahead of the actual walk. Only the xdiff computation
+ * runs on the workers; the blobs are read by the main thread, and the
+ * recorded hunks are fed to the usual callback, so the result does
+ * not change.
+ */
+enum blame_diff_state {
+	BLAME_DIFF_QUEUED,
+	BLAME_DIFF_RUNNING,
+	BLAME_DIFF_DONE,
+};
+
+struct blame_diff {
+	struct list_head list;
+	/* the diff is between "parent_oid" and "target_oid" at "path" */
+	struct commit *commit;
+	char *path;
+	struct object_id parent_oid, target_oid;
+	mmfile_t file_p, file_o;
+	long *hunks;
+	size_t nr, alloc;
+	int status;
+	enum blame_diff_state state;
+};
+
+struct blame_prefetch {
+	pthread_mutex_t mutex;
+	pthread_cond_t work, done;
+	pthread_t *threads;
+	int nr_threads;
+	int xdl_opts;
+	/* the diffs in the order they were queued */
+	struct list_head diffs;
+	int nr_diffs, max_diffs;
+	int shutdown;
+
+	/* blobs at which to continue looking ahead, newest first */
+	struct prio_queue cursors;
+	struct strset seen;
+};
+
+static int blame_prefetch_queued;
+static int blame_prefetch_used;
+
+static int record_hunk(long start_a, long count_a,
+		       long start_b, long count_b, void *data)
+{
+	struct blame_diff *diff = data;
+
+	ALLOC_GROW(diff->hunks, diff->nr + 4, diff->alloc);
+	diff->hunks[diff->nr++] = start_a;
+	diff->hunks[diff->nr++] = count_a;
+	diff->hunks[diff->nr++] = start_b;
+	diff->hunks[diff->nr++] = count_b;
+	return 0;
+}
+
+/*
+ * Only the main thread frees diffs. The caller must hold the mutex, and
+ * the diff must not be running.
+ */
+static void free_blame_diff(struct blame_prefetch *pf, struct blame_diff *diff)
+{
+	list_del(&diff->list);
+	pf->nr_diffs--;
+	free(diff->path);
+	free(diff->file_p.ptr);
+	free(diff->file_o.ptr);
+	free(diff->hunks);
+	free(diff);
+}
+
+static void *blame_diff_worker(void *data)
+{
+	struct blame_prefetch *pf = data;
+
+	pthread_mutex_lock(&pf->mutex);
+	while (!pf->shutdown) {
+		struct blame_diff *diff = NULL;
+		struct list_head *pos;
+
+		list_for_each(pos, &pf->diffs) {
+			struct blame_diff *d = list_entry(pos, struct blame_diff, list);
+			if (d->state == BLAME_DIFF_QUEUED) {
+				diff = d;
+				break;
+			}
+		}
+		if (!diff) {
+			pthread_cond_wait(&pf->work, &pf->mutex);
+			continue;
+		}
+
+		diff->state = BLAME_DIFF_RUNNING;
+		pthread_mutex_unlock(&pf->mutex);
+		diff->status = diff_hunks(&diff->file_p, &diff->file_o,
+					  record_hunk, diff, pf->xdl_opts);
+		FREE_AND_NULL(diff->file_p.ptr);
+		FREE_AND_NULL(diff->file_o.ptr);
+		pthread_mutex_lock(&pf->mutex);
+
+		diff->state = BLAME_DIFF_DONE;
+		pthread_cond_broadcast(&pf->done);
+	}
+	pthread_mutex_unlock(&pf->mutex);
+	return NULL;
+}
+
+/*
+ * Feed the hunks between "parent" and "target" to blame_chunk_cb(),
+ * from a diff computed ahead of time if there is one.
+ */
+static int blame_diff_hunks(struct blame_scoreboard *sb,
+			    struct blame_origin *target,
+			    struct blame_origin *parent,
+			    struct blame_chunk_cb_data *d)
+{
+	struct blame_prefetch *pf = sb->prefetch;
+	struct blame_diff *diff = NULL;
+	struct list_head *pos;
+	mmfile_t file_p, file_o;
+	int status = 0;
+	size_t i;
+
+	if (pf && !strcmp(parent->path, target->path)) {
+		pthread_mutex_lock(&pf->mutex);
+		list_for_each(pos, &pf->diffs) {
+			struct blame_diff *d = list_entry(pos, struct blame_diff, list);
+			if (d->commit == target->commit &&
+			    oideq(&d->parent_oid, &parent->blob_oid) &&
+			    oideq(&d->target_oid, &target->blob_oid) &&
+			    !strcmp(d->path, target->path)) {
+				diff = d;
+				break;
+			}
+		}
+		while (diff && diff->state != BLAME_DIFF_DONE)
+			pthread_cond_wait(&pf->done, &pf->mutex);
+		pthread_mutex_unlock(&pf->mutex);
+	}
+
+	/*
+	 * The contents are not needed if the diff is known, unless we
+	 * have to guess where the lines of an ignored commit came from.
+	 */
+	if (!diff || d->ignore_diffs) {
+		fill_origin_blob(&sb->revs->diffopt, parent, &file_p,
+				 &sb->num_read_blob, d->ignore_diffs);
+		fill_origin_blob(&sb->revs->diffopt, target, &file_o,
+				 &sb->num_read_blob, d->ignore_diffs);
+	}
+	if (!diff)
+		return diff_hunks(&file_p, &file_o, blame_chunk_cb, d,
+				  sb->xdl_opts);
+
+	/* only we free diffs, so "diff" stays around while we use it */
+	blame_prefetch_used++;
+	status = diff->status;
+	for (i = 0; !status && i < diff->nr; i += 4)
+		blame_chunk_cb(diff->hunks[i], diff->hunks[i + 1],
+			       diff->hunks[i + 2], diff->hunks[i + 3], d);
+
+	pthread_mutex_lock(&pf->mutex);
+	free_blame_diff(pf, diff);
+	pthread_mutex_unlock(&pf->mutex);
+	return status;
+}
+
 /*
  * We are looking at the origin 'target' and aiming to pass blame
  * for the lines it is suspected to its parent.  Run diff to find
@@ -1936,7 +2116,6 @@ static void pass_blame_to_parent(struct blame_scoreboard *sb,
 				 struct blame_origin *target,
 				 struct blame_origin *parent, int ignore_diffs)
 {
-	mmfile_t file_p, file_o;
 	struct blame_chunk_cb_data d;
 	struct blame_entry *newdest = NULL;
 
@@ -1949,13 +2128,9 @@ static void pass_blame_to_parent(struct blame_scoreboard *sb,
 	d.ignore_diffs = ignore_diffs;
 	d.dstq = &newdest; d.srcq = &target->suspects;
 
-	fill_origin_blob(&sb->revs->diffopt, parent, &file_p,
-			 &sb->num_read_blob, ignore_diffs);
-	fill_origin_blob(&sb->revs->diffopt, target, &file_o,
-			 &sb->num_read_blob, ignore_diffs);
 	sb->num_get_patch++;
 
-	if (diff_hunks(&file_p, &file_o, blame_chunk_cb, &d, sb->xdl_opts))
+	if (blame_diff_hunks(sb, target, parent, &d))
 		die("unable to generate diff (%s -> %s)",
 		    oid_to_hex(&parent->commit->object.oid),
 		    oid_to_hex(&target->commit->object.oid));
@@ -2575,6 +2750,501 @@ static void pass_blame(struct blame_scoreboard *sb, struct blame_origin *origin,
 		free(sg_origin);
 }
 
+struct blame_cursor {
+	struct commit *commit;
+	struct object_id blob_oid;
+	char path[FLEX_ARRAY];
+};
+
+static int compare_blame_cursors(const void *a_, const void *b_, void *data)
+{
+	const struct blame_cursor *a = a_, *b = b_;
+
+	return compare_commits_by_commit_date(a->commit, b->commit, data);
+}
+
+static void add_blame_cursor(struct blame_prefetch *pf, struct commit *commit,
+			     const char *path, const struct object_id *blob_oid)
+{
+	struct strbuf key = STRBUF_INIT;
+	struct blame_cursor *c;
+
+	strbuf_addf(&key, "%s %s", oid_to_hex(&commit->object.oid), path);
+	if (strset_add(&pf->seen, key.buf)) {
+		FLEX_ALLOC_STR(c, path, path);
+		c->commit = commit;
+		oidcpy(&c->blob_oid, blob_oid);
+		prio_queue_put(&pf->cursors, c);
+	}
+	strbuf_release(&key);
+}
+
+static void queue_blame_diff(struct blame_scoreboard *sb,
+			     struct blame_cursor *c,
+			     const struct object_id *parent_oid)
+{
+	struct blame_prefetch *pf = sb->prefetch;
+	struct blame_diff *diff;
+	enum object_type type_p, type_o;
+	unsigned long size_p, size_o;
+	char *buf_p, *buf_o;
+
+	buf_p = read_object_file(parent_oid, &type_p, &size_p);
+	buf_o = read_object_file(&c->blob_oid, &type_o, &size_o);
+	if (!buf_p || !buf_o || type_p != OBJ_BLOB || type_o != OBJ_BLOB) {
+		free(buf_p);
+		free(buf_o);
+		return;
+	}
+
+	CALLOC_ARRAY(diff, 1);
+	diff->commit = c->commit;
+	diff->path = xstrdup(c->path);
+	oidcpy(&diff->parent_oid, parent_oid);
+	oidcpy(&diff->target_oid, &c->blob_oid);
+	diff->file_p.ptr = buf_p;
+	diff->file_p.size = size_p;
+	diff->file_o.ptr = buf_o;
+	diff->file_o.size = size_o;
+	blame_prefetch_queued++;
+
+	pthread_mutex_lock(&pf->mutex);
+	list_add_tail(&diff->list, &pf->diffs);
+	pf->nr_diffs++;
+	pthread_cond_signal(&pf->work);
+	pthread_mutex_unlock(&pf->mutex);
+}
+
+/*
+ * Take the newest blob we have not looked past yet, and queue the
+ * diffs against the same path in the parents of its commit, which is
+ * what pass_blame() will do if the walk gets there. Then continue
+ * with the parents.
+ */
+static void advance_blame_cursor(struct blame_scoreboard *sb)
+{
+	struct blame_prefetch *pf = sb->prefetch;
+	struct blame_cursor *c = prio_queue_get(&pf->cursors);
+	struct commit *commit = c->commit;
+	struct oid_array parents = OID_ARRAY_INIT;
+	struct commit_list *sg;
+	size_t i;
+
+	if (repo_parse_commit(sb->repo, commit) ||
+	    (commit->object.flags & UNINTERESTING) ||
+	    (sb->revs->max_age != -1 && commit->date < sb->revs->max_age))
+		goto out;
+	/* the walk would diff the converted contents */
+	if (sb->revs->diffopt.flags.allow_textconv) {
+		struct userdiff_driver *driver;
+
+		driver = userdiff_find_by_path(sb->repo->index, c->path);
+		if (driver && userdiff_get_textconv(sb->repo, driver))
+			goto out;
+	}
+
+	for (sg = first_scapegoat(sb->revs, commit, 0); sg; sg = sg->next) {
+		struct object_id oid;
+		unsigned short mode;
+
+		if (repo_parse_commit(sb->repo, sg->item) ||
+		    get_tree_entry(sb->repo, get_commit_tree_oid(sg->item),
+				   c->path, &oid, &mode) ||
+		    !S_ISREG(mode))
+			continue;
+		/* the blame will be passed to this parent as a whole */
+		if (oideq(&oid, &c->blob_oid)) {
+			add_blame_cursor(pf, sg->item, c->path, &oid);
+			goto out;
+		}
+		if (oid_array_lookup(&parents, &oid) < 0) {
+			oid_array_append(&parents, &oid);
+			add_blame_cursor(pf, sg->item, c->path, &oid);
+		}
+	}
+	for (i = 0; i < parents.nr; i++)
+		queue_blame_diff(sb, c, &parents.oid[i]);
+
+out:
+	oid_array_clear(&parents);
+	free(c);
+}
+
+/*
+ * Called before "origin" is handled by the walk. Drop the diffs of
+ * the commits the walk has already left behind, and queue diffs for
+ * what lies ahead.
+ */
+static void prefetch_diffs(struct blame_scoreboard *sb,
+			   struct blame_origin *origin)
+{
+	struct blame_prefetch *pf = sb->prefetch;
+	timestamp_t date = origin->commit->date;
+	struct list_head *pos, *tmp;
+	size_t i;
+	int full;
+
+	pthread_mutex_lock(&pf->mutex);
+	list_for_each_safe(pos, tmp, &pf->diffs) {
+		struct blame_diff *diff = list_entry(pos, struct blame_diff, list);
+
+		/*
+		 * A running diff is left for a later call to drop; with
+		 * skewed commit dates the walk may yet get to it.
+		 */
+		if (diff->commit->date <= date ||
+		    diff->state == BLAME_DIFF_RUNNING)
+			continue;
+		free_blame_diff(pf, diff);
+	}
+	pthread_mutex_unlock(&pf->mutex);
+
+	/* the walk may have taken a turn the cursors did not foresee */
+	if (!is_null_oid(&origin->commit->object.oid) &&
+	    S_ISREG(origin->mode))
+		add_blame_cursor(pf, origin->commit, origin->path,
+				 &origin->blob_oid);
+	for (i = 0; i < sb->commits.nr; i++) {
+		struct blame_origin *o;
+
+		for (o = get_blame_suspects(sb->commits.array[i].data); o; o = o->next)
+			if (o->suspects && S_ISREG(o->mode))
+				add_blame_cursor(pf, o->commit, o->path,
+						 &o->blob_oid);
+	}
+
+	for (;;) {
+		struct blame_cursor *c = prio_queue_peek(&pf->cursors);
+
+		if (!c)
+			break;
+		if (c->commit->date > date) {
+			free(prio_queue_get(&pf->cursors));
+			continue;
+		}
+		pthread_mutex_lock(&pf->mutex);
+		full = pf->nr_diffs >= pf->max_diffs;
+		pthread_mutex_unlock(&pf->mutex);
+		if (full)
+			break;
+		advance_blame_cursor(sb);
+	}
+}
+
+static void start_blame_prefetch(struct blame_scoreboard *sb)
+{
+	struct blame_prefetch *pf;
+	int i, err;
+
+	CALLOC_ARRAY(pf, 1);
+	pthread_mutex_init(&pf->mutex, NULL);
+	pthread_cond_init(&pf->work, NULL);
+	pthread_cond_init(&pf->done, NULL);
+	INIT_LIST_HEAD(&pf->diffs);
+	pf->xdl_opts = sb->xdl_opts;
+	pf->nr_threads = sb->num_threads;
+	pf->max_diffs = 4 * pf->nr_threads;
+	pf->cursors.compare = compare_blame_cursors;
+	strset_init(&pf->seen);
+	sb->prefetch = pf;
+
+	CALLOC_ARRAY(pf->threads, pf->nr_threads);
+	for (i = 0; i < pf->nr_threads; i++) {
+		err = pthread_create(&pf->threads[i], NULL,
+				     blame_diff_worker, pf);
+		if (err)
+			die(_("blame: failed to create thread: %s"),
+			    strerror(err));
+	}
+}
+
+static void stop_blame_prefetch(struct blame_scoreboard *sb)
+{
+	struct blame_prefetch *pf = sb->prefetch;
+	struct list_head *pos, *tmp;
+	struct blame_cursor *c;
+	int i;
+
+	pthread_mutex_lock(&pf->mutex);
+	pf->shutdown = 1;
+	pthread_cond_broadcast(&pf->work);
+	pthread_mutex_unlock(&pf->mutex);
+	for (i = 0; i < pf->nr_threads; i++)
+		pthread_join(pf->threads[i], NULL);
+
+	list_for_each_safe(pos, tmp, &pf->diffs)
+		free_blame_diff(pf, list_entry(pos, struct blame_diff, list));
+	while ((c = prio_queue_get(&pf->cursors)))
+		free(c);
+	clear_prio_queue(&pf->cursors);
+	strset_clear(&pf->seen);
+
+	pthread_mutex_destroy(&pf->mutex);
+	pthread_cond_destroy(&pf->work);
+	pthread_cond_destroy(&pf->done);
+	free(pf->threads);
+	FREE_AND_NULL(sb->prefetch);
+
+	trace2_data_intmax("blame", sb->repo,
+			   "prefetch/queued", blame_prefetch_queued);
+	trace2_data_intmax("blame", sb->repo,
+			   "prefetch/used", blame_prefetch_used);
+}
+
+/*
+ * The blame cache remembers, for a commit and a path in it, which
+ * commit each line of the file at that commit came from. It is kept
+ * as a notes tree, and consulted whenever the walk reaches an origin,
+ * so that a blame of a descendant only needs to dig through the
+ * commits made since the last cached one.
+ *
+ * A cached entry is a sequence of runs covering the whole file, each
+ * of which is recorded as
+ *
+ *   "<num-lines> <s-lno> <origin> <previous-origin>" NUL
+ *   "<path>" NUL "<previous-path>" NUL
+ *
+ * where an origin is written as "<commit> <blob> <octal-mode>", and
+ * the previous origin is all zeroes if the suspect has none.
+ */
+struct blame_cache_origin {
+	struct commit *commit;
+	struct object_id blob_oid;
+	unsigned mode;
+	const char *path;
+};
+
+struct blame_cache_run {
+	int lno, num_lines, s_lno;
+	struct blame_cache_origin suspect, previous;
+};
+
+static int blame_cache_lookups;
+static int blame_cache_hits;
+
+static void blame_cache_key(struct blame_scoreboard *sb,
+			    struct commit *commit, const char *path,
+			    struct object_id *key)
+{
+	struct strbuf buf = STRBUF_INIT;
+
+	strbuf_addf(&buf, "blame %s %d %d", oid_to_hex(&commit->object.oid),
+		    sb->xdl_opts, sb->no_whole_file_rename);
+	strbuf_addch(&buf, '\0');
+	strbuf_addstr(&buf, path);
+	hash_object_file(sb->repo->hash_algo, buf.buf, buf.len,
+			 OBJ_BLOB, key);
+	strbuf_release(&buf);
+}
+
+static void blame_cache_add_origin(struct strbuf *buf, struct blame_origin *o)
+{
+	if (!o) {
+		strbuf_addf(buf, "%s %s 0", oid_to_hex(null_oid()),
+			    oid_to_hex(null_oid()));
+		return;
+	}
+	strbuf_addf(buf, "%s ", oid_to_hex(&o->commit->object.oid));
+	strbuf_addf(buf, "%s %o", oid_to_hex(&o->blob_oid), o->mode);
+}
+
+/*
+ * Parse "<commit> <blob> <octal-mode>" at "p" into "o". A null commit
+ * leaves o->commit NULL.
+ */
+static int parse_blame_cache_origin(struct blame_scoreboard *sb,
+				    const char *p, const char **end,
+				    struct blame_cache_origin *o)
+{
+	struct object_id oid;
+	char *mode_end;
+
+	o->commit = NULL;
+	if (parse_oid_hex(p, &oid, &p) || *p++ != ' ' ||
+	    parse_oid_hex(p, &o->blob_oid, &p) || *p++ != ' ')
+		return -1;
+	o->mode = strtoul(p, &mode_end, 8);
+	*end = mode_end;
+	if (mode_end == p)
+		return -1;
+	if (is_null_oid(&oid))
+		return 0;
+	o->commit = lookup_commit(sb->repo, &oid);
+	if (!o->commit || repo_parse_commit(sb->repo, o->commit))
+		return -1;
+	return 0;
+}
+
+/*
+ * Parse the cached runs in "data" into "runs". Returns the number of
+ * runs, or -1 if the entry is malformed or names commits we do not
+ * have.
+ */
+static int parse_blame_cache(struct blame_scoreboard *sb,
+			     const char *data, size_t size,
+			     struct blame_cache_run **runs)
+{
+	const char *end = data + size;
+	int nr = 0, alloc = 0, lno = 0;
+
+	*runs = NULL;
+	while (data < end) {
+		struct blame_cache_run *run;
+		const char *eol = memchr(data, '\0', end - data);
+		const char *p;
+		char *num_end;
+
+		if (!eol)
+			goto corrupt;
+		ALLOC_GROW(*runs, nr + 1, alloc);
+		run = &(*runs)[nr++];
+		run->lno = lno;
+		run->num_lines = strtol(data, &num_end, 10);
+		if (*num_end != ' ' || run->num_lines <= 0)
+			goto corrupt;
+		run->s_lno = strtol(num_end + 1, &num_end, 10);
+		if (*num_end != ' ' || run->s_lno < 0)
+			goto corrupt;
+		if (parse_blame_cache_origin(sb, num_end + 1, &p, &run->suspect) ||
+		    !run->suspect.commit || *p != ' ' ||
+		    parse_blame_cache_origin(sb, p + 1, &p, &run->previous) ||
+		    p != eol)
+			goto corrupt;
+
+		run->suspect.path = eol + 1;
+		eol = memchr(run->suspect.path, '\0', end - run->suspect.path);
+		if (!eol || eol == run->suspect.path)
+			goto corrupt;
+		run->previous.path = eol + 1;
+		eol = memchr(run->previous.path, '\0', end - run->previous.path);
+		if (!eol)
+			goto corrupt;
+		if (run->previous.commit && eol == run->previous.path)
+			goto corrupt;
+
+		lno += run->num_lines;
+		data = eol + 1;
+	}
+	return nr;
+
+corrupt:
+	FREE_AND_NULL(*runs);
+	return -1;
+}
+
+static struct blame_origin *get_cached_origin(struct blame_cache_origin *c)
+{
+	struct blame_origin *o = get_origin(c->commit, c->path);
+
+	/*
+	 * The walk may reach this origin later on, and expects it to
+	 * know its blob just like the ones it creates itself.
+	 */
+	if (is_null_oid(&o->blob_oid)) {
+		oidcpy(&o->blob_oid, &c->blob_oid);
+		o->mode = c->mode;
+	}
+	return o;
+}
+
+static struct blame_origin *blame_cache_origin(struct blame_scoreboard *sb,
+					       struct blame_cache_run *run)
+{
+	struct blame_origin *o = get_cached_origin(&run->suspect);
+
+	if (!o->previous && run->previous.commit)
+		o->previous = get_cached_origin(&run->previous);
+	o->guilty = 1;
+
+	/* treat root commit as boundary */
+	if (!run->suspect.commit->parents && !sb->show_root)
+		run->suspect.commit->object.flags |= UNINTERESTING;
+	return o;
+}
+
+/*
+ * If the blame for "origin" is cached, hand the blame for its suspects
+ * to the commits recorded in the cache and return 1. Otherwise leave
+ * the suspects alone and return 0.
+ */
+static int blame_from_cache(struct blame_scoreboard *sb,
+			    struct blame_origin *origin)
+{
+	struct object_id key;
+	struct blame_cache_run *runs;
+	struct blame_entry *e, *next, *found = NULL, **tail = &found;
+	char *data;
+	size_t size;
+	int nr;
+
+	if (is_null_oid(&origin->commit->object.oid))
+		return 0;
+
+	blame_cache_lookups++;
+	blame_cache_key(sb, origin->commit, origin->path, &key);
+	data = notes_cache_get(sb->cache, &key, &size);
+	if (!data)
+		return 0;
+	nr = parse_blame_cache(sb, data, size, &runs);
+	if (nr <= 0)
+		goto miss;
+
+	/* make sure every suspect line is covered */
+	for (e = origin->suspects; e; e = e->next)
+		if (e->s_lno + e->num_lines >
+		    runs[nr - 1].lno + runs[nr - 1].num_lines)
+			goto miss;
+
+	for (e = origin->suspects; e; e = next) {
+		int lo = 0, hi = nr, start = e->s_lno;
+		int end = e->s_lno + e->num_lines;
+
+		next = e->next;
+		while (lo + 1 < hi) {
+			int mi = lo + (hi - lo) / 2;
+			if (runs[mi].lno <= start)
+				lo = mi;
+			else
+				hi = mi;
+		}
+		while (start < end) {
+			struct blame_cache_run *run = &runs[lo++];
+			int stop = run->lno + run->num_lines;
+			struct blame_entry *n;
+
+			if (stop > end)
+				stop = end;
+			CALLOC_ARRAY(n, 1);
+			n->lno = e->lno + (start - e->s_lno);
+			n->s_lno = run->s_lno + (start - run->lno);
+			n->num_lines = stop - start;
+			n->suspect = blame_cache_origin(sb, run);
+			*tail = n;
+			tail = &n->next;
+			start = stop;
+		}
+		blame_origin_decref(e->suspect);
+		free(e);
+	}
+	origin->suspects = NULL;
+
+	for (e = found; e; e = e->next)
+		if (sb->found_guilty_entry)
+			sb->found_guilty_entry(e, sb->found_guilty_entry_data);
+	*tail = sb->ent;
+	sb->ent = found;
+
+	blame_cache_hits++;
+	free(runs);
+	free(data);
+	return 1;
+
+miss:
+	free(runs);
+	free(data);
+	return 0;
+}
+
 /*
  * The main loop -- while we have blobs with lines whose true origin
  * is still unknown, pick one blob, and allow its lines to pass blames
@@ -2584,6 +3254,9 @@ void assign_blame(struct blame_scoreboard *sb, int opt)
 	struct rev_info *revs = sb->revs;
 	struct commit *commit = prio_queue_get(&sb->commits);
 
+	if (HAVE_THREADS && sb->num_threads > 1 && !sb->reverse)
+		start_blame_prefetch(sb);
+
 	while (commit) {
 		struct blame_entry *ent;
 		struct blame_origin *suspect = get_blame_suspects(commit);
@@ -2605,11 +3278,14 @@ void assign_blame(struct blame_scoreboard *sb, int opt)
 		 */
 		blame_origin_incref(suspect);
 		parse_commit(commit);
+		if (sb->prefetch)
+			prefetch_diffs(sb, suspect);
 		if (sb->reverse ||
 		    (!(commit->object.flags & UNINTERESTING) &&
-		     !(revs->max_age != -1 && commit->date < revs->max_age)))
-			pass_blame(sb, suspect, opt);
-		else {
+		     !(revs->max_age != -1 && commit->date < revs->max_age))) {
+			if (!sb->cache || !blame_from_cache(sb, suspect))
+				pass_blame(sb, suspect, opt);
+		} else {
 			commit->object.flags |= UNINTERESTING;
 			if (commit->object.parsed)
 				mark_parents_uninteresting(sb->revs, commit);
@@ -2641,6 +3317,9 @@ void assign_blame(struct blame_scoreboard *sb, int opt)
 		if (sb->debug) /* sanity */
 			sanity_check_refcnt(sb);
 	}
+
+	if (sb->prefetch)
+		stop_blame_prefetch(sb);
 }
 
 /*
@@ -2908,6 +3587,121 @@ void setup_blame_bloom_data(struct blame_scoreboard *sb)
 	sb->bloom_data = bd;
 }
 
+/*
+ * Cached results describe the history as recorded in the commits.
+ * A shallow clone, grafts or replace refs give another view of it,
+ * which must neither be served from the cache nor be stored in it.
+ */
+static int blame_cache_compatible(struct repository *r)
+{
+	if (read_replace_refs) {
+		prepare_replace_object(r);
+		if (hashmap_get_size(&r->objects->replace_map->map))
+			return 0;
+	}
+
+	prepare_commit_graft(r);
+	if (r->parsed_objects &&
+	    (r->parsed_objects->grafts_nr ||
+	     r->parsed_objects->substituted_parent))
+		return 0;
+	if (is_repository_shallow(r))
+		return 0;
+
+	return 1;
+}
+
+void setup_blame_cache(struct blame_scoreboard *sb, int opt)
+{
+	struct userdiff_driver *driver;
+	int i;
+
+	/*
+	 * Cached results are only valid for a plain blame of the whole
+	 * history: anything that changes which commits are dug through,
+	 * or how lines are matched up, disables the cache.
+	 */
+	if (sb->reverse ||
+	    (opt & (PICKAXE_BLAME_MOVE | PICKAXE_BLAME_COPY)) ||
+	    oidset_size(&sb->ignore_list) ||
+	    sb->revs->first_parent_only || sb->revs->max_age != -1 ||
+	    !blame_cache_compatible(sb->repo))
+		return;
+	for (i = 0; i < sb->revs->pending.nr; i++)
+		if (sb->revs->pending.objects[i].item->flags & UNINTERESTING)
+			return;
+	if (sb->revs->diffopt.flags.allow_textconv) {
+		driver = userdiff_find_by_path(sb->repo->index, sb->path);
+		if (driver && userdiff_get_textconv(sb->repo, driver))
+			return;
+	}
+
+	CALLOC_ARRAY(sb->cache, 1);
+	notes_cache_init(sb->repo, sb->cache, "blame-cache", "blame cache v1");
+}
+
+void write_blame_cache(struct blame_scoreboard *sb)
+{
+	struct strbuf buf = STRBUF_INIT;
+	struct object_id key;
+	struct blame_entry *e;
+	int lno = 0;
+
+	if (!sb->cache || is_null_oid(&sb->final->object.oid))
+		return;
+	/*
+	 * Writing the cache must never make "blame" die, so only do so
+	 * if committing the notes tree will not complain about the
+	 * identity (asking for it notices the environment variables).
+	 */
+	git_author_info(0);
+	git_committer_info(0);
+	if (!author_ident_sufficiently_given() ||
+	    !committer_ident_sufficiently_given())
+		return;
+
+	blame_cache_key(sb, sb->final, sb->path, &key);
+	if (get_note(&sb->cache->tree, &key))
+		return;
+
+	blame_sort_final(sb);
+	for (e = sb->ent; e; e = e->next) {
+		struct blame_origin *suspect = e->suspect;
+		int num_lines = e->num_lines;
+
+		if (e->lno != lno)
+			goto out; /* only part of the file was blamed */
+
+		/* coalesce runs from the same suspect */
+		while (e->next && e->next->suspect == suspect &&
+		       e->next->s_lno == e->s_lno + num_lines) {
+			num_lines += e->next->num_lines;
+			e = e->next;
+		}
+
+		strbuf_addf(&buf, "%d %d ", num_lines,
+			    e->s_lno + e->num_lines - num_lines);
+		blame_cache_add_origin(&buf, suspect);
+		strbuf_addch(&buf, ' ');
+		blame_cache_add_origin(&buf, suspect->previous);
+		strbuf_addch(&buf, '\0');
+		strbuf_addstr(&buf, suspect->path);
+		strbuf_addch(&buf, '\0');
+		if (suspect->previous)
+			strbuf_addstr(&buf, suspect->previous->path);
+		strbuf_addch(&buf, '\0');
+		lno = e->lno + e->num_lines;
+	}
+	if (lno != sb->num_lines || !buf.len)
+		goto out;
+
+	if (!notes_cache_put(sb->cache, &key, buf.buf, buf.len))
+		notes_cache_write(sb->cache);
+
+out:
+	strbuf_release(&buf);
+}
+
 void cleanup_scoreboard(struct blame_scoreboard *sb)
 {
 	if (sb->bloom_data) {
@@ -2924,4 +3718,14 @@ void cleanup_scoreboard(struct blame_scoreboard *sb)
 		trace2_data_intmax("blame", sb->repo,
 				   "bloom/response-no", bloom_count_no);
 	}
+	if (sb->cache) {
+		free_notes(&sb->cache->tree);
+		free(sb->cache->validity);
+		FREE_AND_NULL(sb->cache);
+
+		trace2_data_intmax("blame", sb->repo,
+				   "cache/lookups", blame_cache_lookups);
+		trace2_data_intmax("blame", sb->repo,
+				   "cache/hits", blame_cache_hits);
+	}
 }
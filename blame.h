@@ -101,6 +101,8 @@ struct blame_entry {
 };
 
 struct blame_bloom_data;
+struct blame_prefetch;
+struct notes_cache;
 
 /*
  * The current state of the blame assignment.
@@ -152,6 +154,8 @@ struct blame_scoreboard {
 	int xdl_opts;
 	int no_whole_file_rename;
 	int debug;
+	/* compute diffs on this many worker threads */
+	int num_threads;
 
 	/* callbacks */
 	void(*on_sanity_fail)(struct blame_scoreboard *, int);
@@ -159,6 +163,8 @@ struct blame_scoreboard {
 
 	void *found_guilty_entry_data;
 	struct blame_bloom_data *bloom_data;
+	struct notes_cache *cache;
+	struct blame_prefetch *prefetch;
 };
 
 /*
@@ -183,6 +189,20 @@ void init_scoreboard(struct blame_scoreboard *sb);
 void setup_scoreboard(struct blame_scoreboard *sb,
 		      struct blame_origin **orig);
 void setup_blame_bloom_data(struct blame_scoreboard *sb);
+
+/*
+ * Consult and extend the blame cache in "refs/notes/blame-cache",
+ * unless "opt" or the options in "sb" make cached results unusable.
+ * This needs to be called before setup_scoreboard(), which consumes
+ * the pending revisions.
+ */
+void setup_blame_cache(struct blame_scoreboard *sb, int opt);
+
+/*
+ * Record the result of blaming the whole final image in the blame
+ * cache. Does nothing if the cache is not in use.
+ */
+void write_blame_cache(struct blame_scoreboard *sb);
 void cleanup_scoreboard(struct blame_scoreboard *sb);
 
 struct blame_entry *blame_entry_prepend(struct blame_entry *head,
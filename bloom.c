@@ -1,9 +1,9 @@
 #include "git-compat-util.h"
 #include "bloom.h"
-#include "diff.h"
-#include "diffcore.h"
-#include "revision.h"
 #include "hashmap.h"
+#include "tree-walk.h"
+#include "string-list.h"
+#include "object-store.h"
 #include "commit-graph.h"
 #include "commit.h"
 
@@ -184,57 +184,121 @@ static void init_truncated_large_filter(struct bloom_filter *filter)
 	filter->len = 1;
 }
 
-struct bloom_filter *get_or_compute_bloom_filter(struct repository *r,
-						 struct commit *c,
-						 int compute_if_not_present,
-						 const struct bloom_filter_settings *settings,
-						 enum bloom_filter_computed *computed)
-{
-	struct bloom_filter *filter;
-	int i;
-	struct diff_options diffopt;
-
-	if (computed)
-		*computed = BLOOM_NOT_COMPUTED;
-
-	if (!bloom_filters.slab_size)
-		return NULL;
-
-	filter = bloom_filter_slab_at(&bloom_filters, c);
+/*
+ * Collect the paths that differ between two trees, recursing into
+ * subtrees, like a recursive diff without rename detection would. Stop
+ * and return -1 as soon as more than "max" paths have been found.
+ */
+struct changed_paths {
+	struct string_list paths;
+	size_t max;
+};
 
-	if (!filter->data) {
-		load_commit_graph_info(r, c);
-		if (commit_graph_position(c) != COMMIT_NOT_FROM_GRAPH)
-			load_bloom_filter_from_graph(r->objects->commit_graph, filter, c);
+static int collect_changed_paths(struct repository *r,
+				 const struct object_id *old_oid,
+				 const struct object_id *new_oid,
+				 struct strbuf *base,
+				 struct changed_paths *out);
+
+static int collect_changed_entry(struct repository *r,
+				 const struct name_entry *old_entry,
+				 const struct name_entry *new_entry,
+				 struct strbuf *base,
+				 struct changed_paths *out)
+{
+	const struct name_entry *e = old_entry ? old_entry : new_entry;
+	size_t baselen = base->len;
+	int ret = 0;
+
+	strbuf_add(base, e->path, tree_entry_len(e));
+	if (S_ISDIR(e->mode)) {
+		/* entries of the same name are both trees or both not */
+		strbuf_addch(base, '/');
+		ret = collect_changed_paths(r,
+					    old_entry ? &old_entry->oid : NULL,
+					    new_entry ? &new_entry->oid : NULL,
+					    base, out);
+	} else if (out->paths.nr >= out->max) {
+		ret = -1;
+	} else {
+		string_list_append(&out->paths, base->buf);
 	}
+	strbuf_setlen(base, baselen);
+	return ret;
+}
 
-	if (filter->data && filter->len)
-		return filter;
-	if (!compute_if_not_present)
-		return NULL;
-
-	repo_diff_setup(r, &diffopt);
-	diffopt.flags.recursive = 1;
-	diffopt.detect_rename = 0;
-	diffopt.max_changes = settings->max_changed_paths;
-	diff_setup_done(&diffopt);
+static int collect_changed_paths(struct repository *r,
+				 const struct object_id *old_oid,
+				 const struct object_id *new_oid,
+				 struct strbuf *base,
+				 struct changed_paths *out)
+{
+	struct tree_desc t1, t2;
+	void *buf1, *buf2;
+	int ret = 0;
+
+	buf1 = fill_tree_descriptor(r, &t1, old_oid);
+	buf2 = fill_tree_descriptor(r, &t2, new_oid);
+
+	while (!ret && (t1.size || t2.size)) {
+		int cmp;
+
+		if (!t1.size)
+			cmp = 1;
+		else if (!t2.size)
+			cmp = -1;
+		else
+			cmp = base_name_compare(t1.entry.path, tree_entry_len(&t1.entry),
+						t1.entry.mode,
+						t2.entry.path, tree_entry_len(&t2.entry),
+						t2.entry.mode);
+
+		if (cmp < 0) {
+			ret = collect_changed_entry(r, &t1.entry, NULL, base, out);
+			update_tree_entry(&t1);
+		} else if (cmp > 0) {
+			ret = collect_changed_entry(r, NULL, &t2.entry, base, out);
+			update_tree_entry(&t2);
+		} else {
+			if (t1.entry.mode != t2.entry.mode ||
+			    !oideq(&t1.entry.oid, &t2.entry.oid))
+				ret = collect_changed_entry(r, &t1.entry, &t2.entry,
+							    base, out);
+			update_tree_entry(&t1);
+			update_tree_entry(&t2);
+		}
+	}
 
-	/* ensure commit is parsed so we have parent information */
-	repo_parse_commit(r, c);
+	free(buf1);
+	free(buf2);
+	return ret;
+}
 
-	if (c->parents)
-		diff_tree_oid(&c->parents->item->object.oid, &c->object.oid, "", &diffopt);
-	else
-		diff_tree_oid(NULL, &c->object.oid, "", &diffopt);
-	diffcore_std(&diffopt);
+static void fill_bloom_filter(struct repository *r,
+			      struct commit *c,
+			      struct bloom_filter *filter,
+			      const struct bloom_filter_settings *settings,
+			      enum bloom_filter_computed *computed)
+{
+	struct changed_paths changed = { STRING_LIST_INIT_DUP };
+	struct strbuf base = STRBUF_INIT;
+	int i;
 
-	if (diff_queued_diff.nr <= settings->max_changed_paths) {
+	/*
+	 * Compare the commits' trees ourselves instead of using the diff
+	 * machinery and its global queue, so that filters for different
+	 * commits can be computed in parallel.
+	 */
+	changed.max = settings->max_changed_paths;
+	if (!collect_changed_paths(r,
+				   c->parents ? &c->parents->item->object.oid : NULL,
+				   &c->object.oid, &base, &changed)) {
 		struct hashmap pathmap = HASHMAP_INIT(pathmap_cmp, NULL);
 		struct pathmap_hash_entry *e;
 		struct hashmap_iter iter;
 
-		for (i = 0; i < diff_queued_diff.nr; i++) {
-			const char *path = diff_queued_diff.queue[i]->two->path;
+		for (i = 0; i < changed.paths.nr; i++) {
+			char *path = changed.paths.items[i].string;
 
 			/*
 			 * Add each leading directory of the changed file, i.e. for
@@ -256,12 +320,10 @@ struct bloom_filter *get_or_compute_bloom_filter(struct repository *r,
 					free(e);
 
 				if (!last_slash)
-					last_slash = (char*)path;
+					last_slash = path;
 				*last_slash = '\0';
 
 			} while (*path);
-
-			diff_free_filepair(diff_queued_diff.queue[i]);
 		}
 
 		if (hashmap_get_size(&pathmap) > settings->max_changed_paths) {
@@ -289,8 +351,6 @@ struct bloom_filter *get_or_compute_bloom_filter(struct repository *r,
 	cleanup:
 		hashmap_clear_and_free(&pathmap, struct pathmap_hash_entry, entry);
 	} else {
-		for (i = 0; i < diff_queued_diff.nr; i++)
-			diff_free_filepair(diff_queued_diff.queue[i]);
 		init_truncated_large_filter(filter);
 
 		if (computed)
@@ -300,9 +360,60 @@ struct bloom_filter *get_or_compute_bloom_filter(struct repository *r,
 	if (computed)
 		*computed |= BLOOM_COMPUTED;
 
-	free(diff_queued_diff.queue);
-	DIFF_QUEUE_CLEAR(&diff_queued_diff);
+	string_list_clear(&changed.paths, 0);
+	strbuf_release(&base);
+}
+
+struct bloom_filter *get_or_compute_bloom_filter(struct repository *r,
+						 struct commit *c,
+						 int compute_if_not_present,
+						 const struct bloom_filter_settings *settings,
+						 enum bloom_filter_computed *computed)
+{
+	struct bloom_filter *filter;
+
+	if (computed)
+		*computed = BLOOM_NOT_COMPUTED;
+
+	if (!bloom_filters.slab_size)
+		return NULL;
+
+	filter = bloom_filter_slab_at(&bloom_filters, c);
+
+	if (!filter->data) {
+		load_commit_graph_info(r, c);
+		if (commit_graph_position(c) != COMMIT_NOT_FROM_GRAPH)
+			load_bloom_filter_from_graph(r->objects->commit_graph, filter, c);
+	}
+
+	if (filter->data && filter->len)
+		return filter;
+	if (!compute_if_not_present)
+		return NULL;
+
+	/* ensure commit is parsed so we have parent information */
+	repo_parse_commit(r, c);
+
+	fill_bloom_filter(r, c, filter, settings, computed);
+	return filter;
+}
+
+struct bloom_filter *compute_bloom_filter(struct repository *r,
+					  struct commit *c,
+					  const struct bloom_filter_settings *settings,
+					  enum bloom_filter_computed *computed)
+{
+	struct bloom_filter *filter = bloom_filter_slab_peek(&bloom_filters, c);
+
+	if (computed)
+		*computed = BLOOM_NOT_COMPUTED;
+	if (!filter)
+		BUG("no Bloom filter slot for commit %s",
+		    oid_to_hex(&c->object.oid));
+	if (filter->data && filter->len)
+		return filter;
 
+	fill_bloom_filter(r, c, filter, settings, computed);
 	return filter;
 }
 
@@ -105,6 +105,19 @@ struct bloom_filter *get_or_compute_bloom_filter(struct repository *r,
 #define get_bloom_filter(r, c) get_or_compute_bloom_filter( \
 	(r), (c), 0, NULL, NULL)
 
+/*
+ * Compute the changed-path Bloom filter of "c" unless it already has
+ * one. Unlike get_or_compute_bloom_filter() this does not parse or look
+ * up any objects, so that it can be called for different commits from
+ * several threads at once while the object read lock is enabled (see
+ * enable_obj_read_lock()). The commit must have been parsed, and its
+ * filter slot set up by calling get_or_compute_bloom_filter() for it.
+ */
+struct bloom_filter *compute_bloom_filter(struct repository *r,
+					  struct commit *c,
+					  const struct bloom_filter_settings *settings,
+					  enum bloom_filter_computed *computed);
+
 int bloom_filter_contains(const struct bloom_filter *filter,
 			  const struct bloom_key *key,
 			  const struct bloom_filter_settings *settings);
@@ -16,6 +16,8 @@
 #include "packfile.h"
 #include "object-store.h"
 #include "promisor-remote.h"
+#include "replace-object.h"
+#include "thread-utils.h"
 
 enum batch_mode {
 	BATCH_MODE_CONTENTS,
@@ -30,6 +32,7 @@ struct batch_options {
 	int buffer_output;
 	int all_objects;
 	int unordered;
+	int nr_threads;
 	int transform_mode; /* may be 'w' or 'c' for --filters or --textconv */
 	const char *format;
 };
@@ -206,6 +209,13 @@ struct expand_data {
 	const char *rest;
 	struct object_id delta_base_oid;
 
+	/*
+	 * The contents of the object, if the caller has them at hand
+	 * already (see batch_unordered_contents()).
+	 */
+	const void *contents;
+	unsigned long contents_size;
+
 	/*
 	 * If mark_query is true, we do not expand anything, but rather
 	 * just mark the object_info with items we wish to query.
@@ -240,14 +250,20 @@ static int is_atom(const char *atom, const char *s, int slen)
 	return alen == slen && !memcmp(atom, s, alen);
 }
 
+/*
+ * This and print_default_format() run on the worker threads of
+ * --threads, so they use oid_to_hex_r() rather than the shared buffers
+ * of oid_to_hex().
+ */
 static void expand_atom(struct strbuf *sb, const char *atom, int len,
 			void *vdata)
 {
 	struct expand_data *data = vdata;
+	char hex[GIT_MAX_HEXSZ + 1];
 
 	if (is_atom("objectname", atom, len)) {
 		if (!data->mark_query)
-			strbuf_addstr(sb, oid_to_hex(&data->oid));
+			strbuf_addstr(sb, oid_to_hex_r(hex, &data->oid));
 	} else if (is_atom("objecttype", atom, len)) {
 		if (data->mark_query)
 			data->info.typep = &data->type;
@@ -273,7 +289,7 @@ static void expand_atom(struct strbuf *sb, const char *atom, int len,
 			data->info.delta_base_oid = &data->delta_base_oid;
 		else
 			strbuf_addstr(sb,
-				      oid_to_hex(&data->delta_base_oid));
+				      oid_to_hex_r(hex, &data->delta_base_oid));
 	} else
 		die("unknown format element: %.*s", len, atom);
 }
@@ -338,10 +354,15 @@ static void print_object_or_die(struct batch_options *opt, struct expand_data *d
 				BUG("invalid transform_mode: %c", opt->transform_mode);
 			batch_write(opt, contents, size);
 			free(contents);
+		} else if (data->contents) {
+			batch_write(opt, data->contents, data->contents_size);
 		} else {
 			stream_blob(oid);
 		}
 	}
+	else if (data->contents) {
+		batch_write(opt, data->contents, data->contents_size);
+	}
 	else {
 		enum object_type type;
 		unsigned long size;
@@ -362,7 +383,9 @@ static void print_object_or_die(struct batch_options *opt, struct expand_data *d
 
 static void print_default_format(struct strbuf *scratch, struct expand_data *data)
 {
-	strbuf_addf(scratch, "%s %s %"PRIuMAX"\n", oid_to_hex(&data->oid),
+	char hex[GIT_MAX_HEXSZ + 1];
+
+	strbuf_addf(scratch, "%s %s %"PRIuMAX"\n", oid_to_hex_r(hex, &data->oid),
 		    type_name(data->type),
 		    (uintmax_t)data->size);
 }
@@ -414,10 +437,14 @@ static void batch_object_write(const char *obj_name,
 	}
 }
 
-static void batch_one_object(const char *obj_name,
-			     struct strbuf *scratch,
-			     struct batch_options *opt,
-			     struct expand_data *data)
+/*
+ * Resolve "obj_name" into data->oid. If there is no object to show,
+ * append what to print instead to "out" and return -1.
+ */
+static int batch_resolve_object(const char *obj_name,
+				struct batch_options *opt,
+				struct expand_data *data,
+				struct strbuf *out)
 {
 	struct object_context ctx;
 	int flags = opt->follow_symlinks ? GET_OID_FOLLOW_SYMLINKS : 0;
@@ -428,36 +455,49 @@ static void batch_one_object(const char *obj_name,
 	if (result != FOUND) {
 		switch (result) {
 		case MISSING_OBJECT:
-			printf("%s missing\n", obj_name);
+			strbuf_addf(out, "%s missing\n", obj_name);
 			break;
 		case SHORT_NAME_AMBIGUOUS:
-			printf("%s ambiguous\n", obj_name);
+			strbuf_addf(out, "%s ambiguous\n", obj_name);
 			break;
 		case DANGLING_SYMLINK:
-			printf("dangling %"PRIuMAX"\n%s\n",
-			       (uintmax_t)strlen(obj_name), obj_name);
+			strbuf_addf(out, "dangling %"PRIuMAX"\n%s\n",
+				    (uintmax_t)strlen(obj_name), obj_name);
 			break;
 		case SYMLINK_LOOP:
-			printf("loop %"PRIuMAX"\n%s\n",
-			       (uintmax_t)strlen(obj_name), obj_name);
+			strbuf_addf(out, "loop %"PRIuMAX"\n%s\n",
+				    (uintmax_t)strlen(obj_name), obj_name);
 			break;
 		case NOT_DIR:
-			printf("notdir %"PRIuMAX"\n%s\n",
-			       (uintmax_t)strlen(obj_name), obj_name);
+			strbuf_addf(out, "notdir %"PRIuMAX"\n%s\n",
+				    (uintmax_t)strlen(obj_name), obj_name);
 			break;
 		default:
 			BUG("unknown get_sha1_with_context result %d\n",
 			       result);
 			break;
 		}
-		fflush(stdout);
-		return;
+		return -1;
 	}
 
 	if (ctx.mode == 0) {
-		printf("symlink %"PRIuMAX"\n%s\n",
-		       (uintmax_t)ctx.symlink_path.len,
-		       ctx.symlink_path.buf);
+		strbuf_addf(out, "symlink %"PRIuMAX"\n%s\n",
+			    (uintmax_t)ctx.symlink_path.len,
+			    ctx.symlink_path.buf);
+		return -1;
+	}
+
+	return 0;
+}
+
+static void batch_one_object(const char *obj_name,
+			     struct strbuf *scratch,
+			     struct batch_options *opt,
+			     struct expand_data *data)
+{
+	strbuf_reset(scratch);
+	if (batch_resolve_object(obj_name, opt, data, scratch)) {
+		fwrite(scratch->buf, 1, scratch->len, stdout);
 		fflush(stdout);
 		return;
 	}
@@ -530,6 +570,48 @@ static int batch_unordered_packed(const struct object_id *oid,
 				      data);
 }
 
+/*
+ * With --batch, visit each pack in the order of its delta chains, so that
+ * every delta is applied once, to the base we have just printed, rather
+ * than resolving each object from scratch through the delta base cache.
+ */
+static int batch_unordered_contents(const struct object_id *oid,
+				    struct packed_git *pack,
+				    off_t offset,
+				    enum object_type type,
+				    const void *buf,
+				    unsigned long size,
+				    void *vdata)
+{
+	struct object_cb_data *data = vdata;
+
+	if (oidset_insert(data->seen, oid))
+		return 0;
+
+	oidcpy(&data->expand->oid, oid);
+	data->expand->contents = buf;
+	data->expand->contents_size = size;
+	batch_object_write(NULL, data->scratch, data->opt, data->expand,
+			   pack, offset);
+	data->expand->contents = NULL;
+	return 0;
+}
+
+static void batch_unordered_packed_contents(struct object_cb_data *cb)
+{
+	struct packed_git *p;
+
+	for (p = get_all_packs(the_repository); p; p = p->next) {
+		if (open_pack_index(p))
+			continue;
+		if (for_each_object_in_pack_by_delta(the_repository, p,
+						     batch_unordered_contents,
+						     cb))
+			die(_("unable to read the objects of %s"),
+			    p->pack_name);
+	}
+}
+
 typedef void (*parse_cmd_fn_t)(struct batch_options *, const char *,
 			       struct strbuf *, struct expand_data *);
 
@@ -659,6 +741,292 @@ static void batch_objects_command(struct batch_options *opt,
 	strbuf_release(&input);
 }
 
+/*
+ * With --threads, the objects named on stdin are looked up and read by
+ * worker threads, while the main thread reads ahead on stdin, resolves
+ * the names (which may involve refs and trees) and writes out what the
+ * workers produced.
+ */
+enum batch_job_state {
+	BATCH_JOB_QUEUED,
+	BATCH_JOB_RUNNING,
+	BATCH_JOB_DONE
+};
+
+struct batch_job {
+	enum batch_job_state state;
+	char *obj_name;
+	char *rest;
+	struct expand_data data;
+	/* what to print, unless "stream" is set: the header only */
+	struct strbuf out;
+	/* the contents are too large to hold, stream them when printing */
+	unsigned stream : 1;
+	unsigned printed : 1;
+};
+
+struct batch_threads {
+	struct batch_options *opt;
+	pthread_mutex_t mutex;
+	pthread_cond_t work, done;
+	pthread_t *threads;
+	int nr_threads;
+	int shutdown;
+
+	/* the jobs in input order, from "first" on */
+	struct batch_job *jobs;
+	int alloc, first, nr;
+};
+
+#define BATCH_JOBS_PER_THREAD 32
+
+static struct batch_job *batch_job_at(struct batch_threads *bt, int i)
+{
+	return &bt->jobs[(bt->first + i) % bt->alloc];
+}
+
+/*
+ * Point the object_info in "dst" at its own fields for everything
+ * that is queried through "tmpl".
+ */
+static void copy_expand_data(struct expand_data *dst,
+			     const struct expand_data *tmpl)
+{
+	*dst = *tmpl;
+	if (tmpl->info.typep)
+		dst->info.typep = &dst->type;
+	if (tmpl->info.sizep)
+		dst->info.sizep = &dst->size;
+	if (tmpl->info.disk_sizep)
+		dst->info.disk_sizep = &dst->disk_size;
+	if (tmpl->info.delta_base_oid)
+		dst->info.delta_base_oid = &dst->delta_base_oid;
+}
+
+/* The threaded counterpart of batch_object_write() */
+static void run_batch_job(struct batch_options *opt, struct batch_job *job)
+{
+	struct expand_data *data = &job->data;
+	char hex[GIT_MAX_HEXSZ + 1];
+	enum object_type type;
+	unsigned long size;
+	void *contents;
+
+	if (oid_object_info_extended(the_repository, &data->oid, &data->info,
+				     OBJECT_INFO_LOOKUP_REPLACE) < 0) {
+		strbuf_addf(&job->out, "%s missing\n", job->obj_name);
+		return;
+	}
+
+	if (!opt->format) {
+		print_default_format(&job->out, data);
+	} else {
+		strbuf_expand(&job->out, opt->format, expand_format, data);
+		strbuf_addch(&job->out, '\n');
+	}
+
+	if (opt->batch_mode != BATCH_MODE_CONTENTS)
+		return;
+
+	if (data->type == OBJ_BLOB && data->size > big_file_threshold) {
+		job->stream = 1;
+		return;
+	}
+
+	contents = read_object_file(&data->oid, &type, &size);
+	if (!contents)
+		die("object %s disappeared", oid_to_hex_r(hex, &data->oid));
+	if (type != data->type)
+		die("object %s changed type!?", oid_to_hex_r(hex, &data->oid));
+	if (size != data->size)
+		die("object %s changed size!?", oid_to_hex_r(hex, &data->oid));
+	strbuf_add(&job->out, contents, size);
+	strbuf_addch(&job->out, '\n');
+	free(contents);
+}
+
+static void *batch_worker(void *data)
+{
+	struct batch_threads *bt = data;
+
+	pthread_mutex_lock(&bt->mutex);
+	while (!bt->shutdown) {
+		struct batch_job *job = NULL;
+		int i;
+
+		for (i = 0; i < bt->nr; i++) {
+			if (batch_job_at(bt, i)->state == BATCH_JOB_QUEUED) {
+				job = batch_job_at(bt, i);
+				break;
+			}
+		}
+		if (!job) {
+			pthread_cond_wait(&bt->work, &bt->mutex);
+			continue;
+		}
+
+		job->state = BATCH_JOB_RUNNING;
+		pthread_mutex_unlock(&bt->mutex);
+		run_batch_job(bt->opt, job);
+		pthread_mutex_lock(&bt->mutex);
+
+		job->state = BATCH_JOB_DONE;
+		pthread_cond_broadcast(&bt->done);
+	}
+	pthread_mutex_unlock(&bt->mutex);
+	return NULL;
+}
+
+/* Read the next request from stdin into a new job; returns -1 at EOF. */
+static int queue_batch_job(struct batch_threads *bt,
+			   const struct expand_data *tmpl,
+			   struct strbuf *input)
+{
+	struct batch_job *job;
+	char *p = NULL;
+
+	if (strbuf_getline(input, stdin) == EOF)
+		return -1;
+
+	if (tmpl->split_on_whitespace) {
+		/* see batch_objects() */
+		p = strpbrk(input->buf, " \t");
+		if (p) {
+			while (*p && strchr(" \t", *p))
+				*p++ = '\0';
+		}
+	}
+
+	job = batch_job_at(bt, bt->nr);
+	job->obj_name = xstrdup(input->buf);
+	job->rest = xstrdup_or_null(p);
+	copy_expand_data(&job->data, tmpl);
+	job->data.rest = job->rest;
+	strbuf_reset(&job->out);
+	job->stream = 0;
+	job->printed = 0;
+
+	/*
+	 * Resolving the name may read objects and packs while the
+	 * workers are at it.
+	 */
+	obj_read_lock();
+	if (batch_resolve_object(job->obj_name, bt->opt, &job->data, &job->out))
+		job->state = BATCH_JOB_DONE;
+	else
+		job->state = BATCH_JOB_QUEUED;
+	obj_read_unlock();
+
+	pthread_mutex_lock(&bt->mutex);
+	bt->nr++;
+	if (job->state == BATCH_JOB_QUEUED)
+		pthread_cond_signal(&bt->work);
+	pthread_mutex_unlock(&bt->mutex);
+	return 0;
+}
+
+static void print_batch_job(struct batch_options *opt, struct batch_job *job)
+{
+	batch_write(opt, job->out.buf, job->out.len);
+	if (job->stream) {
+		fflush(stdout);
+		obj_read_lock();
+		stream_blob(&job->data.oid);
+		obj_read_unlock();
+		batch_write(opt, "\n", 1);
+	}
+	job->printed = 1;
+	FREE_AND_NULL(job->obj_name);
+	FREE_AND_NULL(job->rest);
+}
+
+static void batch_objects_threaded(struct batch_options *opt,
+				   struct expand_data *tmpl)
+{
+	struct batch_threads bt = { 0 };
+	struct strbuf input = STRBUF_INIT;
+	int eof = 0;
+	int i;
+
+	bt.opt = opt;
+	pthread_mutex_init(&bt.mutex, NULL);
+	pthread_cond_init(&bt.work, NULL);
+	pthread_cond_init(&bt.done, NULL);
+	bt.alloc = opt->nr_threads * BATCH_JOBS_PER_THREAD;
+	CALLOC_ARRAY(bt.jobs, bt.alloc);
+	for (i = 0; i < bt.alloc; i++)
+		strbuf_init(&bt.jobs[i].out, 0);
+
+	/*
+	 * In case the objects are to be replaced, find out by what in
+	 * the main thread.
+	 */
+	if (read_replace_refs)
+		prepare_replace_object(the_repository);
+
+	enable_obj_read_lock();
+	CALLOC_ARRAY(bt.threads, opt->nr_threads);
+	for (i = 0; i < opt->nr_threads; i++)
+		if (pthread_create(&bt.threads[i], NULL, batch_worker, &bt))
+			die(_("unable to create thread: %s"), strerror(errno));
+	bt.nr_threads = opt->nr_threads;
+
+	for (;;) {
+		struct batch_job *job = NULL;
+
+		while (!eof && bt.nr < bt.alloc)
+			if (queue_batch_job(&bt, tmpl, &input))
+				eof = 1;
+		if (!bt.nr)
+			break;
+
+		/*
+		 * Print the oldest job, or with --unordered any job,
+		 * as soon as it is done.
+		 */
+		pthread_mutex_lock(&bt.mutex);
+		while (!job) {
+			for (i = 0; i < bt.nr && !job; i++) {
+				struct batch_job *j = batch_job_at(&bt, i);
+
+				if (!j->printed && j->state == BATCH_JOB_DONE)
+					job = j;
+				else if (!opt->unordered && !j->printed)
+					break;
+			}
+			if (!job)
+				pthread_cond_wait(&bt.done, &bt.mutex);
+		}
+		pthread_mutex_unlock(&bt.mutex);
+
+		print_batch_job(opt, job);
+
+		pthread_mutex_lock(&bt.mutex);
+		while (bt.nr && batch_job_at(&bt, 0)->printed) {
+			bt.first = (bt.first + 1) % bt.alloc;
+			bt.nr--;
+		}
+		pthread_mutex_unlock(&bt.mutex);
+	}
+
+	pthread_mutex_lock(&bt.mutex);
+	bt.shutdown = 1;
+	pthread_cond_broadcast(&bt.work);
+	pthread_mutex_unlock(&bt.mutex);
+	for (i = 0; i < bt.nr_threads; i++)
+		pthread_join(bt.threads[i], NULL);
+	disable_obj_read_lock();
+
+	for (i = 0; i < bt.alloc; i++)
+		strbuf_release(&bt.jobs[i].out);
+	free(bt.jobs);
+	free(bt.threads);
+	pthread_mutex_destroy(&bt.mutex);
+	pthread_cond_destroy(&bt.work);
+	pthread_cond_destroy(&bt.done);
+	strbuf_release(&input);
+}
+
 #define DEFAULT_FORMAT "%(objectname) %(objecttype) %(objectsize)"
 
 static int batch_objects(struct batch_options *opt)
@@ -716,8 +1084,11 @@ static int batch_objects(struct batch_options *opt)
 			cb.seen = &seen;
 
 			for_each_loose_object(batch_unordered_loose, &cb, 0);
-			for_each_packed_object(batch_unordered_packed, &cb,
-					       FOR_EACH_OBJECT_PACK_ORDER);
+			if (opt->batch_mode == BATCH_MODE_CONTENTS)
+				batch_unordered_packed_contents(&cb);
+			else
+				for_each_packed_object(batch_unordered_packed, &cb,
+						       FOR_EACH_OBJECT_PACK_ORDER);
 
 			oidset_clear(&seen);
 		} else {
@@ -750,6 +1121,18 @@ static int batch_objects(struct batch_options *opt)
 		goto cleanup;
 	}
 
+	/*
+	 * Objects of promisor remotes are fetched as they are looked up,
+	 * which cannot be done from several threads.
+	 */
+	if (opt->nr_threads > 1 && !has_promisor_remote()) {
+		/* decide whether to stream blobs by their size */
+		if (opt->batch_mode == BATCH_MODE_CONTENTS)
+			data.info.sizep = &data.size;
+		batch_objects_threaded(opt, &data);
+		goto cleanup;
+	}
+
 	while (strbuf_getline(&input, stdin) != EOF) {
 		if (data.split_on_whitespace) {
 			/*
@@ -826,7 +1209,7 @@ int cmd_cat_file(int argc, const char **argv, const char *prefix)
 		N_("git cat-file (-t | -s) [--allow-unknown-type] <object>"),
 		N_("git cat-file (--batch | --batch-check | --batch-command) [--batch-all-objects]\n"
 		   "             [--buffer] [--follow-symlinks] [--unordered]\n"
-		   "             [--textconv | --filters]"),
+		   "             [--threads=<n>] [--textconv | --filters]"),
 		N_("git cat-file (--textconv | --filters)\n"
 		   "             [<rev>:<path|tree-ish> | --path=<path|tree-ish> <rev>]"),
 		NULL
@@ -866,6 +1249,8 @@ int cmd_cat_file(int argc, const char **argv, const char *prefix)
 			 N_("follow in-tree symlinks")),
 		OPT_BOOL(0, "unordered", &batch.unordered,
 			 N_("do not order objects before emitting them")),
+		OPT_INTEGER(0, "threads", &batch.nr_threads,
+			    N_("read objects on <n> threads")),
 		/* Textconv options, stand-ole*/
 		OPT_GROUP(N_("Emit object (blob or tree) with conversion or filter (stand-alone, or with batch)")),
 		OPT_CMDMODE(0, "textconv", &opt,
@@ -880,6 +1265,7 @@ int cmd_cat_file(int argc, const char **argv, const char *prefix)
 	git_config(git_cat_file_config, NULL);
 
 	batch.buffer_output = -1;
+	batch.nr_threads = 1;
 
 	argc = parse_options(argc, argv, prefix, options, usage, 0);
 	opt_cw = (opt == 'c' || opt == 'w');
@@ -908,11 +1294,42 @@ int cmd_cat_file(int argc, const char **argv, const char *prefix)
 	else if (batch.all_objects)
 		usage_msg_optf(_("'%s' requires a batch mode"), usage, options,
 			       "--batch-all-objects");
+	else if (batch.nr_threads != 1)
+		usage_msg_optf(_("'%s' requires a batch mode"), usage, options,
+			       "--threads");
 
 	/* Batch defaults */
 	if (batch.buffer_output < 0)
 		batch.buffer_output = batch.all_objects;
 
+	if (batch.nr_threads < 0)
+		die(_("invalid number of threads specified (%d)"),
+		    batch.nr_threads);
+	if (!batch.nr_threads)
+		batch.nr_threads = online_cpus();
+	if (!HAVE_THREADS && batch.nr_threads > 1) {
+		warning(_("no threads support, ignoring --threads"));
+		batch.nr_threads = 1;
+	}
+	if (batch.nr_threads > 1) {
+		/* the input is read ahead of the output */
+		if (!batch.buffer_output)
+			usage_msg_optf(_("'%s' requires '%s'"), usage, options,
+				       "--threads", "--buffer");
+		if (batch.all_objects)
+			usage_msg_optf(_("options '%s' and '%s' cannot be used together"),
+				       usage, options, "--threads",
+				       "--batch-all-objects");
+		if (batch.batch_mode == BATCH_MODE_QUEUE_AND_DISPATCH)
+			usage_msg_optf(_("options '%s' and '%s' cannot be used together"),
+				       usage, options, "--threads",
+				       "--batch-command");
+		if (opt_cw)
+			usage_msg_optf(_("options '%s' and '%s' cannot be used together"),
+				       usage, options, "--threads",
+				       opt == 'c' ? "--textconv" : "--filters");
+	}
+
 	/* Return early if we're in batch mode? */
 	if (batch.enabled) {
 		if (opt_cw)
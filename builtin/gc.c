@@ -21,6 +21,7 @@
 #include "strvec.h"
 #include "commit.h"
 #include "commit-graph.h"
+#include "grep-index.h"
 #include "packfile.h"
 #include "object-store.h"
 #include "pack.h"
@@ -1192,6 +1193,19 @@ static int maintenance_task_incremental_repack(struct maintenance_run_opts *opts
 	return 0;
 }
 
+static int maintenance_task_grep_index(struct maintenance_run_opts *opts)
+{
+	/* Earlier tasks may have replaced the packs we know about. */
+	reprepare_packed_git(the_repository);
+
+	if (write_grep_index(the_repository,
+			     opts->quiet ? 0 : GREP_INDEX_PROGRESS)) {
+		error(_("failed to write grep-index"));
+		return 1;
+	}
+	return 0;
+}
+
 typedef int maintenance_task_fn(struct maintenance_run_opts *opts);
 
 /*
@@ -1220,6 +1234,7 @@ enum maintenance_task_label {
 	TASK_GC,
 	TASK_COMMIT_GRAPH,
 	TASK_PACK_REFS,
+	TASK_GREP_INDEX,
 
 	/* Leave as final value */
 	TASK__COUNT
@@ -1256,6 +1271,11 @@ static struct maintenance_task tasks[] = {
 		maintenance_task_pack_refs,
 		NULL,
 	},
+	[TASK_GREP_INDEX] = {
+		"grep-index",
+		maintenance_task_grep_index,
+		NULL,
+	},
 };
 
 static int compare_tasks_by_selection(const void *a_, const void *b_)
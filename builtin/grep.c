@@ -18,6 +18,7 @@
 #include "run-command.h"
 #include "userdiff.h"
 #include "grep.h"
+#include "grep-index.h"
 #include "quote.h"
 #include "dir.h"
 #include "pathspec.h"
@@ -25,6 +26,7 @@
 #include "submodule-config.h"
 #include "object-store.h"
 #include "packfile.h"
+#include "replace-object.h"
 
 static const char *grep_prefix;
 
@@ -45,6 +47,8 @@ static pthread_t *threads;
  */
 struct work_item {
 	struct grep_source source;
+	/* where the blob of "source" lies, if it is packed */
+	struct pack_entry pack_entry;
 	char done;
 	struct strbuf out;
 };
@@ -98,9 +102,23 @@ static int skip_first_line;
 
 static void add_work(struct grep_opt *opt, struct grep_source *gs)
 {
+	struct pack_entry e = { 0 };
+
 	if (opt->binary != GREP_BINARY_TEXT)
 		grep_source_load_driver(gs, opt->repo->index);
 
+	/*
+	 * Look the blob up while we are allowed to touch the pack list,
+	 * so that the worker can unpack it without obj_read_lock().
+	 */
+	if (gs->type == GREP_SOURCE_OID && !opt->allow_textconv) {
+		obj_read_lock();
+		find_pack_entry(gs->repo,
+				lookup_replace_object(gs->repo, gs->identifier),
+				&e);
+		obj_read_unlock();
+	}
+
 	grep_lock();
 
 	while ((todo_end+1) % ARRAY_SIZE(todo) == todo_done) {
@@ -108,6 +126,7 @@ static void add_work(struct grep_opt *opt, struct grep_source *gs)
 	}
 
 	todo[todo_end].source = *gs;
+	todo[todo_end].pack_entry = e;
 	todo[todo_end].done = 0;
 	strbuf_reset(&todo[todo_end].out);
 	todo_end = (todo_end + 1) % ARRAY_SIZE(todo);
@@ -190,17 +209,48 @@ static void *run(void *arg)
 {
 	int hit = 0;
 	struct grep_opt *opt = arg;
+	uint64_t lock_wait_ns = 0;
+	intmax_t nr_sources = 0, nr_unlocked = 0;
+	struct packed_object_reader *reader = packed_object_reader_new();
+
+	trace2_thread_start("grep");
+	trace2_region_enter("grep", "worker", opt->repo);
+	obj_read_lock_track_wait(&lock_wait_ns);
 
 	while (1) {
 		struct work_item *w = get_work();
 		if (!w)
 			break;
 
+		if (w->pack_entry.p) {
+			enum object_type type;
+
+			/* on failure, grep_source() reads it with the lock */
+			w->source.buf = packed_object_reader_unpack(reader,
+								    w->pack_entry.p,
+								    w->pack_entry.offset,
+								    &type,
+								    &w->source.size);
+			if (w->source.buf)
+				nr_unlocked++;
+		}
+
 		opt->output_priv = w;
 		hit |= grep_source(opt, &w->source);
 		grep_source_clear_data(&w->source);
 		work_done(w);
+		nr_sources++;
 	}
+
+	obj_read_lock_track_wait(NULL);
+	packed_object_reader_free(reader);
+	trace2_data_intmax("grep", opt->repo, "sources", nr_sources);
+	trace2_data_intmax("grep", opt->repo, "unlocked_reads", nr_unlocked);
+	trace2_data_intmax("grep", opt->repo, "obj_read_lock/wait_ns",
+			   lock_wait_ns);
+	trace2_region_leave("grep", "worker", opt->repo);
+	trace2_thread_exit();
+
 	free_grep_patterns(opt);
 	free(opt);
 
@@ -343,6 +393,32 @@ static void grep_source_name(struct grep_opt *opt, const char *filename,
 		strbuf_insert(out, 0, filename, tree_name_len);
 }
 
+static struct grep_index *grep_index;
+
+static void setup_grep_index(struct grep_opt *opt)
+{
+	struct grep_opt *o = opt;
+
+	/* With threads, only the copies of opt have compiled patterns. */
+	if (num_threads > 1) {
+		o = grep_opt_dup(opt);
+		compile_grep_patterns(o);
+	}
+	grep_index = prepare_grep_index(the_repository, o);
+	if (o != opt) {
+		free_grep_patterns(o);
+		free(o);
+	}
+}
+
+/* Returns 0 if the grep index says that the blob "oid" cannot match. */
+static int blob_may_match(struct grep_opt *opt, const struct object_id *oid)
+{
+	if (!grep_index || opt->repo != the_repository)
+		return 1;
+	return grep_index_may_match(grep_index, oid);
+}
+
 static int grep_oid(struct grep_opt *opt, const struct object_id *oid,
 		     const char *filename, int tree_name_len,
 		     const char *path)
@@ -606,8 +682,9 @@ static int grep_tree(struct grep_opt *opt, const struct pathspec *pathspec,
 		strbuf_add(base, entry.path, te_len);
 
 		if (S_ISREG(entry.mode)) {
-			hit |= grep_oid(opt, &entry.oid, base->buf, tn_len,
-					 check_attr ? base->buf + tn_len : NULL);
+			if (blob_may_match(opt, &entry.oid))
+				hit |= grep_oid(opt, &entry.oid, base->buf, tn_len,
+						check_attr ? base->buf + tn_len : NULL);
 		} else if (S_ISDIR(entry.mode)) {
 			enum object_type type;
 			struct tree_desc sub;
@@ -643,8 +720,11 @@ static int grep_tree(struct grep_opt *opt, const struct pathspec *pathspec,
 static int grep_object(struct grep_opt *opt, const struct pathspec *pathspec,
 		       struct object *obj, const char *name, const char *path)
 {
-	if (obj->type == OBJ_BLOB)
+	if (obj->type == OBJ_BLOB) {
+		if (!blob_may_match(opt, &obj->oid))
+			return 0;
 		return grep_oid(opt, &obj->oid, name, 0, path);
+	}
 	if (obj->type == OBJ_COMMIT || obj->type == OBJ_TREE) {
 		struct tree_desc tree;
 		void *data;
@@ -1195,6 +1275,7 @@ int cmd_grep(int argc, const char **argv, const char *prefix)
 		if (cached)
 			die(_("both --cached and trees are given"));
 
+		setup_grep_index(&opt);
 		hit = grep_objects(&opt, &pathspec, &list);
 	}
 
@@ -1205,6 +1286,7 @@ int cmd_grep(int argc, const char **argv, const char *prefix)
 	clear_pathspec(&pathspec);
 	string_list_clear(&path_list, 0);
 	free_grep_patterns(&opt);
+	free_grep_index(grep_index);
 	object_array_clear(&list);
 	free_repos();
 	return !hit;
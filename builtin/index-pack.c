@@ -890,46 +890,71 @@ static void sha1_object(const void *data, struct object_entry *obj_entry,
  * In the typical and best case, this node would already be reconstructed
  * (through the invocation to resolve_delta() in threaded_second_pass()) and it
  * would not be pruned. However, if pruning of this node was necessary due to
- * reaching delta_base_cache_limit, this function will find the closest
+ * reaching the delta base cache limit, this function will find the closest
  * ancestor with reconstructed data that has not been pruned (or if there is
  * none, the ultimate base object), and reconstruct each node in the delta
  * chain in order to generate the reconstructed data for this node.
+ *
+ * Must be called with the work mutex held, and with the retain_data of this
+ * node incremented. The mutex is released while the node is reconstructed,
+ * so that other threads can keep resolving deltas in the meantime.
  */
 static void *get_base_data(struct base_data *c)
 {
-	if (!c->data) {
-		struct object_entry *obj = c->obj;
-		struct base_data **delta = NULL;
-		int delta_nr = 0, delta_alloc = 0;
-
-		while (is_delta_type(c->obj->type) && !c->data) {
-			ALLOC_GROW(delta, delta_nr + 1, delta_alloc);
-			delta[delta_nr++] = c;
-			c = c->base;
-		}
-		if (!delta_nr) {
-			c->data = get_data_from_pack(obj);
-			c->size = obj->size;
-			base_cache_used += c->size;
-			prune_base_data(c);
-		}
-		for (; delta_nr > 0; delta_nr--) {
-			void *base, *raw;
-			c = delta[delta_nr - 1];
-			obj = c->obj;
-			base = get_base_data(c->base);
-			raw = get_data_from_pack(obj);
-			c->data = patch_delta(
-				base, c->base->size,
-				raw, obj->size,
-				&c->size);
-			free(raw);
-			if (!c->data)
-				bad_object(obj->idx.offset, _("failed to apply delta"));
-			base_cache_used += c->size;
-			prune_base_data(c);
-		}
-		free(delta);
+	struct base_data *b, *ancestor = NULL;
+	struct base_data **delta = NULL;
+	int delta_nr = 0, delta_alloc = 0;
+	void *data;
+	unsigned long size;
+
+	if (c->data)
+		return c->data;
+
+	for (b = c; is_delta_type(b->obj->type) && !b->data; b = b->base) {
+		ALLOC_GROW(delta, delta_nr + 1, delta_alloc);
+		delta[delta_nr++] = b;
+	}
+	if (b->data) {
+		/* keep its data around while we use it without the mutex */
+		ancestor = b;
+		ancestor->retain_data++;
+	}
+	work_unlock();
+
+	if (ancestor) {
+		data = ancestor->data;
+		size = ancestor->size;
+	} else {
+		data = get_data_from_pack(b->obj);
+		size = b->obj->size;
+	}
+	for (; delta_nr > 0; delta_nr--) {
+		struct object_entry *obj = delta[delta_nr - 1]->obj;
+		void *raw, *result;
+
+		raw = get_data_from_pack(obj);
+		result = patch_delta(data, size, raw, obj->size, &size);
+		free(raw);
+		if (!result)
+			bad_object(obj->idx.offset, _("failed to apply delta"));
+		if (!ancestor || data != ancestor->data)
+			free(data);
+		data = result;
+	}
+	free(delta);
+
+	work_lock();
+	if (ancestor)
+		ancestor->retain_data--;
+	if (c->data) {
+		/* another thread has beaten us to it */
+		if (!ancestor || data != ancestor->data)
+			free(data);
+	} else {
+		c->data = data;
+		c->size = size;
+		base_cache_used += c->size;
+		prune_base_data(c);
 	}
 	return c->data;
 }
@@ -1068,17 +1093,12 @@ static void *threaded_second_pass(void *data)
 
 			/*
 			 * Ensure that the parent has data, since we will need
-			 * it later.
-			 *
-			 * NEEDSWORK: If parent data needs to be reloaded, this
-			 * prolongs the time that the current thread spends in
-			 * the mutex. A mitigating factor is that parent data
-			 * needs to be reloaded only if the delta base cache
-			 * limit is exceeded, so in the typical case, this does
-			 * not happen.
+			 * it later. Parent data needs to be reloaded only if
+			 * the delta base cache limit was exceeded, in which
+			 * case this releases the mutex for a while.
 			 */
-			get_base_data(parent);
 			parent->retain_data++;
+			get_base_data(parent);
 		}
 		work_unlock();
 
@@ -1112,7 +1132,6 @@ static void *threaded_second_pass(void *data)
 			list_add(&child->list, &work_head);
 			base_cache_used += child->size;
 			prune_base_data(NULL);
-			free_base_data(child);
 		} else {
 			/*
 			 * This child does not have its own children. It may be
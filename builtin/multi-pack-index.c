@@ -8,7 +8,7 @@
 
 #define BUILTIN_MIDX_WRITE_USAGE \
 	N_("git multi-pack-index [<options>] write [--preferred-pack=<pack>]" \
-	   "[--refs-snapshot=<path>]")
+	   "[--refs-snapshot=<path>] [--incremental]")
 
 #define BUILTIN_MIDX_VERIFY_USAGE \
 	N_("git multi-pack-index [<options>] verify")
@@ -87,6 +87,13 @@ static int git_multi_pack_index_write_config(const char *var, const char *value,
 			opts.flags &= ~MIDX_WRITE_BITMAP_HASH_CACHE;
 	}
 
+	if (!strcmp(var, "pack.writebitmaplookuptable")) {
+		if (git_config_bool(var, value))
+			opts.flags |= MIDX_WRITE_BITMAP_LOOKUP_TABLE;
+		else
+			opts.flags &= ~MIDX_WRITE_BITMAP_LOOKUP_TABLE;
+	}
+
 	/*
 	 * We should never make a fall-back call to 'git_default_config', since
 	 * this was already called in 'cmd_multi_pack_index()'.
@@ -119,6 +126,9 @@ static int cmd_multi_pack_index_write(int argc, const char **argv)
 			 N_("write multi-pack index containing only given indexes")),
 		OPT_FILENAME(0, "refs-snapshot", &opts.refs_snapshot,
 			     N_("refs snapshot for selecting bitmap commits")),
+		OPT_BIT(0, "incremental", &opts.flags,
+			N_("write a new layer covering only packs not yet indexed"),
+			MIDX_WRITE_INCREMENTAL),
 		OPT_END(),
 	};
 
@@ -141,6 +151,15 @@ static int cmd_multi_pack_index_write(int argc, const char **argv)
 
 	FREE_AND_NULL(options);
 
+	if (opts.flags & MIDX_WRITE_INCREMENTAL) {
+		if (opts.flags & MIDX_WRITE_BITMAP)
+			die(_("options '%s' and '%s' cannot be used together"),
+			    "--incremental", "--bitmap");
+		if (opts.stdin_packs)
+			die(_("options '%s' and '%s' cannot be used together"),
+			    "--incremental", "--stdin-packs");
+	}
+
 	if (opts.stdin_packs) {
 		struct string_list packs = STRING_LIST_INIT_DUP;
 		int ret;
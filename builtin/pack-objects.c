@@ -216,13 +216,18 @@ static int thin;
 static int num_preferred_base;
 static struct progress *progress_state;
 
-static struct packed_git *reuse_packfile;
+static struct bitmapped_pack *reuse_packfiles;
+static size_t reuse_packfiles_nr;
 static uint32_t reuse_packfile_objects;
 static struct bitmap *reuse_packfile_bitmap;
 
 static int use_bitmap_index_default = 1;
 static int use_bitmap_index = -1;
-static int allow_pack_reuse = 1;
+static enum {
+	NO_PACK_REUSE = 0,
+	SINGLE_PACK_REUSE,
+	MULTI_PACK_REUSE,
+} allow_pack_reuse = SINGLE_PACK_REUSE;
 static enum {
 	WRITE_BITMAP_FALSE = 0,
 	WRITE_BITMAP_QUIET,
@@ -288,6 +293,7 @@ static void *get_delta(struct object_entry *entry)
 	void *buf, *base_buf, *delta_buf;
 	enum object_type type;
 
+	packing_data_lock(&to_pack);
 	buf = read_object_file(&entry->idx.oid, &type, &size);
 	if (!buf)
 		die(_("unable to read %s"), oid_to_hex(&entry->idx.oid));
@@ -296,6 +302,7 @@ static void *get_delta(struct object_entry *entry)
 	if (!base_buf)
 		die("unable to read %s",
 		    oid_to_hex(&DELTA(entry)->idx.oid));
+	packing_data_unlock(&to_pack);
 	delta_buf = diff_delta(base_buf, base_size,
 			       buf, size, &delta_size, 0);
 	/*
@@ -434,6 +441,275 @@ static inline int oe_size_greater_than(struct packing_data *pack,
 	return oe_get_size_slow(pack, lhs) > rhs;
 }
 
+static int want_object_reuse(struct object_entry *entry, int usable_delta)
+{
+	if (!reuse_object)
+		return 0;	/* explicit */
+	else if (!IN_PACK(entry))
+		return 0;	/* can't reuse what we don't have */
+	else if (oe_type(entry) == OBJ_REF_DELTA ||
+		 oe_type(entry) == OBJ_OFS_DELTA)
+				/* check_object() decided it for us ... */
+		return usable_delta;
+				/* ... but pack split may override that */
+	else if (oe_type(entry) != entry->in_pack_type)
+		return 0;	/* pack has delta which is unusable */
+	else if (DELTA(entry))
+		return 0;	/* we want to pack afresh */
+	else
+		return 1;	/* we have it in-pack undeltified,
+				 * and we do not need to deltify it.
+				 */
+}
+
+/*
+ * Objects that cannot be copied verbatim from an existing pack have
+ * to be deflated while the pack is written, which is by far the most
+ * expensive part of the write phase.  When we are allowed to use more
+ * than one thread, a pool of compression threads walks the write order
+ * ahead of the writer and deflates these objects into a ring of
+ * slots; write_no_reuse_object() then only has to pick up the result.
+ *
+ * The writer stays the only one touching the output file, so the pack
+ * is byte-for-byte identical to what a single thread would produce.
+ * All accesses to the object store are serialized by the packing data
+ * lock, just like during the threaded delta search.
+ */
+#define COMPRESS_AHEAD_PER_THREAD 64
+#define COMPRESS_AHEAD_MAX_BYTES (64 * 1024 * 1024)
+
+struct compressed_slot {
+	struct object_entry *entry;	/* NULL if the slot is free */
+	struct object_entry *delta;	/* base the data is a delta against */
+	void *data;
+	unsigned long size;
+	unsigned long datalen;
+	enum object_type type;
+	unsigned done:1;
+};
+
+static struct compress_ahead {
+	struct object_entry **order;
+	uint32_t nr;
+	uint32_t next;		/* next position in order to consider */
+	uint32_t written;	/* position of the writer in order */
+	unsigned long pending;	/* bytes compressed but not yet written */
+	struct compressed_slot *slots;
+	uint32_t nr_slots;
+	unsigned char *claimed;	/* by the writer, indexed like to_pack.objects */
+	pthread_t *threads;
+	int nr_threads;
+	int stopping;
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+} compress_ahead;
+
+static inline struct compressed_slot *compress_slot(uint32_t pos)
+{
+	return &compress_ahead.slots[pos % compress_ahead.nr_slots];
+}
+
+/*
+ * Predict what write_object() will do with this entry; we only run
+ * ahead when the pack cannot be split, so there is no limit to take
+ * into account.
+ */
+static int want_compress_ahead(struct object_entry *e)
+{
+	int usable_delta = !!DELTA(e);
+
+	if (e->preferred_base || want_object_reuse(e, usable_delta))
+		return 0;
+	if (usable_delta)
+		return !e->z_delta_size;
+	/* large blobs are streamed by the writer */
+	return !(oe_type(e) == OBJ_BLOB &&
+		 oe_size_greater_than(&to_pack, e, big_file_threshold));
+}
+
+static void compress_one(struct compressed_slot *slot)
+{
+	struct object_entry *e = slot->entry;
+
+	slot->delta = DELTA(e);
+	if (!slot->delta) {
+		packing_data_lock(&to_pack);
+		slot->data = read_object_file(&e->idx.oid, &slot->type,
+					      &slot->size);
+		packing_data_unlock(&to_pack);
+		if (!slot->data)
+			return; /* let the writer complain */
+	} else if (e->delta_data) {
+		slot->size = DELTA_SIZE(e);
+		slot->data = e->delta_data;
+		e->delta_data = NULL;
+	} else {
+		slot->data = get_delta(e);
+		slot->size = DELTA_SIZE(e);
+	}
+	slot->datalen = do_compress(&slot->data, slot->size);
+}
+
+static void *threaded_compress_ahead(void *arg)
+{
+	struct compress_ahead *ca = arg;
+
+	pthread_mutex_lock(&ca->mutex);
+	while (!ca->stopping && ca->next < ca->nr) {
+		struct compressed_slot *slot;
+		struct object_entry *e;
+		uint32_t pos;
+		int want;
+
+		if (ca->next - ca->written >= ca->nr_slots ||
+		    ca->pending >= COMPRESS_AHEAD_MAX_BYTES) {
+			pthread_cond_wait(&ca->cond, &ca->mutex);
+			continue;
+		}
+		pos = ca->next++;
+		e = ca->order[pos];
+
+		/* this may need the packing data lock; do not nest it */
+		pthread_mutex_unlock(&ca->mutex);
+		want = want_compress_ahead(e);
+		pthread_mutex_lock(&ca->mutex);
+		if (!want)
+			continue;
+
+		slot = compress_slot(pos);
+		while (slot->entry && !ca->stopping)
+			pthread_cond_wait(&ca->cond, &ca->mutex);
+		if (ca->stopping || ca->claimed[e - to_pack.objects])
+			continue;
+		slot->entry = e;
+		slot->done = 0;
+		pthread_mutex_unlock(&ca->mutex);
+
+		compress_one(slot);
+
+		pthread_mutex_lock(&ca->mutex);
+		slot->done = 1;
+		if (slot->data)
+			ca->pending += slot->datalen;
+		pthread_cond_broadcast(&ca->cond);
+	}
+	pthread_mutex_unlock(&ca->mutex);
+	return NULL;
+}
+
+static void start_compress_ahead(struct object_entry **order)
+{
+	struct compress_ahead *ca = &compress_ahead;
+	int i, ret;
+
+	if (delta_search_threads <= 1 || pack_size_limit ||
+	    to_pack.nr_objects < 2)
+		return;
+
+	ca->order = order;
+	ca->nr = to_pack.nr_objects;
+	ca->nr_threads = delta_search_threads;
+	ca->nr_slots = ca->nr_threads * COMPRESS_AHEAD_PER_THREAD;
+	CALLOC_ARRAY(ca->slots, ca->nr_slots);
+	CALLOC_ARRAY(ca->claimed, ca->nr);
+	pthread_mutex_init(&ca->mutex, NULL);
+	pthread_cond_init(&ca->cond, NULL);
+
+	CALLOC_ARRAY(ca->threads, ca->nr_threads);
+	for (i = 0; i < ca->nr_threads; i++) {
+		ret = pthread_create(&ca->threads[i], NULL,
+				     threaded_compress_ahead, ca);
+		if (ret)
+			die(_("unable to create thread: %s"), strerror(ret));
+	}
+}
+
+static void stop_compress_ahead(void)
+{
+	struct compress_ahead *ca = &compress_ahead;
+	uint32_t i;
+
+	if (!ca->threads)
+		return;
+
+	pthread_mutex_lock(&ca->mutex);
+	ca->stopping = 1;
+	pthread_cond_broadcast(&ca->cond);
+	pthread_mutex_unlock(&ca->mutex);
+
+	for (i = 0; i < ca->nr_threads; i++)
+		pthread_join(ca->threads[i], NULL);
+	for (i = 0; i < ca->nr_slots; i++)
+		free(ca->slots[i].data);
+
+	pthread_cond_destroy(&ca->cond);
+	pthread_mutex_destroy(&ca->mutex);
+	free(ca->threads);
+	free(ca->slots);
+	free(ca->claimed);
+	memset(ca, 0, sizeof(*ca));
+}
+
+static void advance_compress_ahead(uint32_t written)
+{
+	struct compress_ahead *ca = &compress_ahead;
+
+	if (!ca->threads)
+		return;
+
+	pthread_mutex_lock(&ca->mutex);
+	ca->written = written;
+	pthread_cond_broadcast(&ca->cond);
+	pthread_mutex_unlock(&ca->mutex);
+}
+
+/*
+ * Hand over the deflated data for "entry", if a compression thread
+ * prepared it.  Otherwise, make sure no thread will pick it up later
+ * and return NULL, in which case the caller has to do the work.
+ */
+static void *take_compressed(struct object_entry *entry, int usable_delta,
+			     enum object_type *type, unsigned long *size,
+			     unsigned long *datalen)
+{
+	struct compress_ahead *ca = &compress_ahead;
+	struct compressed_slot *slot = NULL;
+	void *data = NULL;
+	uint32_t i;
+
+	if (!ca->threads)
+		return NULL;
+
+	pthread_mutex_lock(&ca->mutex);
+	ca->claimed[entry - to_pack.objects] = 1;
+	for (i = ca->written; i < ca->next; i++) {
+		if (compress_slot(i)->entry == entry) {
+			slot = compress_slot(i);
+			break;
+		}
+	}
+	if (slot) {
+		while (!slot->done)
+			pthread_cond_wait(&ca->cond, &ca->mutex);
+		if (slot->data)
+			ca->pending -= slot->datalen;
+		if (slot->delta == (usable_delta ? DELTA(entry) : NULL)) {
+			data = slot->data;
+			*type = slot->type;
+			*size = slot->size;
+			*datalen = slot->datalen;
+		} else {
+			/* the delta was dropped after all */
+			free(slot->data);
+		}
+		slot->entry = NULL;
+		slot->data = NULL;
+		pthread_cond_broadcast(&ca->cond);
+	}
+	pthread_mutex_unlock(&ca->mutex);
+	return data;
+}
+
 /* Return 0 if we will bust the pack-size limit */
 static unsigned long write_no_reuse_object(struct hashfile *f, struct object_entry *entry,
 					   unsigned long limit, int usable_delta)
@@ -446,8 +722,16 @@ static unsigned long write_no_reuse_object(struct hashfile *f, struct object_ent
 	void *buf;
 	struct git_istream *st = NULL;
 	const unsigned hashsz = the_hash_algo->rawsz;
-
-	if (!usable_delta) {
+	int compressed = 0;
+
+	buf = take_compressed(entry, usable_delta, &type, &size, &datalen);
+	if (buf) {
+		compressed = 1;
+		if (usable_delta)
+			type = (allow_ofs_delta && DELTA(entry)->idx.offset) ?
+				OBJ_OFS_DELTA : OBJ_REF_DELTA;
+	} else if (!usable_delta) {
+		packing_data_lock(&to_pack);
 		if (oe_type(entry) == OBJ_BLOB &&
 		    oe_size_greater_than(&to_pack, entry, big_file_threshold) &&
 		    (st = open_istream(the_repository, &entry->idx.oid, &type,
@@ -459,6 +743,7 @@ static unsigned long write_no_reuse_object(struct hashfile *f, struct object_ent
 				die(_("unable to read %s"),
 				    oid_to_hex(&entry->idx.oid));
 		}
+		packing_data_unlock(&to_pack);
 		/*
 		 * make sure no cached delta data remains from a
 		 * previous attempt before a pack split occurred.
@@ -478,7 +763,9 @@ static unsigned long write_no_reuse_object(struct hashfile *f, struct object_ent
 			OBJ_OFS_DELTA : OBJ_REF_DELTA;
 	}
 
-	if (st)	/* large blob case, just assume we don't compress well */
+	if (compressed)
+		; /* done by a compression thread */
+	else if (st)	/* large blob case, just assume we don't compress well */
 		datalen = size;
 	else if (entry->z_delta_size)
 		datalen = entry->z_delta_size;
@@ -536,8 +823,10 @@ static unsigned long write_no_reuse_object(struct hashfile *f, struct object_ent
 		hashwrite(f, header, hdrlen);
 	}
 	if (st) {
+		packing_data_lock(&to_pack);
 		datalen = write_large_blob_data(st, f, &entry->idx.oid);
 		close_istream(st);
+		packing_data_unlock(&to_pack);
 	} else {
 		hashwrite(f, buf, datalen);
 		free(buf);
@@ -666,28 +955,15 @@ static off_t write_object(struct hashfile *f,
 	else
 		usable_delta = 0;	/* base could end up in another pack */
 
-	if (!reuse_object)
-		to_reuse = 0;	/* explicit */
-	else if (!IN_PACK(entry))
-		to_reuse = 0;	/* can't reuse what we don't have */
-	else if (oe_type(entry) == OBJ_REF_DELTA ||
-		 oe_type(entry) == OBJ_OFS_DELTA)
-				/* check_object() decided it for us ... */
-		to_reuse = usable_delta;
-				/* ... but pack split may override that */
-	else if (oe_type(entry) != entry->in_pack_type)
-		to_reuse = 0;	/* pack has delta which is unusable */
-	else if (DELTA(entry))
-		to_reuse = 0;	/* we want to pack afresh */
-	else
-		to_reuse = 1;	/* we have it in-pack undeltified,
-				 * and we do not need to deltify it.
-				 */
+	to_reuse = want_object_reuse(entry, usable_delta);
 
 	if (!to_reuse)
 		len = write_no_reuse_object(f, entry, limit, usable_delta);
-	else
+	else {
+		packing_data_lock(&to_pack);
 		len = write_reuse_object(f, entry, limit, usable_delta);
+		packing_data_unlock(&to_pack);
+	}
 	if (!len)
 		return 0;
 
@@ -1002,7 +1278,8 @@ static off_t find_reused_offset(off_t where)
 	return reused_chunks[lo-1].difference;
 }
 
-static void write_reused_pack_one(size_t pos, struct hashfile *out,
+static void write_reused_pack_one(struct packed_git *reuse_packfile,
+				  size_t pos, struct hashfile *out,
 				  struct pack_window **w_curs)
 {
 	off_t offset, next, cur;
@@ -1080,59 +1357,88 @@ static void write_reused_pack_one(size_t pos, struct hashfile *out,
 	copy_pack_data(out, reuse_packfile, w_curs, offset, next - offset);
 }
 
-static size_t write_reused_pack_verbatim(struct hashfile *out,
+/*
+ * Copy the longest run of reused objects at the beginning of "pack" in
+ * one go, and return the number of objects written.
+ */
+static size_t write_reused_pack_verbatim(struct bitmapped_pack *pack,
+					 struct hashfile *out,
 					 struct pack_window **w_curs)
 {
-	size_t pos = 0;
+	size_t pos = pack->bitmap_pos;
+	size_t end = pack->bitmap_pos + pack->bitmap_nr;
+	size_t nr;
+
+	while (pos < end) {
+		size_t i = pos / BITS_IN_EWORD;
 
-	while (pos < reuse_packfile_bitmap->word_alloc &&
-			reuse_packfile_bitmap->words[pos] == (eword_t)~0)
+		if (!(pos % BITS_IN_EWORD) && pos + BITS_IN_EWORD <= end &&
+		    i < reuse_packfile_bitmap->word_alloc &&
+		    reuse_packfile_bitmap->words[i] == (eword_t)~0) {
+			pos += BITS_IN_EWORD;
+			continue;
+		}
+		if (!bitmap_get(reuse_packfile_bitmap, pos))
+			break;
 		pos++;
+	}
 
-	if (pos) {
-		off_t to_write;
+	nr = pos - pack->bitmap_pos;
+	if (nr) {
+		off_t from = pack_pos_to_offset(pack->p, 0);
+		off_t to_write = pack_pos_to_offset(pack->p, nr) - from;
 
-		written = (pos * BITS_IN_EWORD);
-		to_write = pack_pos_to_offset(reuse_packfile, written)
-			- sizeof(struct pack_header);
+		written += nr;
 
 		/* We're recording one chunk, not one object. */
-		record_reused_object(sizeof(struct pack_header), 0);
+		record_reused_object(from, from - hashfile_total(out));
 		hashflush(out);
-		copy_pack_data(out, reuse_packfile, w_curs,
-			sizeof(struct pack_header), to_write);
+		copy_pack_data(out, pack->p, w_curs, from, to_write);
 
 		display_progress(progress_state, written);
 	}
-	return pos;
+	return nr;
 }
 
-static void write_reused_pack(struct hashfile *f)
+static void write_reused_pack(struct bitmapped_pack *pack,
+			      struct hashfile *f)
 {
-	size_t i = 0;
-	uint32_t offset;
+	size_t pos = pack->bitmap_pos;
+	size_t end = pack->bitmap_pos + pack->bitmap_nr;
 	struct pack_window *w_curs = NULL;
 
-	if (allow_ofs_delta)
-		i = write_reused_pack_verbatim(f, &w_curs);
+	/*
+	 * Deltas only ever refer to bases from the same pack, so
+	 * offsets only need to be translated within each pack.
+	 */
+	reused_chunks_nr = 0;
 
-	for (; i < reuse_packfile_bitmap->word_alloc; ++i) {
-		eword_t word = reuse_packfile_bitmap->words[i];
-		size_t pos = (i * BITS_IN_EWORD);
+	if (allow_ofs_delta)
+		pos += write_reused_pack_verbatim(pack, f, &w_curs);
 
-		for (offset = 0; offset < BITS_IN_EWORD; ++offset) {
-			if ((word >> offset) == 0)
-				break;
+	while (pos < end) {
+		size_t i = pos / BITS_IN_EWORD;
+		eword_t word;
 
-			offset += ewah_bit_ctz64(word >> offset);
-			/*
-			 * Can use bit positions directly, even for MIDX
-			 * bitmaps. See comment in try_partial_reuse()
-			 * for why.
-			 */
-			write_reused_pack_one(pos + offset, f, &w_curs);
-			display_progress(progress_state, ++written);
+		if (i >= reuse_packfile_bitmap->word_alloc)
+			break;
+		word = reuse_packfile_bitmap->words[i] >> (pos % BITS_IN_EWORD);
+		if (!word) {
+			pos = (i + 1) * BITS_IN_EWORD;
+			continue;
 		}
+		pos += ewah_bit_ctz64(word);
+		if (pos >= end)
+			break;
+
+		/*
+		 * Bit positions map directly to positions in the pack.
+		 * See comment in try_partial_reuse() for why.
+		 */
+		write_reused_pack_one(pack->p, pos - pack->bitmap_pos,
+				      f, &w_curs);
+		display_progress(progress_state, ++written);
+		pos++;
 	}
 
 	unuse_pack(&w_curs);
@@ -1186,19 +1492,23 @@ static void write_pack_file(void)
 
 		offset = write_pack_header(f, nr_remaining);
 
-		if (reuse_packfile) {
+		if (reuse_packfiles_nr) {
 			assert(pack_to_stdout);
-			write_reused_pack(f);
+			for (j = 0; j < reuse_packfiles_nr; j++)
+				write_reused_pack(&reuse_packfiles[j], f);
 			offset = hashfile_total(f);
 		}
 
 		nr_written = 0;
+		start_compress_ahead(write_order);
 		for (; i < to_pack.nr_objects; i++) {
 			struct object_entry *e = write_order[i];
 			if (write_one(f, e, &offset) == WRITE_ONE_BREAK)
 				break;
+			advance_compress_ahead(i + 1);
 			display_progress(progress_state, written);
 		}
+		stop_compress_ahead();
 
 		if (pack_to_stdout) {
 			/*
@@ -3148,12 +3458,31 @@ static int git_pack_config(const char *k, const char *v, void *cb)
 		else
 			write_bitmap_options &= ~BITMAP_OPT_HASH_CACHE;
 	}
+
+	if (!strcmp(k, "pack.writebitmaplookuptable")) {
+		if (git_config_bool(k, v))
+			write_bitmap_options |= BITMAP_OPT_LOOKUP_TABLE;
+		else
+			write_bitmap_options &= ~BITMAP_OPT_LOOKUP_TABLE;
+	}
 	if (!strcmp(k, "pack.usebitmaps")) {
 		use_bitmap_index_default = git_config_bool(k, v);
 		return 0;
 	}
 	if (!strcmp(k, "pack.allowpackreuse")) {
-		allow_pack_reuse = git_config_bool(k, v);
+		int res = git_parse_maybe_bool(v);
+		if (res < 0) {
+			if (!strcasecmp(v, "single"))
+				allow_pack_reuse = SINGLE_PACK_REUSE;
+			else if (!strcasecmp(v, "multi"))
+				allow_pack_reuse = MULTI_PACK_REUSE;
+			else
+				die(_("invalid pack.allowPackReuse value: '%s'"), v);
+		} else if (res) {
+			allow_pack_reuse = SINGLE_PACK_REUSE;
+		} else {
+			allow_pack_reuse = NO_PACK_REUSE;
+		}
 		return 0;
 	}
 	if (!strcmp(k, "pack.threads")) {
@@ -3923,13 +4252,17 @@ static int get_object_list_from_bitmap(struct rev_info *revs)
 	if (pack_options_allow_reuse() &&
 	    !reuse_partial_packfile_from_bitmap(
 			bitmap_git,
-			&reuse_packfile,
+			&reuse_packfiles,
+			&reuse_packfiles_nr,
 			&reuse_packfile_objects,
-			&reuse_packfile_bitmap)) {
+			&reuse_packfile_bitmap,
+			allow_pack_reuse == MULTI_PACK_REUSE)) {
 		assert(reuse_packfile_objects);
 		nr_result += reuse_packfile_objects;
 		nr_seen += reuse_packfile_objects;
 		display_progress(progress_state, nr_seen);
+		trace2_data_intmax("pack-objects", the_repository,
+				   "pack-reused-packs", reuse_packfiles_nr);
 	}
 
 	traverse_bitmap_commit_list(bitmap_git, revs,
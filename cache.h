@@ -116,7 +116,7 @@ struct cache_header {
 };
 
 #define INDEX_FORMAT_LB 2
-#define INDEX_FORMAT_UB 4
+#define INDEX_FORMAT_UB 5
 
 /*
  * The "cache_time" is just the low 32 bits of the
@@ -351,6 +351,8 @@ struct index_state {
 	struct hashmap name_hash;
 	struct hashmap dir_hash;
 	struct object_id oid;
+	/* the index file we read or wrote, for when its hash is skipped */
+	struct stat_data file_stat;
 	struct untracked_cache *untracked;
 	char *fsmonitor_last_update;
 	struct ewah_bitmap *fsmonitor_dirty;
@@ -668,11 +670,25 @@ int path_inside_repo(const char *prefix, const char *path);
 
 #define INIT_DB_QUIET 0x0001
 #define INIT_DB_EXIST_OK 0x0002
+#define INIT_DB_SKIP_REFDB 0x0004
 
 int init_db(const char *git_dir, const char *real_git_dir,
 	    const char *template_dir, int hash_algo,
+	    enum ref_storage_format ref_storage_format,
 	    const char *initial_branch, unsigned int flags);
-void initialize_repository_version(int hash_algo, int reinit);
+void initialize_repository_version(int hash_algo,
+				   enum ref_storage_format ref_storage_format,
+				   int reinit);
+
+/*
+ * Set up the reference database of the repository in the current git
+ * directory, pointing HEAD at `initial_branch` (or the configured
+ * default branch) unless HEAD already exists. This is done as part of
+ * init_db() unless INIT_DB_SKIP_REFDB is given, in which case the
+ * caller must call it once the repository format is final.
+ */
+void create_reference_database(enum ref_storage_format ref_storage_format,
+			       const char *initial_branch, int quiet);
 
 void sanitize_stdfds(void);
 int daemonize(void);
@@ -1146,6 +1162,7 @@ struct repository_format {
 	int worktree_config;
 	int is_bare;
 	int hash_algo;
+	enum ref_storage_format ref_storage_format;
 	int sparse_index;
 	char *work_tree;
 	struct string_list unknown_extensions;
@@ -1162,6 +1179,7 @@ struct repository_format {
 	.version = -1, \
 	.is_bare = -1, \
 	.hash_algo = GIT_HASH_SHA1, \
+	.ref_storage_format = REF_STORAGE_FORMAT_FILES, \
 	.unknown_extensions = STRING_LIST_INIT_DUP, \
 	.v1_only_extensions = STRING_LIST_INIT_DUP, \
 }
@@ -1249,6 +1267,11 @@ enum sharedrepo {
 };
 int git_config_perm(const char *var, const char *value);
 int adjust_shared_perm(const char *path);
+/*
+ * Compute the permission bits that "mode" should have according to
+ * core.sharedRepository.
+ */
+int calc_shared_perm(int mode);
 
 /*
  * Create the directory containing the named path, using care to be
@@ -1575,12 +1575,142 @@ static void trace2_bloom_filter_write_statistics(struct write_commit_graph_conte
 			   ctx->count_bloom_filter_trunc_large);
 }
 
+struct bloom_filter_todo {
+	struct commit *commit;
+	struct bloom_filter *filter;
+	enum bloom_filter_computed computed;
+};
+
+struct bloom_filter_worker {
+	pthread_t thread;
+	struct write_commit_graph_context *ctx;
+	struct bloom_filter_todo *todo;
+	size_t todo_nr;
+	size_t *next;
+	struct progress *progress;
+	uint64_t *done;
+};
+
+static pthread_mutex_t bloom_filter_mutex;
+
+/*
+ * Commits are handed out in small batches, so that threads do not
+ * contend on the mutex, yet do not end up with all the expensive
+ * commits (e.g. large merges or imports) at once.
+ */
+#define BLOOM_FILTER_BATCH 16
+
+static void *compute_bloom_filters_thread(void *arg)
+{
+	struct bloom_filter_worker *w = arg;
+
+	for (;;) {
+		size_t i, start, end;
+
+		pthread_mutex_lock(&bloom_filter_mutex);
+		start = *w->next;
+		end = start + BLOOM_FILTER_BATCH;
+		if (end > w->todo_nr)
+			end = w->todo_nr;
+		*w->next = end;
+		pthread_mutex_unlock(&bloom_filter_mutex);
+
+		if (start >= end)
+			break;
+
+		for (i = start; i < end; i++)
+			w->todo[i].filter =
+				compute_bloom_filter(w->ctx->r, w->todo[i].commit,
+						     w->ctx->bloom_settings,
+						     &w->todo[i].computed);
+
+		pthread_mutex_lock(&bloom_filter_mutex);
+		*w->done += end - start;
+		display_progress(w->progress, *w->done);
+		pthread_mutex_unlock(&bloom_filter_mutex);
+	}
+	return NULL;
+}
+
+/*
+ * Compute the filters of "todo" from "nr_threads" threads, each comparing
+ * the trees of its commits independently. "done" is the progress so far.
+ */
+static void compute_bloom_filters_threaded(struct write_commit_graph_context *ctx,
+					   struct bloom_filter_todo *todo,
+					   size_t todo_nr, int nr_threads,
+					   struct progress *progress,
+					   uint64_t done)
+{
+	struct bloom_filter_worker *workers;
+	size_t next = 0;
+	int i;
+
+	CALLOC_ARRAY(workers, nr_threads);
+	pthread_mutex_init(&bloom_filter_mutex, NULL);
+	enable_obj_read_lock();
+
+	for (i = 0; i < nr_threads; i++) {
+		struct bloom_filter_worker *w = &workers[i];
+		int err;
+
+		w->ctx = ctx;
+		w->todo = todo;
+		w->todo_nr = todo_nr;
+		w->next = &next;
+		w->progress = progress;
+		w->done = &done;
+		err = pthread_create(&w->thread, NULL,
+				     compute_bloom_filters_thread, w);
+		if (err)
+			die(_("unable to create thread: %s"), strerror(err));
+	}
+	for (i = 0; i < nr_threads; i++)
+		pthread_join(workers[i].thread, NULL);
+
+	disable_obj_read_lock();
+	pthread_mutex_destroy(&bloom_filter_mutex);
+	free(workers);
+}
+
+static int bloom_filter_threads(struct write_commit_graph_context *ctx)
+{
+	int nr_threads = 0;
+
+	if (!HAVE_THREADS)
+		return 1;
+
+	repo_config_get_int(ctx->r, "commitgraph.threads", &nr_threads);
+	if (nr_threads <= 0)
+		nr_threads = online_cpus();
+	return nr_threads;
+}
+
+static void count_bloom_filter(struct write_commit_graph_context *ctx,
+			       struct bloom_filter *filter,
+			       enum bloom_filter_computed computed)
+{
+	if (computed & BLOOM_COMPUTED) {
+		ctx->count_bloom_filter_computed++;
+		if (computed & BLOOM_TRUNC_EMPTY)
+			ctx->count_bloom_filter_trunc_empty++;
+		if (computed & BLOOM_TRUNC_LARGE)
+			ctx->count_bloom_filter_trunc_large++;
+	} else if (computed & BLOOM_NOT_COMPUTED)
+		ctx->count_bloom_filter_not_computed++;
+	ctx->total_bloom_filter_data_size += filter
+		? sizeof(unsigned char) * filter->len : 0;
+}
+
 static void compute_bloom_filters(struct write_commit_graph_context *ctx)
 {
 	int i;
 	struct progress *progress = NULL;
 	struct commit **sorted_commits;
+	struct bloom_filter_todo *todo = NULL;
+	size_t todo_nr = 0, todo_alloc = 0;
 	int max_new_filters;
+	int nr_threads = bloom_filter_threads(ctx);
 
 	init_bloom_filters();
 
@@ -1603,28 +1733,50 @@ static void compute_bloom_filters(struct write_commit_graph_context *ctx)
 	for (i = 0; i < ctx->commits.nr; i++) {
 		enum bloom_filter_computed computed = 0;
 		struct commit *c = sorted_commits[i];
-		struct bloom_filter *filter = get_or_compute_bloom_filter(
-			ctx->r,
-			c,
-			ctx->count_bloom_filter_computed < max_new_filters,
-			ctx->bloom_settings,
-			&computed);
-		if (computed & BLOOM_COMPUTED) {
-			ctx->count_bloom_filter_computed++;
-			if (computed & BLOOM_TRUNC_EMPTY)
-				ctx->count_bloom_filter_trunc_empty++;
-			if (computed & BLOOM_TRUNC_LARGE)
-				ctx->count_bloom_filter_trunc_large++;
-		} else if (computed & BLOOM_NOT_COMPUTED)
-			ctx->count_bloom_filter_not_computed++;
-		ctx->total_bloom_filter_data_size += filter
-			? sizeof(unsigned char) * filter->len : 0;
-		display_progress(progress, i + 1);
+		int compute = ctx->count_bloom_filter_computed + (int)todo_nr <
+			      max_new_filters;
+		struct bloom_filter *filter;
+
+		if (nr_threads > 1 && compute) {
+			/*
+			 * Set up the filter slot and load any existing
+			 * filter, and leave the rest to the threads below.
+			 */
+			filter = get_or_compute_bloom_filter(ctx->r, c, 0,
+							     ctx->bloom_settings,
+							     &computed);
+			if (!filter) {
+				repo_parse_commit(ctx->r, c);
+				ALLOC_GROW(todo, todo_nr + 1, todo_alloc);
+				todo[todo_nr].commit = c;
+				todo[todo_nr].filter = NULL;
+				todo[todo_nr].computed = 0;
+				todo_nr++;
+				continue;
+			}
+		} else {
+			filter = get_or_compute_bloom_filter(ctx->r, c, compute,
+							     ctx->bloom_settings,
+							     &computed);
+		}
+		count_bloom_filter(ctx, filter, computed);
+		display_progress(progress, i + 1 - todo_nr);
+	}
+
+	if (todo_nr) {
+		size_t j;
+
+		compute_bloom_filters_threaded(ctx, todo, todo_nr, nr_threads,
+					       progress,
+					       ctx->commits.nr - todo_nr);
+		for (j = 0; j < todo_nr; j++)
+			count_bloom_filter(ctx, todo[j].filter, todo[j].computed);
 	}
 
 	if (trace2_is_enabled())
 		trace2_bloom_filter_write_statistics(ctx);
 
+	free(todo);
 	free(sorted_commits);
 	stop_progress(&progress);
 }
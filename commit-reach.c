@@ -942,3 +942,204 @@ struct commit_list *get_reachable_subset(struct commit **from, int nr_from,
 
 	return found_commits;
 }
+
+static void push_unseen_commit(struct repository *r,
+			       struct prio_queue *queue,
+			       struct commit *c,
+			       timestamp_t min_generation)
+{
+	if (c->object.flags & PARENT1)
+		return;
+	if (repo_parse_commit(r, c) ||
+	    commit_graph_generation(c) < min_generation)
+		return;
+	c->object.flags |= PARENT1;
+	prio_queue_put(queue, c);
+}
+
+void tips_reaching_commits(struct repository *r,
+			   struct commit **tips, size_t nr,
+			   struct commit_list *want,
+			   unsigned int mark,
+			   reach_hint_fn hint, void *hint_data)
+{
+	struct prio_queue queue = { compare_commits_by_gen_then_commit_date };
+	timestamp_t min_generation = GENERATION_NUMBER_INFINITY;
+	struct commit **visited = NULL;
+	size_t visited_nr = 0, visited_alloc = 0, i;
+	struct commit_list *p;
+	struct commit *c;
+	int in_order = 1, changed;
+
+	if (!want || !nr)
+		return;
+
+	for (p = want; p; p = p->next) {
+		timestamp_t generation;
+
+		if (repo_parse_commit(r, p->item))
+			continue;
+		p->item->object.flags |= PARENT2;
+		generation = commit_graph_generation(p->item);
+		if (generation < min_generation)
+			min_generation = generation;
+	}
+
+	/*
+	 * Walk down from all the tips at once, highest generation first,
+	 * no further than the lowest of the wanted commits. Below a wanted
+	 * commit there is nothing left to find: a tip that reaches another
+	 * wanted commit through it is answered by the first one.
+	 */
+	for (i = 0; i < nr; i++)
+		push_unseen_commit(r, &queue, tips[i], min_generation);
+	while ((c = prio_queue_get(&queue))) {
+		ALLOC_GROW(visited, visited_nr + 1, visited_alloc);
+		visited[visited_nr++] = c;
+		c->object.flags |= STALE;
+
+		if (c->object.flags & PARENT2) {
+			c->object.flags |= RESULT;
+			continue;
+		}
+		if (hint) {
+			int known = hint(c, hint_data);
+
+			if (known > 0)
+				c->object.flags |= RESULT;
+			if (known >= 0)
+				continue;
+		}
+		for (p = c->parents; p; p = p->next) {
+			/*
+			 * A parent that came out of the queue before its child
+			 * (commits outside the commit-graph are ordered by
+			 * their possibly skewed dates) breaks the order the
+			 * pass below relies on.
+			 */
+			if (p->item->object.flags & STALE)
+				in_order = 0;
+			push_unseen_commit(r, &queue, p->item, min_generation);
+		}
+	}
+
+	/*
+	 * Then let the answer flow from the wanted commits up to their
+	 * descendants, parents before children. One pass does it when
+	 * the walk visited every commit before its parents.
+	 */
+	do {
+		changed = 0;
+		for (i = visited_nr; i--; ) {
+			c = visited[i];
+			if (c->object.flags & RESULT)
+				continue;
+			for (p = c->parents; p; p = p->next) {
+				if (p->item->object.flags & RESULT) {
+					c->object.flags |= RESULT;
+					changed = 1;
+					break;
+				}
+			}
+		}
+	} while (changed && !in_order);
+
+	for (i = 0; i < nr; i++)
+		if (tips[i]->object.flags & RESULT)
+			tips[i]->object.flags |= mark;
+
+	for (i = 0; i < visited_nr; i++)
+		visited[i]->object.flags &= ~all_flags;
+	for (p = want; p; p = p->next)
+		p->item->object.flags &= ~all_flags;
+	clear_prio_queue(&queue);
+	free(visited);
+}
+
+void tips_reachable_from_bases(struct repository *r,
+			       struct commit_list *bases,
+			       struct commit **tips, size_t nr,
+			       unsigned int mark)
+{
+	struct prio_queue queue = { compare_commits_by_gen_then_commit_date };
+	struct commit **to_find, **seen = NULL;
+	size_t to_find_nr = 0, lowest = 0, seen_nr = 0, seen_alloc = 0, i;
+	timestamp_t min_generation;
+	struct commit_list *p;
+	struct commit *c;
+
+	if (!bases || !nr)
+		return;
+
+	ALLOC_ARRAY(to_find, nr);
+	for (i = 0; i < nr; i++) {
+		if (tips[i]->object.flags & PARENT2)
+			continue;
+		if (repo_parse_commit(r, tips[i]))
+			continue;
+		tips[i]->object.flags |= PARENT2;
+		to_find[to_find_nr++] = tips[i];
+	}
+	if (!to_find_nr) {
+		free(to_find);
+		return;
+	}
+
+	/*
+	 * Walk down from the bases, highest generation first, for as long
+	 * as there is a tip left to find at or below the current commit.
+	 */
+	QSORT(to_find, to_find_nr, compare_commits_by_gen);
+	min_generation = commit_graph_generation(to_find[0]);
+
+	for (p = bases; p; p = p->next) {
+		if (p->item->object.flags & PARENT1)
+			continue;
+		if (repo_parse_commit(r, p->item))
+			continue;
+		p->item->object.flags |= PARENT1;
+		prio_queue_put(&queue, p->item);
+		ALLOC_GROW(seen, seen_nr + 1, seen_alloc);
+		seen[seen_nr++] = p->item;
+	}
+
+	while ((c = prio_queue_get(&queue))) {
+		if (commit_graph_generation(c) < min_generation)
+			break;
+
+		if ((c->object.flags & PARENT2) &&
+		    !(c->object.flags & RESULT)) {
+			c->object.flags |= RESULT;
+			while (lowest < to_find_nr &&
+			       (to_find[lowest]->object.flags & RESULT))
+				lowest++;
+			if (lowest == to_find_nr)
+				break;
+			min_generation = commit_graph_generation(to_find[lowest]);
+		}
+
+		for (p = c->parents; p; p = p->next) {
+			if (p->item->object.flags & PARENT1)
+				continue;
+			if (repo_parse_commit(r, p->item) ||
+			    commit_graph_generation(p->item) < min_generation)
+				continue;
+			p->item->object.flags |= PARENT1;
+			prio_queue_put(&queue, p->item);
+			ALLOC_GROW(seen, seen_nr + 1, seen_alloc);
+			seen[seen_nr++] = p->item;
+		}
+	}
+
+	for (i = 0; i < nr; i++)
+		if (tips[i]->object.flags & RESULT)
+			tips[i]->object.flags |= mark;
+
+	for (i = 0; i < seen_nr; i++)
+		seen[i]->object.flags &= ~all_flags;
+	for (i = 0; i < to_find_nr; i++)
+		to_find[i]->object.flags &= ~all_flags;
+	clear_prio_queue(&queue);
+	free(seen);
+	free(to_find);
+}
@@ -104,4 +104,39 @@ struct commit_list *get_reachable_subset(struct commit **from, int nr_from,
 					 struct commit **to, int nr_to,
 					 unsigned int reachable_flag);
 
+/*
+ * Tell whether a commit can reach the commits wanted by the caller
+ * without walking its history: 1 or 0, or -1 if it does not know.
+ */
+typedef int (*reach_hint_fn)(struct commit *commit, void *data);
+
+/*
+ * Add 'mark' to the flags of each of the 'nr' commits in 'tips' that can
+ * reach at least one of the commits in 'want' (like commit_contains()
+ * does for a single commit), answering for all the tips in a single walk
+ * that stops at the lowest generation among 'want'. If 'hint' is given,
+ * the walk does not go past the commits it has an answer for.
+ *
+ * This method uses the PARENT1, PARENT2, STALE and RESULT flags during
+ * its operation, so be sure these flags are not set before calling it.
+ */
+void tips_reaching_commits(struct repository *r,
+			   struct commit **tips, size_t nr,
+			   struct commit_list *want,
+			   unsigned int mark,
+			   reach_hint_fn hint, void *hint_data);
+
+/*
+ * Add 'mark' to the flags of each of the 'nr' commits in 'tips' that is
+ * reachable from at least one of the commits in 'bases', in a single walk
+ * that stops as soon as no tip that is yet to be found can be reached.
+ *
+ * This method uses the PARENT1, PARENT2 and RESULT flags during its
+ * operation, so be sure these flags are not set before calling it.
+ */
+void tips_reachable_from_bases(struct repository *r,
+			       struct commit_list *bases,
+			       struct commit **tips, size_t nr,
+			       unsigned int mark);
+
 #endif
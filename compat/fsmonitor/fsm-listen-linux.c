@@ -0,0 +1,646 @@
+#include "cache.h"
+#include "fsmonitor.h"
+#include "fsm-listen.h"
+#include "fsmonitor--daemon.h"
+#include <sys/inotify.h>
+#include <poll.h>
+
+/*
+ * inotify(7) is not recursive: the kernel only reports events for the
+ * immediate children of a watched directory.  So we must add a watch
+ * to every directory within the worktree and keep that set of watches
+ * in sync as directories are created, deleted and renamed.
+ *
+ * Each watch descriptor is mapped back to the absolute pathname of the
+ * directory that it watches so that we can construct the full pathname
+ * of each event.
+ */
+struct watch_entry {
+	struct hashmap_entry ent;
+	int wd;
+	char dir[FLEX_ARRAY];
+};
+
+struct fsm_listen_data
+{
+	int fd_inotify;
+	int fd_stop[2];
+
+	struct hashmap watches; /* map<wd, struct watch_entry> */
+
+	int wd_worktree;
+	int wd_gitdir;
+
+	enum shutdown_style {
+		SHUTDOWN_EVENT = 0,
+		FORCE_SHUTDOWN,
+		FORCE_ERROR_STOP,
+	} shutdown_style;
+};
+
+/*
+ * The events that we want to hear about for each directory in the
+ * worktree.  We are not interested in access or open/close events.
+ * We do not follow symlinks; a symlink to a directory is a leaf
+ * (just like it is in the index).
+ */
+#define WATCH_MASK (IN_ATTRIB | IN_CREATE | IN_DELETE | IN_MODIFY | \
+		    IN_MOVED_FROM | IN_MOVED_TO | \
+		    IN_DELETE_SELF | IN_MOVE_SELF | \
+		    IN_DONT_FOLLOW | IN_EXCL_UNLINK | IN_ONLYDIR)
+
+static int watch_entry_cmp(const void *unused_cmp_data,
+			   const struct hashmap_entry *eptr,
+			   const struct hashmap_entry *entry_or_key,
+			   const void *unused_keydata)
+{
+	const struct watch_entry *a, *b;
+
+	a = container_of(eptr, const struct watch_entry, ent);
+	b = container_of(entry_or_key, const struct watch_entry, ent);
+
+	return a->wd != b->wd;
+}
+
+static struct watch_entry *find_watch(struct fsm_listen_data *data, int wd)
+{
+	struct watch_entry key;
+
+	hashmap_entry_init(&key.ent, memhash(&wd, sizeof(wd)));
+	key.wd = wd;
+
+	return hashmap_get_entry(&data->watches, &key, ent, NULL);
+}
+
+static void remove_watch_entry(struct fsm_listen_data *data,
+			       struct watch_entry *w)
+{
+	hashmap_remove(&data->watches, &w->ent, NULL);
+	free(w);
+}
+
+/*
+ * Add (or refresh) the watch on a single directory.  Returns the
+ * watch descriptor or -1 (with errno set) on error.
+ */
+static int add_watch(struct fsm_listen_data *data, const char *path)
+{
+	struct watch_entry *w;
+	int wd;
+
+	wd = inotify_add_watch(data->fd_inotify, path, WATCH_MASK);
+	if (wd < 0)
+		return -1;
+
+	/*
+	 * The kernel returns the existing watch descriptor if the
+	 * directory (inode) is already being watched, for example
+	 * after a directory was renamed.  Update the pathname.
+	 */
+	w = find_watch(data, wd);
+	if (w) {
+		if (!strcmp(w->dir, path))
+			return wd;
+		remove_watch_entry(data, w);
+	}
+
+	FLEX_ALLOC_STR(w, dir, path);
+	w->wd = wd;
+	hashmap_entry_init(&w->ent, memhash(&wd, sizeof(wd)));
+	hashmap_add(&data->watches, &w->ent);
+
+	return wd;
+}
+
+/*
+ * Stop watching the directory tree rooted at `path`, for example
+ * because it has been renamed (the existing watches would report
+ * stale pathnames) or deleted.
+ */
+static void remove_watches_recursive(struct fsm_listen_data *data,
+				     const char *path)
+{
+	struct hashmap_iter iter;
+	struct watch_entry *w;
+	struct watch_entry **doomed = NULL;
+	size_t nr = 0, alloc = 0, k;
+
+	/*
+	 * Collect the entries first; removing entries while iterating
+	 * may cause the hashmap to be resized.
+	 */
+	hashmap_for_each_entry(&data->watches, &iter, w, ent) {
+		const char *rest;
+
+		if (!skip_prefix(w->dir, path, &rest) ||
+		    (*rest && *rest != '/'))
+			continue;
+
+		ALLOC_GROW(doomed, nr + 1, alloc);
+		doomed[nr++] = w;
+	}
+
+	for (k = 0; k < nr; k++) {
+		inotify_rm_watch(data->fd_inotify, doomed[k]->wd);
+		remove_watch_entry(data, doomed[k]);
+	}
+	free(doomed);
+}
+
+static int is_watch_limit_error(int err)
+{
+	return err == ENOSPC || err == ENOMEM;
+}
+
+/*
+ * Watch the directory `path` and all of the directories below it.
+ *
+ * We add the watch before we read the directory so that anything
+ * created while we are scanning it will generate an event (that may
+ * cause us to rescan a subdirectory, but that is harmless).
+ *
+ * The <gitdir> is skipped; we only watch the cookie directory within
+ * it (see `fsm_listen__ctor()`).
+ *
+ * If `batch` is not NULL, the paths found below `path` are added to
+ * it, as they may have been created before the watches were and so
+ * would not be reported otherwise.
+ *
+ * Returns -1 only on fatal errors (such as running out of watches).
+ * Directories that disappear while we are scanning are ignored.
+ */
+static int add_watches_recursive(struct fsmonitor_daemon_state *state,
+				 struct strbuf *path,
+				 struct fsmonitor_batch **batch)
+{
+	struct fsm_listen_data *data = state->listen_data;
+	DIR *dir;
+	struct dirent *de;
+	size_t len = path->len;
+	int ret = 0;
+
+	if (add_watch(data, path->buf) < 0) {
+		if (is_watch_limit_error(errno))
+			return error_errno(_("could not watch '%s' "
+					     "(see fs.inotify.max_user_watches)"),
+					   path->buf);
+		return 0;
+	}
+
+	dir = opendir(path->buf);
+	if (!dir)
+		return 0;
+
+	while (!ret && (de = readdir(dir))) {
+		unsigned char dtype = DTYPE(de);
+
+		if (is_dot_or_dotdot(de->d_name))
+			continue;
+
+		strbuf_setlen(path, len);
+		strbuf_addch(path, '/');
+		strbuf_addstr(path, de->d_name);
+
+		if (dtype == DT_UNKNOWN) {
+			struct stat st;
+
+			if (lstat(path->buf, &st))
+				continue;
+			dtype = S_ISDIR(st.st_mode) ? DT_DIR : DT_REG;
+		}
+
+		if (batch &&
+		    fsmonitor_classify_path_absolute(state, path->buf) ==
+		    IS_WORKDIR_PATH) {
+			if (!*batch)
+				*batch = fsmonitor_batch__new();
+			if (dtype == DT_DIR)
+				strbuf_addch(path, '/');
+			fsmonitor_batch__add_path(*batch, path->buf +
+						  state->path_worktree_watch.len + 1);
+			if (dtype == DT_DIR)
+				strbuf_setlen(path, path->len - 1);
+		}
+
+		if (dtype != DT_DIR)
+			continue;
+
+		if (!fspathcmp(path->buf, state->path_gitdir_watch.buf))
+			continue;
+
+		ret = add_watches_recursive(state, path, batch);
+	}
+
+	closedir(dir);
+	strbuf_setlen(path, len);
+	return ret;
+}
+
+static int add_worktree_watches(struct fsmonitor_daemon_state *state)
+{
+	struct strbuf path = STRBUF_INIT;
+	int ret;
+
+	strbuf_addbuf(&path, &state->path_worktree_watch);
+	ret = add_watches_recursive(state, &path, NULL);
+	strbuf_release(&path);
+
+	return ret;
+}
+
+static void log_mask_set(const char *path, uint32_t mask)
+{
+	struct strbuf msg = STRBUF_INIT;
+
+	if (mask & IN_ACCESS)
+		strbuf_addstr(&msg, "IN_ACCESS|");
+	if (mask & IN_MODIFY)
+		strbuf_addstr(&msg, "IN_MODIFY|");
+	if (mask & IN_ATTRIB)
+		strbuf_addstr(&msg, "IN_ATTRIB|");
+	if (mask & IN_CLOSE_WRITE)
+		strbuf_addstr(&msg, "IN_CLOSE_WRITE|");
+	if (mask & IN_CLOSE_NOWRITE)
+		strbuf_addstr(&msg, "IN_CLOSE_NOWRITE|");
+	if (mask & IN_OPEN)
+		strbuf_addstr(&msg, "IN_OPEN|");
+	if (mask & IN_MOVED_FROM)
+		strbuf_addstr(&msg, "IN_MOVED_FROM|");
+	if (mask & IN_MOVED_TO)
+		strbuf_addstr(&msg, "IN_MOVED_TO|");
+	if (mask & IN_CREATE)
+		strbuf_addstr(&msg, "IN_CREATE|");
+	if (mask & IN_DELETE)
+		strbuf_addstr(&msg, "IN_DELETE|");
+	if (mask & IN_DELETE_SELF)
+		strbuf_addstr(&msg, "IN_DELETE_SELF|");
+	if (mask & IN_MOVE_SELF)
+		strbuf_addstr(&msg, "IN_MOVE_SELF|");
+	if (mask & IN_UNMOUNT)
+		strbuf_addstr(&msg, "IN_UNMOUNT|");
+	if (mask & IN_Q_OVERFLOW)
+		strbuf_addstr(&msg, "IN_Q_OVERFLOW|");
+	if (mask & IN_IGNORED)
+		strbuf_addstr(&msg, "IN_IGNORED|");
+	if (mask & IN_ISDIR)
+		strbuf_addstr(&msg, "IN_ISDIR|");
+
+	trace_printf_key(&trace_fsmonitor, "inotify: '%s', mask=0x%x %s",
+			 path, mask, msg.buf);
+
+	strbuf_release(&msg);
+}
+
+/*
+ * Process a single inotify event.  Add worktree paths to `*batch`
+ * and cookie file names to `cookie_list`.
+ *
+ * Returns 0 normally or one of the `shutdown_style` values if the
+ * listener should stop.
+ */
+static int process_event(struct fsmonitor_daemon_state *state,
+			 const struct inotify_event *ev,
+			 struct fsmonitor_batch **batch,
+			 struct string_list *cookie_list,
+			 struct strbuf *path)
+{
+	struct fsm_listen_data *data = state->listen_data;
+	struct watch_entry *w;
+	const char *rel;
+
+	w = find_watch(data, ev->wd);
+	if (!w)
+		return 0; /* a stale event for a watch we already removed */
+
+	if (ev->mask & IN_IGNORED) {
+		remove_watch_entry(data, w);
+		return 0;
+	}
+
+	strbuf_reset(path);
+	strbuf_addstr(path, w->dir);
+	if (ev->len && *ev->name) {
+		strbuf_addch(path, '/');
+		strbuf_addstr(path, ev->name);
+	}
+
+	if (ev->mask & (IN_DELETE_SELF | IN_MOVE_SELF | IN_UNMOUNT)) {
+		if (ev->wd == data->wd_worktree) {
+			trace_printf_key(&trace_fsmonitor,
+					 "event: worktree root removed");
+			return FORCE_SHUTDOWN;
+		}
+		if (ev->wd == data->wd_gitdir) {
+			trace_printf_key(&trace_fsmonitor,
+					 "event: gitdir removed");
+			return FORCE_SHUTDOWN;
+		}
+
+		/*
+		 * Deletes and renames of other directories are also
+		 * reported (with the name) by the parent directory.
+		 */
+		return 0;
+	}
+
+	switch (fsmonitor_classify_path_absolute(state, path->buf)) {
+
+	case IS_INSIDE_DOT_GIT_WITH_COOKIE_PREFIX:
+	case IS_INSIDE_GITDIR_WITH_COOKIE_PREFIX:
+		/* special case cookie files within .git or gitdir */
+
+		/* Use just the filename of the cookie file. */
+		string_list_append(cookie_list, ev->name);
+		break;
+
+	case IS_INSIDE_DOT_GIT:
+	case IS_INSIDE_GITDIR:
+		/* ignore all other paths inside of .git or gitdir */
+		break;
+
+	case IS_DOT_GIT:
+	case IS_GITDIR:
+		/*
+		 * If .git directory is deleted or renamed away,
+		 * we have to quit.
+		 */
+		if (ev->mask & (IN_DELETE | IN_MOVED_FROM)) {
+			trace_printf_key(&trace_fsmonitor,
+					 "event: gitdir removed");
+			return FORCE_SHUTDOWN;
+		}
+		break;
+
+	case IS_WORKDIR_PATH:
+		/* try to queue normal pathnames */
+
+		if (trace_pass_fl(&trace_fsmonitor))
+			log_mask_set(path->buf, ev->mask);
+
+		rel = path->buf + state->path_worktree_watch.len + 1;
+
+		if (!(ev->mask & IN_ISDIR)) {
+			if (!*batch)
+				*batch = fsmonitor_batch__new();
+			fsmonitor_batch__add_path(*batch, rel);
+			break;
+		}
+
+		/*
+		 * Attribute changes on a directory are not interesting
+		 * (and would otherwise invalidate the whole subtree).
+		 */
+		if (!(ev->mask & (IN_CREATE | IN_DELETE |
+				  IN_MOVED_FROM | IN_MOVED_TO)))
+			break;
+
+		if (ev->mask & (IN_DELETE | IN_MOVED_FROM))
+			remove_watches_recursive(data, path->buf);
+
+		if (ev->mask & (IN_CREATE | IN_MOVED_TO)) {
+			struct strbuf dir = STRBUF_INIT;
+			int ret;
+
+			/*
+			 * Files may have been created in the new
+			 * directory before we could add a watch to it,
+			 * so report everything we find in it.
+			 */
+			strbuf_addbuf(&dir, path);
+			ret = add_watches_recursive(state, &dir, batch);
+			strbuf_release(&dir);
+			if (ret)
+				return FORCE_ERROR_STOP;
+		}
+
+		if (!*batch)
+			*batch = fsmonitor_batch__new();
+		strbuf_addch(path, '/');
+		rel = path->buf + state->path_worktree_watch.len + 1;
+		fsmonitor_batch__add_path(*batch, rel);
+		break;
+
+	case IS_OUTSIDE_CONE:
+	default:
+		trace_printf_key(&trace_fsmonitor,
+				 "ignoring '%s'", path->buf);
+		break;
+	}
+
+	return 0;
+}
+
+/*
+ * Drain the inotify queue and publish the resulting batch.
+ *
+ * Returns 0 normally or one of the `shutdown_style` values if the
+ * listener should stop.
+ */
+static int process_events(struct fsmonitor_daemon_state *state)
+{
+	struct fsm_listen_data *data = state->listen_data;
+	struct fsmonitor_batch *batch = NULL;
+	struct string_list cookie_list = STRING_LIST_INIT_DUP;
+	struct strbuf path = STRBUF_INIT;
+	/* aligned for `struct inotify_event` */
+	uint64_t buf[16 * 1024 / sizeof(uint64_t)];
+	int ret = 0;
+
+	while (!ret) {
+		ssize_t len = read(data->fd_inotify, buf, sizeof(buf));
+		const char *p;
+
+		if (len < 0) {
+			if (errno == EINTR)
+				continue;
+			if (errno == EAGAIN || errno == EWOULDBLOCK)
+				break;
+			error_errno(_("could not read inotify events"));
+			ret = FORCE_ERROR_STOP;
+			break;
+		}
+		if (!len)
+			break;
+
+		for (p = (const char *)buf;
+		     !ret && p < (const char *)buf + len;
+		     p += sizeof(struct inotify_event) +
+			     ((const struct inotify_event *)p)->len) {
+			const struct inotify_event *ev =
+				(const struct inotify_event *)p;
+
+			if (ev->mask & IN_Q_OVERFLOW) {
+				/*
+				 * The kernel dropped events, so we have
+				 * lost sync with the filesystem.  Flush
+				 * our cached data, discard the batch we
+				 * were building (it is relative to the
+				 * flushed token) and make sure we are
+				 * watching any directories created while
+				 * we were not listening.
+				 */
+				trace_printf_key(&trace_fsmonitor,
+						 "inotify: queue overflow");
+				fsmonitor_force_resync(state);
+				fsmonitor_batch__free_list(batch);
+				batch = NULL;
+				string_list_clear(&cookie_list, 0);
+
+				if (add_worktree_watches(state))
+					ret = FORCE_ERROR_STOP;
+				continue;
+			}
+
+			ret = process_event(state, ev, &batch,
+					    &cookie_list, &path);
+		}
+	}
+
+	if (ret)
+		fsmonitor_batch__free_list(batch);
+	else
+		fsmonitor_publish(state, batch, &cookie_list);
+
+	string_list_clear(&cookie_list, 0);
+	strbuf_release(&path);
+	return ret;
+}
+
+int fsm_listen__ctor(struct fsmonitor_daemon_state *state)
+{
+	struct fsm_listen_data *data;
+	struct strbuf cookie_dir = STRBUF_INIT;
+
+	CALLOC_ARRAY(data, 1);
+	state->listen_data = data;
+
+	data->fd_stop[0] = -1;
+	data->fd_stop[1] = -1;
+	hashmap_init(&data->watches, watch_entry_cmp, NULL, 0);
+
+	data->fd_inotify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (data->fd_inotify < 0) {
+		error_errno(_("could not initialize inotify"));
+		goto failed;
+	}
+
+	if (pipe(data->fd_stop) < 0) {
+		error_errno(_("could not create pipe"));
+		goto failed;
+	}
+
+	if (add_worktree_watches(state))
+		goto failed;
+	data->wd_worktree = add_watch(data, state->path_worktree_watch.buf);
+
+	/*
+	 * We do not recursively watch the <gitdir>.  We only need to
+	 * know when it is deleted (so we can shutdown) and when
+	 * cookie files are created.
+	 */
+	data->wd_gitdir = add_watch(data, state->path_gitdir_watch.buf);
+	if (data->wd_gitdir < 0) {
+		error_errno(_("could not watch '%s'"),
+			    state->path_gitdir_watch.buf);
+		goto failed;
+	}
+
+	strbuf_add(&cookie_dir, state->path_cookie_prefix.buf,
+		   state->path_cookie_prefix.len - 1);
+	if (add_watch(data, cookie_dir.buf) < 0) {
+		error_errno(_("could not watch '%s'"), cookie_dir.buf);
+		strbuf_release(&cookie_dir);
+		goto failed;
+	}
+	strbuf_release(&cookie_dir);
+
+	trace_printf_key(&trace_fsmonitor, "inotify: watching %u directories",
+			 hashmap_get_size(&data->watches));
+	return 0;
+
+failed:
+	error(_("Unable to create inotify watches."));
+	fsm_listen__dtor(state);
+	return -1;
+}
+
+void fsm_listen__dtor(struct fsmonitor_daemon_state *state)
+{
+	struct fsm_listen_data *data;
+
+	if (!state || !state->listen_data)
+		return;
+
+	data = state->listen_data;
+
+	if (data->fd_inotify >= 0)
+		close(data->fd_inotify);
+	if (data->fd_stop[0] >= 0)
+		close(data->fd_stop[0]);
+	if (data->fd_stop[1] >= 0)
+		close(data->fd_stop[1]);
+
+	hashmap_clear_and_free(&data->watches, struct watch_entry, ent);
+
+	FREE_AND_NULL(state->listen_data);
+}
+
+void fsm_listen__stop_async(struct fsmonitor_daemon_state *state)
+{
+	struct fsm_listen_data *data;
+
+	data = state->listen_data;
+	data->shutdown_style = SHUTDOWN_EVENT;
+
+	if (write(data->fd_stop[1], "q", 1) < 0)
+		warning_errno(_("could not signal inotify listener"));
+}
+
+void fsm_listen__loop(struct fsmonitor_daemon_state *state)
+{
+	struct fsm_listen_data *data;
+	struct pollfd pfd[2];
+
+	data = state->listen_data;
+
+	pfd[0].fd = data->fd_inotify;
+	pfd[0].events = POLLIN;
+	pfd[1].fd = data->fd_stop[0];
+	pfd[1].events = POLLIN;
+
+	for (;;) {
+		int ret;
+
+		if (poll(pfd, ARRAY_SIZE(pfd), -1) < 0) {
+			if (errno == EINTR)
+				continue;
+			error_errno(_("poll on inotify failed"));
+			data->shutdown_style = FORCE_ERROR_STOP;
+			break;
+		}
+
+		if (pfd[1].revents)
+			break;
+
+		if (!pfd[0].revents)
+			continue;
+
+		ret = process_events(state);
+		if (ret) {
+			data->shutdown_style = ret;
+			break;
+		}
+	}
+
+	switch (data->shutdown_style) {
+	case FORCE_ERROR_STOP:
+		state->listen_error_code = -1;
+		/* fall thru */
+	case FORCE_SHUTDOWN:
+		ipc_server_stop_async(state->ipc_server_data);
+		/* fall thru */
+	case SHUTDOWN_EVENT:
+	default:
+		break;
+	}
+}
@@ -0,0 +1,77 @@
+#include "cache.h"
+#include "config.h"
+#include "repository.h"
+#include "fsmonitor-settings.h"
+#include "fsmonitor.h"
+#include <sys/vfs.h>
+
+/*
+ * Filesystem magic numbers from <linux/magic.h> (and friends).  Spell
+ * them out here rather than depending on the kernel headers.
+ */
+#define FSM_NFS_SUPER_MAGIC	0x6969
+#define FSM_SMB_SUPER_MAGIC	0x517b
+#define FSM_CIFS_MAGIC_NUMBER	0xff534d42
+#define FSM_SMB2_MAGIC_NUMBER	0xfe534d42
+#define FSM_CODA_SUPER_MAGIC	0x73757245
+#define FSM_AFS_SUPER_MAGIC	0x5346414f
+#define FSM_V9FS_MAGIC		0x01021997
+#define FSM_MSDOS_SUPER_MAGIC	0x4d44
+#define FSM_EXFAT_SUPER_MAGIC	0x2011bab0
+#define FSM_NTFS_SB_MAGIC	0x5346544e
+
+/*
+ * See the comments in fsm-settings-darwin.c for why remote working
+ * directories and filesystems without Unix domain sockets are
+ * incompatible with the builtin FSMonitor.
+ *
+ * In addition, inotify only reports changes made through the local
+ * kernel, so changes made on the server (or by another client) of a
+ * network filesystem would never be seen.
+ */
+static enum fsmonitor_reason check_volume(struct repository *r)
+{
+	struct statfs fs;
+
+	if (statfs(r->worktree, &fs) == -1) {
+		int saved_errno = errno;
+		trace_printf_key(&trace_fsmonitor, "statfs('%s') failed: %s",
+				 r->worktree, strerror(saved_errno));
+		errno = saved_errno;
+		return FSMONITOR_REASON_ERROR;
+	}
+
+	trace_printf_key(&trace_fsmonitor,
+			 "statfs('%s') [type 0x%08lx]",
+			 r->worktree, (unsigned long)fs.f_type);
+
+	switch ((unsigned long)fs.f_type) {
+	case FSM_NFS_SUPER_MAGIC:
+	case FSM_SMB_SUPER_MAGIC:
+	case FSM_CIFS_MAGIC_NUMBER:
+	case FSM_SMB2_MAGIC_NUMBER:
+	case FSM_CODA_SUPER_MAGIC:
+	case FSM_AFS_SUPER_MAGIC:
+	case FSM_V9FS_MAGIC:
+		return FSMONITOR_REASON_REMOTE;
+
+	case FSM_MSDOS_SUPER_MAGIC:
+	case FSM_EXFAT_SUPER_MAGIC:
+	case FSM_NTFS_SB_MAGIC:
+		return FSMONITOR_REASON_NOSOCKETS;
+
+	default:
+		return FSMONITOR_REASON_OK;
+	}
+}
+
+enum fsmonitor_reason fsm_os__incompatible(struct repository *r)
+{
+	enum fsmonitor_reason reason;
+
+	reason = check_volume(r);
+	if (reason != FSMONITOR_REASON_OK)
+		return reason;
+
+	return FSMONITOR_REASON_OK;
+}
@@ -0,0 +1,206 @@
+#include "git-compat-util.h"
+
+#include "lstat-batch.h"
+
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#include <sys/sysmacros.h>
+
+/*
+ * Batched lstat() on top of io_uring: the statx() requests for a whole
+ * batch are queued in the submission ring and handed to the kernel
+ * with a single io_uring_enter(), which also waits for them to
+ * complete. This talks to the kernel directly rather than through
+ * liburing, as we only need one kind of request.
+ */
+struct lstat_batch {
+	int fd;
+
+	void *sq_ring;
+	size_t sq_ring_size;
+	unsigned *sq_tail, *sq_mask, *sq_array;
+	struct io_uring_sqe *sqes;
+	size_t sqes_size;
+
+	void *cq_ring;
+	size_t cq_ring_size;
+	unsigned *cq_head, *cq_tail, *cq_mask;
+	struct io_uring_cqe *cqes;
+
+	struct statx stx[LSTAT_BATCH_MAX];
+
+	/* the kernel predates IORING_OP_STATX, or io_uring failed us */
+	int broken;
+};
+
+static void unmap_rings(struct lstat_batch *b)
+{
+	if (b->sq_ring && b->sq_ring != MAP_FAILED)
+		munmap(b->sq_ring, b->sq_ring_size);
+	if (b->cq_ring && b->cq_ring != MAP_FAILED)
+		munmap(b->cq_ring, b->cq_ring_size);
+	if (b->sqes && b->sqes != MAP_FAILED)
+		munmap(b->sqes, b->sqes_size);
+}
+
+struct lstat_batch *lstat_batch_new(void)
+{
+	struct io_uring_params p;
+	struct lstat_batch *b;
+	int fd;
+
+	memset(&p, 0, sizeof(p));
+	fd = syscall(__NR_io_uring_setup, LSTAT_BATCH_MAX, &p);
+	if (fd < 0)
+		return NULL;
+
+	CALLOC_ARRAY(b, 1);
+	b->fd = fd;
+	b->sq_ring_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+	b->cq_ring_size = p.cq_off.cqes +
+			  p.cq_entries * sizeof(struct io_uring_cqe);
+	b->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+
+	b->sq_ring = mmap(NULL, b->sq_ring_size, PROT_READ | PROT_WRITE,
+			  MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+	b->cq_ring = mmap(NULL, b->cq_ring_size, PROT_READ | PROT_WRITE,
+			  MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+	b->sqes = mmap(NULL, b->sqes_size, PROT_READ | PROT_WRITE,
+		       MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+	if (b->sq_ring == MAP_FAILED || b->cq_ring == MAP_FAILED ||
+	    b->sqes == MAP_FAILED) {
+		unmap_rings(b);
+		close(fd);
+		free(b);
+		return NULL;
+	}
+
+	b->sq_tail = (unsigned *)((char *)b->sq_ring + p.sq_off.tail);
+	b->sq_mask = (unsigned *)((char *)b->sq_ring + p.sq_off.ring_mask);
+	b->sq_array = (unsigned *)((char *)b->sq_ring + p.sq_off.array);
+	b->cq_head = (unsigned *)((char *)b->cq_ring + p.cq_off.head);
+	b->cq_tail = (unsigned *)((char *)b->cq_ring + p.cq_off.tail);
+	b->cq_mask = (unsigned *)((char *)b->cq_ring + p.cq_off.ring_mask);
+	b->cqes = (struct io_uring_cqe *)((char *)b->cq_ring + p.cq_off.cqes);
+	return b;
+}
+
+void lstat_batch_free(struct lstat_batch *b)
+{
+	if (!b)
+		return;
+	unmap_rings(b);
+	close(b->fd);
+	free(b);
+}
+
+static void statx_to_stat(const struct statx *stx, struct stat *st)
+{
+	memset(st, 0, sizeof(*st));
+	st->st_dev = makedev(stx->stx_dev_major, stx->stx_dev_minor);
+	st->st_ino = stx->stx_ino;
+	st->st_mode = stx->stx_mode;
+	st->st_nlink = stx->stx_nlink;
+	st->st_uid = stx->stx_uid;
+	st->st_gid = stx->stx_gid;
+	st->st_rdev = makedev(stx->stx_rdev_major, stx->stx_rdev_minor);
+	st->st_size = stx->stx_size;
+	st->st_blksize = stx->stx_blksize;
+	st->st_blocks = stx->stx_blocks;
+	st->st_atim.tv_sec = stx->stx_atime.tv_sec;
+	st->st_atim.tv_nsec = stx->stx_atime.tv_nsec;
+	st->st_mtim.tv_sec = stx->stx_mtime.tv_sec;
+	st->st_mtim.tv_nsec = stx->stx_mtime.tv_nsec;
+	st->st_ctim.tv_sec = stx->stx_ctime.tv_sec;
+	st->st_ctim.tv_nsec = stx->stx_ctime.tv_nsec;
+}
+
+static int ring_enter(struct lstat_batch *b, unsigned submit, unsigned wait)
+{
+	int ret;
+
+	do {
+		ret = syscall(__NR_io_uring_enter, b->fd, submit, wait,
+			      IORING_ENTER_GETEVENTS, NULL, 0);
+	} while (ret < 0 && errno == EINTR);
+	return ret;
+}
+
+static void lstat_one(const char *path, struct stat *st, int *err)
+{
+	*err = lstat(path, st) ? errno : 0;
+}
+
+void lstat_batch(struct lstat_batch *b, int nr,
+		 const char **paths, struct stat *st, int *errs)
+{
+	unsigned sq_tail, cq_head, cq_tail;
+	int submitted = 0, done = 0;
+	int i;
+
+	if (nr > LSTAT_BATCH_MAX)
+		BUG("too many paths for lstat_batch(): %d", nr);
+
+	if (b->broken) {
+		for (i = 0; i < nr; i++)
+			lstat_one(paths[i], &st[i], &errs[i]);
+		return;
+	}
+
+	sq_tail = *b->sq_tail;
+	for (i = 0; i < nr; i++) {
+		struct io_uring_sqe *sqe = &b->sqes[i];
+
+		memset(sqe, 0, sizeof(*sqe));
+		sqe->opcode = IORING_OP_STATX;
+		sqe->fd = AT_FDCWD;
+		sqe->addr = (uintptr_t)paths[i];
+		sqe->len = STATX_BASIC_STATS;
+		sqe->off = (uintptr_t)&b->stx[i];
+		sqe->statx_flags = AT_SYMLINK_NOFOLLOW;
+		sqe->user_data = i;
+		b->sq_array[(sq_tail + i) & *b->sq_mask] = i;
+	}
+	__atomic_store_n(b->sq_tail, sq_tail + nr, __ATOMIC_RELEASE);
+
+	while (done < nr) {
+		int ret = ring_enter(b, nr - submitted, 1);
+
+		if (ret < 0) {
+			/*
+			 * Nothing is in flight if nothing was submitted,
+			 * so take the requests back and do without.
+			 */
+			if (!submitted) {
+				__atomic_store_n(b->sq_tail, sq_tail,
+						 __ATOMIC_RELEASE);
+				b->broken = 1;
+				for (i = 0; i < nr; i++)
+					lstat_one(paths[i], &st[i], &errs[i]);
+				return;
+			}
+			die_errno("io_uring_enter");
+		}
+		submitted += ret;
+
+		cq_head = *b->cq_head;
+		cq_tail = __atomic_load_n(b->cq_tail, __ATOMIC_ACQUIRE);
+		for (; cq_head != cq_tail; cq_head++) {
+			struct io_uring_cqe *cqe = &b->cqes[cq_head & *b->cq_mask];
+
+			i = cqe->user_data;
+			if (!cqe->res) {
+				statx_to_stat(&b->stx[i], &st[i]);
+				errs[i] = 0;
+			} else if (cqe->res == -EINVAL) {
+				/* IORING_OP_STATX is not known to this kernel */
+				b->broken = 1;
+				lstat_one(paths[i], &st[i], &errs[i]);
+			} else {
+				errs[i] = -cqe->res;
+			}
+			done++;
+		}
+		__atomic_store_n(b->cq_head, cq_head, __ATOMIC_RELEASE);
+	}
+}
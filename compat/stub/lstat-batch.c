@@ -0,0 +1,21 @@
+#include "git-compat-util.h"
+
+#include "lstat-batch.h"
+
+/*
+ * Stub. See the implementation in compat/linux/lstat-batch.c.
+ */
+struct lstat_batch *lstat_batch_new(void)
+{
+	return NULL;
+}
+
+void lstat_batch(struct lstat_batch *b, int nr,
+		 const char **paths, struct stat *st, int *errs)
+{
+	BUG("lstat_batch() without a batch");
+}
+
+void lstat_batch_free(struct lstat_batch *b)
+{
+}
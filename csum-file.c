@@ -11,6 +11,11 @@
 #include "progress.h"
 #include "csum-file.h"
 
+/* glibc only declares copy_file_range() since 2.27 */
+#if defined(HAVE_COPY_FILE_RANGE) && defined(__GLIBC__) && !__GLIBC_PREREQ(2, 27)
+#undef HAVE_COPY_FILE_RANGE
+#endif
+
 static void verify_buffer_or_die(struct hashfile *f,
 				 const void *buf,
 				 unsigned int count)
@@ -45,7 +50,8 @@ void hashflush(struct hashfile *f)
 	unsigned offset = f->offset;
 
 	if (offset) {
-		the_hash_algo->update_fn(&f->ctx, f->buffer, offset);
+		if (!f->skip_hash)
+			the_hash_algo->update_fn(&f->ctx, f->buffer, offset);
 		flush(f, f->buffer, offset);
 		f->offset = 0;
 	}
@@ -64,7 +70,10 @@ int finalize_hashfile(struct hashfile *f, unsigned char *result,
 	int fd;
 
 	hashflush(f);
-	the_hash_algo->final_fn(f->buffer, &f->ctx);
+	if (f->skip_hash)
+		hashclr(f->buffer);
+	else
+		the_hash_algo->final_fn(f->buffer, &f->ctx);
 	if (result)
 		hashcpy(result, f->buffer);
 	if (flags & CSUM_HASH_IN_STREAM)
@@ -108,7 +117,8 @@ void hashwrite(struct hashfile *f, const void *buf, unsigned int count)
 			 * the hashfile's buffer. In this block,
 			 * f->offset is necessarily zero.
 			 */
-			the_hash_algo->update_fn(&f->ctx, buf, nr);
+			if (!f->skip_hash)
+				the_hash_algo->update_fn(&f->ctx, buf, nr);
 			flush(f, buf, nr);
 		} else {
 			/*
@@ -127,6 +137,32 @@ void hashwrite(struct hashfile *f, const void *buf, unsigned int count)
 	}
 }
 
+size_t hashfile_copy_range(struct hashfile *f, int fd, off_t offset, size_t len)
+{
+	size_t copied = 0;
+
+	if (!f->skip_hash)
+		BUG("copying data into a hashfile would bypass the hash");
+	if (f->do_crc || 0 <= f->check_fd || f->tp)
+		return 0;
+
+#ifdef HAVE_COPY_FILE_RANGE
+	hashflush(f);
+	while (copied < len) {
+		ssize_t ret = copy_file_range(fd, &offset, f->fd, NULL,
+					      len - copied, 0);
+
+		if (ret < 0 && errno == EINTR)
+			continue;
+		if (ret <= 0)
+			break;
+		copied += ret;
+		f->total += ret;
+	}
+#endif
+	return copied;
+}
+
 struct hashfile *hashfd_check(const char *name)
 {
 	int sink, check;
@@ -153,6 +189,7 @@ static struct hashfile *hashfd_internal(int fd, const char *name,
 	f->tp = tp;
 	f->name = name;
 	f->do_crc = 0;
+	f->skip_hash = 0;
 	the_hash_algo->init_fn(&f->ctx);
 
 	f->buffer_len = buffer_len;
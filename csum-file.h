@@ -20,6 +20,12 @@ struct hashfile {
 	size_t buffer_len;
 	unsigned char *buffer;
 	unsigned char *check_buffer;
+
+	/*
+	 * If set, the data is not hashed, and a null hash is written in
+	 * its place by finalize_hashfile().
+	 */
+	int skip_hash;
 };
 
 /* Checkpoint */
@@ -42,6 +48,14 @@ struct hashfile *hashfd_throughput(int fd, const char *name, struct progress *tp
 int finalize_hashfile(struct hashfile *, unsigned char *, enum fsync_component, unsigned int);
 void hashwrite(struct hashfile *, const void *, unsigned int);
 void hashflush(struct hashfile *f);
+
+/*
+ * Append up to 'len' bytes found at 'offset' in 'fd' to a hashfile
+ * with 'skip_hash' set, letting the kernel share or copy the data
+ * where the platform allows it. Returns the number of bytes copied;
+ * the caller has to write the remaining ones itself.
+ */
+size_t hashfile_copy_range(struct hashfile *f, int fd, off_t offset, size_t len);
 void crc32_begin(struct hashfile *);
 uint32_t crc32_end(struct hashfile *);
 
@@ -18,6 +18,8 @@
 #include "ewah/ewok.h"
 #include "fsmonitor.h"
 #include "submodule-config.h"
+#include "strmap.h"
+#include "thread-utils.h"
 
 /*
  * Tells read_directory_recursive how a file or directory should be treated.
@@ -37,6 +39,8 @@ enum path_treatment {
  */
 struct cached_dir {
 	DIR *fdir;
+	struct dir_listing *listing;
+	int listing_pos;
 	struct untracked_cache_dir *untracked;
 	int nr_files;
 	int nr_dirs;
@@ -919,6 +923,8 @@ static int read_skip_worktree_file_from_index(struct index_state *istate,
  * Frees memory within pl which was allocated for exclude patterns and
  * the file buffer.  Does not free pl itself.
  */
+static void free_pattern_matcher(struct pattern_matcher *m);
+
 void clear_pattern_list(struct pattern_list *pl)
 {
 	int i;
@@ -929,6 +935,7 @@ void clear_pattern_list(struct pattern_list *pl)
 	free(pl->filebuf);
 	hashmap_clear_and_free(&pl->recursive_hashmap, struct pattern_entry, ent);
 	hashmap_clear_and_free(&pl->parent_hashmap, struct pattern_entry, ent);
+	free_pattern_matcher(pl->matcher);
 
 	memset(pl, 0, sizeof(*pl));
 }
@@ -1301,6 +1308,292 @@ int match_pathname(const char *pathname, int pathlen,
 				 WM_PATHNAME) == 0;
 }
 
+static int path_pattern_matches(struct path_pattern *pattern,
+				const char *pathname, int pathlen,
+				const char *basename, int *dtype,
+				struct index_state *istate)
+{
+	const char *exclude = pattern->pattern;
+	int prefix = pattern->nowildcardlen;
+
+	if (pattern->flags & PATTERN_FLAG_MUSTBEDIR) {
+		*dtype = resolve_dtype(*dtype, istate, pathname, pathlen);
+		if (*dtype != DT_DIR)
+			return 0;
+	}
+
+	if (pattern->flags & PATTERN_FLAG_NODIR)
+		return match_basename(basename,
+				      pathlen - (basename - pathname),
+				      exclude, prefix, pattern->patternlen,
+				      pattern->flags);
+
+	assert(pattern->baselen == 0 ||
+	       pattern->base[pattern->baselen - 1] == '/');
+	return match_pathname(pathname, pathlen,
+			      pattern->base,
+			      pattern->baselen ? pattern->baselen - 1 : 0,
+			      exclude, prefix, pattern->patternlen,
+			      pattern->flags);
+}
+
+/*
+ * Lists with at least this many patterns are matched through a
+ * pattern_matcher instead of trying each pattern in turn.
+ */
+#define PATTERN_MATCHER_MIN_NR 32
+
+/*
+ * Most patterns in long exclude files are literal names ("foo"),
+ * extensions ("*.o"), literal paths ("/foo/bar") or globs below a
+ * literal directory ("doc/git-*.txt"). A path can only match such a
+ * pattern if its basename, extension, path or one of its leading
+ * directories equals the literal part of the pattern, so the patterns
+ * are indexed by that part; only the patterns found under the parts of
+ * the path, and those that could not be indexed, are tried.
+ */
+enum pattern_key_type {
+	PATTERN_KEY_BASENAME,
+	PATTERN_KEY_EXTENSION,
+	PATTERN_KEY_PATHNAME,
+	PATTERN_KEY_DIRECTORY
+};
+
+struct pattern_bucket {
+	struct hashmap_entry ent;
+	enum pattern_key_type type;
+	const char *key;
+	size_t keylen;
+	/* positions in the pattern list, in ascending order */
+	int *patterns;
+	int nr, alloc;
+};
+
+struct pattern_matcher {
+	/* the number of patterns in the list when this was built */
+	int nr;
+	int icase;
+	int have_directories;
+	struct hashmap buckets;
+	/* the patterns that are not indexed */
+	struct pattern_bucket others;
+};
+
+static unsigned int pattern_key_hash(enum pattern_key_type type,
+				     const char *key, size_t keylen,
+				     int icase)
+{
+	return (icase ? memihash(key, keylen) : memhash(key, keylen)) ^ type;
+}
+
+static int pattern_bucket_cmp(const void *cmp_data,
+			      const struct hashmap_entry *eptr,
+			      const struct hashmap_entry *entry_or_key,
+			      const void *keydata)
+{
+	const struct pattern_matcher *m = cmp_data;
+	const struct pattern_bucket *a, *b;
+
+	a = container_of(eptr, const struct pattern_bucket, ent);
+	b = container_of(entry_or_key, const struct pattern_bucket, ent);
+	if (a->type != b->type || a->keylen != b->keylen)
+		return 1;
+	return m->icase ? strncasecmp(a->key, b->key, a->keylen) :
+			  strncmp(a->key, b->key, a->keylen);
+}
+
+static struct pattern_bucket *find_pattern_bucket(struct pattern_matcher *m,
+						  enum pattern_key_type type,
+						  const char *key,
+						  size_t keylen)
+{
+	struct pattern_bucket k;
+
+	hashmap_entry_init(&k.ent, pattern_key_hash(type, key, keylen, m->icase));
+	k.type = type;
+	k.key = key;
+	k.keylen = keylen;
+	return hashmap_get_entry(&m->buckets, &k, ent, NULL);
+}
+
+static void add_to_bucket(struct pattern_bucket *b, int pos)
+{
+	ALLOC_GROW(b->patterns, b->nr + 1, b->alloc);
+	b->patterns[b->nr++] = pos;
+}
+
+static void add_to_pattern_bucket(struct pattern_matcher *m,
+				  enum pattern_key_type type,
+				  const char *key, size_t keylen,
+				  int pos)
+{
+	struct pattern_bucket *b;
+	size_t i;
+
+	/*
+	 * strncasecmp() may fold more than memihash() does in some
+	 * locales, so do not index what it might fold differently.
+	 */
+	for (i = 0; m->icase && i < keylen; i++) {
+		if ((unsigned char)key[i] >= 0x80) {
+			add_to_bucket(&m->others, pos);
+			return;
+		}
+	}
+
+	b = find_pattern_bucket(m, type, key, keylen);
+	if (!b) {
+		CALLOC_ARRAY(b, 1);
+		hashmap_entry_init(&b->ent,
+				   pattern_key_hash(type, key, keylen, m->icase));
+		b->type = type;
+		b->key = xmemdupz(key, keylen);
+		b->keylen = keylen;
+		hashmap_add(&m->buckets, &b->ent);
+		if (type == PATTERN_KEY_DIRECTORY)
+			m->have_directories = 1;
+	}
+	add_to_bucket(b, pos);
+}
+
+static const char *find_last_char(const char *s, size_t len, char c)
+{
+	while (len--)
+		if (s[len] == c)
+			return s + len;
+	return NULL;
+}
+
+static void add_pattern_to_matcher(struct pattern_matcher *m,
+				   struct path_pattern *pattern, int pos)
+{
+	const char *p = pattern->pattern;
+	int len = pattern->patternlen;
+	int prefix = pattern->nowildcardlen;
+	struct strbuf key = STRBUF_INIT;
+	const char *c;
+
+	if (pattern->flags & PATTERN_FLAG_NODIR) {
+		if (len && prefix == len)
+			add_to_pattern_bucket(m, PATTERN_KEY_BASENAME, p, len, pos);
+		else if ((pattern->flags & PATTERN_FLAG_ENDSWITH) &&
+			 (c = find_last_char(p + 1, len - 1, '.')))
+			add_to_pattern_bucket(m, PATTERN_KEY_EXTENSION,
+					      c, p + len - c, pos);
+		else
+			add_to_bucket(&m->others, pos);
+		return;
+	}
+
+	/* see match_pathname() */
+	if (*p == '/') {
+		p++;
+		len--;
+		prefix--;
+	}
+	strbuf_add(&key, pattern->base, pattern->baselen);
+	if (prefix == len) {
+		strbuf_add(&key, p, len);
+		add_to_pattern_bucket(m, PATTERN_KEY_PATHNAME,
+				      key.buf, key.len, pos);
+	} else if ((c = find_last_char(p, prefix, '/')) || key.len) {
+		if (c)
+			strbuf_add(&key, p, c - p + 1);
+		add_to_pattern_bucket(m, PATTERN_KEY_DIRECTORY,
+				      key.buf, key.len, pos);
+	} else {
+		add_to_bucket(&m->others, pos);
+	}
+	strbuf_release(&key);
+}
+
+static struct pattern_matcher *build_pattern_matcher(struct pattern_list *pl)
+{
+	struct pattern_matcher *m;
+	int i;
+
+	CALLOC_ARRAY(m, 1);
+	m->nr = pl->nr;
+	m->icase = ignore_case;
+	hashmap_init(&m->buckets, pattern_bucket_cmp, m, 0);
+	for (i = 0; i < pl->nr; i++)
+		add_pattern_to_matcher(m, pl->patterns[i], i);
+	return m;
+}
+
+static void free_pattern_matcher(struct pattern_matcher *m)
+{
+	struct hashmap_iter iter;
+	struct pattern_bucket *b;
+
+	if (!m)
+		return;
+	hashmap_for_each_entry(&m->buckets, &iter, b, ent) {
+		free((char *)b->key);
+		free(b->patterns);
+	}
+	hashmap_clear_and_free(&m->buckets, struct pattern_bucket, ent);
+	free(m->others.patterns);
+	free(m);
+}
+
+/*
+ * Return the position of the last pattern in "b" that matches, if it
+ * comes after "last", or "last" otherwise.
+ */
+static int last_matching_pattern_in_bucket(struct pattern_bucket *b, int last,
+					   const char *pathname, int pathlen,
+					   const char *basename, int *dtype,
+					   struct pattern_list *pl,
+					   struct index_state *istate)
+{
+	int i;
+
+	if (!b)
+		return last;
+	for (i = b->nr - 1; 0 <= i && b->patterns[i] > last; i--)
+		if (path_pattern_matches(pl->patterns[b->patterns[i]],
+					 pathname, pathlen, basename,
+					 dtype, istate))
+			return b->patterns[i];
+	return last;
+}
+
+static struct path_pattern *last_matching_pattern_from_matcher(
+		const char *pathname, int pathlen,
+		const char *basename, int *dtype,
+		struct pattern_list *pl,
+		struct index_state *istate)
+{
+	struct pattern_matcher *m = pl->matcher;
+	int basenamelen = pathlen - (basename - pathname);
+	const char *ext;
+	int last = -1;
+	int i;
+
+#define TRY_BUCKET(b) \
+	last = last_matching_pattern_in_bucket((b), last, pathname, pathlen, \
+					       basename, dtype, pl, istate)
+
+	TRY_BUCKET(find_pattern_bucket(m, PATTERN_KEY_PATHNAME,
+				       pathname, pathlen));
+	TRY_BUCKET(find_pattern_bucket(m, PATTERN_KEY_BASENAME,
+				       basename, basenamelen));
+	ext = find_last_char(basename, basenamelen, '.');
+	if (ext)
+		TRY_BUCKET(find_pattern_bucket(m, PATTERN_KEY_EXTENSION,
+					       ext, pathname + pathlen - ext));
+	for (i = 0; m->have_directories && i < pathlen; i++)
+		if (pathname[i] == '/')
+			TRY_BUCKET(find_pattern_bucket(m, PATTERN_KEY_DIRECTORY,
+						       pathname, i + 1));
+	TRY_BUCKET(&m->others);
+
+#undef TRY_BUCKET
+
+	return last < 0 ? NULL : pl->patterns[last];
+}
+
 /*
  * Scan the given exclude list in reverse to see whether pathname
  * should be ignored.  The first match (i.e. the last on the list), if
@@ -1314,46 +1607,30 @@ static struct path_pattern *last_matching_pattern_from_list(const char *pathname
 						       struct pattern_list *pl,
 						       struct index_state *istate)
 {
-	struct path_pattern *res = NULL; /* undecided */
 	int i;
 
 	if (!pl->nr)
 		return NULL;	/* undefined */
 
-	for (i = pl->nr - 1; 0 <= i; i--) {
-		struct path_pattern *pattern = pl->patterns[i];
-		const char *exclude = pattern->pattern;
-		int prefix = pattern->nowildcardlen;
-
-		if (pattern->flags & PATTERN_FLAG_MUSTBEDIR) {
-			*dtype = resolve_dtype(*dtype, istate, pathname, pathlen);
-			if (*dtype != DT_DIR)
-				continue;
-		}
-
-		if (pattern->flags & PATTERN_FLAG_NODIR) {
-			if (match_basename(basename,
-					   pathlen - (basename - pathname),
-					   exclude, prefix, pattern->patternlen,
-					   pattern->flags)) {
-				res = pattern;
-				break;
-			}
-			continue;
-		}
-
-		assert(pattern->baselen == 0 ||
-		       pattern->base[pattern->baselen - 1] == '/');
-		if (match_pathname(pathname, pathlen,
-				   pattern->base,
-				   pattern->baselen ? pattern->baselen - 1 : 0,
-				   exclude, prefix, pattern->patternlen,
-				   pattern->flags)) {
-			res = pattern;
-			break;
+	if (pl->nr >= PATTERN_MATCHER_MIN_NR) {
+		/* patterns may have been added since it was built */
+		if (pl->matcher && (pl->matcher->nr != pl->nr ||
+				    pl->matcher->icase != ignore_case)) {
+			free_pattern_matcher(pl->matcher);
+			pl->matcher = NULL;
 		}
+		if (!pl->matcher)
+			pl->matcher = build_pattern_matcher(pl);
+		return last_matching_pattern_from_matcher(pathname, pathlen,
+							  basename, dtype,
+							  pl, istate);
 	}
-	return res;
+
+	for (i = pl->nr - 1; 0 <= i; i--)
+		if (path_pattern_matches(pl->patterns[i], pathname, pathlen,
+					 basename, dtype, istate))
+			return pl->patterns[i];
+	return NULL;
 }
 
 /*
@@ -2421,6 +2698,324 @@ static int valid_cached_dir(struct dir_struct *dir,
 	return untracked->valid;
 }
 
+/*
+ * The names in a directory, read by a worker thread of the prefetcher
+ * before read_directory_recursive() gets to it, or by the main thread
+ * if it got there first.
+ */
+struct dir_listing_entry {
+	size_t name;
+	unsigned char d_type;
+	unsigned is_dir:1;
+};
+
+enum dir_listing_state {
+	DIR_LISTING_QUEUED,
+	DIR_LISTING_READING,
+	DIR_LISTING_DONE
+};
+
+struct dir_listing {
+	struct strbuf names;
+	struct dir_listing_entry *entries;
+	int nr, alloc;
+	int error;
+	enum dir_listing_state state;
+	/* free it as soon as it is read, nobody is waiting for it */
+	unsigned abandoned:1;
+	char path[FLEX_ARRAY];
+};
+
+struct dir_prefetch {
+	pthread_mutex_t mutex;
+	pthread_cond_t work, done;
+	pthread_t *threads;
+	int nr_threads;
+	int shutdown;
+
+	/* the directories that were queued and not taken yet, by path */
+	struct strmap listings;
+	/* the queued directories, the next one to read last */
+	struct dir_listing **queue;
+	int queue_nr, queue_alloc;
+	/* how many directories may be queued or read ahead at a time */
+	int max_listings;
+
+	/* stats */
+	unsigned hits, waits, misses;
+};
+
+/*
+ * How far workers may read ahead of the traversal, in directories.
+ * This bounds the memory held by listings the traversal never uses,
+ * e.g. those of ignored directories.
+ */
+#define DIR_PREFETCH_MAX_LISTINGS 1024
+
+static void read_dir_listing(struct dir_listing *listing)
+{
+	struct strbuf path = STRBUF_INIT;
+	struct dirent *de;
+	DIR *fdir;
+	size_t baselen;
+
+	fdir = opendir(*listing->path ? listing->path : ".");
+	if (!fdir) {
+		listing->error = errno;
+		return;
+	}
+	strbuf_addstr(&path, listing->path);
+	baselen = path.len;
+	while ((de = readdir_skip_dot_and_dotdot(fdir)) != NULL) {
+		struct dir_listing_entry *e;
+
+		ALLOC_GROW(listing->entries, listing->nr + 1, listing->alloc);
+		e = &listing->entries[listing->nr++];
+		e->name = listing->names.len;
+		e->d_type = DTYPE(de);
+		strbuf_addstr(&listing->names, de->d_name);
+		strbuf_addch(&listing->names, '\0');
+
+		/*
+		 * Leave an unknown d_type for resolve_dtype(), which
+		 * consults the index first, but find out whether to
+		 * read the directory ahead anyway.
+		 */
+		if (e->d_type == DT_UNKNOWN) {
+			struct stat st;
+
+			strbuf_setlen(&path, baselen);
+			strbuf_addstr(&path, de->d_name);
+			e->is_dir = !lstat(path.buf, &st) && S_ISDIR(st.st_mode);
+		} else {
+			e->is_dir = e->d_type == DT_DIR;
+		}
+	}
+	closedir(fdir);
+	strbuf_release(&path);
+}
+
+static void free_dir_listing(struct dir_listing *listing)
+{
+	if (!listing)
+		return;
+	strbuf_release(&listing->names);
+	free(listing->entries);
+	free(listing);
+}
+
+static void *dir_prefetch_worker(void *data)
+{
+	struct dir_prefetch *pf = data;
+
+	pthread_mutex_lock(&pf->mutex);
+	while (!pf->shutdown) {
+		struct dir_listing *listing;
+
+		if (!pf->queue_nr) {
+			pthread_cond_wait(&pf->work, &pf->mutex);
+			continue;
+		}
+		listing = pf->queue[--pf->queue_nr];
+		if (listing->abandoned) {
+			free_dir_listing(listing);
+			continue;
+		}
+
+		listing->state = DIR_LISTING_READING;
+		pthread_mutex_unlock(&pf->mutex);
+		read_dir_listing(listing);
+		pthread_mutex_lock(&pf->mutex);
+
+		listing->state = DIR_LISTING_DONE;
+		if (listing->abandoned)
+			free_dir_listing(listing);
+		pthread_cond_broadcast(&pf->done);
+	}
+	pthread_mutex_unlock(&pf->mutex);
+	return NULL;
+}
+
+static struct dir_prefetch *start_dir_prefetch(int nr_threads)
+{
+	struct dir_prefetch *pf;
+	int i;
+
+	CALLOC_ARRAY(pf, 1);
+	pthread_mutex_init(&pf->mutex, NULL);
+	pthread_cond_init(&pf->work, NULL);
+	pthread_cond_init(&pf->done, NULL);
+	strmap_init(&pf->listings);
+	pf->max_listings = DIR_PREFETCH_MAX_LISTINGS;
+
+	CALLOC_ARRAY(pf->threads, nr_threads);
+	for (i = 0; i < nr_threads; i++) {
+		if (pthread_create(&pf->threads[i], NULL,
+				   dir_prefetch_worker, pf)) {
+			warning(_("unable to create directory reading thread"));
+			break;
+		}
+	}
+	pf->nr_threads = i;
+	return pf;
+}
+
+static void stop_dir_prefetch(struct dir_struct *dir, struct repository *r)
+{
+	struct dir_prefetch *pf = dir->prefetch;
+	struct hashmap_iter iter;
+	struct strmap_entry *e;
+	int i;
+
+	if (!pf)
+		return;
+
+	pthread_mutex_lock(&pf->mutex);
+	pf->shutdown = 1;
+	pthread_cond_broadcast(&pf->work);
+	pthread_mutex_unlock(&pf->mutex);
+	for (i = 0; i < pf->nr_threads; i++)
+		pthread_join(pf->threads[i], NULL);
+
+	/* what is left is either still queued or done */
+	for (i = 0; i < pf->queue_nr; i++)
+		if (pf->queue[i]->abandoned)
+			free_dir_listing(pf->queue[i]);
+	strmap_for_each_entry(&pf->listings, &iter, e)
+		free_dir_listing(e->value);
+	strmap_clear(&pf->listings, 0);
+
+	trace2_data_intmax("read_directory", r, "prefetch/hits", pf->hits);
+	trace2_data_intmax("read_directory", r, "prefetch/waits", pf->waits);
+	trace2_data_intmax("read_directory", r, "prefetch/misses", pf->misses);
+
+	pthread_mutex_destroy(&pf->mutex);
+	pthread_cond_destroy(&pf->work);
+	pthread_cond_destroy(&pf->done);
+	free(pf->queue);
+	free(pf->threads);
+	FREE_AND_NULL(dir->prefetch);
+}
+
+/*
+ * Queue the subdirectories in "listing" to be read ahead, as long as
+ * there is room. They are pushed in reverse so that they are read in
+ * the order in which the traversal is going to get to them.
+ */
+static void queue_dir_prefetch(struct dir_prefetch *pf,
+			       struct dir_listing *listing)
+{
+	struct strbuf path = STRBUF_INIT;
+	int queued = 0;
+	int i;
+
+	strbuf_addstr(&path, listing->path);
+	pthread_mutex_lock(&pf->mutex);
+	for (i = listing->nr - 1; i >= 0; i--) {
+		const char *name = listing->names.buf + listing->entries[i].name;
+		struct dir_listing *child;
+		size_t baselen = path.len;
+
+		if (strmap_get_size(&pf->listings) >= pf->max_listings)
+			break;
+		if (!listing->entries[i].is_dir || is_dot_or_dotdot(name) ||
+		    !fspathcmp(name, ".git"))
+			continue;
+
+		strbuf_addstr(&path, name);
+		strbuf_addch(&path, '/');
+		if (!strmap_contains(&pf->listings, path.buf)) {
+			FLEX_ALLOC_MEM(child, path, path.buf, path.len);
+			strbuf_init(&child->names, 0);
+			strmap_put(&pf->listings, path.buf, child);
+			ALLOC_GROW(pf->queue, pf->queue_nr + 1, pf->queue_alloc);
+			pf->queue[pf->queue_nr++] = child;
+			queued = 1;
+		}
+		strbuf_setlen(&path, baselen);
+	}
+	if (queued)
+		pthread_cond_broadcast(&pf->work);
+	pthread_mutex_unlock(&pf->mutex);
+	strbuf_release(&path);
+}
+
+/*
+ * Get the listing of "path", which a worker may have read already,
+ * and queue its subdirectories.
+ */
+static struct dir_listing *get_dir_listing(struct dir_prefetch *pf,
+					   const char *path)
+{
+	struct dir_listing *listing;
+
+	pthread_mutex_lock(&pf->mutex);
+	listing = strmap_get(&pf->listings, path);
+	if (listing)
+		strmap_remove(&pf->listings, path, 0);
+	if (listing && listing->state == DIR_LISTING_QUEUED) {
+		/* leave it to the worker to throw away, read it ourselves */
+		listing->abandoned = 1;
+		listing = NULL;
+	}
+	if (listing) {
+		if (listing->state == DIR_LISTING_DONE) {
+			pf->hits++;
+		} else {
+			pf->waits++;
+			while (listing->state != DIR_LISTING_DONE)
+				pthread_cond_wait(&pf->done, &pf->mutex);
+		}
+	} else {
+		pf->misses++;
+	}
+	pthread_mutex_unlock(&pf->mutex);
+
+	if (!listing) {
+		FLEX_ALLOC_STR(listing, path, path);
+		strbuf_init(&listing->names, 0);
+		read_dir_listing(listing);
+	}
+	if (!listing->error)
+		queue_dir_prefetch(pf, listing);
+	return listing;
+}
+
+/*
+ * Throw away the listings read ahead for the subdirectories of
+ * "listing" that the traversal did not go into.
+ */
+static void drop_dir_prefetch(struct dir_prefetch *pf,
+			      struct dir_listing *listing)
+{
+	struct strbuf path = STRBUF_INIT;
+	int i;
+
+	strbuf_addstr(&path, listing->path);
+	pthread_mutex_lock(&pf->mutex);
+	for (i = 0; i < listing->nr; i++) {
+		struct dir_listing *child;
+		size_t baselen = path.len;
+
+		if (!listing->entries[i].is_dir)
+			continue;
+		strbuf_addstr(&path, listing->names.buf + listing->entries[i].name);
+		strbuf_addch(&path, '/');
+		child = strmap_get(&pf->listings, path.buf);
+		if (child)
+			strmap_remove(&pf->listings, path.buf, 0);
+		strbuf_setlen(&path, baselen);
+		if (!child)
+			continue;
+		if (child->state == DIR_LISTING_DONE)
+			free_dir_listing(child);
+		else
+			child->abandoned = 1;
+	}
+	pthread_mutex_unlock(&pf->mutex);
+	strbuf_release(&path);
+}
+
 static int open_cached_dir(struct cached_dir *cdir,
 			   struct dir_struct *dir,
 			   struct untracked_cache_dir *untracked,
@@ -2435,6 +3030,17 @@ static int open_cached_dir(struct cached_dir *cdir,
 	if (valid_cached_dir(dir, untracked, istate, path, check_only))
 		return 0;
 	c_path = path->len ? path->buf : ".";
+	if (dir->prefetch) {
+		cdir->listing = get_dir_listing(dir->prefetch, path->buf);
+		if (cdir->listing->error) {
+			errno = cdir->listing->error;
+			warning_errno(_("could not open directory '%s'"), c_path);
+			drop_dir_prefetch(dir->prefetch, cdir->listing);
+			FREE_AND_NULL(cdir->listing);
+			return -1;
+		}
+		return 0;
+	}
 	cdir->fdir = opendir(c_path);
 	if (!cdir->fdir)
 		warning_errno(_("could not open directory '%s'"), c_path);
@@ -2451,6 +3057,19 @@ static int read_cached_dir(struct cached_dir *cdir)
 {
 	struct dirent *de;
 
+	if (cdir->listing) {
+		struct dir_listing_entry *e;
+
+		if (cdir->listing_pos >= cdir->listing->nr) {
+			cdir->d_name = NULL;
+			cdir->d_type = DT_UNKNOWN;
+			return -1;
+		}
+		e = &cdir->listing->entries[cdir->listing_pos++];
+		cdir->d_name = cdir->listing->names.buf + e->name;
+		cdir->d_type = e->d_type;
+		return 0;
+	}
 	if (cdir->fdir) {
 		de = readdir_skip_dot_and_dotdot(cdir->fdir);
 		if (!de) {
@@ -2481,10 +3100,15 @@ static int read_cached_dir(struct cached_dir *cdir)
 	return -1;
 }
 
-static void close_cached_dir(struct cached_dir *cdir)
+static void close_cached_dir(struct cached_dir *cdir,
+			     struct dir_struct *dir)
 {
 	if (cdir->fdir)
 		closedir(cdir->fdir);
+	if (cdir->listing) {
+		drop_dir_prefetch(dir->prefetch, cdir->listing);
+		free_dir_listing(cdir->listing);
+	}
 	/*
 	 * We have gone through this directory and found no untracked
 	 * entries. Mark it valid.
@@ -2520,7 +3144,7 @@ static void add_path_to_appropriate_result_list(struct dir_struct *dir,
 		if (dir->flags & DIR_SHOW_IGNORED)
 			break;
 		dir_add_name(dir, istate, path->buf, path->len);
-		if (cdir->fdir)
+		if (cdir->fdir || cdir->listing)
 			add_untracked(untracked, path->buf + baselen);
 		break;
 
@@ -2625,7 +3249,7 @@ static enum path_treatment read_directory_recursive(struct dir_struct *dir,
 
 			/* abort early if maximum state has been reached */
 			if (dir_state == path_untracked) {
-				if (cdir.fdir)
+				if (cdir.fdir || cdir.listing)
 					add_untracked(untracked, path.buf + baselen);
 				break;
 			}
@@ -2637,7 +3261,7 @@ static enum path_treatment read_directory_recursive(struct dir_struct *dir,
 						    istate, &path, baselen,
 						    pathspec, state);
 	}
-	close_cached_dir(&cdir);
+	close_cached_dir(&cdir, dir);
  out:
 	strbuf_release(&path);
 
@@ -3005,8 +3629,22 @@ int read_directory(struct dir_struct *dir, struct index_state *istate,
 		 * e.g. prep_exclude()
 		 */
 		dir->untracked = NULL;
+
+	/*
+	 * The untracked cache avoids reading most directories at all,
+	 * so only read directories ahead of the traversal without it.
+	 */
+	if (HAVE_THREADS && !dir->untracked &&
+	    istate->repo && istate->repo->gitdir) {
+		prepare_repo_settings(istate->repo);
+		if (istate->repo->settings.core_untracked_threads > 1)
+			dir->prefetch = start_dir_prefetch(
+				istate->repo->settings.core_untracked_threads);
+	}
+
 	if (!len || treat_leading_path(dir, istate, path, len, pathspec))
 		read_directory_recursive(dir, istate, path, len, untracked, 0, 0, pathspec);
+	stop_dir_prefetch(dir, istate->repo);
 	QSORT(dir->entries, dir->nr, cmp_dir_entry);
 	QSORT(dir->ignored, dir->ignored_nr, cmp_dir_entry);
 
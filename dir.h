@@ -39,6 +39,8 @@
  *
  */
 
+struct dir_prefetch;
+
 struct dir_entry {
 	unsigned int len;
 	char name[FLEX_ARRAY]; /* more */
@@ -84,6 +86,8 @@ struct pattern_entry {
  * can also be used to represent the list of --exclude values passed
  * via CLI args.
  */
+struct pattern_matcher;
+
 struct pattern_list {
 	int nr;
 	int alloc;
@@ -115,6 +119,12 @@ struct pattern_list {
 	 * Used to check single-level parents of blobs.
 	 */
 	struct hashmap parent_hashmap;
+
+	/*
+	 * Index of the patterns by the literal parts of the paths they
+	 * can match, built on demand when the list is long.
+	 */
+	struct pattern_matcher *matcher;
 };
 
 /*
@@ -337,6 +347,9 @@ struct dir_struct {
 	struct oid_stat ss_excludes_file;
 	unsigned unmanaged_exclude_files;
 
+	/* Read directories ahead of the traversal if set */
+	struct dir_prefetch *prefetch;
+
 	/* Stats about the traversal */
 	unsigned visited_paths;
 	unsigned visited_directories;
@@ -95,6 +95,12 @@ uint32_t ewah_checksum(struct ewah_bitmap *self);
  */
 void ewah_each_bit(struct ewah_bitmap *self, ewah_callback callback, void *payload);
 
+/**
+ * Return whether the bit at "pos" is set, skipping over whole runs and
+ * literal blocks without decompressing them.
+ */
+int ewah_get(struct ewah_bitmap *self, size_t pos);
+
 /**
  * Set a given bit on the bitmap.
  *
@@ -0,0 +1,929 @@
+#include "cache.h"
+#include "chunk-format.h"
+#include "config.h"
+#include "csum-file.h"
+#include "grep.h"
+#include "grep-index.h"
+#include "hash-lookup.h"
+#include "lockfile.h"
+#include "object-store.h"
+#include "oid-array.h"
+#include "progress.h"
+#include "repository.h"
+#include "trace2.h"
+#include "varint.h"
+
+#define GREP_INDEX_SIGNATURE 0x47494458 /* "GIDX" */
+#define GREP_INDEX_VERSION 1
+#define GREP_INDEX_HEADER_SIZE 8
+
+#define GREP_INDEX_CHUNKID_OIDFANOUT 0x4f494446 /* "OIDF" */
+#define GREP_INDEX_CHUNKID_OIDLOOKUP 0x4f49444c /* "OIDL" */
+#define GREP_INDEX_CHUNKID_TRIGRAMS 0x54524947 /* "TRIG" */
+#define GREP_INDEX_CHUNKID_POSTINGS 0x504f5354 /* "POST" */
+
+#define GREP_INDEX_FANOUT_SIZE (sizeof(uint32_t) * 256)
+#define GREP_INDEX_TRIGRAM_WIDTH (2 * sizeof(uint32_t))
+
+/*
+ * The posting list of a trigram is the sorted list of the positions
+ * of the blobs containing it, each stored as a varint of its distance
+ * to the position after the previous one (the first one as is). The
+ * trigram table records where each list ends in the postings chunk,
+ * as a 32-bit offset.
+ */
+#define GREP_INDEX_MAX_POSTINGS_SIZE UINT32_MAX
+
+/*
+ * Larger blobs are left out of the index (and are therefore always
+ * searched): they contain most trigrams anyway.
+ */
+#define GREP_INDEX_MAX_BLOB_SIZE (1024 * 1024)
+
+#define NR_TRIGRAMS (1 << 24)
+
+static inline uint32_t trigram_at(const unsigned char *s)
+{
+	return ((uint32_t)tolower(s[0]) << 16) |
+	       ((uint32_t)tolower(s[1]) << 8) |
+	       (uint32_t)tolower(s[2]);
+}
+
+static char *get_grep_index_filename(struct repository *r)
+{
+	return xstrfmt("%s/info/grep-index", r->objects->odb->path);
+}
+
+/*
+ * A sorted list of blob positions in the index, or all of them.
+ */
+struct blob_set {
+	uint32_t *blobs;
+	size_t nr, alloc;
+	unsigned all : 1;
+};
+
+static void blob_set_clear(struct blob_set *set)
+{
+	FREE_AND_NULL(set->blobs);
+	set->nr = set->alloc = 0;
+	set->all = 0;
+}
+
+static void blob_set_intersect(struct blob_set *a, struct blob_set *b)
+{
+	size_t i = 0, j = 0, nr = 0;
+
+	if (b->all)
+		return;
+	if (a->all) {
+		SWAP(*a, *b);
+		return;
+	}
+
+	while (i < a->nr && j < b->nr) {
+		if (a->blobs[i] < b->blobs[j])
+			i++;
+		else if (a->blobs[i] > b->blobs[j])
+			j++;
+		else {
+			a->blobs[nr++] = a->blobs[i];
+			i++;
+			j++;
+		}
+	}
+	a->nr = nr;
+}
+
+static void blob_set_union(struct blob_set *a, struct blob_set *b)
+{
+	struct blob_set out = { 0 };
+	size_t i = 0, j = 0;
+
+	if (a->all)
+		return;
+	if (b->all) {
+		SWAP(*a, *b);
+		return;
+	}
+
+	ALLOC_ARRAY(out.blobs, a->nr + b->nr);
+	while (i < a->nr || j < b->nr) {
+		uint32_t next;
+
+		if (j == b->nr || (i < a->nr && a->blobs[i] < b->blobs[j]))
+			next = a->blobs[i++];
+		else if (i == a->nr || b->blobs[j] < a->blobs[i])
+			next = b->blobs[j++];
+		else {
+			next = a->blobs[i++];
+			j++;
+		}
+		out.blobs[out.nr++] = next;
+	}
+	out.alloc = a->nr + b->nr;
+
+	blob_set_clear(a);
+	*a = out;
+}
+
+struct grep_index {
+	struct repository *repo;
+
+	const unsigned char *data;
+	size_t data_len;
+
+	uint32_t num_blobs;
+	uint32_t num_trigrams;
+	size_t postings_size;
+
+	const uint32_t *chunk_oid_fanout;
+	const unsigned char *chunk_oid_lookup;
+	const unsigned char *chunk_trigrams;
+	const unsigned char *chunk_postings;
+
+	struct blob_set candidates;
+	uint32_t nr_skipped;
+};
+
+static int grep_index_read_oid_fanout(const unsigned char *chunk_start,
+				      size_t chunk_size, void *data)
+{
+	struct grep_index *gi = data;
+
+	if (chunk_size != GREP_INDEX_FANOUT_SIZE)
+		return error(_("grep-index OID fanout is of the wrong size"));
+	gi->chunk_oid_fanout = (const uint32_t *)chunk_start;
+	gi->num_blobs = ntohl(gi->chunk_oid_fanout[255]);
+	return 0;
+}
+
+static int grep_index_read_oid_lookup(const unsigned char *chunk_start,
+				      size_t chunk_size, void *data)
+{
+	struct grep_index *gi = data;
+
+	if (chunk_size != st_mult(gi->num_blobs, the_hash_algo->rawsz))
+		return error(_("grep-index OID lookup is of the wrong size"));
+	gi->chunk_oid_lookup = chunk_start;
+	return 0;
+}
+
+static int grep_index_read_trigrams(const unsigned char *chunk_start,
+				    size_t chunk_size, void *data)
+{
+	struct grep_index *gi = data;
+
+	if (chunk_size % GREP_INDEX_TRIGRAM_WIDTH)
+		return error(_("grep-index trigram table is of the wrong size"));
+	gi->chunk_trigrams = chunk_start;
+	gi->num_trigrams = chunk_size / GREP_INDEX_TRIGRAM_WIDTH;
+	return 0;
+}
+
+static int grep_index_read_postings(const unsigned char *chunk_start,
+				    size_t chunk_size, void *data)
+{
+	struct grep_index *gi = data;
+
+	if (chunk_size > GREP_INDEX_MAX_POSTINGS_SIZE)
+		return error(_("grep-index posting lists are of the wrong size"));
+	gi->chunk_postings = chunk_start;
+	gi->postings_size = chunk_size;
+	return 0;
+}
+
+static void free_grep_index_data(struct grep_index *gi)
+{
+	if (gi->data)
+		munmap((void *)gi->data, gi->data_len);
+	blob_set_clear(&gi->candidates);
+	free(gi);
+}
+
+static struct grep_index *load_grep_index(struct repository *r)
+{
+	struct grep_index *gi = NULL;
+	struct chunkfile *cf = NULL;
+	char *filename = get_grep_index_filename(r);
+	struct stat st;
+	size_t size;
+	void *map;
+	int fd;
+
+	fd = git_open(filename);
+	if (fd < 0)
+		goto cleanup;
+	if (fstat(fd, &st)) {
+		error_errno(_("failed to read %s"), filename);
+		close(fd);
+		goto cleanup;
+	}
+	size = xsize_t(st.st_size);
+	if (size < GREP_INDEX_HEADER_SIZE + the_hash_algo->rawsz) {
+		error(_("grep-index file %s is too small"), filename);
+		close(fd);
+		goto cleanup;
+	}
+	map = xmmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+
+	CALLOC_ARRAY(gi, 1);
+	gi->repo = r;
+	gi->data = map;
+	gi->data_len = size;
+
+	if (get_be32(gi->data) != GREP_INDEX_SIGNATURE) {
+		error(_("grep-index signature %X does not match signature %X"),
+		      get_be32(gi->data), GREP_INDEX_SIGNATURE);
+		goto fail;
+	}
+	if (gi->data[4] != GREP_INDEX_VERSION) {
+		error(_("grep-index version %d not recognized"), gi->data[4]);
+		goto fail;
+	}
+	if (gi->data[5] != oid_version(the_hash_algo)) {
+		error(_("grep-index hash version %u does not match version %u"),
+		      gi->data[5], oid_version(the_hash_algo));
+		goto fail;
+	}
+
+	cf = init_chunkfile(NULL);
+	if (read_table_of_contents(cf, gi->data, size,
+				   GREP_INDEX_HEADER_SIZE, gi->data[6]))
+		goto fail;
+
+	if (read_chunk(cf, GREP_INDEX_CHUNKID_OIDFANOUT,
+		       grep_index_read_oid_fanout, gi) ||
+	    read_chunk(cf, GREP_INDEX_CHUNKID_OIDLOOKUP,
+		       grep_index_read_oid_lookup, gi) ||
+	    read_chunk(cf, GREP_INDEX_CHUNKID_TRIGRAMS,
+		       grep_index_read_trigrams, gi) ||
+	    read_chunk(cf, GREP_INDEX_CHUNKID_POSTINGS,
+		       grep_index_read_postings, gi)) {
+		error(_("grep-index is missing required chunks"));
+		goto fail;
+	}
+
+	free_chunkfile(cf);
+	free(filename);
+	return gi;
+
+fail:
+	free_chunkfile(cf);
+	free_grep_index_data(gi);
+	gi = NULL;
+cleanup:
+	free(filename);
+	return gi;
+}
+
+/* Find the blobs containing "trigram" (if any). */
+static void trigram_postings(struct grep_index *gi, uint32_t trigram,
+			     struct blob_set *out)
+{
+	uint32_t lo = 0, hi = gi->num_trigrams;
+
+	while (lo < hi) {
+		uint32_t mi = lo + (hi - lo) / 2;
+		const unsigned char *entry = gi->chunk_trigrams +
+					     (size_t)mi * GREP_INDEX_TRIGRAM_WIDTH;
+		uint32_t cur = get_be32(entry);
+
+		if (cur < trigram) {
+			lo = mi + 1;
+		} else if (cur > trigram) {
+			hi = mi;
+		} else {
+			uint32_t start = mi ? get_be32(entry - sizeof(uint32_t)) : 0;
+			uint32_t end = get_be32(entry + sizeof(uint32_t));
+			const unsigned char *p = gi->chunk_postings + start;
+			uint32_t next = 0;
+
+			/*
+			 * The last byte of a list ends a varint, so decoding
+			 * cannot run past the list.
+			 */
+			if (start > end || end > gi->postings_size ||
+			    (start < end && gi->chunk_postings[end - 1] & 0x80))
+				die(_("grep-index posting list out of bounds"));
+
+			while (p < gi->chunk_postings + end) {
+				uintmax_t delta = decode_varint(&p);
+
+				if (delta >= gi->num_blobs - next)
+					die(_("grep-index posting list out of bounds"));
+				ALLOC_GROW(out->blobs, out->nr + 1, out->alloc);
+				out->blobs[out->nr++] = next + delta;
+				next += delta + 1;
+			}
+			return;
+		}
+	}
+}
+
+struct trigram_list {
+	uint32_t *v;
+	size_t nr, alloc;
+};
+
+static void flush_literal(struct strbuf *lit, struct trigram_list *t)
+{
+	size_t i;
+
+	for (i = 0; i + 2 < lit->len; i++) {
+		ALLOC_GROW(t->v, t->nr + 1, t->alloc);
+		t->v[t->nr++] = trigram_at((const unsigned char *)lit->buf + i);
+	}
+	strbuf_reset(lit);
+}
+
+/*
+ * Return a pointer to the "]" ending the bracket expression starting at
+ * "s", or to the last character of the pattern.
+ */
+static const char *skip_bracket(const char *s, const char *end)
+{
+	s++;
+	if (s < end && *s == '^')
+		s++;
+	if (s < end && *s == ']')
+		s++;
+	for (; s < end; s++) {
+		if (*s == '\\' && s + 1 < end) {
+			s++; /* skips more than POSIX does, which is safe */
+		} else if (*s == '[' && s + 1 < end &&
+			   (s[1] == ':' || s[1] == '.' || s[1] == '=')) {
+			char close = s[1];
+
+			for (s += 2; s + 1 < end; s++)
+				if (s[0] == close && s[1] == ']')
+					break;
+			s++;
+		} else if (*s == ']') {
+			return s;
+		}
+	}
+	return end - 1;
+}
+
+/* Return a pointer to the next "c" after "s", or to the end of the pattern. */
+static const char *skip_to(const char *s, const char *end, char c)
+{
+	const char *p = memchr(s + 1, c, end - s - 1);
+	return p ? p : end - 1;
+}
+
+/*
+ * Return a pointer to the last character of the escape sequence starting
+ * at "s", including the arguments of escapes like "\x41", "\p{L}" and
+ * "\{1,2\}".
+ */
+static const char *skip_escape(const char *s, const char *end)
+{
+	s++;
+	if (*s == '{')
+		return skip_to(s, end, '}');
+	if (isdigit(*s)) {
+		while (s + 1 < end && isdigit(s[1]))
+			s++;
+		return s;
+	}
+	if (s + 1 < end && (s[1] == '{' || s[1] == '<') &&
+	    strchr("xopPNgk", *s))
+		return skip_to(s + 1, end, s[1] == '{' ? '}' : '>');
+	if (s + 1 < end && s[1] == '\'' && strchr("gk", *s))
+		return skip_to(s + 1, end, '\'');
+	switch (*s) {
+	case 'x':
+		if (s + 1 < end && isxdigit(s[1]))
+			s++;
+		if (s + 1 < end && isxdigit(s[1]))
+			s++;
+		break;
+	case 'g':
+		if (s + 1 < end && s[1] == '-')
+			s++;
+		while (s + 1 < end && isdigit(s[1]))
+			s++;
+		break;
+	case 'c':
+	case 'p':
+	case 'P':
+		if (s + 1 < end)
+			s++;
+		break;
+	}
+	return s;
+}
+
+/*
+ * Return a pointer to the last character of the group starting at "s"
+ * ("(" or, in a basic regex, "\("), or to the last character of the
+ * pattern.
+ */
+static const char *skip_group(const char *s, const char *end, int bre)
+{
+	int depth = 0;
+
+	for (; s < end; s++) {
+		if (*s == '\\') {
+			if (++s == end)
+				break;
+			if (bre && *s == '(')
+				depth++;
+			else if (bre && *s == ')' && !--depth)
+				return s;
+		} else if (*s == '[') {
+			s = skip_bracket(s, end);
+		} else if (!bre && *s == '(') {
+			depth++;
+		} else if (!bre && *s == ')' && !--depth) {
+			return s;
+		}
+	}
+	return end - 1;
+}
+
+/*
+ * Collect into "t" the trigrams of the literal text that every match
+ * of "p" has to contain. This errs on the side of collecting fewer
+ * trigrams: characters that are optional or followed by an escape, and
+ * anything inside groups and bracket expressions, are left out, and
+ * we give up on alternation altogether by returning -1.
+ *
+ * When ignoring case, non-ASCII characters and the letters that Unicode
+ * or some locales case-fold to non-ASCII characters (e.g. KELVIN SIGN
+ * for "k", LATIN SMALL LETTER LONG S for "s", and the Turkish dotted
+ * and dotless "i") are left out, too.
+ */
+static int pattern_trigrams(struct grep_opt *opt, struct grep_pat *p,
+			    struct trigram_list *t)
+{
+	const char *s = p->pattern, *end = p->pattern + p->patternlen;
+	int literal = p->fixed || p->is_fixed;
+	int bre = opt->pattern_type_option == GREP_PATTERN_TYPE_BRE;
+	int pcre = opt->pattern_type_option == GREP_PATTERN_TYPE_PCRE;
+	struct strbuf lit = STRBUF_INIT;
+	int ret = 0;
+
+	for (; s < end; s++) {
+		unsigned char c = *s;
+
+		if (c == '\n' ||
+		    (p->ignore_case &&
+		     (!isascii(c) || strchr("kKsSiI", c)))) {
+			flush_literal(&lit, t);
+			continue;
+		}
+		if (literal) {
+			strbuf_addch(&lit, c);
+			continue;
+		}
+
+		switch (c) {
+		case '|':
+			ret = -1;
+			goto done;
+		case '\\':
+			if (s + 1 == end || s[1] == '|' || s[1] == 'Q') {
+				/* alternation, or quoting we do not bother with */
+				ret = -1;
+				goto done;
+			}
+			if (bre && s[1] == '(') {
+				flush_literal(&lit, t);
+				s = skip_group(s, end, bre);
+				break;
+			}
+			/* the escape may be a quantifier of the last character */
+			strbuf_setlen(&lit, lit.len ? lit.len - 1 : 0);
+			flush_literal(&lit, t);
+			s = skip_escape(s, end);
+			break;
+		case '(':
+			if (bre) {
+				strbuf_addch(&lit, c);
+				break;
+			}
+			if (pcre && s + 1 < end && s[1] == '?') {
+				/* e.g. "(?x)" changes how the rest is read */
+				ret = -1;
+				goto done;
+			}
+			flush_literal(&lit, t);
+			s = skip_group(s, end, bre);
+			break;
+		case '[':
+			flush_literal(&lit, t);
+			s = skip_bracket(s, end);
+			break;
+		case '{':
+			strbuf_setlen(&lit, lit.len ? lit.len - 1 : 0);
+			flush_literal(&lit, t);
+			s = skip_to(s, end, '}');
+			break;
+		case '*':
+		case '?':
+			strbuf_setlen(&lit, lit.len ? lit.len - 1 : 0);
+			flush_literal(&lit, t);
+			break;
+		case '+':
+		case '.':
+		case '^':
+		case '$':
+		case ')':
+		case ']':
+		case '}':
+			flush_literal(&lit, t);
+			break;
+		default:
+			strbuf_addch(&lit, c);
+			break;
+		}
+	}
+	flush_literal(&lit, t);
+
+done:
+	strbuf_release(&lit);
+	return ret;
+}
+
+static void pattern_candidates(struct grep_index *gi, struct grep_opt *opt,
+			       struct grep_pat *p, struct blob_set *out)
+{
+	struct trigram_list t = { 0 };
+	size_t i;
+
+	out->all = 1;
+	if (p->token != GREP_PATTERN || pattern_trigrams(opt, p, &t) < 0)
+		goto done;
+
+	for (i = 0; i < t.nr; i++) {
+		struct blob_set postings = { 0 };
+
+		trigram_postings(gi, t.v[i], &postings);
+		blob_set_intersect(out, &postings);
+		blob_set_clear(&postings);
+
+		if (!out->nr)
+			break;
+	}
+
+done:
+	free(t.v);
+}
+
+static void expr_candidates(struct grep_index *gi, struct grep_opt *opt,
+			    struct grep_expr *x, struct blob_set *out)
+{
+	struct blob_set other = { 0 };
+
+	switch (x->node) {
+	case GREP_NODE_ATOM:
+		pattern_candidates(gi, opt, x->u.atom, out);
+		break;
+	case GREP_NODE_AND:
+		expr_candidates(gi, opt, x->u.binary.left, out);
+		expr_candidates(gi, opt, x->u.binary.right, &other);
+		blob_set_intersect(out, &other);
+		break;
+	case GREP_NODE_OR:
+		/*
+		 * Also with --all-match, where each of the patterns has to
+		 * match; that would allow intersecting, but is rare.
+		 */
+		expr_candidates(gi, opt, x->u.binary.left, out);
+		expr_candidates(gi, opt, x->u.binary.right, &other);
+		blob_set_union(out, &other);
+		break;
+	case GREP_NODE_NOT:
+	case GREP_NODE_TRUE:
+		out->all = 1;
+		break;
+	}
+	blob_set_clear(&other);
+}
+
+struct grep_index *prepare_grep_index(struct repository *r,
+				      struct grep_opt *opt)
+{
+	struct grep_index *gi;
+	int enabled = 1;
+
+	/* Only the blobs containing a match can be ruled out. */
+	if (opt->invert || opt->unmatch_name_only || opt->allow_textconv ||
+	    !opt->pattern_list || (opt->extended && !opt->pattern_expression))
+		return NULL;
+
+	if (!repo_config_get_bool(r, "grep.trigramindex", &enabled) &&
+	    !enabled)
+		return NULL;
+
+	gi = load_grep_index(r);
+	if (!gi)
+		return NULL;
+
+	if (opt->extended) {
+		expr_candidates(gi, opt, opt->pattern_expression,
+				&gi->candidates);
+	} else {
+		/* a line matches if any of the patterns does */
+		struct grep_pat *p;
+
+		for (p = opt->pattern_list; p; p = p->next) {
+			struct blob_set one = { 0 };
+
+			pattern_candidates(gi, opt, p, &one);
+			if (p == opt->pattern_list)
+				SWAP(gi->candidates, one);
+			else
+				blob_set_union(&gi->candidates, &one);
+			blob_set_clear(&one);
+			if (gi->candidates.all)
+				break;
+		}
+	}
+	if (gi->candidates.all) {
+		free_grep_index_data(gi);
+		return NULL;
+	}
+
+	trace2_data_intmax("grep-index", r, "candidates", gi->candidates.nr);
+	return gi;
+}
+
+int grep_index_may_match(struct grep_index *gi, const struct object_id *oid)
+{
+	uint32_t pos, lo = 0, hi = gi->candidates.nr;
+
+	if (!bsearch_hash(oid->hash, gi->chunk_oid_fanout,
+			  gi->chunk_oid_lookup, the_hash_algo->rawsz, &pos))
+		return 1; /* not indexed */
+
+	while (lo < hi) {
+		uint32_t mi = lo + (hi - lo) / 2;
+
+		if (gi->candidates.blobs[mi] == pos)
+			return 1;
+		if (gi->candidates.blobs[mi] < pos)
+			lo = mi + 1;
+		else
+			hi = mi;
+	}
+
+	gi->nr_skipped++;
+	return 0;
+}
+
+void free_grep_index(struct grep_index *gi)
+{
+	if (!gi)
+		return;
+	trace2_data_intmax("grep-index", gi->repo, "skipped", gi->nr_skipped);
+	free_grep_index_data(gi);
+}
+
+struct posting_list {
+	unsigned char *buf;
+	size_t len, alloc;
+	/* one more than the last blob added */
+	uint32_t next;
+};
+
+struct write_grep_index_context {
+	struct repository *repo;
+	struct oid_array objects;
+	struct progress *progress;
+	uint64_t progress_nr;
+
+	struct object_id *blobs;
+	uint32_t nr_blobs;
+	size_t alloc_blobs;
+	uint32_t nr_left_out;
+
+	/*
+	 * The posting lists of the trigrams seen so far, encoded as the
+	 * blobs are indexed, and for each trigram one more than the
+	 * position of its list, or 0.
+	 */
+	struct posting_list *lists;
+	uint32_t nr_lists;
+	size_t alloc_lists;
+	uint32_t *list_of;
+	size_t postings_size, max_postings_size;
+};
+
+static int add_loose_object(const struct object_id *oid,
+			    const char *path, void *data)
+{
+	struct write_grep_index_context *ctx = data;
+	oid_array_append(&ctx->objects, oid);
+	return 0;
+}
+
+static int add_packed_object(const struct object_id *oid,
+			     struct packed_git *pack,
+			     uint32_t pos, void *data)
+{
+	struct write_grep_index_context *ctx = data;
+	oid_array_append(&ctx->objects, oid);
+	return 0;
+}
+
+static void add_posting(struct write_grep_index_context *ctx,
+			uint32_t trigram)
+{
+	struct posting_list *list;
+	unsigned char varint[16];
+	int len;
+
+	if (!ctx->list_of[trigram]) {
+		ALLOC_GROW(ctx->lists, ctx->nr_lists + 1, ctx->alloc_lists);
+		memset(&ctx->lists[ctx->nr_lists], 0, sizeof(*list));
+		ctx->list_of[trigram] = ++ctx->nr_lists;
+	}
+	list = &ctx->lists[ctx->list_of[trigram] - 1];
+	if (list->next > ctx->nr_blobs)
+		return; /* seen earlier in this blob */
+
+	len = encode_varint(ctx->nr_blobs - list->next, varint);
+	ALLOC_GROW(list->buf, list->len + len, list->alloc);
+	memcpy(list->buf + list->len, varint, len);
+	list->len += len;
+	list->next = ctx->nr_blobs + 1;
+	ctx->postings_size += len;
+}
+
+static int index_blob(const struct object_id *oid, void *data)
+{
+	struct write_grep_index_context *ctx = data;
+	enum object_type type;
+	unsigned long size, i;
+	unsigned char *buf;
+
+	display_progress(ctx->progress, ++ctx->progress_nr);
+
+	type = oid_object_info(ctx->repo, oid, &size);
+	if (type != OBJ_BLOB || size > GREP_INDEX_MAX_BLOB_SIZE)
+		return 0;
+
+	/*
+	 * Leave out the blobs whose postings might not fit; like those
+	 * that are too large, they are always searched.
+	 */
+	if (ctx->nr_blobs == UINT32_MAX ||
+	    st_mult(size, 5) > ctx->max_postings_size - ctx->postings_size) {
+		ctx->nr_left_out++;
+		return 0;
+	}
+
+	buf = repo_read_object_file(ctx->repo, oid, &type, &size);
+	if (!buf)
+		return error(_("unable to read %s"), oid_to_hex(oid));
+
+	for (i = 0; i + 2 < size; i++)
+		add_posting(ctx, trigram_at(buf + i));
+	free(buf);
+
+	ALLOC_GROW(ctx->blobs, ctx->nr_blobs + 1, ctx->alloc_blobs);
+	oidcpy(&ctx->blobs[ctx->nr_blobs++], oid);
+	return 0;
+}
+
+static int write_grep_index_oid_fanout(struct hashfile *f, void *data)
+{
+	struct write_grep_index_context *ctx = data;
+	uint32_t i, count = 0;
+
+	for (i = 0; i < 256; i++) {
+		while (count < ctx->nr_blobs && ctx->blobs[count].hash[0] == i)
+			count++;
+		hashwrite_be32(f, count);
+	}
+	return 0;
+}
+
+static int write_grep_index_oid_lookup(struct hashfile *f, void *data)
+{
+	struct write_grep_index_context *ctx = data;
+	uint32_t i;
+
+	for (i = 0; i < ctx->nr_blobs; i++)
+		hashwrite(f, ctx->blobs[i].hash, the_hash_algo->rawsz);
+	return 0;
+}
+
+static int write_grep_index_trigrams(struct hashfile *f, void *data)
+{
+	struct write_grep_index_context *ctx = data;
+	uint32_t trigram;
+	size_t end = 0;
+
+	for (trigram = 0; trigram < NR_TRIGRAMS; trigram++) {
+		if (!ctx->list_of[trigram])
+			continue;
+		end += ctx->lists[ctx->list_of[trigram] - 1].len;
+		hashwrite_be32(f, trigram);
+		hashwrite_be32(f, end);
+	}
+	return 0;
+}
+
+static int write_grep_index_postings(struct hashfile *f, void *data)
+{
+	struct write_grep_index_context *ctx = data;
+	uint32_t trigram;
+
+	for (trigram = 0; trigram < NR_TRIGRAMS; trigram++) {
+		struct posting_list *list;
+
+		if (!ctx->list_of[trigram])
+			continue;
+		list = &ctx->lists[ctx->list_of[trigram] - 1];
+		hashwrite(f, list->buf, list->len);
+	}
+	return 0;
+}
+
+int write_grep_index(struct repository *r, unsigned flags)
+{
+	struct write_grep_index_context ctx = { .repo = r };
+	struct lock_file lk = LOCK_INIT;
+	char *filename = get_grep_index_filename(r);
+	struct chunkfile *cf;
+	struct hashfile *f;
+	uint32_t i;
+	int ret = 0;
+
+	for_each_loose_object(add_loose_object, &ctx,
+			      FOR_EACH_OBJECT_LOCAL_ONLY);
+	for_each_packed_object(add_packed_object, &ctx,
+			       FOR_EACH_OBJECT_LOCAL_ONLY);
+
+	if (flags & GREP_INDEX_PROGRESS)
+		ctx.progress = start_delayed_progress(_("Indexing blobs for grep"),
+						      ctx.objects.nr);
+	ctx.max_postings_size = git_env_ulong("GIT_TEST_GREP_INDEX_MAX_POSTINGS",
+					      GREP_INDEX_MAX_POSTINGS_SIZE);
+	CALLOC_ARRAY(ctx.list_of, NR_TRIGRAMS);
+	ret = oid_array_for_each_unique(&ctx.objects, index_blob, &ctx);
+	stop_progress(&ctx.progress);
+	oid_array_clear(&ctx.objects);
+	if (ret)
+		goto cleanup;
+	if (ctx.nr_left_out)
+		warning(Q_("the grep-index is full, %"PRIu32" blob is left out "
+			   "and will always be searched",
+			   "the grep-index is full, %"PRIu32" blobs are left out "
+			   "and will always be searched", ctx.nr_left_out),
+			ctx.nr_left_out);
+
+	if (safe_create_leading_directories(filename)) {
+		ret = error_errno(_("unable to create leading directories of %s"),
+				  filename);
+		goto cleanup;
+	}
+	hold_lock_file_for_update(&lk, filename, LOCK_DIE_ON_ERROR);
+	f = hashfd(get_lock_file_fd(&lk), get_lock_file_path(&lk));
+
+	cf = init_chunkfile(f);
+	add_chunk(cf, GREP_INDEX_CHUNKID_OIDFANOUT, GREP_INDEX_FANOUT_SIZE,
+		  write_grep_index_oid_fanout);
+	add_chunk(cf, GREP_INDEX_CHUNKID_OIDLOOKUP,
+		  st_mult(ctx.nr_blobs, the_hash_algo->rawsz),
+		  write_grep_index_oid_lookup);
+	add_chunk(cf, GREP_INDEX_CHUNKID_TRIGRAMS,
+		  st_mult(ctx.nr_lists, GREP_INDEX_TRIGRAM_WIDTH),
+		  write_grep_index_trigrams);
+	add_chunk(cf, GREP_INDEX_CHUNKID_POSTINGS, ctx.postings_size,
+		  write_grep_index_postings);
+
+	hashwrite_be32(f, GREP_INDEX_SIGNATURE);
+	hashwrite_u8(f, GREP_INDEX_VERSION);
+	hashwrite_u8(f, oid_version(the_hash_algo));
+	hashwrite_u8(f, get_num_chunks(cf));
+	hashwrite_u8(f, 0); /* unused */
+	write_chunkfile(cf, &ctx);
+
+	finalize_hashfile(f, NULL, FSYNC_COMPONENT_PACK_METADATA,
+			  CSUM_HASH_IN_STREAM | CSUM_FSYNC);
+	free_chunkfile(cf);
+
+	if (commit_lock_file(&lk) < 0)
+		ret = error_errno(_("could not write grep-index"));
+
+	trace2_data_intmax("grep-index", r, "write/blobs", ctx.nr_blobs);
+	trace2_data_intmax("grep-index", r, "write/trigrams", ctx.nr_lists);
+	trace2_data_intmax("grep-index", r, "write/postings_size",
+			   ctx.postings_size);
+
+cleanup:
+	for (i = 0; i < ctx.nr_lists; i++)
+		free(ctx.lists[i].buf);
+	free(ctx.lists);
+	free(ctx.list_of);
+	free(ctx.blobs);
+	free(filename);
+	return ret;
+}
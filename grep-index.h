@@ -0,0 +1,45 @@
+#ifndef GREP_INDEX_H
+#define GREP_INDEX_H
+
+struct grep_opt;
+struct object_id;
+struct repository;
+
+/*
+ * The grep index records, for each indexed blob, the set of trigrams
+ * (runs of three bytes, folded to lowercase) that occur in it. Before
+ * searching a blob of a committed tree, "git grep" can check whether
+ * the blob contains all of the trigrams of the literal text that any
+ * match of its patterns must contain, and skip it if not.
+ *
+ * Blobs are immutable, so the index never becomes wrong; blobs that
+ * were added after it was written (or that were too large to index)
+ * are simply searched as usual.
+ */
+struct grep_index;
+
+#define GREP_INDEX_PROGRESS (1 << 0)
+
+/*
+ * Write "$GIT_DIR/objects/info/grep-index" for all blobs in the local
+ * object directory.
+ */
+int write_grep_index(struct repository *r, unsigned flags);
+
+/*
+ * Load the grep index of "r" and compute which of its blobs may match
+ * the patterns of "opt". Returns NULL if there is no index, or if the
+ * patterns do not allow ruling out any blob.
+ */
+struct grep_index *prepare_grep_index(struct repository *r,
+				      struct grep_opt *opt);
+
+/*
+ * Returns 0 if the blob "oid" cannot match the patterns the index was
+ * prepared for, and 1 if it may (or if it is not indexed).
+ */
+int grep_index_may_match(struct grep_index *gi, const struct object_id *oid);
+
+void free_grep_index(struct grep_index *gi);
+
+#endif
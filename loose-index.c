@@ -0,0 +1,295 @@
+#include "cache.h"
+#include "loose-index.h"
+#include "lockfile.h"
+#include "object-store.h"
+#include "repository.h"
+
+#define LOOSE_INDEX_SIGNATURE 0x4c4f4958 /* "LOIX" */
+#define LOOSE_INDEX_VERSION 1
+
+/*
+ * The file starts with a header of:
+ *
+ *   4 bytes: signature
+ *   4 bytes: version
+ *   4 bytes: hash function id
+ *   4 bytes: number of objects
+ *   8 bytes: mtime of the fan-out directory, seconds
+ *   4 bytes: mtime of the fan-out directory, nanoseconds
+ *   4 bytes: reserved, zero
+ *
+ * followed by the sorted object names and a checksum of everything
+ * before it. All numbers are in network byte order.
+ */
+#define LOOSE_INDEX_HEADER_SIZE 32
+
+struct loose_index {
+	const unsigned char *oids;
+	uint32_t nr;
+	size_t rawsz;
+
+	/* the mapped file the names come from, or NULL if they are ours */
+	void *map;
+	size_t map_size;
+};
+
+static void free_loose_index(struct loose_index *li)
+{
+	if (!li)
+		return;
+	if (li->map)
+		munmap(li->map, li->map_size);
+	else
+		free((void *)li->oids);
+	free(li);
+}
+
+static struct loose_index *load_loose_index(const struct git_hash_algo *algo,
+					    const char *path,
+					    const struct stat *dir_st)
+{
+	struct loose_index *li;
+	const unsigned char *data;
+	struct stat st;
+	size_t size;
+	uint32_t nr;
+	void *map;
+	int fd;
+
+	fd = git_open(path);
+	if (fd < 0)
+		return NULL;
+	if (fstat(fd, &st)) {
+		close(fd);
+		return NULL;
+	}
+	size = xsize_t(st.st_size);
+	if (size < LOOSE_INDEX_HEADER_SIZE + algo->rawsz) {
+		close(fd);
+		return NULL;
+	}
+	map = xmmap_gently(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED)
+		return NULL;
+
+	data = map;
+	nr = get_be32(data + 12);
+	if (get_be32(data) != LOOSE_INDEX_SIGNATURE ||
+	    get_be32(data + 4) != LOOSE_INDEX_VERSION ||
+	    get_be32(data + 8) != algo->format_id ||
+	    size != st_add3(LOOSE_INDEX_HEADER_SIZE,
+			    st_mult(nr, algo->rawsz), algo->rawsz) ||
+	    get_be64(data + 16) != (uint64_t)dir_st->st_mtime ||
+	    get_be32(data + 24) != ST_MTIME_NSEC(*dir_st)) {
+		munmap(map, size);
+		return NULL;
+	}
+
+	CALLOC_ARRAY(li, 1);
+	li->oids = data + LOOSE_INDEX_HEADER_SIZE;
+	li->nr = nr;
+	li->rawsz = algo->rawsz;
+	li->map = map;
+	li->map_size = size;
+	return li;
+}
+
+static void write_loose_index(const struct git_hash_algo *algo,
+			      const char *path, const struct stat *dir_st,
+			      const unsigned char *oids, uint32_t nr)
+{
+	struct lock_file lk = LOCK_INIT;
+	struct strbuf buf = STRBUF_INIT;
+	unsigned char hdr[LOOSE_INDEX_HEADER_SIZE];
+	unsigned char hash[GIT_MAX_RAWSZ];
+	git_hash_ctx ctx;
+
+	/*
+	 * The index is only an optimization; if we cannot write it (say,
+	 * because the repository is read-only to us, or because somebody
+	 * else is writing it right now), the next reader will do without.
+	 */
+	if (safe_create_leading_directories_const(path) ||
+	    hold_lock_file_for_update(&lk, path, 0) < 0)
+		return;
+
+	put_be32(hdr, LOOSE_INDEX_SIGNATURE);
+	put_be32(hdr + 4, LOOSE_INDEX_VERSION);
+	put_be32(hdr + 8, algo->format_id);
+	put_be32(hdr + 12, nr);
+	put_be64(hdr + 16, dir_st->st_mtime);
+	put_be32(hdr + 24, ST_MTIME_NSEC(*dir_st));
+	put_be32(hdr + 28, 0);
+	strbuf_add(&buf, hdr, sizeof(hdr));
+	strbuf_add(&buf, oids, st_mult(nr, algo->rawsz));
+
+	algo->init_fn(&ctx);
+	algo->update_fn(&ctx, buf.buf, buf.len);
+	algo->final_fn(hash, &ctx);
+	strbuf_add(&buf, hash, algo->rawsz);
+
+	if (write_in_full(get_lock_file_fd(&lk), buf.buf, buf.len) < 0 ||
+	    commit_lock_file(&lk) < 0)
+		rollback_lock_file(&lk);
+	strbuf_release(&buf);
+}
+
+static int append_loose_name(const struct object_id *oid, const char *path,
+			     void *data)
+{
+	oid_array_append(data, oid);
+	return 0;
+}
+
+/*
+ * Read the fan-out directory "subdir_nr" of "odb", whose stat data
+ * before we started was "dir_st" (NULL if it does not exist), and
+ * record what we found in the index file at "index_path".
+ */
+static struct loose_index *list_loose_objects(struct repository *r,
+					      struct object_directory *odb,
+					      int subdir_nr, time_t started,
+					      const struct stat *dir_st,
+					      const char *index_path)
+{
+	struct oid_array names = OID_ARRAY_INIT;
+	struct strbuf buf = STRBUF_INIT;
+	size_t rawsz = r->hash_algo->rawsz;
+	unsigned char *oids;
+	struct loose_index *li;
+	struct stat st;
+	size_t i;
+
+	strbuf_addstr(&buf, odb->path);
+	for_each_file_in_obj_subdir(subdir_nr, &buf, append_loose_name,
+				    NULL, NULL, &names);
+	oid_array_sort(&names);
+
+	ALLOC_ARRAY(oids, st_mult(names.nr, rawsz));
+	for (i = 0; i < names.nr; i++)
+		memcpy(oids + i * rawsz, names.oid[i].hash, rawsz);
+
+	/*
+	 * Only record the listing if the directory did not change while
+	 * we read it, and if its mtime is older than the second we
+	 * started in, so that no later change can leave it the same (the
+	 * same reasoning as for racily clean index entries).
+	 */
+	strbuf_addf(&buf, "/%02x", subdir_nr);
+	if (dir_st && !odb->will_destroy && dir_st->st_mtime < started &&
+	    !stat(buf.buf, &st) &&
+	    st.st_mtime == dir_st->st_mtime &&
+	    ST_MTIME_NSEC(st) == ST_MTIME_NSEC(*dir_st))
+		write_loose_index(r->hash_algo, index_path, dir_st,
+				  oids, names.nr);
+
+	CALLOC_ARRAY(li, 1);
+	li->oids = oids;
+	li->nr = names.nr;
+	li->rawsz = rawsz;
+
+	oid_array_clear(&names);
+	strbuf_release(&buf);
+	return li;
+}
+
+struct loose_index *odb_loose_index(struct repository *r,
+				    struct object_directory *odb,
+				    const struct object_id *oid)
+{
+	int subdir_nr = oid->hash[0];
+	struct strbuf path = STRBUF_INIT;
+	struct loose_index *li = NULL;
+	time_t started;
+	struct stat st;
+	int have_dir;
+
+	if (!r->gitdir)
+		return NULL;
+	prepare_repo_settings(r);
+	if (!r->settings.core_loose_object_index)
+		return NULL;
+
+	if (!odb->loose_index)
+		CALLOC_ARRAY(odb->loose_index, 256);
+	if (odb->loose_index[subdir_nr])
+		return odb->loose_index[subdir_nr];
+
+	started = time(NULL);
+	strbuf_addf(&path, "%s/%02x", odb->path, subdir_nr);
+	have_dir = !stat(path.buf, &st);
+
+	strbuf_reset(&path);
+	strbuf_addf(&path, "%s/info/loose-index/%02x", odb->path, subdir_nr);
+	if (have_dir)
+		li = load_loose_index(r->hash_algo, path.buf, &st);
+	if (!li)
+		li = list_loose_objects(r, odb, subdir_nr, started,
+					have_dir ? &st : NULL, path.buf);
+
+	strbuf_release(&path);
+	odb->loose_index[subdir_nr] = li;
+	return li;
+}
+
+int loose_index_contains(struct loose_index *li, const struct object_id *oid)
+{
+	size_t lo = 0, hi = li->nr;
+
+	while (lo < hi) {
+		size_t mi = lo + (hi - lo) / 2;
+		int cmp = memcmp(oid->hash, li->oids + mi * li->rawsz,
+				 li->rawsz);
+
+		if (!cmp)
+			return 1;
+		if (cmp < 0)
+			hi = mi;
+		else
+			lo = mi + 1;
+	}
+	return 0;
+}
+
+void loose_index_each(struct loose_index *li, const struct object_id *prefix,
+		      size_t prefix_hex_len, oidtree_iter fn, void *data)
+{
+	size_t klen = prefix_hex_len / 2;
+	size_t lo = 0, hi = li->nr, i;
+
+	/* find the first name whose leading whole bytes match */
+	while (lo < hi) {
+		size_t mi = lo + (hi - lo) / 2;
+
+		if (memcmp(li->oids + mi * li->rawsz, prefix->hash, klen) < 0)
+			lo = mi + 1;
+		else
+			hi = mi;
+	}
+
+	for (i = lo; i < li->nr; i++) {
+		const unsigned char *name = li->oids + i * li->rawsz;
+		struct object_id oid;
+
+		if (memcmp(name, prefix->hash, klen))
+			break;
+		if ((prefix_hex_len & 1) &&
+		    ((name[klen] ^ prefix->hash[klen]) & 0xf0))
+			continue;
+		oidread(&oid, name);
+		if (fn(&oid, data) != CB_CONTINUE)
+			break;
+	}
+}
+
+void odb_clear_loose_index(struct object_directory *odb)
+{
+	int i;
+
+	if (!odb->loose_index)
+		return;
+	for (i = 0; i < 256; i++)
+		free_loose_index(odb->loose_index[i]);
+	FREE_AND_NULL(odb->loose_index);
+}
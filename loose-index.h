@@ -0,0 +1,49 @@
+#ifndef LOOSE_INDEX_H
+#define LOOSE_INDEX_H
+
+#include "oidtree.h"
+
+struct repository;
+struct object_directory;
+struct object_id;
+
+/*
+ * The loose object index keeps the sorted names of the loose objects in
+ * each fan-out directory of an object directory, together with the
+ * mtime the directory had when it was listed, in
+ * "$objdir/info/loose-index/<xx>". As long as the directory's mtime is
+ * unchanged, no loose object has been added to or removed from it, and
+ * lookups can binary-search the mmap'd file instead of reading the
+ * directory. A directory that has changed is listed again and its file
+ * rewritten, so the index is kept up to date one fan-out directory at a
+ * time.
+ *
+ * Like the loose object cache, this trades accuracy for speed: only
+ * use it where the loose object cache could be used.
+ */
+struct loose_index;
+
+/*
+ * Return the index of the loose objects in "odb" that share the first
+ * byte of "oid", listing the fan-out directory if its index is missing
+ * or out of date. Returns NULL when core.looseObjectIndex is not set,
+ * in which case the caller should use odb_loose_cache() instead.
+ */
+struct loose_index *odb_loose_index(struct repository *r,
+				    struct object_directory *odb,
+				    const struct object_id *oid);
+
+int loose_index_contains(struct loose_index *li, const struct object_id *oid);
+
+/*
+ * Call "fn" on each object in the index whose name starts with the
+ * first "prefix_hex_len" hex digits of "prefix", in the manner of
+ * oidtree_each().
+ */
+void loose_index_each(struct loose_index *li, const struct object_id *prefix,
+		      size_t prefix_hex_len, oidtree_iter fn, void *data);
+
+/* Forget the indexes loaded for "odb", as odb_clear_loose_cache() does. */
+void odb_clear_loose_index(struct object_directory *odb);
+
+#endif /* LOOSE_INDEX_H */
@@ -0,0 +1,31 @@
+#ifndef LSTAT_BATCH_H
+#define LSTAT_BATCH_H
+
+/*
+ * Look up the stat information of many paths with fewer system calls
+ * than calling lstat() on each of them, where the platform allows it
+ * (with io_uring on Linux, see compat/linux/lstat-batch.c).
+ */
+
+/* the most paths that can be passed to lstat_batch() at once */
+#define LSTAT_BATCH_MAX 64
+
+struct lstat_batch;
+
+/*
+ * Prepare to look up paths in batches. Returns NULL if batching is not
+ * supported by the platform or the running kernel, in which case the
+ * caller should call lstat() itself.
+ */
+struct lstat_batch *lstat_batch_new(void);
+
+/*
+ * Do what lstat(paths[i], &st[i]) would do for the first "nr" paths,
+ * setting errs[i] to 0 or to the errno it would fail with.
+ */
+void lstat_batch(struct lstat_batch *b, int nr,
+		 const char **paths, struct stat *st, int *errs);
+
+void lstat_batch_free(struct lstat_batch *b);
+
+#endif /* LSTAT_BATCH_H */
@@ -80,6 +80,16 @@ void mem_pool_discard(struct mem_pool *pool, int invalidate_memory)
 		free(block_to_free);
 	}
 
+	while (pool->mp_mmap) {
+		struct mp_mmap *m = pool->mp_mmap;
+
+		pool->mp_mmap = m->next;
+		if (invalidate_memory)
+			memset(m->start, 0xDD, m->len);
+		munmap(m->start, m->len);
+		free(m);
+	}
+
 	pool->mp_block = NULL;
 	pool->pool_alloc = 0;
 }
@@ -138,6 +148,7 @@ char *mem_pool_strndup(struct mem_pool *pool, const char *str, size_t len)
 int mem_pool_contains(struct mem_pool *pool, void *mem)
 {
 	struct mp_block *p;
+	struct mp_mmap *m;
 
 	/* Check if memory is allocated in a block */
 	for (p = pool->mp_block; p; p = p->next_block)
@@ -145,9 +156,24 @@ int mem_pool_contains(struct mem_pool *pool, void *mem)
 		    (mem < ((void *)p->end)))
 			return 1;
 
+	for (m = pool->mp_mmap; m; m = m->next)
+		if ((mem >= m->start) &&
+		    (mem < (void *)((char *)m->start + m->len)))
+			return 1;
+
 	return 0;
 }
 
+void mem_pool_adopt_mmap(struct mem_pool *pool, void *start, size_t len)
+{
+	struct mp_mmap *m = xmalloc(sizeof(*m));
+
+	m->start = start;
+	m->len = len;
+	m->next = pool->mp_mmap;
+	pool->mp_mmap = m;
+}
+
 void mem_pool_combine(struct mem_pool *dst, struct mem_pool *src)
 {
 	struct mp_block *p;
@@ -172,7 +198,16 @@ void mem_pool_combine(struct mem_pool *dst, struct mem_pool *src)
 		/* src is empty, nothing to do. */
 	}
 
+	if (src->mp_mmap) {
+		struct mp_mmap **tail = &dst->mp_mmap;
+
+		while (*tail)
+			tail = &(*tail)->next;
+		*tail = src->mp_mmap;
+	}
+
 	dst->pool_alloc += src->pool_alloc;
 	src->pool_alloc = 0;
 	src->mp_block = NULL;
+	src->mp_mmap = NULL;
 }
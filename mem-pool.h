@@ -8,6 +8,16 @@ struct mp_block {
 	uintmax_t space[FLEX_ARRAY]; /* more */
 };
 
+/*
+ * A region of a file mapped with xmmap() whose lifetime is tied to
+ * the pool, see mem_pool_adopt_mmap().
+ */
+struct mp_mmap {
+	struct mp_mmap *next;
+	void *start;
+	size_t len;
+};
+
 struct mem_pool {
 	struct mp_block *mp_block;
 
@@ -19,6 +29,9 @@ struct mem_pool {
 
 	/* The total amount of memory allocated by the pool. */
 	size_t pool_alloc;
+
+	/* File mappings the pool is responsible for. */
+	struct mp_mmap *mp_mmap;
 };
 
 /*
@@ -60,4 +73,12 @@ void mem_pool_combine(struct mem_pool *dst, struct mem_pool *src);
  */
 int mem_pool_contains(struct mem_pool *pool, void *mem);
 
+/*
+ * Make the pool responsible for the 'len' bytes mapped at 'start' by
+ * xmmap(). The memory is considered part of the pool by
+ * `mem_pool_contains`, moves with it in `mem_pool_combine`, and is
+ * unmapped by `mem_pool_discard`.
+ */
+void mem_pool_adopt_mmap(struct mem_pool *pool, void *start, size_t len);
+
 #endif
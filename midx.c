@@ -41,6 +41,14 @@
 
 #define PACK_EXPIRED UINT_MAX
 
+/*
+ * When writing an incremental multi-pack-index, fold the top-most layer
+ * of the existing chain into the new one for as long as the new layer
+ * would cover at least 1/MIDX_SPLIT_SIZE_MULTIPLE as many objects as
+ * that layer, so that the chain stays logarithmic in length.
+ */
+#define MIDX_SPLIT_SIZE_MULTIPLE 2
+
 const unsigned char *get_midx_checksum(struct multi_pack_index *m)
 {
 	return m->data + m->data_len - the_hash_algo->rawsz;
@@ -57,6 +65,24 @@ void get_midx_rev_filename(struct strbuf *out, struct multi_pack_index *m)
 	strbuf_addf(out, "-%s.rev", hash_to_hex(get_midx_checksum(m)));
 }
 
+void get_midx_chain_dirname(struct strbuf *out, const char *object_dir)
+{
+	strbuf_addf(out, "%s/pack/multi-pack-index.d", object_dir);
+}
+
+void get_midx_chain_filename(struct strbuf *out, const char *object_dir)
+{
+	get_midx_chain_dirname(out, object_dir);
+	strbuf_addstr(out, "/multi-pack-index-chain");
+}
+
+void get_split_midx_filename(struct strbuf *out, const char *object_dir,
+			     const char *hash)
+{
+	get_midx_chain_dirname(out, object_dir);
+	strbuf_addf(out, "/multi-pack-index-%s.midx", hash);
+}
+
 static int midx_read_oid_fanout(const unsigned char *chunk_start,
 				size_t chunk_size, void *data)
 {
@@ -70,7 +96,9 @@ static int midx_read_oid_fanout(const unsigned char *chunk_start,
 	return 0;
 }
 
-struct multi_pack_index *load_multi_pack_index(const char *object_dir, int local)
+static struct multi_pack_index *load_multi_pack_index_one(const char *object_dir,
+							 const char *midx_name,
+							 int local)
 {
 	struct multi_pack_index *m = NULL;
 	int fd;
@@ -78,31 +106,26 @@ struct multi_pack_index *load_multi_pack_index(const char *object_dir, int local
 	size_t midx_size;
 	void *midx_map = NULL;
 	uint32_t hash_version;
-	struct strbuf midx_name = STRBUF_INIT;
 	uint32_t i;
 	const char *cur_pack_name;
 	struct chunkfile *cf = NULL;
 
-	get_midx_filename(&midx_name, object_dir);
-
-	fd = git_open(midx_name.buf);
+	fd = git_open(midx_name);
 
 	if (fd < 0)
 		goto cleanup_fail;
 	if (fstat(fd, &st)) {
-		error_errno(_("failed to read %s"), midx_name.buf);
+		error_errno(_("failed to read %s"), midx_name);
 		goto cleanup_fail;
 	}
 
 	midx_size = xsize_t(st.st_size);
 
 	if (midx_size < MIDX_MIN_SIZE) {
-		error(_("multi-pack-index file %s is too small"), midx_name.buf);
+		error(_("multi-pack-index file %s is too small"), midx_name);
 		goto cleanup_fail;
 	}
 
-	strbuf_release(&midx_name);
-
 	midx_map = xmmap(NULL, midx_size, PROT_READ, MAP_PRIVATE, fd, 0);
 	close(fd);
 
@@ -178,7 +201,6 @@ struct multi_pack_index *load_multi_pack_index(const char *object_dir, int local
 
 cleanup_fail:
 	free(m);
-	strbuf_release(&midx_name);
 	free_chunkfile(cf);
 	if (midx_map)
 		munmap(midx_map, midx_size);
@@ -187,6 +209,76 @@ struct multi_pack_index *load_multi_pack_index(const char *object_dir, int local
 	return NULL;
 }
 
+/*
+ * Read the layers named in "multi-pack-index-chain", bottom-most first.
+ * A layer whose trailing checksum does not match its name in the chain
+ * ends the chain; the layers below it are still usable on their own.
+ */
+static struct multi_pack_index *load_multi_pack_index_chain(const char *object_dir,
+							   int local)
+{
+	struct multi_pack_index *chain = NULL;
+	struct strbuf chain_name = STRBUF_INIT;
+	struct strbuf layer_name = STRBUF_INIT;
+	struct strbuf line = STRBUF_INIT;
+	FILE *fp;
+
+	get_midx_chain_filename(&chain_name, object_dir);
+	fp = fopen(chain_name.buf, "r");
+	if (!fp)
+		goto cleanup;
+
+	while (strbuf_getline_lf(&line, fp) != EOF) {
+		struct multi_pack_index *m;
+		struct object_id oid;
+
+		if (get_oid_hex(line.buf, &oid)) {
+			warning(_("invalid multi-pack-index chain: line '%s' not a hash"),
+				line.buf);
+			break;
+		}
+
+		strbuf_reset(&layer_name);
+		get_split_midx_filename(&layer_name, object_dir, line.buf);
+		m = load_multi_pack_index_one(object_dir, layer_name.buf, local);
+		if (!m || !hasheq(get_midx_checksum(m), oid.hash)) {
+			warning(_("unable to find all multi-pack-index layers"));
+			close_midx(m);
+			break;
+		}
+
+		if (chain) {
+			m->base_midx = chain;
+			m->num_objects_in_base = chain->num_objects_in_base +
+						 chain->num_objects;
+			m->num_packs_in_base = chain->num_packs_in_base +
+					       chain->num_packs;
+		}
+		chain = m;
+	}
+
+	fclose(fp);
+cleanup:
+	strbuf_release(&chain_name);
+	strbuf_release(&layer_name);
+	strbuf_release(&line);
+	return chain;
+}
+
+struct multi_pack_index *load_multi_pack_index(const char *object_dir, int local)
+{
+	struct strbuf midx_name = STRBUF_INIT;
+	struct multi_pack_index *m;
+
+	get_midx_filename(&midx_name, object_dir);
+	m = load_multi_pack_index_one(object_dir, midx_name.buf, local);
+	strbuf_release(&midx_name);
+
+	if (!m)
+		m = load_multi_pack_index_chain(object_dir, local);
+	return m;
+}
+
 void close_midx(struct multi_pack_index *m)
 {
 	uint32_t i;
@@ -195,6 +287,7 @@ void close_midx(struct multi_pack_index *m)
 		return;
 
 	close_midx(m->next);
+	close_midx(m->base_midx);
 
 	munmap((unsigned char *)m->data, m->data_len);
 
@@ -207,14 +300,38 @@ void close_midx(struct multi_pack_index *m)
 	free(m);
 }
 
+/*
+ * Find the layer of "m" holding the object at global position "*pos" (or
+ * the pack with global pack-int-id "*pos"), and make "*pos" local to it.
+ */
+static struct multi_pack_index *midx_for_object(struct multi_pack_index *m,
+						uint32_t *pos)
+{
+	while (m->base_midx && *pos < m->num_objects_in_base)
+		m = m->base_midx;
+	*pos -= m->num_objects_in_base;
+	return m;
+}
+
+static struct multi_pack_index *midx_for_pack(struct multi_pack_index *m,
+					      uint32_t *pack_int_id)
+{
+	while (m->base_midx && *pack_int_id < m->num_packs_in_base)
+		m = m->base_midx;
+	*pack_int_id -= m->num_packs_in_base;
+	return m;
+}
+
 int prepare_midx_pack(struct repository *r, struct multi_pack_index *m, uint32_t pack_int_id)
 {
 	struct strbuf pack_name = STRBUF_INIT;
 	struct packed_git *p;
 
-	if (pack_int_id >= m->num_packs)
+	if (pack_int_id >= m->num_packs_in_base + m->num_packs)
 		die(_("bad pack-int-id: %u (%u total packs)"),
-		    pack_int_id, m->num_packs);
+		    pack_int_id, m->num_packs_in_base + m->num_packs);
+
+	m = midx_for_pack(m, &pack_int_id);
 
 	if (m->packs[pack_int_id])
 		return 0;
@@ -236,19 +353,47 @@ int prepare_midx_pack(struct repository *r, struct multi_pack_index *m, uint32_t
 	return 0;
 }
 
+struct packed_git *nth_midxed_pack(struct multi_pack_index *m,
+				   uint32_t pack_int_id)
+{
+	m = midx_for_pack(m, &pack_int_id);
+	return m->packs[pack_int_id];
+}
+
+/*
+ * Search only the top-most layer of "m"; "result" is still a global
+ * position, both when "oid" is found and when it is not (in which case
+ * it is where "oid" would be inserted into that layer).
+ */
+int bsearch_one_midx(const struct object_id *oid, struct multi_pack_index *m,
+		     uint32_t *result)
+{
+	uint32_t pos;
+	int ret = bsearch_hash(oid->hash, m->chunk_oid_fanout,
+			       m->chunk_oid_lookup, the_hash_algo->rawsz,
+			       &pos);
+
+	if (result)
+		*result = pos + m->num_objects_in_base;
+	return ret;
+}
+
 int bsearch_midx(const struct object_id *oid, struct multi_pack_index *m, uint32_t *result)
 {
-	return bsearch_hash(oid->hash, m->chunk_oid_fanout, m->chunk_oid_lookup,
-			    the_hash_algo->rawsz, result);
+	for (; m; m = m->base_midx)
+		if (bsearch_one_midx(oid, m, result))
+			return 1;
+	return 0;
 }
 
 struct object_id *nth_midxed_object_oid(struct object_id *oid,
 					struct multi_pack_index *m,
 					uint32_t n)
 {
-	if (n >= m->num_objects)
+	if (n >= m->num_objects_in_base + m->num_objects)
 		return NULL;
 
+	m = midx_for_object(m, &n);
 	oidread(oid, m->chunk_oid_lookup + m->hash_len * n);
 	return oid;
 }
@@ -258,6 +403,7 @@ off_t nth_midxed_offset(struct multi_pack_index *m, uint32_t pos)
 	const unsigned char *offset_data;
 	uint32_t offset32;
 
+	m = midx_for_object(m, &pos);
 	offset_data = m->chunk_object_offsets + (off_t)pos * MIDX_CHUNK_OFFSET_WIDTH;
 	offset32 = get_be32(offset_data + sizeof(uint32_t));
 
@@ -274,8 +420,10 @@ off_t nth_midxed_offset(struct multi_pack_index *m, uint32_t pos)
 
 uint32_t nth_midxed_pack_int_id(struct multi_pack_index *m, uint32_t pos)
 {
+	m = midx_for_object(m, &pos);
 	return get_be32(m->chunk_object_offsets +
-			(off_t)pos * MIDX_CHUNK_OFFSET_WIDTH);
+			(off_t)pos * MIDX_CHUNK_OFFSET_WIDTH) +
+	       m->num_packs_in_base;
 }
 
 int fill_midx_entry(struct repository * r,
@@ -290,14 +438,14 @@ int fill_midx_entry(struct repository * r,
 	if (!bsearch_midx(oid, m, &pos))
 		return 0;
 
-	if (pos >= m->num_objects)
+	if (pos >= m->num_objects_in_base + m->num_objects)
 		return 0;
 
 	pack_int_id = nth_midxed_pack_int_id(m, pos);
 
 	if (prepare_midx_pack(r, m, pack_int_id))
 		return 0;
-	p = m->packs[pack_int_id];
+	p = nth_midxed_pack(m, pack_int_id);
 
 	/*
 	* We are about to tell the caller where they can locate the
@@ -351,7 +499,8 @@ static int cmp_idx_or_pack_name(const char *idx_or_pack_name,
 	return strcmp(idx_or_pack_name, idx_name);
 }
 
-int midx_contains_pack(struct multi_pack_index *m, const char *idx_or_pack_name)
+static int midx_contains_pack_one(struct multi_pack_index *m,
+				  const char *idx_or_pack_name)
 {
 	uint32_t first = 0, last = m->num_packs;
 
@@ -374,6 +523,14 @@ int midx_contains_pack(struct multi_pack_index *m, const char *idx_or_pack_name)
 	return 0;
 }
 
+int midx_contains_pack(struct multi_pack_index *m, const char *idx_or_pack_name)
+{
+	for (; m; m = m->base_midx)
+		if (midx_contains_pack_one(m, idx_or_pack_name))
+			return 1;
+	return 0;
+}
+
 int prepare_multi_pack_index_one(struct repository *r, const char *object_dir, int local)
 {
 	struct multi_pack_index *m;
@@ -443,6 +600,7 @@ struct write_midx_context {
 	uint32_t nr;
 	uint32_t alloc;
 	struct multi_pack_index *m;
+	struct multi_pack_index *base;
 	struct progress *progress;
 	unsigned pack_paths_checked;
 
@@ -459,6 +617,34 @@ struct write_midx_context {
 	struct string_list *to_include;
 };
 
+static void add_pack_info(struct write_midx_context *ctx,
+			  const char *full_path, size_t full_path_len,
+			  const char *file_name)
+{
+	ALLOC_GROW(ctx->info, ctx->nr + 1, ctx->alloc);
+
+	ctx->info[ctx->nr].p = add_packed_git(full_path, full_path_len, 0);
+
+	if (!ctx->info[ctx->nr].p) {
+		warning(_("failed to add packfile '%s'"),
+			full_path);
+		return;
+	}
+
+	if (open_pack_index(ctx->info[ctx->nr].p)) {
+		warning(_("failed to open pack-index '%s'"),
+			full_path);
+		close_pack(ctx->info[ctx->nr].p);
+		FREE_AND_NULL(ctx->info[ctx->nr].p);
+		return;
+	}
+
+	ctx->info[ctx->nr].pack_name = xstrdup(file_name);
+	ctx->info[ctx->nr].orig_pack_int_id = ctx->nr;
+	ctx->info[ctx->nr].expired = 0;
+	ctx->nr++;
+}
+
 static void add_pack_to_midx(const char *full_path, size_t full_path_len,
 			     const char *file_name, void *data)
 {
@@ -486,32 +672,125 @@ static void add_pack_to_midx(const char *full_path, size_t full_path_len,
 		else if (ctx->to_include &&
 			 !string_list_has_string(ctx->to_include, file_name))
 			return;
+		else if (ctx->base && midx_contains_pack(ctx->base, file_name))
+			return;
+
+		add_pack_info(ctx, full_path, full_path_len, file_name);
+	}
+}
 
-		ALLOC_GROW(ctx->info, ctx->nr + 1, ctx->alloc);
+/*
+ * Pick the layers of ctx->base to fold into the incremental layer being
+ * written, and add their packs to it. Afterwards, ctx->base is the
+ * layer the new one will be written on top of, if any.
+ */
+static void fold_midx_layers(struct write_midx_context *ctx,
+			     const char *object_dir)
+{
+	struct strbuf pack_name = STRBUF_INIT;
+	uint64_t nr_objects = 0;
+	uint32_t i;
 
-		ctx->info[ctx->nr].p = add_packed_git(full_path,
-						      full_path_len,
-						      0);
+	for (i = 0; i < ctx->nr; i++)
+		nr_objects += ctx->info[i].p->num_objects;
 
-		if (!ctx->info[ctx->nr].p) {
-			warning(_("failed to add packfile '%s'"),
-				full_path);
-			return;
-		}
+	while (ctx->base &&
+	       nr_objects * MIDX_SPLIT_SIZE_MULTIPLE >= ctx->base->num_objects) {
+		struct multi_pack_index *m = ctx->base;
 
-		if (open_pack_index(ctx->info[ctx->nr].p)) {
-			warning(_("failed to open pack-index '%s'"),
-				full_path);
-			close_pack(ctx->info[ctx->nr].p);
-			FREE_AND_NULL(ctx->info[ctx->nr].p);
-			return;
+		for (i = 0; i < m->num_packs; i++) {
+			strbuf_reset(&pack_name);
+			strbuf_addf(&pack_name, "%s/pack/%s", object_dir,
+				    m->pack_names[i]);
+			add_pack_info(ctx, pack_name.buf, pack_name.len,
+				      m->pack_names[i]);
 		}
 
-		ctx->info[ctx->nr].pack_name = xstrdup(file_name);
-		ctx->info[ctx->nr].orig_pack_int_id = ctx->nr;
-		ctx->info[ctx->nr].expired = 0;
-		ctx->nr++;
+		nr_objects += m->num_objects;
+		ctx->base = m->base_midx;
+	}
+
+	strbuf_release(&pack_name);
+}
+
+/* Print the checksums of "m" and its base layers, bottom-most first. */
+static void write_midx_chain_hashes(FILE *fp, struct multi_pack_index *m)
+{
+	if (!m)
+		return;
+	write_midx_chain_hashes(fp, m->base_midx);
+	fprintf(fp, "%s\n", hash_to_hex(get_midx_checksum(m)));
+}
+
+static void add_midx_layer_names(struct string_list *names,
+				 struct multi_pack_index *m)
+{
+	struct strbuf name = STRBUF_INIT;
+
+	for (; m; m = m->base_midx) {
+		strbuf_reset(&name);
+		strbuf_addf(&name, "multi-pack-index-%s.midx",
+			    hash_to_hex(get_midx_checksum(m)));
+		string_list_insert(names, name.buf);
 	}
+	strbuf_release(&name);
+}
+
+/*
+ * Remove the layers of an incremental multi-pack-index that are not
+ * listed in "keep", along with the chain itself when "keep" is NULL.
+ */
+static void clear_midx_chain(const char *object_dir, struct string_list *keep)
+{
+	struct strbuf path = STRBUF_INIT;
+	struct dirent *de;
+	size_t dirlen;
+	DIR *dir;
+
+	get_midx_chain_dirname(&path, object_dir);
+	dir = opendir(path.buf);
+	if (!dir)
+		goto cleanup;
+
+	strbuf_addch(&path, '/');
+	dirlen = path.len;
+	while ((de = readdir_skip_dot_and_dotdot(dir))) {
+		if (!starts_with(de->d_name, "multi-pack-index-") ||
+		    !ends_with(de->d_name, ".midx"))
+			continue;
+		if (keep && string_list_has_string(keep, de->d_name))
+			continue;
+
+		strbuf_setlen(&path, dirlen);
+		strbuf_addstr(&path, de->d_name);
+		if (unlink(path.buf) && errno != ENOENT)
+			warning_errno(_("failed to remove %s"), path.buf);
+	}
+	closedir(dir);
+
+	if (!keep) {
+		strbuf_setlen(&path, dirlen);
+		strbuf_addstr(&path, "multi-pack-index-chain");
+		if (unlink(path.buf) && errno != ENOENT)
+			die_errno(_("failed to remove %s"), path.buf);
+
+		strbuf_setlen(&path, dirlen - 1);
+		rmdir(path.buf);
+	}
+
+cleanup:
+	strbuf_release(&path);
+}
+
+static int midx_chain_exists(const char *object_dir)
+{
+	struct strbuf chain_name = STRBUF_INIT;
+	int ret;
+
+	get_midx_chain_filename(&chain_name, object_dir);
+	ret = file_exists(chain_name.buf);
+	strbuf_release(&chain_name);
+	return ret;
 }
 
 struct pack_midx_entry {
@@ -1072,6 +1351,9 @@ static int write_midx_bitmap(char *midx_name, unsigned char *midx_hash,
 	if (flags & MIDX_WRITE_BITMAP_HASH_CACHE)
 		options |= BITMAP_OPT_HASH_CACHE;
 
+	if (flags & MIDX_WRITE_BITMAP_LOOKUP_TABLE)
+		options |= BITMAP_OPT_LOOKUP_TABLE;
+
 	prepare_midx_packing_data(&pdata, ctx);
 
 	commits = find_commits_for_midx_bitmap(&commits_nr, refs_snapshot, ctx);
@@ -1154,23 +1436,47 @@ static int write_midx_internal(const char *object_dir,
 	unsigned char midx_hash[GIT_MAX_RAWSZ];
 	uint32_t i;
 	struct hashfile *f = NULL;
-	struct lock_file lk;
+	struct lock_file lk = LOCK_INIT;
+	struct tempfile *layer = NULL;
 	struct write_midx_context ctx = { 0 };
+	struct multi_pack_index *chain = NULL;
+	int incremental = flags & MIDX_WRITE_INCREMENTAL;
+	int had_chain = midx_chain_exists(object_dir);
 	int pack_name_concat_len = 0;
 	int dropped_packs = 0;
 	int result = 0;
 	struct chunkfile *cf;
 
-	get_midx_filename(&midx_name, object_dir);
+	if (incremental) {
+		if (flags & MIDX_WRITE_BITMAP)
+			BUG("cannot write a bitmap for an incremental multi-pack-index");
+		if (packs_to_include || packs_to_drop)
+			BUG("cannot filter packs of an incremental multi-pack-index");
+		flags &= ~MIDX_WRITE_REV_INDEX;
+
+		get_midx_chain_dirname(&midx_name, object_dir);
+		strbuf_addstr(&midx_name, "/tmp_midx_XXXXXX");
+	} else {
+		get_midx_filename(&midx_name, object_dir);
+	}
 	if (safe_create_leading_directories(midx_name.buf))
 		die_errno(_("unable to create leading directories of %s"),
 			  midx_name.buf);
 
-	if (!packs_to_include) {
+	if (incremental) {
+		/*
+		 * Read the chain afresh rather than using the one in the
+		 * object store, which we may have to close before we are
+		 * done; its layers become the base of the new one.
+		 */
+		chain = load_multi_pack_index_chain(object_dir, 1);
+		ctx.base = chain;
+	} else if (!packs_to_include && !had_chain) {
 		/*
 		 * Only reference an existing MIDX when not filtering which
 		 * packs to include, since all packs and objects are copied
-		 * blindly from an existing MIDX if one is present.
+		 * blindly from an existing MIDX if one is present. An
+		 * incremental MIDX is instead rewritten from its packs.
 		 */
 		ctx.m = lookup_multi_pack_index(the_repository, object_dir);
 	}
@@ -1227,6 +1533,12 @@ static int write_midx_internal(const char *object_dir,
 	for_each_file_in_pack_dir(object_dir, add_pack_to_midx, &ctx);
 	stop_progress(&ctx.progress);
 
+	if (incremental) {
+		if (!ctx.nr && chain)
+			goto cleanup; /* every pack is in a layer already */
+		fold_midx_layers(&ctx, object_dir);
+	}
+
 	if ((ctx.m && ctx.nr == ctx.m->num_packs) &&
 	    !(packs_to_include || packs_to_drop)) {
 		struct bitmap_index *bitmap_git;
@@ -1316,6 +1628,16 @@ static int write_midx_internal(const char *object_dir,
 	ctx.entries = get_sorted_entries(ctx.m, ctx.info, ctx.nr, &ctx.entries_nr,
 					 ctx.preferred_pack_idx);
 
+	if (ctx.base) {
+		uint32_t nr = 0;
+
+		/* Objects already in a lower layer are found there. */
+		for (i = 0; i < ctx.entries_nr; i++)
+			if (!bsearch_midx(&ctx.entries[i].oid, ctx.base, NULL))
+				ctx.entries[nr++] = ctx.entries[i];
+		ctx.entries_nr = nr;
+	}
+
 	ctx.large_offsets_needed = 0;
 	for (i = 0; i < ctx.entries_nr; i++) {
 		if (ctx.entries[i].offset > 0x7fffffff)
@@ -1393,8 +1715,30 @@ static int write_midx_internal(const char *object_dir,
 		pack_name_concat_len += MIDX_CHUNK_ALIGNMENT -
 					(pack_name_concat_len % MIDX_CHUNK_ALIGNMENT);
 
-	hold_lock_file_for_update(&lk, midx_name.buf, LOCK_DIE_ON_ERROR);
-	f = hashfd(get_lock_file_fd(&lk), get_lock_file_path(&lk));
+	if (incremental) {
+		struct strbuf chain_name = STRBUF_INIT;
+
+		get_midx_chain_filename(&chain_name, object_dir);
+		hold_lock_file_for_update(&lk, chain_name.buf, LOCK_DIE_ON_ERROR);
+		strbuf_release(&chain_name);
+
+		layer = mks_tempfile_m(midx_name.buf, 0444);
+		if (!layer) {
+			error_errno(_("unable to create temporary multi-pack-index layer"));
+			result = 1;
+			goto cleanup;
+		}
+		if (adjust_shared_perm(get_tempfile_path(layer))) {
+			error(_("unable to adjust shared permissions for '%s'"),
+			      get_tempfile_path(layer));
+			result = 1;
+			goto cleanup;
+		}
+		f = hashfd(get_tempfile_fd(layer), get_tempfile_path(layer));
+	} else {
+		hold_lock_file_for_update(&lk, midx_name.buf, LOCK_DIE_ON_ERROR);
+		f = hashfd(get_lock_file_fd(&lk), get_lock_file_path(&lk));
+	}
 
 	if (ctx.nr - dropped_packs == 0) {
 		error(_("no pack files to index."));
@@ -1452,16 +1796,62 @@ static int write_midx_internal(const char *object_dir,
 		}
 	}
 
-	if (ctx.m)
+	if (ctx.m || had_chain || incremental)
 		close_object_store(the_repository->objects);
 
-	if (commit_lock_file(&lk) < 0)
-		die_errno(_("could not write multi-pack-index"));
+	if (incremental) {
+		struct string_list keep = STRING_LIST_INIT_DUP;
+		struct strbuf final_name = STRBUF_INIT;
+		FILE *chainf = fdopen_lock_file(&lk, "w");
+
+		if (!chainf)
+			die_errno(_("unable to open multi-pack-index chain file"));
 
-	clear_midx_files_ext(object_dir, ".bitmap", midx_hash);
-	clear_midx_files_ext(object_dir, ".rev", midx_hash);
+		get_split_midx_filename(&final_name, object_dir,
+					hash_to_hex(midx_hash));
+		if (rename_tempfile(&layer, final_name.buf) < 0)
+			die_errno(_("unable to rename temporary multi-pack-index layer"));
+		strbuf_release(&final_name);
+
+		write_midx_chain_hashes(chainf, ctx.base);
+		fprintf(chainf, "%s\n", hash_to_hex(midx_hash));
+		if (commit_lock_file(&lk) < 0)
+			die_errno(_("could not write multi-pack-index chain"));
+
+		/*
+		 * The packs of a non-incremental MIDX are now covered by
+		 * the chain (see load_multi_pack_index()), as are those of
+		 * the layers we folded into the new one.
+		 */
+		strbuf_reset(&midx_name);
+		get_midx_filename(&midx_name, object_dir);
+		if (unlink(midx_name.buf) && errno != ENOENT)
+			die_errno(_("failed to remove %s"), midx_name.buf);
+		clear_midx_files_ext(object_dir, ".bitmap", NULL);
+		clear_midx_files_ext(object_dir, ".rev", NULL);
+
+		add_midx_layer_names(&keep, ctx.base);
+		strbuf_reset(&final_name);
+		strbuf_addf(&final_name, "multi-pack-index-%s.midx",
+			    hash_to_hex(midx_hash));
+		string_list_insert(&keep, final_name.buf);
+		strbuf_release(&final_name);
+		clear_midx_chain(object_dir, &keep);
+		string_list_clear(&keep, 0);
+	} else {
+		if (commit_lock_file(&lk) < 0)
+			die_errno(_("could not write multi-pack-index"));
+
+		clear_midx_files_ext(object_dir, ".bitmap", midx_hash);
+		clear_midx_files_ext(object_dir, ".rev", midx_hash);
+		if (had_chain)
+			clear_midx_chain(object_dir, NULL);
+	}
 
 cleanup:
+	rollback_lock_file(&lk);
+	delete_tempfile(&layer);
+	close_midx(chain);
 	for (i = 0; i < ctx.nr; i++) {
 		if (ctx.info[i].p) {
 			close_pack(ctx.info[i].p);
@@ -1552,6 +1942,7 @@ void clear_midx_file(struct repository *r)
 
 	clear_midx_files_ext(r->objects->odb->path, ".bitmap", NULL);
 	clear_midx_files_ext(r->objects->odb->path, ".rev", NULL);
+	clear_midx_chain(r->objects->odb->path, NULL);
 
 	strbuf_release(&midx);
 }
@@ -1598,9 +1989,10 @@ static int compare_pair_pos_vs_id(const void *_a, const void *_b)
 int verify_midx_file(struct repository *r, const char *object_dir, unsigned flags)
 {
 	struct pair_pos_vs_id *pairs = NULL;
-	uint32_t i;
+	uint32_t i, num_packs, num_objects;
 	struct progress *progress = NULL;
 	struct multi_pack_index *m = load_multi_pack_index(object_dir, 1);
+	struct multi_pack_index *layer;
 	verify_midx_error = 0;
 
 	if (!m) {
@@ -1614,17 +2006,27 @@ int verify_midx_file(struct repository *r, const char *object_dir, unsigned flag
 			error(_("multi-pack-index file exists, but failed to parse"));
 			result = 1;
 		}
+		strbuf_reset(&filename);
+		get_midx_chain_filename(&filename, object_dir);
+		if (!result && !stat(filename.buf, &sb)) {
+			error(_("multi-pack-index chain exists, but failed to parse"));
+			result = 1;
+		}
 		strbuf_release(&filename);
 		return result;
 	}
 
-	if (!midx_checksum_valid(m))
-		midx_report(_("incorrect checksum"));
+	num_packs = m->num_packs_in_base + m->num_packs;
+	num_objects = m->num_objects_in_base + m->num_objects;
+
+	for (layer = m; layer; layer = layer->base_midx)
+		if (!midx_checksum_valid(layer))
+			midx_report(_("incorrect checksum"));
 
 	if (flags & MIDX_PROGRESS)
 		progress = start_delayed_progress(_("Looking for referenced packfiles"),
-					  m->num_packs);
-	for (i = 0; i < m->num_packs; i++) {
+					  num_packs);
+	for (i = 0; i < num_packs; i++) {
 		if (prepare_midx_pack(r, m, i))
 			midx_report("failed to load pack in position %d", i);
 
@@ -1632,16 +2034,18 @@ int verify_midx_file(struct repository *r, const char *object_dir, unsigned flag
 	}
 	stop_progress(&progress);
 
-	for (i = 0; i < 255; i++) {
-		uint32_t oid_fanout1 = ntohl(m->chunk_oid_fanout[i]);
-		uint32_t oid_fanout2 = ntohl(m->chunk_oid_fanout[i + 1]);
+	for (layer = m; layer; layer = layer->base_midx) {
+		for (i = 0; i < 255; i++) {
+			uint32_t oid_fanout1 = ntohl(layer->chunk_oid_fanout[i]);
+			uint32_t oid_fanout2 = ntohl(layer->chunk_oid_fanout[i + 1]);
 
-		if (oid_fanout1 > oid_fanout2)
-			midx_report(_("oid fanout out of order: fanout[%d] = %"PRIx32" > %"PRIx32" = fanout[%d]"),
-				    i, oid_fanout1, oid_fanout2, i + 1);
+			if (oid_fanout1 > oid_fanout2)
+				midx_report(_("oid fanout out of order: fanout[%d] = %"PRIx32" > %"PRIx32" = fanout[%d]"),
+					    i, oid_fanout1, oid_fanout2, i + 1);
+		}
 	}
 
-	if (m->num_objects == 0) {
+	if (num_objects == 0) {
 		midx_report(_("the midx contains no oid"));
 		/*
 		 * Remaining tests assume that we have objects, so we can
@@ -1652,18 +2056,25 @@ int verify_midx_file(struct repository *r, const char *object_dir, unsigned flag
 
 	if (flags & MIDX_PROGRESS)
 		progress = start_sparse_progress(_("Verifying OID order in multi-pack-index"),
-						 m->num_objects - 1);
-	for (i = 0; i < m->num_objects - 1; i++) {
+						 num_objects - 1);
+	for (i = 0; i < num_objects - 1; i++) {
 		struct object_id oid1, oid2;
 
+		midx_display_sparse_progress(progress, i + 1);
+
+		/* Each layer is sorted on its own. */
+		for (layer = m; layer; layer = layer->base_midx)
+			if (i + 1 == layer->num_objects_in_base)
+				break;
+		if (layer)
+			continue;
+
 		nth_midxed_object_oid(&oid1, m, i);
 		nth_midxed_object_oid(&oid2, m, i + 1);
 
 		if (oidcmp(&oid1, &oid2) >= 0)
 			midx_report(_("oid lookup out of order: oid[%d] = %s >= %s = oid[%d]"),
 				    i, oid_to_hex(&oid1), oid_to_hex(&oid2), i + 1);
-
-		midx_display_sparse_progress(progress, i + 1);
 	}
 	stop_progress(&progress);
 
@@ -1673,31 +2084,31 @@ int verify_midx_file(struct repository *r, const char *object_dir, unsigned flag
 	 * each of the objects and only require 1 packfile to be open at a
 	 * time.
 	 */
-	ALLOC_ARRAY(pairs, m->num_objects);
-	for (i = 0; i < m->num_objects; i++) {
+	ALLOC_ARRAY(pairs, num_objects);
+	for (i = 0; i < num_objects; i++) {
 		pairs[i].pos = i;
 		pairs[i].pack_int_id = nth_midxed_pack_int_id(m, i);
 	}
 
 	if (flags & MIDX_PROGRESS)
 		progress = start_sparse_progress(_("Sorting objects by packfile"),
-						 m->num_objects);
+						 num_objects);
 	display_progress(progress, 0); /* TODO: Measure QSORT() progress */
-	QSORT(pairs, m->num_objects, compare_pair_pos_vs_id);
+	QSORT(pairs, num_objects, compare_pair_pos_vs_id);
 	stop_progress(&progress);
 
 	if (flags & MIDX_PROGRESS)
-		progress = start_sparse_progress(_("Verifying object offsets"), m->num_objects);
-	for (i = 0; i < m->num_objects; i++) {
+		progress = start_sparse_progress(_("Verifying object offsets"), num_objects);
+	for (i = 0; i < num_objects; i++) {
 		struct object_id oid;
 		struct pack_entry e;
 		off_t m_offset, p_offset;
 
 		if (i > 0 && pairs[i-1].pack_int_id != pairs[i].pack_int_id &&
-		    m->packs[pairs[i-1].pack_int_id])
+		    nth_midxed_pack(m, pairs[i-1].pack_int_id))
 		{
-			close_pack_fd(m->packs[pairs[i-1].pack_int_id]);
-			close_pack_index(m->packs[pairs[i-1].pack_int_id]);
+			close_pack_fd(nth_midxed_pack(m, pairs[i-1].pack_int_id));
+			close_pack_index(nth_midxed_pack(m, pairs[i-1].pack_int_id));
 		}
 
 		nth_midxed_object_oid(&oid, m, pairs[i].pos);
@@ -1741,6 +2152,8 @@ int expire_midx_packs(struct repository *r, const char *object_dir, unsigned fla
 
 	if (!m)
 		return 0;
+	if (midx_chain_exists(object_dir))
+		return error(_("cannot expire packs from an incremental multi-pack-index"));
 
 	CALLOC_ARRAY(count, m->num_packs);
 
@@ -1913,6 +2326,8 @@ int midx_repack(struct repository *r, const char *object_dir, size_t batch_size,
 
 	if (!m)
 		return 0;
+	if (midx_chain_exists(object_dir))
+		return error(_("cannot repack an incremental multi-pack-index"));
 
 	CALLOC_ARRAY(include_pack, m->num_packs);
 
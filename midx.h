@@ -12,8 +12,20 @@ struct repository;
 #define GIT_TEST_MULTI_PACK_INDEX_WRITE_BITMAP \
 	"GIT_TEST_MULTI_PACK_INDEX_WRITE_BITMAP"
 
+/*
+ * A multi-pack-index is either a single "multi-pack-index" file, or a
+ * chain of layers listed in "multi-pack-index.d/multi-pack-index-chain",
+ * each of which covers only the packs (and objects) that are not
+ * already covered by the layers below it. Only the top-most layer of a
+ * chain appears in the "next" list; object positions and pack-int-ids
+ * passed to the functions below are global across the whole chain,
+ * with those of "base_midx" coming first.
+ */
 struct multi_pack_index {
 	struct multi_pack_index *next;
+	struct multi_pack_index *base_midx;
+	uint32_t num_objects_in_base;
+	uint32_t num_packs_in_base;
 
 	const unsigned char *data;
 	size_t data_len;
@@ -47,14 +59,22 @@ struct multi_pack_index {
 #define MIDX_WRITE_REV_INDEX (1 << 1)
 #define MIDX_WRITE_BITMAP (1 << 2)
 #define MIDX_WRITE_BITMAP_HASH_CACHE (1 << 3)
+#define MIDX_WRITE_BITMAP_LOOKUP_TABLE (1 << 4)
+#define MIDX_WRITE_INCREMENTAL (1 << 5)
 
 const unsigned char *get_midx_checksum(struct multi_pack_index *m);
 void get_midx_filename(struct strbuf *out, const char *object_dir);
 void get_midx_rev_filename(struct strbuf *out, struct multi_pack_index *m);
+void get_midx_chain_dirname(struct strbuf *out, const char *object_dir);
+void get_midx_chain_filename(struct strbuf *out, const char *object_dir);
+void get_split_midx_filename(struct strbuf *out, const char *object_dir,
+			     const char *hash);
 
 struct multi_pack_index *load_multi_pack_index(const char *object_dir, int local);
 int prepare_midx_pack(struct repository *r, struct multi_pack_index *m, uint32_t pack_int_id);
+int bsearch_one_midx(const struct object_id *oid, struct multi_pack_index *m, uint32_t *result);
 int bsearch_midx(const struct object_id *oid, struct multi_pack_index *m, uint32_t *result);
+struct packed_git *nth_midxed_pack(struct multi_pack_index *m, uint32_t pack_int_id);
 off_t nth_midxed_offset(struct multi_pack_index *m, uint32_t pos);
 uint32_t nth_midxed_pack_int_id(struct multi_pack_index *m, uint32_t pos);
 struct object_id *nth_midxed_object_oid(struct object_id *oid,
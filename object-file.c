@@ -31,6 +31,7 @@
 #include "quote.h"
 #include "packfile.h"
 #include "object-store.h"
+#include "loose-index.h"
 #include "promisor-remote.h"
 #include "submodule.h"
 
@@ -1199,7 +1200,10 @@ static int quick_has_loose(struct repository *r,
 
 	prepare_alt_odb(r);
 	for (odb = r->objects->odb; odb; odb = odb->next) {
-		if (oidtree_contains(odb_loose_cache(odb, oid), oid))
+		struct loose_index *li = odb_loose_index(r, odb, oid);
+
+		if (li ? loose_index_contains(li, oid) :
+		    oidtree_contains(odb_loose_cache(odb, oid), oid))
 			return 1;
 	}
 	return 0;
@@ -1505,7 +1509,9 @@ static int loose_object_info(struct repository *r,
 }
 
 int obj_read_use_lock = 0;
+int obj_read_track_wait = 0;
 pthread_mutex_t obj_read_mutex;
+static pthread_key_t obj_read_wait_key;
 
 void enable_obj_read_lock(void)
 {
@@ -1514,6 +1520,12 @@ void enable_obj_read_lock(void)
 
 	obj_read_use_lock = 1;
 	init_recursive_mutex(&obj_read_mutex);
+	setup_delta_base_cache(1);
+
+	if (trace2_is_enabled()) {
+		pthread_key_create(&obj_read_wait_key, NULL);
+		obj_read_track_wait = 1;
+	}
 }
 
 void disable_obj_read_lock(void)
@@ -1523,6 +1535,33 @@ void disable_obj_read_lock(void)
 
 	obj_read_use_lock = 0;
 	pthread_mutex_destroy(&obj_read_mutex);
+	setup_delta_base_cache(0);
+
+	if (obj_read_track_wait) {
+		pthread_key_delete(obj_read_wait_key);
+		obj_read_track_wait = 0;
+	}
+}
+
+void obj_read_lock_track_wait(uint64_t *wait_ns)
+{
+	if (obj_read_track_wait)
+		pthread_setspecific(obj_read_wait_key, wait_ns);
+}
+
+void obj_read_lock_tracked(void)
+{
+	uint64_t *wait_ns = pthread_getspecific(obj_read_wait_key);
+	uint64_t start;
+
+	if (!wait_ns) {
+		pthread_mutex_lock(&obj_read_mutex);
+		return;
+	}
+
+	start = getnanotime();
+	pthread_mutex_lock(&obj_read_mutex);
+	*wait_ns += getnanotime() - start;
 }
 
 int fetch_if_missing = 1;
@@ -2724,6 +2763,7 @@ void odb_clear_loose_cache(struct object_directory *odb)
 	FREE_AND_NULL(odb->loose_objects_cache);
 	memset(&odb->loose_objects_subdir_seen, 0,
 	       sizeof(odb->loose_objects_subdir_seen));
+	odb_clear_loose_index(odb);
 }
 
 static int check_stream_oid(git_zstream *stream,
@@ -14,6 +14,7 @@
 #include "repository.h"
 #include "submodule.h"
 #include "midx.h"
+#include "loose-index.h"
 #include "commit-reach.h"
 #include "date.h"
 
@@ -100,9 +101,17 @@ static void find_short_object_filename(struct disambiguate_state *ds)
 {
 	struct object_directory *odb;
 
-	for (odb = ds->repo->objects->odb; odb && !ds->ambiguous; odb = odb->next)
-		oidtree_each(odb_loose_cache(odb, &ds->bin_pfx),
-				&ds->bin_pfx, ds->len, match_prefix, ds);
+	for (odb = ds->repo->objects->odb; odb && !ds->ambiguous; odb = odb->next) {
+		struct loose_index *li = odb_loose_index(ds->repo, odb,
+							 &ds->bin_pfx);
+
+		if (li)
+			loose_index_each(li, &ds->bin_pfx, ds->len,
+					 match_prefix, ds);
+		else
+			oidtree_each(odb_loose_cache(odb, &ds->bin_pfx),
+				     &ds->bin_pfx, ds->len, match_prefix, ds);
+	}
 }
 
 static int match_hash(unsigned len, const unsigned char *a, const unsigned char *b)
@@ -120,17 +129,17 @@ static int match_hash(unsigned len, const unsigned char *a, const unsigned char
 	return 1;
 }
 
-static void unique_in_midx(struct multi_pack_index *m,
-			   struct disambiguate_state *ds)
+static void unique_in_midx_one(struct multi_pack_index *m,
+			       struct disambiguate_state *ds)
 {
 	uint32_t num, i, first = 0;
 	const struct object_id *current = NULL;
-	num = m->num_objects;
+	num = m->num_objects_in_base + m->num_objects;
 
-	if (!num)
+	if (!m->num_objects)
 		return;
 
-	bsearch_midx(&ds->bin_pfx, m, &first);
+	bsearch_one_midx(&ds->bin_pfx, m, &first);
 
 	/*
 	 * At this point, "first" is the location of the lowest object
@@ -146,6 +155,13 @@ static void unique_in_midx(struct multi_pack_index *m,
 	}
 }
 
+static void unique_in_midx(struct multi_pack_index *m,
+			   struct disambiguate_state *ds)
+{
+	for (; m && !ds->ambiguous; m = m->base_midx)
+		unique_in_midx_one(m, ds);
+}
+
 static void unique_in_pack(struct packed_git *p,
 			   struct disambiguate_state *ds)
 {
@@ -672,8 +688,8 @@ static int repo_extend_abbrev_len(struct repository *r,
 	return extend_abbrev_len(oid, cb_data);
 }
 
-static void find_abbrev_len_for_midx(struct multi_pack_index *m,
-				     struct min_abbrev_data *mad)
+static void find_abbrev_len_for_midx_one(struct multi_pack_index *m,
+					 struct min_abbrev_data *mad)
 {
 	int match = 0;
 	uint32_t num, first = 0;
@@ -683,9 +699,9 @@ static void find_abbrev_len_for_midx(struct multi_pack_index *m,
 	if (!m->num_objects)
 		return;
 
-	num = m->num_objects;
+	num = m->num_objects_in_base + m->num_objects;
 	mad_oid = mad->oid;
-	match = bsearch_midx(mad_oid, m, &first);
+	match = bsearch_one_midx(mad_oid, m, &first);
 
 	/*
 	 * first is now the position in the packfile where we would insert
@@ -701,13 +717,20 @@ static void find_abbrev_len_for_midx(struct multi_pack_index *m,
 		if (nth_midxed_object_oid(&oid, m, first + 1))
 			extend_abbrev_len(&oid, mad);
 	}
-	if (first > 0) {
+	if (first > m->num_objects_in_base) {
 		if (nth_midxed_object_oid(&oid, m, first - 1))
 			extend_abbrev_len(&oid, mad);
 	}
 	mad->init_len = mad->cur_len;
 }
 
+static void find_abbrev_len_for_midx(struct multi_pack_index *m,
+				     struct min_abbrev_data *mad)
+{
+	for (; m; m = m->base_midx)
+		find_abbrev_len_for_midx_one(m, mad);
+}
+
 static void find_abbrev_len_for_pack(struct packed_git *p,
 				     struct min_abbrev_data *mad)
 {
@@ -12,6 +12,8 @@
 #include "oidtree.h"
 #include "oidset.h"
 
+struct loose_index;
+
 struct object_directory {
 	struct object_directory *next;
 
@@ -27,6 +29,12 @@ struct object_directory {
 	uint32_t loose_objects_subdir_seen[8]; /* 256 bits */
 	struct oidtree *loose_objects_cache;
 
+	/*
+	 * Used instead of the above with core.looseObjectIndex, one entry
+	 * per fan-out directory, loaded lazily (see loose-index.h).
+	 */
+	struct loose_index **loose_index;
+
 	/*
 	 * This is a temporary object store created by the tmp_objdir
 	 * facility. Disable ref updates since the objects in the store
@@ -374,12 +382,27 @@ void assert_oid_type(const struct object_id *oid, enum object_type expect);
 void enable_obj_read_lock(void);
 void disable_obj_read_lock(void);
 
+/*
+ * Make obj_read_lock() add the time the calling thread spends waiting for
+ * the lock to "*wait_ns", until called again with NULL. This only has an
+ * effect if trace2 was enabled when enable_obj_read_lock() was called, so
+ * that the lock does not have to consult the clock otherwise.
+ */
+void obj_read_lock_track_wait(uint64_t *wait_ns);
+
 extern int obj_read_use_lock;
+extern int obj_read_track_wait;
 extern pthread_mutex_t obj_read_mutex;
 
+void obj_read_lock_tracked(void);
+
 static inline void obj_read_lock(void)
 {
-	if(obj_read_use_lock)
+	if (!obj_read_use_lock)
+		return;
+	if (obj_read_track_wait)
+		obj_read_lock_tracked();
+	else
 		pthread_mutex_lock(&obj_read_mutex);
 }
 
@@ -547,4 +570,28 @@ int for_each_object_in_pack(struct packed_git *p,
 int for_each_packed_object(each_packed_object_fn, void *,
 			   enum for_each_object_flags flags);
 
+/*
+ * Visit the objects of "p" together with their contents, in an order in
+ * which every object is inflated and every delta applied only once: the
+ * objects which are not deltas come in pack order, each followed by the
+ * objects that are deltified against it (and so on, depth first), which
+ * are resolved from the contents of their base that were just visited.
+ *
+ * "buf" (of "size" bytes, of the given "type") belongs to the iterator
+ * and is only valid for the duration of the call. It is NULL for the
+ * objects which gain nothing from this order (those which are neither
+ * deltas nor the base of one), whose contents are left for the callback
+ * to read if it needs them; "type" and "size" are meaningless then.
+ */
+typedef int each_packed_object_contents_fn(const struct object_id *oid,
+					   struct packed_git *pack,
+					   off_t offset,
+					   enum object_type type,
+					   const void *buf,
+					   unsigned long size,
+					   void *data);
+int for_each_object_in_pack_by_delta(struct repository *r,
+				     struct packed_git *p,
+				     each_packed_object_contents_fn, void *data);
+
 #endif /* OBJECT_STORE_H */
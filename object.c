@@ -9,6 +9,7 @@
 #include "alloc.h"
 #include "packfile.h"
 #include "commit-graph.h"
+#include "thread-utils.h"
 
 unsigned int get_max_object_index(void)
 {
@@ -80,6 +81,69 @@ static void insert_obj_hash(struct object *obj, struct object **hash, unsigned i
 	hash[j] = obj;
 }
 
+/*
+ * Look up the given object in the hash table hash of length size,
+ * without modifying it.  Return NULL if it was not found.
+ */
+static struct object *find_obj_hash(const struct object_id *oid,
+				    struct object **hash, unsigned int size)
+{
+	unsigned int i;
+	struct object *obj;
+
+	if (!hash)
+		return NULL;
+
+	i = hash_obj(oid, size);
+	while ((obj = hash[i]) != NULL) {
+		if (oideq(oid, &obj->oid))
+			break;
+		i++;
+		if (i == size)
+			i = 0;
+	}
+	return obj;
+}
+
+/*
+ * While concurrent lookups are enabled, objects are created in one of
+ * OBJECT_SHARDS hash tables, each protected by its own lock, which are
+ * selected by other bits of the object name than those used to index
+ * the tables.  The main hash table is left alone and can be read
+ * without locking.
+ */
+#define OBJECT_SHARD_BITS 6
+#define OBJECT_SHARDS (1 << OBJECT_SHARD_BITS)
+
+struct object_shard {
+	pthread_mutex_t mutex;
+	struct object **hash;
+	unsigned int nr, size;
+};
+
+static struct object_shard *object_shard(struct parsed_object_pool *o,
+					 const struct object_id *oid)
+{
+	return &o->shards[oidhash(oid) >> (32 - OBJECT_SHARD_BITS)];
+}
+
+static struct object *lookup_object_concurrent(struct parsed_object_pool *o,
+					       const struct object_id *oid)
+{
+	struct object_shard *shard;
+	struct object *obj;
+
+	obj = find_obj_hash(oid, o->obj_hash, o->obj_hash_size);
+	if (obj)
+		return obj;
+
+	shard = object_shard(o, oid);
+	pthread_mutex_lock(&shard->mutex);
+	obj = find_obj_hash(oid, shard->hash, shard->size);
+	pthread_mutex_unlock(&shard->mutex);
+	return obj;
+}
+
 /*
  * Look up the record for the given sha1 in the hash map stored in
  * obj_hash.  Return NULL if it was not found.
@@ -89,6 +153,8 @@ struct object *lookup_object(struct repository *r, const struct object_id *oid)
 	unsigned int i, first;
 	struct object *obj;
 
+	if (r->parsed_objects->shards)
+		return lookup_object_concurrent(r->parsed_objects, oid);
 	if (!r->parsed_objects->obj_hash)
 		return NULL;
 
@@ -140,6 +206,47 @@ static void grow_object_hash(struct repository *r)
 	r->parsed_objects->obj_hash_size = new_hash_size;
 }
 
+static void grow_shard(struct object_shard *shard)
+{
+	unsigned int i, new_size = shard->size < 32 ? 32 : 2 * shard->size;
+	struct object **new_hash;
+
+	CALLOC_ARRAY(new_hash, new_size);
+	for (i = 0; i < shard->size; i++)
+		if (shard->hash[i])
+			insert_obj_hash(shard->hash[i], new_hash, new_size);
+	free(shard->hash);
+	shard->hash = new_hash;
+	shard->size = new_size;
+}
+
+static void *create_object_concurrent(struct parsed_object_pool *o,
+				      struct object *obj)
+{
+	struct object_shard *shard = object_shard(o, &obj->oid);
+	struct object *existing;
+
+	pthread_mutex_lock(&shard->mutex);
+	existing = find_obj_hash(&obj->oid, shard->hash, shard->size);
+	if (existing) {
+		/*
+		 * Somebody else beat us to it; "obj" stays unused in its
+		 * slab. Pretend we looked it up instead.
+		 */
+		if (obj->type != OBJ_NONE)
+			existing = object_as_type(existing, obj->type, 0);
+		pthread_mutex_unlock(&shard->mutex);
+		return existing;
+	}
+
+	if (shard->nr * 2 + 1 >= shard->size)
+		grow_shard(shard);
+	insert_obj_hash(obj, shard->hash, shard->size);
+	shard->nr++;
+	pthread_mutex_unlock(&shard->mutex);
+	return obj;
+}
+
 void *create_object(struct repository *r, const struct object_id *oid, void *o)
 {
 	struct object *obj = o;
@@ -148,6 +255,9 @@ void *create_object(struct repository *r, const struct object_id *oid, void *o)
 	obj->flags = 0;
 	oidcpy(&obj->oid, oid);
 
+	if (r->parsed_objects->shards)
+		return create_object_concurrent(r->parsed_objects, obj);
+
 	if (r->parsed_objects->obj_hash_size - 1 <= r->parsed_objects->nr_objs * 2)
 		grow_object_hash(r);
 
@@ -157,6 +267,51 @@ void *create_object(struct repository *r, const struct object_id *oid, void *o)
 	return obj;
 }
 
+void begin_concurrent_object_lookup(struct repository *r)
+{
+	struct parsed_object_pool *o = r->parsed_objects;
+	int i;
+
+	if (o->shards)
+		BUG("concurrent object lookup is already enabled");
+
+	CALLOC_ARRAY(o->shards, OBJECT_SHARDS);
+	for (i = 0; i < OBJECT_SHARDS; i++)
+		pthread_mutex_init(&o->shards[i].mutex, NULL);
+	alloc_begin_concurrent();
+}
+
+void end_concurrent_object_lookup(struct repository *r)
+{
+	struct parsed_object_pool *o = r->parsed_objects;
+	struct object_shard *shards = o->shards;
+	unsigned int i, j;
+
+	if (!shards)
+		BUG("concurrent object lookup is not enabled");
+
+	o->shards = NULL;
+	alloc_end_concurrent();
+
+	for (i = 0; i < OBJECT_SHARDS; i++) {
+		struct object_shard *shard = &shards[i];
+
+		for (j = 0; j < shard->size; j++) {
+			struct object *obj = shard->hash[j];
+
+			if (!obj)
+				continue;
+			if (o->obj_hash_size - 1 <= o->nr_objs * 2)
+				grow_object_hash(r);
+			insert_obj_hash(obj, o->obj_hash, o->obj_hash_size);
+			o->nr_objs++;
+		}
+		free(shard->hash);
+		pthread_mutex_destroy(&shard->mutex);
+	}
+	free(shards);
+}
+
 void *object_as_type(struct object *obj, enum object_type type, int quiet)
 {
 	if (obj->type == type)
@@ -566,6 +721,9 @@ void parsed_object_pool_clear(struct parsed_object_pool *o)
 	 */
 	unsigned i;
 
+	if (o->shards)
+		BUG("concurrent object lookup is still enabled");
+
 	for (i = 0; i < o->obj_hash_size; i++) {
 		struct object *obj = o->obj_hash[i];
 
@@ -4,11 +4,18 @@
 #include "cache.h"
 
 struct buffer_slab;
+struct object_shard;
 
 struct parsed_object_pool {
 	struct object **obj_hash;
 	int nr_objs, obj_hash_size;
 
+	/*
+	 * Objects created while concurrent lookups are enabled; see
+	 * begin_concurrent_object_lookup().
+	 */
+	struct object_shard *shards;
+
 	/* TODO: migrate alloc_states to mem-pool? */
 	struct alloc_state *blob_state;
 	struct alloc_state *tree_state;
@@ -119,8 +126,36 @@ struct object *get_indexed_object(unsigned int);
  */
 struct object *lookup_object(struct repository *r, const struct object_id *oid);
 
+/*
+ * Add the newly allocated "obj" to the object hashmap under "oid", and
+ * return it.
+ *
+ * While concurrent lookups are enabled, another thread may have created
+ * an object with the same name in the meantime; that one is returned
+ * instead (or NULL, if its type is incompatible with the type of "obj").
+ */
 void *create_object(struct repository *r, const struct object_id *oid, void *obj);
 
+/*
+ * Allow lookup_object() and create_object() to be called from multiple
+ * threads at the same time, until end_concurrent_object_lookup() is
+ * called. The lookup_<type>() functions built on top of them are safe
+ * too, except on an object that is still of type OBJ_NONE (as created
+ * by lookup_unknown_object()): giving it its type with object_as_type()
+ * modifies it in place, so callers must not let threads race on such
+ * objects.
+ *
+ * In between, the existing object hashmap is only read, and objects
+ * created by any thread are kept in separately locked shards. They are
+ * moved to the object hashmap when the concurrent section ends, so
+ * get_max_object_index() and get_indexed_object() do not see them
+ * before. Anything beyond looking up and creating objects, like
+ * parsing them or updating their flags, is still up to the caller to
+ * serialize.
+ */
+void begin_concurrent_object_lookup(struct repository *r);
+void end_concurrent_object_lookup(struct repository *r);
+
 void *object_as_type(struct object *obj, enum object_type type, int quiet);
 
 /*
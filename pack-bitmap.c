@@ -79,6 +79,13 @@ struct bitmap_index {
 	/* If not NULL, this is a name-hash cache pointing into map. */
 	uint32_t *hashes;
 
+	/*
+	 * If not NULL, this is the commit lookup table pointing into map.
+	 * It allows loading the bitmap of a single commit on demand
+	 * instead of reading all of them when opening the index.
+	 */
+	const unsigned char *table_lookup;
+
 	/* The checksum of the packfile or MIDX; points into map. */
 	const unsigned char *checksum;
 
@@ -185,6 +192,16 @@ static int load_bitmap_header(struct bitmap_index *index)
 			index->hashes = (void *)(index_end - cache_size);
 			index_end -= cache_size;
 		}
+
+		if (flags & BITMAP_OPT_LOOKUP_TABLE) {
+			size_t table_size = st_mult(ntohl(header->entry_count),
+						    BITMAP_LOOKUP_TABLE_TRIPLET_WIDTH);
+			if (table_size > index_end - index->map - header_size)
+				return error(_("corrupted bitmap index file (too short to fit lookup table)"));
+			if (git_env_bool("GIT_TEST_READ_COMMIT_TABLE", 1))
+				index->table_lookup = (void *)(index_end - table_size);
+			index_end -= table_size;
+		}
 	}
 
 	index->entry_count = ntohl(header->entry_count);
@@ -313,11 +330,17 @@ static int open_midx_bitmap_1(struct bitmap_index *bitmap_git,
 			      struct multi_pack_index *midx)
 {
 	struct stat st;
-	char *idx_name = midx_bitmap_filename(midx);
-	int fd = git_open(idx_name);
+	char *idx_name;
+	int fd;
 	uint32_t i;
 	struct packed_git *preferred;
 
+	/* Bitmaps are not written for incremental multi-pack-indexes. */
+	if (midx->base_midx)
+		return -1;
+
+	idx_name = midx_bitmap_filename(midx);
+	fd = git_open(idx_name);
 	free(idx_name);
 
 	if (fd < 0)
@@ -470,7 +493,7 @@ static int load_bitmap(struct bitmap_index *bitmap_git)
 		!(bitmap_git->tags = read_bitmap_1(bitmap_git)))
 		goto failed;
 
-	if (load_bitmap_entries_v1(bitmap_git) < 0)
+	if (!bitmap_git->table_lookup && load_bitmap_entries_v1(bitmap_git) < 0)
 		goto failed;
 
 	return 0;
@@ -557,13 +580,259 @@ struct include_data {
 	struct bitmap *seen;
 };
 
+struct bitmap_lookup_table_triplet {
+	uint32_t commit_pos;
+	uint64_t offset;
+	uint32_t xor_row;
+};
+
+struct bitmap_lookup_table_xor_item {
+	struct object_id oid;
+	uint64_t offset;
+};
+
+/*
+ * Given a `triplet` struct pointer and pointer `p`, this
+ * function reads the triplet beginning at `p` into the struct.
+ * Note that this function assumes that there is enough memory
+ * left for filling the `triplet` struct from `p`.
+ */
+static int bitmap_lookup_table_get_triplet_by_pointer(struct bitmap_lookup_table_triplet *triplet,
+						      const unsigned char *p)
+{
+	if (!triplet)
+		return -1;
+
+	triplet->commit_pos = get_be32(p);
+	p += sizeof(uint32_t);
+	triplet->offset = get_be64(p);
+	p += sizeof(uint64_t);
+	triplet->xor_row = get_be32(p);
+	return 0;
+}
+
+/*
+ * This function gets the raw triplet from `row`'th row in the
+ * lookup table and fills that data to the `triplet`.
+ */
+static int bitmap_lookup_table_get_triplet(struct bitmap_index *bitmap_git,
+					   uint32_t pos,
+					   struct bitmap_lookup_table_triplet *triplet)
+{
+	const unsigned char *p;
+
+	if (pos >= bitmap_git->entry_count)
+		return error(_("corrupt bitmap lookup table: triplet position out of index"));
+
+	p = bitmap_git->table_lookup + st_mult(pos, BITMAP_LOOKUP_TABLE_TRIPLET_WIDTH);
+
+	return bitmap_lookup_table_get_triplet_by_pointer(triplet, p);
+}
+
+/*
+ * Searches for a matching triplet. `commit_pos` is a pointer
+ * to the wanted commit position value. `table_entry` points to
+ * a triplet in lookup table. The first 4 bytes of each
+ * triplet (pointed by `table_entry`) are compared with `*commit_pos`.
+ */
+static int triplet_cmp(const void *commit_pos, const void *table_entry)
+{
+	uint32_t a = *(uint32_t *)commit_pos;
+	uint32_t b = get_be32(table_entry);
+
+	if (a > b)
+		return 1;
+	else if (a < b)
+		return -1;
+
+	return 0;
+}
+
+static int bitmap_bsearch_pos(struct bitmap_index *bitmap_git,
+			      struct object_id *oid,
+			      uint32_t *result)
+{
+	int found;
+
+	if (bitmap_is_midx(bitmap_git))
+		found = bsearch_midx(oid, bitmap_git->midx, result);
+	else
+		found = bsearch_pack(oid, bitmap_git->pack, result);
+
+	return found;
+}
+
+/*
+ * `bsearch_triplet_by_pos` function searches for the raw triplet
+ * having commit position same as `commit_pos` and fills `triplet`
+ * object from the raw triplet. Returns 0 on success and -1 on
+ * failure.
+ */
+static int bitmap_bsearch_triplet_by_pos(uint32_t commit_pos,
+					 struct bitmap_index *bitmap_git,
+					 struct bitmap_lookup_table_triplet *triplet)
+{
+	unsigned char *p = bsearch(&commit_pos, bitmap_git->table_lookup,
+				   bitmap_git->entry_count,
+				   BITMAP_LOOKUP_TABLE_TRIPLET_WIDTH, triplet_cmp);
+
+	if (!p)
+		return -1;
+
+	return bitmap_lookup_table_get_triplet_by_pointer(triplet, p);
+}
+
+static struct stored_bitmap *lazy_bitmap_for_commit(struct bitmap_index *bitmap_git,
+						    struct commit *commit)
+{
+	uint32_t commit_pos, xor_row;
+	uint64_t offset;
+	int flags;
+	struct bitmap_lookup_table_triplet triplet;
+	struct object_id *oid = &commit->object.oid;
+	struct ewah_bitmap *bitmap;
+	struct stored_bitmap *xor_bitmap = NULL;
+	const int bitmap_header_size = 6;
+	struct bitmap_lookup_table_xor_item *xor_items = NULL;
+	size_t xor_items_nr = 0, xor_items_alloc = 0;
+	struct stored_bitmap *ret = NULL;
+	int xor_flags;
+	khiter_t hash_pos;
+	struct bitmap_lookup_table_xor_item *xor_item;
+
+	if (!bitmap_bsearch_pos(bitmap_git, oid, &commit_pos))
+		return NULL;
+
+	if (bitmap_bsearch_triplet_by_pos(commit_pos, bitmap_git, &triplet) < 0)
+		return NULL;
+
+	offset = triplet.offset;
+	xor_row = triplet.xor_row;
+
+	/*
+	 * Collect the chain of bitmaps this one is XOR'd against until
+	 * we either reach the end of the chain or a bitmap which has
+	 * already been loaded.
+	 */
+	while (xor_row != 0xffffffff) {
+		ALLOC_GROW(xor_items, xor_items_nr + 1, xor_items_alloc);
+
+		if (xor_items_nr + 1 >= bitmap_git->entry_count) {
+			error(_("corrupt bitmap lookup table: xor chain exceeds entry count"));
+			goto done;
+		}
+
+		if (bitmap_lookup_table_get_triplet(bitmap_git, xor_row, &triplet) < 0)
+			goto done;
+
+		xor_item = &xor_items[xor_items_nr];
+		xor_item->offset = triplet.offset;
+
+		if (nth_bitmap_object_oid(bitmap_git, &xor_item->oid, triplet.commit_pos) < 0) {
+			error(_("corrupt bitmap lookup table: commit index %u out of range"),
+			      triplet.commit_pos);
+			goto done;
+		}
+
+		hash_pos = kh_get_oid_map(bitmap_git->bitmaps, xor_item->oid);
+
+		/*
+		 * If the desired bitmap is already stored, then all of
+		 * the bitmaps it depends on have been stored, too, so
+		 * there is no need to walk any further.
+		 */
+		if (hash_pos < kh_end(bitmap_git->bitmaps) &&
+		    (xor_bitmap = kh_value(bitmap_git->bitmaps, hash_pos)))
+			break;
+		xor_items_nr++;
+		xor_row = triplet.xor_row;
+	}
+
+	/* Now load the chain starting with its base. */
+	while (xor_items_nr) {
+		xor_item = &xor_items[xor_items_nr - 1];
+		bitmap_git->map_pos = xor_item->offset;
+		if (bitmap_git->map_size - bitmap_git->map_pos < bitmap_header_size) {
+			error(_("corrupt ewah bitmap: truncated header for bitmap of commit \"%s\""),
+			      oid_to_hex(&xor_item->oid));
+			goto done;
+		}
+
+		bitmap_git->map_pos += sizeof(uint32_t) + sizeof(uint8_t);
+		xor_flags = read_u8(bitmap_git->map, &bitmap_git->map_pos);
+		bitmap = read_bitmap_1(bitmap_git);
+
+		if (!bitmap)
+			goto done;
+
+		xor_bitmap = store_bitmap(bitmap_git, bitmap, &xor_item->oid,
+					  xor_bitmap, xor_flags);
+		if (!xor_bitmap)
+			goto done;
+		xor_items_nr--;
+	}
+
+	bitmap_git->map_pos = offset;
+	if (bitmap_git->map_size - bitmap_git->map_pos < bitmap_header_size) {
+		error(_("corrupt ewah bitmap: truncated header for bitmap of commit \"%s\""),
+		      oid_to_hex(oid));
+		goto done;
+	}
+
+	/*
+	 * Don't bother reading the commit's index position or its xor
+	 * offset:
+	 *
+	 *   - The commit's index position is irrelevant to us, since
+	 *     load_bitmap_entries_v1 only uses it to learn the object
+	 *     id which is used to compute the hashmap's key. We already
+	 *     have an object id, so no need to look it up again.
+	 *
+	 *   - The xor_offset is unusable for us, since it specifies how
+	 *     many entries previous to ours we should look at. This
+	 *     makes sense when reading the bitmaps sequentially (as in
+	 *     load_bitmap_entries_v1()), since we can keep track of
+	 *     each bitmap as we read them.
+	 *
+	 *     But it can't work for us, since the bitmaps don't have a
+	 *     fixed size. So we learn the position of the xor'd bitmap
+	 *     from the commit table (and resolve it to a bitmap in the
+	 *     above loop).
+	 *
+	 * Instead, we can skip ahead and immediately read the flags and
+	 * ewah bitmap.
+	 */
+	bitmap_git->map_pos += sizeof(uint32_t) + sizeof(uint8_t);
+	flags = read_u8(bitmap_git->map, &bitmap_git->map_pos);
+	bitmap = read_bitmap_1(bitmap_git);
+
+	if (!bitmap)
+		goto done;
+
+	ret = store_bitmap(bitmap_git, bitmap, oid, xor_bitmap, flags);
+
+done:
+	free(xor_items);
+	return ret;
+}
+
 struct ewah_bitmap *bitmap_for_commit(struct bitmap_index *bitmap_git,
 				      struct commit *commit)
 {
 	khiter_t hash_pos = kh_get_oid_map(bitmap_git->bitmaps,
 					   commit->object.oid);
-	if (hash_pos >= kh_end(bitmap_git->bitmaps))
-		return NULL;
+	if (hash_pos >= kh_end(bitmap_git->bitmaps)) {
+		struct stored_bitmap *bitmap = NULL;
+
+		if (!bitmap_git->table_lookup)
+			return NULL;
+
+		/* this is a fairly hot codepath - no trace2_region please */
+		bitmap = lazy_bitmap_for_commit(bitmap_git, commit);
+		if (!bitmap)
+			return NULL;
+		return lookup_stored_bitmap(bitmap);
+	}
 	return lookup_stored_bitmap(kh_value(bitmap_git->bitmaps, hash_pos));
 }
 
@@ -1346,10 +1615,10 @@ struct bitmap_index *prepare_bitmap_walk(struct rev_info *revs,
 }
 
 /*
- * -1 means "stop trying further objects"; 0 means we may or may not have
- * reused, but you can keep feeding bits.
+ * -1 means "stop trying further objects from this pack"; 0 means we may
+ * or may not have reused, but you can keep feeding bits.
  */
-static int try_partial_reuse(struct packed_git *pack,
+static int try_partial_reuse(struct bitmapped_pack *pack,
 			     size_t pos,
 			     struct bitmap *reuse,
 			     struct pack_window **w_curs)
@@ -1359,33 +1628,33 @@ static int try_partial_reuse(struct packed_git *pack,
 	unsigned long size;
 
 	/*
-	 * try_partial_reuse() is called either on (a) objects in the
-	 * bitmapped pack (in the case of a single-pack bitmap) or (b)
-	 * objects in the preferred pack of a multi-pack bitmap.
-	 * Importantly, the latter can pretend as if only a single pack
-	 * exists because:
+	 * "pos" is the position of the object in "pack", and we
+	 * look at the bits starting at pack->bitmap_pos. This works
+	 * for objects in the bitmapped pack of a single-pack bitmap, as
+	 * well as for objects in any pack of a multi-pack bitmap, as
+	 * long as all of its objects are selected by the MIDX (which we
+	 * only allow for the preferred pack, unless multi-pack reuse is
+	 * enabled, see reuse_partial_packfile_from_bitmap()):
 	 *
-	 *   - The first pack->num_objects bits of a MIDX bitmap are
-	 *     reserved for the preferred pack, and
+	 *   - The objects of each pack are placed next to each other
+	 *     in the MIDX bitmap, in pack order, and
 	 *
 	 *   - Ties due to duplicate objects are always resolved in
-	 *     favor of the preferred pack.
+	 *     favor of the preferred pack, and other packs only
+	 *     qualify when no other copy of any of their objects was
+	 *     selected.
 	 *
 	 * Therefore we do not need to ever ask the MIDX for its copy of
-	 * an object by OID, since it will always select it from the
-	 * preferred pack. Likewise, the selected copy of the base
-	 * object for any deltas will reside in the same pack.
-	 *
-	 * This means that we can reuse pos when looking up the bit in
-	 * the reuse bitmap, too, since bits corresponding to the
-	 * preferred pack precede all bits from other packs.
+	 * an object by OID, since it will always select it from "pack".
+	 * Likewise, the selected copy of the base object for any deltas
+	 * will reside in the same pack.
 	 */
 
-	if (pos >= pack->num_objects)
-		return -1; /* not actually in the pack or MIDX preferred pack */
+	if (pos >= pack->bitmap_nr)
+		return -1; /* not actually in the pack */
 
-	offset = delta_obj_offset = pack_pos_to_offset(pack, pos);
-	type = unpack_object_header(pack, w_curs, &offset, &size);
+	offset = delta_obj_offset = pack_pos_to_offset(pack->p, pos);
+	type = unpack_object_header(pack->p, w_curs, &offset, &size);
 	if (type < 0)
 		return -1; /* broken packfile, punt */
 
@@ -1401,11 +1670,11 @@ static int try_partial_reuse(struct packed_git *pack,
 		 * and the normal slow path will complain about it in
 		 * more detail.
 		 */
-		base_offset = get_delta_base(pack, w_curs, &offset, type,
+		base_offset = get_delta_base(pack->p, w_curs, &offset, type,
 					     delta_obj_offset);
 		if (!base_offset)
 			return 0;
-		if (offset_to_pack_pos(pack, base_offset, &base_pos) < 0)
+		if (offset_to_pack_pos(pack->p, base_offset, &base_pos) < 0)
 			return 0;
 
 		/*
@@ -1428,14 +1697,14 @@ static int try_partial_reuse(struct packed_git *pack,
 		 * to REF_DELTA on the fly. Better to just let the normal
 		 * object_entry code path handle it.
 		 */
-		if (!bitmap_get(reuse, base_pos))
+		if (!bitmap_get(reuse, pack->bitmap_pos + base_pos))
 			return 0;
 	}
 
 	/*
 	 * If we got here, then the object is OK to reuse. Mark it.
 	 */
-	bitmap_set(reuse, pos);
+	bitmap_set(reuse, pack->bitmap_pos + pos);
 	return 0;
 }
 
@@ -1447,39 +1716,141 @@ uint32_t midx_preferred_pack(struct bitmap_index *bitmap_git)
 	return nth_midxed_pack_int_id(m, pack_pos_to_midx(bitmap_git->midx, 0));
 }
 
+static uint32_t midx_bitmap_pack_id(struct bitmap_index *bitmap_git,
+				    uint32_t pos)
+{
+	struct multi_pack_index *m = bitmap_git->midx;
+	return nth_midxed_pack_int_id(m, pack_pos_to_midx(m, pos));
+}
+
+/*
+ * List the packs of a multi-pack bitmap along with the range of bits
+ * their selected objects occupy. The preferred pack comes first, and
+ * all other packs follow in the order of their pack-int-ids (c.f.
+ * midx_pack_order_cmp()), so the end of each range can be found with a
+ * binary search.
+ */
+static void midx_bitmapped_packs(struct bitmap_index *bitmap_git,
+				 struct bitmapped_pack *packs)
+{
+	struct multi_pack_index *m = bitmap_git->midx;
+	uint32_t preferred = midx_preferred_pack(bitmap_git);
+	uint32_t pos, i, nr = 0;
+
+	packs[nr].p = m->packs[preferred];
+	packs[nr].bitmap_pos = 0;
+	packs[nr].bitmap_nr = m->packs[preferred]->num_objects;
+	pos = packs[nr++].bitmap_nr;
+
+	for (i = 0; i < m->num_packs; i++) {
+		uint32_t lo = pos, hi = m->num_objects;
+
+		if (i == preferred)
+			continue;
+
+		/* find the first position of a pack after this one */
+		while (lo < hi) {
+			uint32_t mi = lo + (hi - lo) / 2;
+			if (midx_bitmap_pack_id(bitmap_git, mi) > i)
+				hi = mi;
+			else
+				lo = mi + 1;
+		}
+
+		packs[nr].p = m->packs[i];
+		packs[nr].bitmap_pos = pos;
+		packs[nr].bitmap_nr = lo - pos;
+		pos = lo;
+		nr++;
+	}
+}
+
+/*
+ * Try to reuse the objects of "pack" which are marked in "result",
+ * starting at bit position "pos". Returns the number of objects marked
+ * in "reuse".
+ */
+static uint32_t reuse_partial_packfile(struct bitmapped_pack *pack,
+				       size_t pos,
+				       struct bitmap *result,
+				       struct bitmap *reuse)
+{
+	struct pack_window *w_curs = NULL;
+	size_t end = pack->bitmap_pos + pack->bitmap_nr;
+	uint32_t nr = 0;
+
+	while (pos < end) {
+		size_t i = pos / BITS_IN_EWORD;
+		eword_t word;
+
+		if (i >= result->word_alloc)
+			break;
+		word = result->words[i] >> (pos % BITS_IN_EWORD);
+		if (!word) {
+			pos = (i + 1) * BITS_IN_EWORD;
+			continue;
+		}
+		pos += ewah_bit_ctz64(word);
+		if (pos >= end)
+			break;
+
+		if (try_partial_reuse(pack, pos - pack->bitmap_pos,
+				      reuse, &w_curs) < 0) {
+			/*
+			 * try_partial_reuse indicated we couldn't reuse
+			 * any more bits from this pack, so there is no
+			 * point in trying the rest of them.
+			 */
+			break;
+		}
+		if (bitmap_get(reuse, pos))
+			nr++;
+		pos++;
+	}
+
+	unuse_pack(&w_curs);
+	return nr;
+}
+
 int reuse_partial_packfile_from_bitmap(struct bitmap_index *bitmap_git,
-				       struct packed_git **packfile_out,
+				       struct bitmapped_pack **packs_out,
+				       size_t *packs_nr_out,
 				       uint32_t *entries,
-				       struct bitmap **reuse_out)
+				       struct bitmap **reuse_out,
+				       int multi_pack_reuse)
 {
-	struct packed_git *pack;
+	struct bitmapped_pack *packs;
+	size_t packs_nr, reused_packs_nr = 0;
 	struct bitmap *result = bitmap_git->result;
 	struct bitmap *reuse;
-	struct pack_window *w_curs = NULL;
-	size_t i = 0;
-	uint32_t offset;
+	size_t i = 0, j;
 	uint32_t objects_nr;
 
 	assert(result);
 
 	load_reverse_index(bitmap_git);
 
-	if (bitmap_is_midx(bitmap_git))
-		pack = bitmap_git->midx->packs[midx_preferred_pack(bitmap_git)];
-	else
-		pack = bitmap_git->pack;
-	objects_nr = pack->num_objects;
+	if (bitmap_is_midx(bitmap_git)) {
+		packs_nr = multi_pack_reuse ? bitmap_git->midx->num_packs : 1;
+		CALLOC_ARRAY(packs, bitmap_git->midx->num_packs);
+		midx_bitmapped_packs(bitmap_git, packs);
+	} else {
+		packs_nr = 1;
+		CALLOC_ARRAY(packs, packs_nr);
+		packs[0].p = bitmap_git->pack;
+		packs[0].bitmap_nr = bitmap_git->pack->num_objects;
+	}
+	objects_nr = packs[0].bitmap_nr;
 
 	while (i < result->word_alloc && result->words[i] == (eword_t)~0)
 		i++;
 
 	/*
-	 * Don't mark objects not in the packfile or preferred pack. This bitmap
-	 * marks objects eligible for reuse, but the pack-reuse code only
-	 * understands how to reuse a single pack. Since the preferred pack is
-	 * guaranteed to have all bases for its deltas (in a multi-pack bitmap),
-	 * we use it instead of another pack. In single-pack bitmaps, the choice
-	 * is made for us.
+	 * Don't mark objects not in the packfile or preferred pack. The
+	 * leading objects which are all wanted can be reused from it
+	 * without looking at them one by one, since the pack has the
+	 * bases of all of its deltas, and the MIDX selects every object
+	 * in the preferred pack.
 	 */
 	if (i > objects_nr / BITS_IN_EWORD)
 		i = objects_nr / BITS_IN_EWORD;
@@ -1487,36 +1858,34 @@ int reuse_partial_packfile_from_bitmap(struct bitmap_index *bitmap_git,
 	reuse = bitmap_word_alloc(i);
 	memset(reuse->words, 0xFF, i * sizeof(eword_t));
 
-	for (; i < result->word_alloc; ++i) {
-		eword_t word = result->words[i];
-		size_t pos = (i * BITS_IN_EWORD);
-
-		for (offset = 0; offset < BITS_IN_EWORD; ++offset) {
-			if ((word >> offset) == 0)
-				break;
-
-			offset += ewah_bit_ctz64(word >> offset);
-			if (try_partial_reuse(pack, pos + offset,
-					      reuse, &w_curs) < 0) {
-				/*
-				 * try_partial_reuse indicated we couldn't reuse
-				 * any bits, so there is no point in trying more
-				 * bits in the current word, or any other words
-				 * in result.
-				 *
-				 * Jump out of both loops to avoid future
-				 * unnecessary calls to try_partial_reuse.
-				 */
-				goto done;
-			}
+	for (j = 0; j < packs_nr; j++) {
+		struct bitmapped_pack *pack = &packs[j];
+		uint32_t nr;
+
+		if (!j) {
+			nr = i * BITS_IN_EWORD;
+			nr += reuse_partial_packfile(pack, i * BITS_IN_EWORD,
+						     result, reuse);
+		} else if (pack->bitmap_nr != pack->p->num_objects ||
+			   !is_pack_valid(pack->p)) {
+			/*
+			 * Other packs are only safe to reuse from when
+			 * every single one of their objects was selected
+			 * from them; see try_partial_reuse().
+			 */
+			continue;
+		} else {
+			nr = reuse_partial_packfile(pack, pack->bitmap_pos,
+						    result, reuse);
 		}
-	}
 
-done:
-	unuse_pack(&w_curs);
+		if (nr)
+			packs[reused_packs_nr++] = *pack;
+	}
 
 	*entries = bitmap_popcount(reuse);
 	if (!*entries) {
+		free(packs);
 		bitmap_free(reuse);
 		return -1;
 	}
@@ -1526,7 +1895,8 @@ int reuse_partial_packfile_from_bitmap(struct bitmap_index *bitmap_git,
 	 * need to be handled separately.
 	 */
 	bitmap_and_not(result, reuse);
-	*packfile_out = pack;
+	*packs_out = packs;
+	*packs_nr_out = reused_packs_nr;
 	*reuse_out = reuse;
 	return 0;
 }
@@ -1760,6 +2130,15 @@ int test_bitmap_commits(struct repository *r)
 	if (!bitmap_git)
 		die("failed to load bitmap indexes");
 
+	/*
+	 * As this function is only used to print bitmap selected
+	 * commits, we don't have to read the commit table.
+	 */
+	if (bitmap_git->table_lookup) {
+		if (load_bitmap_entries_v1(bitmap_git) < 0)
+			die(_("failed to load bitmap indexes"));
+	}
+
 	kh_foreach(bitmap_git->bitmaps, oid, value, {
 		printf("%s\n", oid_to_hex(&oid));
 	});
@@ -1911,6 +2290,30 @@ int bitmap_has_oid_in_uninteresting(struct bitmap_index *bitmap_git,
 		bitmap_walk_contains(bitmap_git, bitmap_git->haves, oid);
 }
 
+int bitmap_has_oid_in_result(struct bitmap_index *bitmap_git,
+			      const struct object_id *oid)
+{
+	return bitmap_git &&
+		bitmap_walk_contains(bitmap_git, bitmap_git->result, oid);
+}
+
+int bitmap_commit_reaches(struct bitmap_index *bitmap_git,
+			  struct commit *commit,
+			  const struct object_id *oid)
+{
+	struct ewah_bitmap *bitmap = bitmap_for_commit(bitmap_git, commit);
+	int pos;
+
+	if (!bitmap)
+		return -1;
+
+	/* a stored bitmap knows nothing of the extended index */
+	pos = bitmap_position(bitmap_git, oid);
+	if (pos < 0 || (uint32_t)pos >= bitmap_num_objects(bitmap_git))
+		return -1;
+	return ewah_get(bitmap, pos);
+}
+
 static off_t get_disk_usage_for_type(struct bitmap_index *bitmap_git,
 				     enum object_type object_type)
 {
@@ -26,8 +26,18 @@ struct bitmap_disk_header {
 enum pack_bitmap_opts {
 	BITMAP_OPT_FULL_DAG = 1,
 	BITMAP_OPT_HASH_CACHE = 4,
+	BITMAP_OPT_LOOKUP_TABLE = 16,
 };
 
+/*
+ * The width in bytes of a single triplet in the lookup table
+ * extension:
+ *     (commit_pos, offset, xor_row)
+ *
+ * whose fields are 32-, 64-, 32- bits wide, respectively.
+ */
+#define BITMAP_LOOKUP_TABLE_TRIPLET_WIDTH (16)
+
 enum pack_bitmap_flags {
 	BITMAP_FLAG_REUSE = 0x1
 };
@@ -55,10 +65,35 @@ int test_bitmap_hashes(struct repository *r);
 struct bitmap_index *prepare_bitmap_walk(struct rev_info *revs,
 					 int filter_provided_objects);
 uint32_t midx_preferred_pack(struct bitmap_index *bitmap_git);
+
+/*
+ * A pack whose objects occupy the bit positions [bitmap_pos,
+ * bitmap_pos + bitmap_nr) of a bitmap, in the same order as they appear
+ * in the pack.
+ */
+struct bitmapped_pack {
+	struct packed_git *p;
+	uint32_t bitmap_pos;
+	uint32_t bitmap_nr;
+};
+
+/*
+ * Find the objects of the bitmap walk result which can be sent verbatim
+ * from the packs they are stored in, and remove them from the result.
+ * Only the bitmapped pack (or the preferred pack of a multi-pack
+ * bitmap) is considered, unless "multi_pack_reuse" is set, in which
+ * case any pack of a multi-pack bitmap whose objects are all selected
+ * by the multi-pack index may contribute.
+ *
+ * On success, "packs_out" lists the packs to reuse objects from in bit
+ * order, and "reuse_out" marks the objects to reuse.
+ */
 int reuse_partial_packfile_from_bitmap(struct bitmap_index *,
-				       struct packed_git **packfile,
+				       struct bitmapped_pack **packs_out,
+				       size_t *packs_nr_out,
 				       uint32_t *entries,
-				       struct bitmap **reuse_out);
+				       struct bitmap **reuse_out,
+				       int multi_pack_reuse);
 int rebuild_existing_bitmaps(struct bitmap_index *, struct packing_data *mapping,
 			     kh_oid_map_t *reused_bitmaps, int show_progress);
 void free_bitmap_index(struct bitmap_index *);
@@ -72,6 +107,21 @@ int bitmap_walk_contains(struct bitmap_index *,
  */
 int bitmap_has_oid_in_uninteresting(struct bitmap_index *, const struct object_id *oid);
 
+/*
+ * After a traversal has been performed by prepare_bitmap_walk(), this can be
+ * queried to see if a particular object was reachable from any of the
+ * objects that were not flagged as UNINTERESTING.
+ */
+int bitmap_has_oid_in_result(struct bitmap_index *, const struct object_id *oid);
+
+/*
+ * Tell from the bitmap stored for "commit" whether "oid" is reachable from
+ * it: returns 1 or 0, or -1 if there is no bitmap for "commit" or "oid" is
+ * not in the bitmapped pack(s).
+ */
+int bitmap_commit_reaches(struct bitmap_index *, struct commit *commit,
+			  const struct object_id *oid);
+
 off_t get_disk_usage_from_bitmap(struct bitmap_index *, struct rev_info *);
 
 void bitmap_writer_show_progress(int show);
@@ -873,7 +873,8 @@ static void prepare_pack(const char *full_name, size_t full_name_len,
 	if (!report_garbage)
 		return;
 
-	if (!strcmp(file_name, "multi-pack-index"))
+	if (!strcmp(file_name, "multi-pack-index") ||
+	    !strcmp(file_name, "multi-pack-index.d"))
 		return;
 	if (starts_with(file_name, "multi-pack-index") &&
 	    (ends_with(file_name, ".bitmap") || ends_with(file_name, ".rev")))
@@ -929,7 +930,7 @@ unsigned long repo_approximate_object_count(struct repository *r)
 		prepare_packed_git(r);
 		count = 0;
 		for (m = get_multi_pack_index(r); m; m = m->next)
-			count += m->num_objects;
+			count += m->num_objects_in_base + m->num_objects;
 		for (p = r->objects->packed_git; p; p = p->next) {
 			if (open_pack_index(p))
 				continue;
@@ -1059,7 +1060,7 @@ struct packed_git *get_all_packs(struct repository *r)
 	prepare_packed_git(r);
 	for (m = r->objects->multi_pack_index; m; m = m->next) {
 		uint32_t i;
-		for (i = 0; i < m->num_packs; i++)
+		for (i = 0; i < m->num_packs_in_base + m->num_packs; i++)
 			prepare_midx_pack(r, m, i);
 	}
 
@@ -1194,13 +1195,12 @@ const struct packed_git *has_packed_and_bad(struct repository *r,
 	return NULL;
 }
 
-off_t get_delta_base(struct packed_git *p,
-		     struct pack_window **w_curs,
-		     off_t *curpos,
-		     enum object_type type,
-		     off_t delta_obj_offset)
+static off_t parse_delta_base(struct packed_git *p,
+			      const unsigned char *base_info,
+			      off_t *curpos,
+			      enum object_type type,
+			      off_t delta_obj_offset)
 {
-	unsigned char *base_info = use_pack(p, w_curs, *curpos, NULL);
 	off_t base_offset;
 
 	/* use_pack() assured us we have [base_info, base_info + 20)
@@ -1233,6 +1233,16 @@ off_t get_delta_base(struct packed_git *p,
 	return base_offset;
 }
 
+off_t get_delta_base(struct packed_git *p,
+		     struct pack_window **w_curs,
+		     off_t *curpos,
+		     enum object_type type,
+		     off_t delta_obj_offset)
+{
+	return parse_delta_base(p, use_pack(p, w_curs, *curpos, NULL),
+				curpos, type, delta_obj_offset);
+}
+
 /*
  * Like get_delta_base above, but we return the sha1 instead of the pack
  * offset. This means it is cheaper for REF deltas (we do not have to do
@@ -1354,10 +1364,34 @@ static enum object_type packed_to_object_type(struct repository *r,
 	goto out;
 }
 
-static struct hashmap delta_base_cache;
-static size_t delta_base_cached;
+/*
+ * The delta base cache is split into shards, each with its own lock,
+ * hashmap and LRU list, so that threads reading objects in parallel
+ * (see enable_obj_read_lock()) do not serialize on a single cache. Each
+ * shard gets an equal part of delta_base_cache_limit. When only a single
+ * thread reads objects, one shard holds the whole cache and no locking
+ * is done.
+ */
+#define DELTA_BASE_CACHE_SHARDS 16
 
-static LIST_HEAD(delta_base_cache_lru);
+struct delta_base_cache_shard {
+	pthread_mutex_t mutex;
+	struct hashmap map;
+	struct list_head lru;
+	size_t cached;
+
+	/* statistics, reported by trace_delta_base_cache_stats() */
+	uintmax_t hits, misses, evictions;
+};
+
+static struct delta_base_cache_shard delta_base_cache[DELTA_BASE_CACHE_SHARDS];
+static unsigned int delta_base_cache_nr;
+static int delta_base_cache_use_lock;
+
+/* statistics of the shards dropped by setup_delta_base_cache() */
+static uintmax_t delta_base_cache_hits;
+static uintmax_t delta_base_cache_misses;
+static uintmax_t delta_base_cache_evictions;
 
 struct delta_base_cache_key {
 	struct packed_git *p;
@@ -1382,22 +1416,6 @@ static unsigned int pack_entry_hash(struct packed_git *p, off_t base_offset)
 	return hash;
 }
 
-static struct delta_base_cache_entry *
-get_delta_base_cache_entry(struct packed_git *p, off_t base_offset)
-{
-	struct hashmap_entry entry, *e;
-	struct delta_base_cache_key key;
-
-	if (!delta_base_cache.cmpfn)
-		return NULL;
-
-	hashmap_entry_init(&entry, pack_entry_hash(p, base_offset));
-	key.p = p;
-	key.base_offset = base_offset;
-	e = hashmap_get(&delta_base_cache, &entry, &key);
-	return e ? container_of(e, struct delta_base_cache_entry, ent) : NULL;
-}
-
 static int delta_base_cache_key_eq(const struct delta_base_cache_key *a,
 				   const struct delta_base_cache_key *b)
 {
@@ -1421,81 +1439,248 @@ static int delta_base_cache_hash_cmp(const void *unused_cmp_data,
 		return !delta_base_cache_key_eq(&a->key, &b->key);
 }
 
+static void init_delta_base_cache(unsigned int nr, int use_lock)
+{
+	unsigned int i;
+
+	for (i = 0; i < nr; i++) {
+		struct delta_base_cache_shard *shard = &delta_base_cache[i];
+
+		hashmap_init(&shard->map, delta_base_cache_hash_cmp, NULL, 0);
+		INIT_LIST_HEAD(&shard->lru);
+		shard->cached = 0;
+		if (use_lock)
+			pthread_mutex_init(&shard->mutex, NULL);
+	}
+	delta_base_cache_nr = nr;
+	delta_base_cache_use_lock = use_lock;
+}
+
+static struct delta_base_cache_shard *
+delta_base_cache_shard(unsigned int hash)
+{
+	/*
+	 * Shards are set up either by setup_delta_base_cache(), or lazily
+	 * here. The latter only happens while a single thread reads
+	 * objects.
+	 */
+	if (!delta_base_cache_nr)
+		init_delta_base_cache(1, 0);
+	return &delta_base_cache[hash % delta_base_cache_nr];
+}
+
+static inline void lock_delta_base_cache(struct delta_base_cache_shard *shard)
+{
+	if (delta_base_cache_use_lock)
+		pthread_mutex_lock(&shard->mutex);
+}
+
+static inline void unlock_delta_base_cache(struct delta_base_cache_shard *shard)
+{
+	if (delta_base_cache_use_lock)
+		pthread_mutex_unlock(&shard->mutex);
+}
+
+/* The caller must hold the lock of the shard. */
+static struct delta_base_cache_entry *
+get_delta_base_cache_entry(struct delta_base_cache_shard *shard,
+			   unsigned int hash,
+			   struct packed_git *p, off_t base_offset)
+{
+	struct hashmap_entry entry, *e;
+	struct delta_base_cache_key key;
+
+	hashmap_entry_init(&entry, hash);
+	key.p = p;
+	key.base_offset = base_offset;
+	e = hashmap_get(&shard->map, &entry, &key);
+	return e ? container_of(e, struct delta_base_cache_entry, ent) : NULL;
+}
+
 static int in_delta_base_cache(struct packed_git *p, off_t base_offset)
 {
-	return !!get_delta_base_cache_entry(p, base_offset);
+	unsigned int hash = pack_entry_hash(p, base_offset);
+	struct delta_base_cache_shard *shard = delta_base_cache_shard(hash);
+	int ret;
+
+	lock_delta_base_cache(shard);
+	ret = !!get_delta_base_cache_entry(shard, hash, p, base_offset);
+	unlock_delta_base_cache(shard);
+	return ret;
 }
 
 /*
  * Remove the entry from the cache, but do _not_ free the associated
  * entry data. The caller takes ownership of the "data" buffer, and
- * should copy out any fields it wants before detaching.
+ * should copy out any fields it wants before detaching. The caller
+ * must hold the lock of the shard.
  */
-static void detach_delta_base_cache_entry(struct delta_base_cache_entry *ent)
+static void detach_delta_base_cache_entry(struct delta_base_cache_shard *shard,
+					  struct delta_base_cache_entry *ent)
 {
-	hashmap_remove(&delta_base_cache, &ent->ent, &ent->key);
+	hashmap_remove(&shard->map, &ent->ent, &ent->key);
 	list_del(&ent->lru);
-	delta_base_cached -= ent->size;
+	shard->cached -= ent->size;
 	free(ent);
 }
 
+/*
+ * Look up the base at "base_offset" and, if it is cached, remove it
+ * from the cache and hand it over to the caller, who then owns "data".
+ */
+static int take_delta_base_cache_entry(struct packed_git *p, off_t base_offset,
+				       void **data, unsigned long *size,
+				       enum object_type *type)
+{
+	unsigned int hash = pack_entry_hash(p, base_offset);
+	struct delta_base_cache_shard *shard = delta_base_cache_shard(hash);
+	struct delta_base_cache_entry *ent;
+
+	lock_delta_base_cache(shard);
+	ent = get_delta_base_cache_entry(shard, hash, p, base_offset);
+	if (!ent) {
+		shard->misses++;
+		unlock_delta_base_cache(shard);
+		return 0;
+	}
+	shard->hits++;
+	*type = ent->type;
+	*data = ent->data;
+	*size = ent->size;
+	detach_delta_base_cache_entry(shard, ent);
+	unlock_delta_base_cache(shard);
+	return 1;
+}
+
 static void *cache_or_unpack_entry(struct repository *r, struct packed_git *p,
 				   off_t base_offset, unsigned long *base_size,
 				   enum object_type *type)
 {
+	unsigned int hash = pack_entry_hash(p, base_offset);
+	struct delta_base_cache_shard *shard = delta_base_cache_shard(hash);
 	struct delta_base_cache_entry *ent;
+	void *data;
 
-	ent = get_delta_base_cache_entry(p, base_offset);
-	if (!ent)
+	lock_delta_base_cache(shard);
+	ent = get_delta_base_cache_entry(shard, hash, p, base_offset);
+	if (!ent) {
+		unlock_delta_base_cache(shard);
 		return unpack_entry(r, p, base_offset, type, base_size);
+	}
 
+	shard->hits++;
 	if (type)
 		*type = ent->type;
 	if (base_size)
 		*base_size = ent->size;
-	return xmemdupz(ent->data, ent->size);
+	data = xmemdupz(ent->data, ent->size);
+	unlock_delta_base_cache(shard);
+	return data;
 }
 
-static inline void release_delta_base_cache(struct delta_base_cache_entry *ent)
+static inline void release_delta_base_cache(struct delta_base_cache_shard *shard,
+					    struct delta_base_cache_entry *ent)
 {
 	free(ent->data);
-	detach_delta_base_cache_entry(ent);
+	detach_delta_base_cache_entry(shard, ent);
 }
 
 void clear_delta_base_cache(void)
 {
-	struct list_head *lru, *tmp;
-	list_for_each_safe(lru, tmp, &delta_base_cache_lru) {
-		struct delta_base_cache_entry *entry =
-			list_entry(lru, struct delta_base_cache_entry, lru);
-		release_delta_base_cache(entry);
+	unsigned int i;
+
+	for (i = 0; i < delta_base_cache_nr; i++) {
+		struct delta_base_cache_shard *shard = &delta_base_cache[i];
+		struct list_head *lru, *tmp;
+
+		lock_delta_base_cache(shard);
+		list_for_each_safe(lru, tmp, &shard->lru) {
+			struct delta_base_cache_entry *entry =
+				list_entry(lru, struct delta_base_cache_entry, lru);
+			release_delta_base_cache(shard, entry);
+		}
+		unlock_delta_base_cache(shard);
 	}
 }
 
+void setup_delta_base_cache(int threaded)
+{
+	unsigned int i;
+
+	clear_delta_base_cache();
+	for (i = 0; i < delta_base_cache_nr; i++) {
+		struct delta_base_cache_shard *shard = &delta_base_cache[i];
+
+		delta_base_cache_hits += shard->hits;
+		delta_base_cache_misses += shard->misses;
+		delta_base_cache_evictions += shard->evictions;
+		shard->hits = shard->misses = shard->evictions = 0;
+		hashmap_clear(&shard->map);
+		if (delta_base_cache_use_lock)
+			pthread_mutex_destroy(&shard->mutex);
+	}
+
+	if (threaded && HAVE_THREADS)
+		init_delta_base_cache(DELTA_BASE_CACHE_SHARDS, 1);
+	else
+		init_delta_base_cache(1, 0);
+}
+
+void trace_delta_base_cache_stats(void)
+{
+	uintmax_t hits = delta_base_cache_hits;
+	uintmax_t misses = delta_base_cache_misses;
+	uintmax_t evictions = delta_base_cache_evictions;
+	unsigned int i;
+
+	for (i = 0; i < delta_base_cache_nr; i++) {
+		hits += delta_base_cache[i].hits;
+		misses += delta_base_cache[i].misses;
+		evictions += delta_base_cache[i].evictions;
+	}
+
+	if (!hits && !misses)
+		return;
+
+	trace2_data_intmax("delta-base-cache", the_repository,
+			   "delta-base-cache/hits", hits);
+	trace2_data_intmax("delta-base-cache", the_repository,
+			   "delta-base-cache/misses", misses);
+	trace2_data_intmax("delta-base-cache", the_repository,
+			   "delta-base-cache/evictions", evictions);
+}
+
 static void add_delta_base_cache(struct packed_git *p, off_t base_offset,
 	void *base, unsigned long base_size, enum object_type type)
 {
+	unsigned int hash = pack_entry_hash(p, base_offset);
+	struct delta_base_cache_shard *shard = delta_base_cache_shard(hash);
+	size_t limit = delta_base_cache_limit / delta_base_cache_nr;
 	struct delta_base_cache_entry *ent;
 	struct list_head *lru, *tmp;
 
+	lock_delta_base_cache(shard);
+
 	/*
 	 * Check required to avoid redundant entries when more than one thread
 	 * is unpacking the same object, in unpack_entry() (since its phases I
 	 * and III might run concurrently across multiple threads).
 	 */
-	if (in_delta_base_cache(p, base_offset)) {
+	if (get_delta_base_cache_entry(shard, hash, p, base_offset)) {
+		unlock_delta_base_cache(shard);
 		free(base);
 		return;
 	}
 
-	delta_base_cached += base_size;
+	shard->cached += base_size;
 
-	list_for_each_safe(lru, tmp, &delta_base_cache_lru) {
+	list_for_each_safe(lru, tmp, &shard->lru) {
 		struct delta_base_cache_entry *f =
 			list_entry(lru, struct delta_base_cache_entry, lru);
-		if (delta_base_cached <= delta_base_cache_limit)
+		if (shard->cached <= limit)
 			break;
-		release_delta_base_cache(f);
+		release_delta_base_cache(shard, f);
+		shard->evictions++;
 	}
 
 	ent = xmalloc(sizeof(*ent));
@@ -1504,12 +1689,12 @@ static void add_delta_base_cache(struct packed_git *p, off_t base_offset,
 	ent->type = type;
 	ent->data = base;
 	ent->size = base_size;
-	list_add_tail(&ent->lru, &delta_base_cache_lru);
+	list_add_tail(&ent->lru, &shard->lru);
 
-	if (!delta_base_cache.cmpfn)
-		hashmap_init(&delta_base_cache, delta_base_cache_hash_cmp, NULL, 0);
-	hashmap_entry_init(&ent->ent, pack_entry_hash(p, base_offset));
-	hashmap_add(&delta_base_cache, &ent->ent);
+	hashmap_entry_init(&ent->ent, hash);
+	hashmap_add(&shard->map, &ent->ent);
+
+	unlock_delta_base_cache(shard);
 }
 
 int packed_object_info(struct repository *r, struct packed_git *p,
@@ -1697,14 +1882,8 @@ void *unpack_entry(struct repository *r, struct packed_git *p, off_t obj_offset,
 	for (;;) {
 		off_t base_offset;
 		int i;
-		struct delta_base_cache_entry *ent;
-
-		ent = get_delta_base_cache_entry(p, curpos);
-		if (ent) {
-			type = ent->type;
-			data = ent->data;
-			size = ent->size;
-			detach_delta_base_cache_entry(ent);
+
+		if (take_delta_base_cache_entry(p, curpos, &data, &size, &type)) {
 			base_from_cache = 1;
 			break;
 		}
@@ -1832,6 +2011,13 @@ void *unpack_entry(struct repository *r, struct packed_git *p, off_t obj_offset,
 
 		delta_data = unpack_compressed_entry(p, &w_curs, curpos, delta_size);
 
+		/*
+		 * Both "base" and "delta_data" are ours alone, and the delta
+		 * base cache has locks of its own, so let other threads read
+		 * objects while we apply the delta.
+		 */
+		obj_read_unlock();
+
 		if (!delta_data) {
 			error("failed to unpack compressed delta "
 			      "at offset %"PRIuMAX" from %s",
@@ -1865,6 +2051,8 @@ void *unpack_entry(struct repository *r, struct packed_git *p, off_t obj_offset,
 		if (!external_base)
 			add_delta_base_cache(p, base_obj_offset, base, base_size, type);
 
+		obj_read_lock();
+
 		free(delta_data);
 		free(external_base);
 	}
@@ -1883,6 +2071,259 @@ void *unpack_entry(struct repository *r, struct packed_git *p, off_t obj_offset,
 	return data;
 }
 
+/*
+ * The windows of a packed_object_reader, one per pack it has read
+ * from, mapped from file descriptors of its own.
+ */
+struct reader_window {
+	struct packed_git *p;
+	unsigned char *base;
+	off_t offset;
+	size_t len;
+};
+
+struct packed_object_reader {
+	struct reader_window *windows;
+	size_t nr, alloc;
+	size_t mapped;
+};
+
+struct packed_object_reader *packed_object_reader_new(void)
+{
+	struct packed_object_reader *rd;
+
+	CALLOC_ARRAY(rd, 1);
+	return rd;
+}
+
+static void reader_unmap_window(struct packed_object_reader *rd,
+				struct reader_window *win)
+{
+	if (!win->base)
+		return;
+	munmap(win->base, win->len);
+	rd->mapped -= win->len;
+	win->base = NULL;
+}
+
+void packed_object_reader_free(struct packed_object_reader *rd)
+{
+	size_t i;
+
+	if (!rd)
+		return;
+	for (i = 0; i < rd->nr; i++)
+		reader_unmap_window(rd, &rd->windows[i]);
+	free(rd->windows);
+	free(rd);
+}
+
+/*
+ * Like use_pack(), but return NULL instead of dying when the pack
+ * cannot be read, so that the caller can fall back to unpack_entry()
+ * and its error reporting.
+ */
+static unsigned char *reader_use_pack(struct packed_object_reader *rd,
+				      struct packed_git *p, off_t offset,
+				      unsigned long *left)
+{
+	struct reader_window *win = NULL;
+	size_t i;
+
+	if (offset < 0 || offset > p->pack_size - the_hash_algo->rawsz)
+		return NULL;
+
+	for (i = 0; i < rd->nr; i++)
+		if (rd->windows[i].p == p) {
+			win = &rd->windows[i];
+			break;
+		}
+	if (!win) {
+		ALLOC_GROW(rd->windows, rd->nr + 1, rd->alloc);
+		win = &rd->windows[rd->nr++];
+		memset(win, 0, sizeof(*win));
+		win->p = p;
+	}
+
+	if (!win->base || offset < win->offset ||
+	    offset + the_hash_algo->rawsz > win->offset + win->len) {
+		size_t window_align = packed_git_window_size / 2;
+		struct stat st;
+		off_t len;
+		int fd;
+
+		reader_unmap_window(rd, win);
+
+		fd = git_open(p->pack_name);
+		if (fd < 0)
+			return NULL;
+		if (fstat(fd, &st) || st.st_size != p->pack_size) {
+			close(fd);
+			return NULL;
+		}
+
+		win->offset = (offset / window_align) * window_align;
+		len = p->pack_size - win->offset;
+		if (len > packed_git_window_size)
+			len = packed_git_window_size;
+		win->len = (size_t)len;
+		for (i = 0; i < rd->nr && packed_git_limit < rd->mapped + win->len; i++)
+			reader_unmap_window(rd, &rd->windows[i]);
+
+		win->base = xmmap_gently(NULL, win->len, PROT_READ, MAP_PRIVATE,
+					 fd, win->offset);
+		close(fd);
+		if (win->base == MAP_FAILED) {
+			win->base = NULL;
+			return NULL;
+		}
+		rd->mapped += win->len;
+	}
+
+	offset -= win->offset;
+	if (left)
+		*left = win->len - xsize_t(offset);
+	return win->base + offset;
+}
+
+static void *reader_unpack_compressed(struct packed_object_reader *rd,
+				      struct packed_git *p, off_t curpos,
+				      unsigned long size)
+{
+	int st = Z_STREAM_ERROR;
+	git_zstream stream;
+	unsigned char *buffer, *in;
+
+	buffer = xmallocz_gently(size);
+	if (!buffer)
+		return NULL;
+	memset(&stream, 0, sizeof(stream));
+	stream.next_out = buffer;
+	stream.avail_out = size + 1;
+
+	git_inflate_init(&stream);
+	do {
+		in = reader_use_pack(rd, p, curpos, &stream.avail_in);
+		if (!in) {
+			st = Z_STREAM_ERROR;
+			break;
+		}
+		stream.next_in = in;
+		st = git_inflate(&stream, Z_FINISH);
+		if (!stream.avail_out)
+			break; /* the payload is larger than it should be */
+		curpos += stream.next_in - in;
+	} while (st == Z_OK || st == Z_BUF_ERROR);
+	git_inflate_end(&stream);
+	if ((st != Z_STREAM_END) || stream.total_out != size) {
+		free(buffer);
+		return NULL;
+	}
+
+	/* versions of zlib can clobber unconsumed portion of outbuf */
+	buffer[size] = '\0';
+
+	return buffer;
+}
+
+void *packed_object_reader_unpack(struct packed_object_reader *rd,
+				  struct packed_git *p, off_t obj_offset,
+				  enum object_type *final_type,
+				  unsigned long *final_size)
+{
+	off_t curpos = obj_offset;
+	void *data = NULL;
+	unsigned long size;
+	enum object_type type;
+	struct unpack_entry_stack_ent *delta_stack = NULL;
+	size_t delta_stack_nr = 0, delta_stack_alloc = 0;
+	int base_from_cache = 0;
+
+	if (do_check_packed_object_crc)
+		return NULL;
+
+	write_pack_access_log(p, obj_offset);
+
+	/* drill down to the innermost base object, as unpack_entry() does */
+	for (;;) {
+		unsigned char *in;
+		unsigned long left, used;
+		off_t base_offset;
+
+		if (take_delta_base_cache_entry(p, curpos, &data, &size, &type)) {
+			base_from_cache = 1;
+			break;
+		}
+
+		in = reader_use_pack(rd, p, curpos, &left);
+		if (!in)
+			goto fail;
+		used = unpack_object_header_buffer(in, left, &type, &size);
+		if (!used)
+			goto fail;
+		curpos += used;
+		if (type != OBJ_OFS_DELTA && type != OBJ_REF_DELTA)
+			break;
+
+		/* find_pack_entry_one() would have to open the index */
+		if (type == OBJ_REF_DELTA && !p->index_data)
+			goto fail;
+		in = reader_use_pack(rd, p, curpos, NULL);
+		if (!in)
+			goto fail;
+		base_offset = parse_delta_base(p, in, &curpos, type, obj_offset);
+		if (!base_offset)
+			goto fail;
+
+		ALLOC_GROW(delta_stack, delta_stack_nr + 1, delta_stack_alloc);
+		delta_stack[delta_stack_nr].obj_offset = obj_offset;
+		delta_stack[delta_stack_nr].curpos = curpos;
+		delta_stack[delta_stack_nr].size = size;
+		delta_stack_nr++;
+
+		curpos = obj_offset = base_offset;
+	}
+
+	if (!base_from_cache) {
+		if (type != OBJ_COMMIT && type != OBJ_TREE &&
+		    type != OBJ_BLOB && type != OBJ_TAG)
+			goto fail;
+		data = reader_unpack_compressed(rd, p, curpos, size);
+		if (!data)
+			goto fail;
+	}
+
+	/* apply the deltas in order */
+	while (delta_stack_nr) {
+		struct unpack_entry_stack_ent *ent = &delta_stack[--delta_stack_nr];
+		void *base = data, *delta_data;
+		unsigned long base_size = size;
+
+		delta_data = reader_unpack_compressed(rd, p, ent->curpos,
+						      ent->size);
+		data = delta_data ?
+			patch_delta(base, base_size, delta_data, ent->size, &size) :
+			NULL;
+		free(delta_data);
+		add_delta_base_cache(p, obj_offset, base, base_size, type);
+		obj_offset = ent->obj_offset;
+		if (!data)
+			goto fail;
+	}
+
+	free(delta_stack);
+	if (final_type)
+		*final_type = type;
+	if (final_size)
+		*final_size = size;
+	return data;
+
+fail:
+	free(delta_stack);
+	free(data);
+	return NULL;
+}
+
 int bsearch_pack(const struct object_id *oid, const struct packed_git *p, uint32_t *result)
 {
 	const unsigned char *index_fanout = p->index_data;
@@ -2192,6 +2633,199 @@ int for_each_object_in_pack(struct packed_git *p,
 	return r;
 }
 
+struct delta_walk_entry {
+	uint32_t pos;
+	uint32_t next_child;
+	void *buf;
+	unsigned long size;
+};
+
+static void *unpack_delta_data(struct packed_git *p,
+			       struct pack_window **w_curs,
+			       off_t offset,
+			       unsigned long *sizep)
+{
+	off_t curpos = offset;
+	enum object_type type;
+
+	type = unpack_object_header(p, w_curs, &curpos, sizep);
+	if (type != OBJ_OFS_DELTA && type != OBJ_REF_DELTA)
+		return NULL;
+	if (!get_delta_base(p, w_curs, &curpos, type, offset))
+		return NULL;
+	return unpack_compressed_entry(p, w_curs, curpos, *sizep);
+}
+
+static int visit_delta_walk_entry(struct packed_git *p, uint32_t pos,
+				  enum object_type type,
+				  const void *buf, unsigned long size,
+				  each_packed_object_contents_fn fn, void *data)
+{
+	struct object_id oid;
+
+	if (nth_packed_object_id(&oid, p, pack_pos_to_index(p, pos)) < 0)
+		return error("unable to get sha1 of object %u in %s",
+			     pack_pos_to_index(p, pos), p->pack_name);
+	return fn(&oid, p, pack_pos_to_offset(p, pos), type, buf, size, data);
+}
+
+int for_each_object_in_pack_by_delta(struct repository *r,
+				     struct packed_git *p,
+				     each_packed_object_contents_fn fn,
+				     void *data)
+{
+	const uint32_t no_base = UINT32_MAX;
+	struct pack_window *w_curs = NULL;
+	uint32_t nr = p->num_objects;
+	uint32_t *base, *first_child, *children;
+	struct delta_walk_entry *stack = NULL;
+	size_t stack_nr = 0, stack_alloc = 0;
+	unsigned char *visited;
+	uint32_t pos;
+	int ret = 0;
+
+	if (load_pack_revindex(p))
+		return -1;
+
+	/*
+	 * Find the base of each delta from the object headers, and lay
+	 * out the children of every object in one array, in pack order.
+	 */
+	ALLOC_ARRAY(base, nr);
+	CALLOC_ARRAY(first_child, st_add(nr, 2));
+	ALLOC_ARRAY(children, nr);
+	CALLOC_ARRAY(visited, nr);
+	for (pos = 0; pos < nr; pos++) {
+		off_t offset = pack_pos_to_offset(p, pos);
+		off_t curpos = offset, base_offset;
+		enum object_type type;
+		unsigned long size;
+		uint32_t base_pos;
+
+		base[pos] = no_base;
+		type = unpack_object_header(p, &w_curs, &curpos, &size);
+		if (type != OBJ_OFS_DELTA && type != OBJ_REF_DELTA)
+			continue;
+		base_offset = get_delta_base(p, &w_curs, &curpos, type, offset);
+		if (!base_offset ||
+		    offset_to_pack_pos(p, base_offset, &base_pos) < 0)
+			continue;
+		base[pos] = base_pos;
+		first_child[base_pos + 2]++;
+	}
+	for (pos = 0; pos < nr; pos++)
+		first_child[pos + 2] += first_child[pos + 1];
+	for (pos = 0; pos < nr; pos++)
+		if (base[pos] != no_base)
+			children[first_child[base[pos] + 1]++] = pos;
+	unuse_pack(&w_curs);
+
+	for (pos = 0; pos < nr && !ret; pos++) {
+		enum object_type type;
+		unsigned long size;
+		void *buf;
+
+		if (base[pos] != no_base)
+			continue;
+		visited[pos] = 1;
+		if (first_child[pos] == first_child[pos + 1]) {
+			ret = visit_delta_walk_entry(p, pos, OBJ_NONE, NULL, 0,
+						     fn, data);
+			continue;
+		}
+
+		/*
+		 * This may itself be a delta, against an object that is
+		 * not in this pack, which unpack_entry() will find.
+		 */
+		buf = unpack_entry(r, p, pack_pos_to_offset(p, pos),
+				   &type, &size);
+		if (!buf) {
+			ret = error(_("unable to unpack object at offset %"PRIuMAX" in %s"),
+				    (uintmax_t)pack_pos_to_offset(p, pos),
+				    p->pack_name);
+			break;
+		}
+		ret = visit_delta_walk_entry(p, pos, type, buf, size, fn, data);
+		if (ret) {
+			free(buf);
+			break;
+		}
+
+		ALLOC_GROW(stack, stack_nr + 1, stack_alloc);
+		stack[stack_nr].pos = pos;
+		stack[stack_nr].next_child = first_child[pos];
+		stack[stack_nr].buf = buf;
+		stack[stack_nr].size = size;
+		stack_nr++;
+
+		while (stack_nr) {
+			struct delta_walk_entry *top = &stack[stack_nr - 1];
+			uint32_t child;
+			void *delta;
+			unsigned long delta_size;
+
+			if (top->next_child == first_child[top->pos + 1]) {
+				free(top->buf);
+				stack_nr--;
+				continue;
+			}
+			child = children[top->next_child++];
+			visited[child] = 1;
+
+			delta = unpack_delta_data(p, &w_curs,
+						  pack_pos_to_offset(p, child),
+						  &delta_size);
+			unuse_pack(&w_curs);
+			buf = delta ? patch_delta(top->buf, top->size,
+						  delta, delta_size, &size) :
+				      NULL;
+			free(delta);
+			if (!buf) {
+				ret = error(_("unable to apply delta at offset %"PRIuMAX" in %s"),
+					    (uintmax_t)pack_pos_to_offset(p, child),
+					    p->pack_name);
+				break;
+			}
+
+			ret = visit_delta_walk_entry(p, child, type, buf, size,
+						     fn, data);
+			if (ret || first_child[child] == first_child[child + 1]) {
+				free(buf);
+				if (ret)
+					break;
+				continue;
+			}
+
+			ALLOC_GROW(stack, stack_nr + 1, stack_alloc);
+			stack[stack_nr].pos = child;
+			stack[stack_nr].next_child = first_child[child];
+			stack[stack_nr].buf = buf;
+			stack[stack_nr].size = size;
+			stack_nr++;
+		}
+		while (stack_nr)
+			free(stack[--stack_nr].buf);
+	}
+
+	/*
+	 * Deltas that cannot be reached from an object that is not a
+	 * delta (i.e. in a cycle, which only a corrupt pack can have)
+	 * are left for the callback to resolve on its own.
+	 */
+	for (pos = 0; pos < nr && !ret; pos++)
+		if (!visited[pos])
+			ret = visit_delta_walk_entry(p, pos, OBJ_NONE, NULL, 0,
+						     fn, data);
+
+	free(stack);
+	free(visited);
+	free(children);
+	free(first_child);
+	free(base);
+	return ret;
+}
+
 int for_each_packed_object(each_packed_object_fn cb, void *data,
 			   enum for_each_object_flags flags)
 {
@@ -94,6 +94,19 @@ void close_pack(struct packed_git *);
 void close_object_store(struct raw_object_store *o);
 void unuse_pack(struct pack_window **);
 void clear_delta_base_cache(void);
+
+/*
+ * Empty the delta base cache and split it into shards that several
+ * threads can use at the same time if "threaded" is set, or merge it
+ * back into a single one otherwise. Must not be called while other
+ * threads are reading objects.
+ */
+void setup_delta_base_cache(int threaded);
+
+/*
+ * Writes out statistics of the delta base cache using the trace2 API.
+ */
+void trace_delta_base_cache_stats(void);
 struct packed_git *add_packed_git(const char *path, size_t path_len, int local);
 
 /*
@@ -142,6 +155,26 @@ off_t find_pack_entry_one(const unsigned char *sha1, struct packed_git *);
 
 int is_pack_valid(struct packed_git *);
 void *unpack_entry(struct repository *r, struct packed_git *, off_t, enum object_type *, unsigned long *);
+
+/*
+ * A packed object reader unpacks objects without obj_read_lock(), so
+ * that threads can read objects concurrently. It maps windows of its
+ * own into the packs, instead of sharing those of the packed_git, and
+ * inflates with zlib streams of its own; only the delta base cache is
+ * shared. Each thread needs its own reader.
+ *
+ * The caller has to find the object's pack entry (with
+ * find_pack_entry(), under obj_read_lock()) beforehand. When the reader
+ * fails, for example on corrupt data or on a REF_DELTA whose pack index
+ * is not open, it returns NULL, and the caller should read the object
+ * the usual way, which also reports the error.
+ */
+struct packed_object_reader;
+struct packed_object_reader *packed_object_reader_new(void);
+void *packed_object_reader_unpack(struct packed_object_reader *rd,
+				  struct packed_git *p, off_t obj_offset,
+				  enum object_type *type, unsigned long *size);
+void packed_object_reader_free(struct packed_object_reader *rd);
 unsigned long unpack_object_header_buffer(const unsigned char *buf, unsigned long len, enum object_type *type, unsigned long *sizep);
 unsigned long get_size_from_delta(struct packed_git *, struct pack_window **, off_t);
 int unpack_object_header(struct packed_git *, struct pack_window **, off_t *, unsigned long *);
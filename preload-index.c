@@ -9,6 +9,7 @@
 #include "progress.h"
 #include "thread-utils.h"
 #include "repository.h"
+#include "lstat-batch.h"
 
 /*
  * Mostly randomly chosen maximum thread counts: we
@@ -31,9 +32,44 @@ struct thread_data {
 	struct pathspec pathspec;
 	struct progress_data *progress;
 	int offset, nr;
+	int use_lstat_batch;
 	int t2_nr_lstat;
+	int t2_nr_batched_lstat;
 };
 
+/* entries waiting to be looked up with lstat_batch() */
+struct preload_batch {
+	struct lstat_batch *lstat;
+	int nr;
+	struct cache_entry *ce[LSTAT_BATCH_MAX];
+	const char *path[LSTAT_BATCH_MAX];
+	struct stat st[LSTAT_BATCH_MAX];
+	int err[LSTAT_BATCH_MAX];
+};
+
+static void preload_entry(struct index_state *index, struct cache_entry *ce,
+			  struct stat *st)
+{
+	if (ie_match_stat(index, ce, st, CE_MATCH_RACY_IS_DIRTY|CE_MATCH_IGNORE_FSMONITOR))
+		return;
+	ce_mark_uptodate(ce);
+	mark_fsmonitor_valid(index, ce);
+}
+
+static void flush_preload_batch(struct index_state *index,
+				struct preload_batch *batch)
+{
+	int i;
+
+	if (!batch->nr)
+		return;
+	lstat_batch(batch->lstat, batch->nr, batch->path, batch->st, batch->err);
+	for (i = 0; i < batch->nr; i++)
+		if (!batch->err[i])
+			preload_entry(index, batch->ce[i], &batch->st[i]);
+	batch->nr = 0;
+}
+
 static void *preload_thread(void *_data)
 {
 	int nr, last_nr;
@@ -41,6 +77,16 @@ static void *preload_thread(void *_data)
 	struct index_state *index = p->index;
 	struct cache_entry **cep = index->cache + p->offset;
 	struct cache_def cache = CACHE_DEF_INIT;
+	struct preload_batch *batch = NULL;
+
+	if (p->use_lstat_batch) {
+		struct lstat_batch *lstat = lstat_batch_new();
+
+		if (lstat) {
+			CALLOC_ARRAY(batch, 1);
+			batch->lstat = lstat;
+		}
+	}
 
 	nr = p->nr;
 	if (nr + p->offset > index->cache_nr)
@@ -75,13 +121,23 @@ static void *preload_thread(void *_data)
 		if (threaded_has_symlink_leading_path(&cache, ce->name, ce_namelen(ce)))
 			continue;
 		p->t2_nr_lstat++;
-		if (lstat(ce->name, &st))
+		if (batch) {
+			p->t2_nr_batched_lstat++;
+			batch->ce[batch->nr] = ce;
+			batch->path[batch->nr] = ce->name;
+			if (++batch->nr == LSTAT_BATCH_MAX)
+				flush_preload_batch(index, batch);
 			continue;
-		if (ie_match_stat(index, ce, &st, CE_MATCH_RACY_IS_DIRTY|CE_MATCH_IGNORE_FSMONITOR))
+		}
+		if (lstat(ce->name, &st))
 			continue;
-		ce_mark_uptodate(ce);
-		mark_fsmonitor_valid(index, ce);
+		preload_entry(index, ce, &st);
 	} while (--nr > 0);
+	if (batch) {
+		flush_preload_batch(index, batch);
+		lstat_batch_free(batch->lstat);
+		free(batch);
+	}
 	if (p->progress) {
 		struct progress_data *pd = p->progress;
 
@@ -101,6 +157,8 @@ void preload_index(struct index_state *index,
 	struct thread_data data[MAX_PARALLEL];
 	struct progress_data pd;
 	int t2_sum_lstat = 0;
+	int t2_sum_batched_lstat = 0;
+	int use_lstat_batch = 0;
 
 	if (!HAVE_THREADS || !core_preload_index)
 		return;
@@ -113,6 +171,11 @@ void preload_index(struct index_state *index,
 
 	trace2_region_enter("index", "preload", NULL);
 
+	if (index->repo) {
+		prepare_repo_settings(index->repo);
+		use_lstat_batch = index->repo->settings.core_io_uring;
+	}
+
 	trace_performance_enter();
 	if (threads > MAX_PARALLEL)
 		threads = MAX_PARALLEL;
@@ -135,6 +198,7 @@ void preload_index(struct index_state *index,
 			copy_pathspec(&p->pathspec, pathspec);
 		p->offset = offset;
 		p->nr = work;
+		p->use_lstat_batch = use_lstat_batch;
 		if (pd.progress)
 			p->progress = &pd;
 		offset += work;
@@ -148,12 +212,16 @@ void preload_index(struct index_state *index,
 		if (pthread_join(p->pthread, NULL))
 			die("unable to join threaded lstat");
 		t2_sum_lstat += p->t2_nr_lstat;
+		t2_sum_batched_lstat += p->t2_nr_batched_lstat;
 	}
 	stop_progress(&pd.progress);
 
 	trace_performance_leave("preload index");
 
 	trace2_data_intmax("index", NULL, "preload/sum_lstat", t2_sum_lstat);
+	if (use_lstat_batch)
+		trace2_data_intmax("index", NULL, "preload/sum_batched_lstat",
+				   t2_sum_batched_lstat);
 	trace2_region_leave("index", "preload", NULL);
 }
 
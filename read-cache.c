@@ -1801,6 +1801,84 @@ struct ondisk_cache_entry {
 #define ondisk_data_size_max(len) (ondisk_data_size(CE_EXTENDED, len))
 #define ondisk_ce_size(ce) (ondisk_cache_entry_size(ondisk_data_size((ce)->ce_flags, ce_namelen(ce))))
 
+/*
+ * Version 5 stores every entry as an image of "struct cache_entry", so
+ * that a reader built with the same layout can use the entries where
+ * the index file is mapped, without parsing or copying them; pages are
+ * only copied when an entry is modified. The layout the images were
+ * written with follows the header as an array of 32-bit numbers, and
+ * readers with any other layout convert the entries using it.
+ */
+enum index_v5_layout_field {
+	V5_LITTLE_ENDIAN,
+	V5_HASH_FORMAT,
+	V5_ENTRIES_SIZE,
+	V5_NAME,
+	V5_OID_HASH,
+	V5_OID_ALGO,
+	V5_CTIME_SEC,
+	V5_CTIME_NSEC,
+	V5_MTIME_SEC,
+	V5_MTIME_NSEC,
+	V5_DEV,
+	V5_INO,
+	V5_UID,
+	V5_GID,
+	V5_SIZE,
+	V5_MODE,
+	V5_FLAGS,
+	V5_MEM_POOL_ALLOCATED,
+	V5_NAMELEN,
+	V5_INDEX,
+	V5_LAYOUT_NR
+};
+
+/* The flags that are saved in a version 5 entry */
+#define CE_V5_FLAGS (CE_STAGEMASK | CE_VALID | CE_EXTENDED | CE_EXTENDED_FLAGS)
+
+#define index_v5_align(size) (((size) + 7) & ~(size_t)7)
+#define index_v5_table_offset() \
+	index_v5_align(sizeof(struct cache_header) + V5_LAYOUT_NR * sizeof(uint32_t))
+#define index_v5_entries_offset(nr) \
+	index_v5_align(index_v5_table_offset() + st_mult((nr), sizeof(uint32_t)))
+#define index_v5_entry_size(name_offset, len) index_v5_align((name_offset) + (len) + 1)
+
+/*
+ * Entries can only be used in place if the mapping may stay around
+ * for as long as the index does.
+ */
+#if defined(NO_MMAP) || defined(MMAP_PREVENTS_DELETE)
+#define INDEX_V5_IN_PLACE 0
+#else
+#define INDEX_V5_IN_PLACE 1
+#endif
+
+static void index_v5_layout(uint32_t *layout)
+{
+	static const uint32_t one = 1;
+
+	layout[V5_LITTLE_ENDIAN] = *(const unsigned char *)&one;
+	layout[V5_HASH_FORMAT] = the_hash_algo->format_id;
+	layout[V5_ENTRIES_SIZE] = 0;
+	layout[V5_NAME] = offsetof(struct cache_entry, name);
+	layout[V5_OID_HASH] = offsetof(struct cache_entry, oid.hash);
+	layout[V5_OID_ALGO] = offsetof(struct cache_entry, oid.algo);
+	layout[V5_CTIME_SEC] = offsetof(struct cache_entry, ce_stat_data.sd_ctime.sec);
+	layout[V5_CTIME_NSEC] = offsetof(struct cache_entry, ce_stat_data.sd_ctime.nsec);
+	layout[V5_MTIME_SEC] = offsetof(struct cache_entry, ce_stat_data.sd_mtime.sec);
+	layout[V5_MTIME_NSEC] = offsetof(struct cache_entry, ce_stat_data.sd_mtime.nsec);
+	layout[V5_DEV] = offsetof(struct cache_entry, ce_stat_data.sd_dev);
+	layout[V5_INO] = offsetof(struct cache_entry, ce_stat_data.sd_ino);
+	layout[V5_UID] = offsetof(struct cache_entry, ce_stat_data.sd_uid);
+	layout[V5_GID] = offsetof(struct cache_entry, ce_stat_data.sd_gid);
+	layout[V5_SIZE] = offsetof(struct cache_entry, ce_stat_data.sd_size);
+	layout[V5_MODE] = offsetof(struct cache_entry, ce_mode);
+	layout[V5_FLAGS] = offsetof(struct cache_entry, ce_flags);
+	layout[V5_MEM_POOL_ALLOCATED] = offsetof(struct cache_entry, mem_pool_allocated);
+	layout[V5_NAMELEN] = offsetof(struct cache_entry, ce_namelen);
+	layout[V5_INDEX] = offsetof(struct cache_entry, index);
+}
+
 /* Allow fsck to force verification of the index checksum. */
 int verify_index_checksum;
 
@@ -1822,6 +1900,10 @@ static int verify_hdr(const struct cache_header *hdr, unsigned long size)
 	if (!verify_index_checksum)
 		return 0;
 
+	/* the index may have been written without a hash, see index.skipHash */
+	if (hasheq((unsigned char *)hdr + size - the_hash_algo->rawsz, null_oid()->hash))
+		return 0;
+
 	the_hash_algo->init_fn(&c);
 	the_hash_algo->update_fn(&c, hdr, size - the_hash_algo->rawsz);
 	the_hash_algo->final_fn(hash, &c);
@@ -2272,6 +2354,177 @@ static void set_new_index_sparsity(struct index_state *istate)
 	}
 }
 
+static uint32_t index_v5_get(const uint32_t *layout, const char *image,
+			     enum index_v5_layout_field field)
+{
+	const unsigned char *p = (const unsigned char *)image + layout[field];
+
+	if (layout[V5_LITTLE_ENDIAN])
+		return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24;
+	return get_be32(p);
+}
+
+/*
+ * Convert an entry written with a layout different from ours.
+ */
+static struct cache_entry *index_v5_convert(struct mem_pool *ce_mem_pool,
+					    const uint32_t *layout,
+					    const char *image, size_t avail)
+{
+	struct cache_entry *ce;
+	unsigned int flags;
+	size_t len;
+
+	len = index_v5_get(layout, image, V5_NAMELEN);
+	if (avail < index_v5_entry_size(layout[V5_NAME], len) ||
+	    image[layout[V5_NAME] + len] ||
+	    index_v5_get(layout, image, V5_MEM_POOL_ALLOCATED) != 1 ||
+	    index_v5_get(layout, image, V5_INDEX) ||
+	    index_v5_get(layout, image, V5_OID_ALGO) !=
+	    hash_algo_by_ptr(the_hash_algo))
+		die(_("index file corrupt"));
+	flags = index_v5_get(layout, image, V5_FLAGS);
+	if (flags & ~CE_V5_FLAGS)
+		die(_("unknown index entry format 0x%08x"), flags);
+
+	ce = mem_pool__ce_alloc(ce_mem_pool, len);
+	ce->ce_stat_data.sd_ctime.sec = index_v5_get(layout, image, V5_CTIME_SEC);
+	ce->ce_stat_data.sd_ctime.nsec = index_v5_get(layout, image, V5_CTIME_NSEC);
+	ce->ce_stat_data.sd_mtime.sec = index_v5_get(layout, image, V5_MTIME_SEC);
+	ce->ce_stat_data.sd_mtime.nsec = index_v5_get(layout, image, V5_MTIME_NSEC);
+	ce->ce_stat_data.sd_dev = index_v5_get(layout, image, V5_DEV);
+	ce->ce_stat_data.sd_ino = index_v5_get(layout, image, V5_INO);
+	ce->ce_stat_data.sd_uid = index_v5_get(layout, image, V5_UID);
+	ce->ce_stat_data.sd_gid = index_v5_get(layout, image, V5_GID);
+	ce->ce_stat_data.sd_size = index_v5_get(layout, image, V5_SIZE);
+	ce->ce_mode = index_v5_get(layout, image, V5_MODE);
+	ce->ce_flags = flags;
+	ce->ce_namelen = len;
+	ce->index = 0;
+	oidread(&ce->oid, (const unsigned char *)image + layout[V5_OID_HASH]);
+	memcpy(ce->name, image + layout[V5_NAME], len + 1);
+	return ce;
+}
+
+/*
+ * Check an entry written with our layout before we use it where it
+ * lies, as index_v5_convert() does for the entries it copies: a corrupt
+ * entry could otherwise make us read past the entries, or free() the
+ * memory of the mapped file. Only read it, so that its page stays
+ * shared with the file.
+ */
+static struct cache_entry *index_v5_use_in_place(const uint32_t *layout,
+						 const char *image,
+						 size_t avail)
+{
+	struct cache_entry *ce = (struct cache_entry *)image;
+
+	if (avail < index_v5_entry_size(layout[V5_NAME], ce->ce_namelen) ||
+	    ce->name[ce->ce_namelen] ||
+	    ce->mem_pool_allocated != 1 || ce->index ||
+	    ce->oid.algo != hash_algo_by_ptr(the_hash_algo))
+		die(_("index file corrupt"));
+	if (ce->ce_flags & ~CE_V5_FLAGS)
+		die(_("unknown index entry format 0x%08x"), ce->ce_flags);
+	return ce;
+}
+
+/*
+ * Point the cache at the entries of a version 5 index, converting them
+ * only when they were written with a different layout. Sets
+ * "*keep_mmap" if the mapping now belongs to the index. Returns the
+ * offset of the extensions.
+ */
+static unsigned long load_index_v5(struct index_state *istate, const char *mmap,
+				   size_t mmap_size, int *keep_mmap)
+{
+	uint32_t layout[V5_LAYOUT_NR], ours[V5_LAYOUT_NR];
+	const unsigned char *table;
+	const char *entries;
+	size_t entries_offset, entries_size, min_size, limit;
+	const char *how;
+	int i;
+
+	limit = mmap_size - the_hash_algo->rawsz;
+	if (index_v5_table_offset() > limit)
+		die(_("index file corrupt"));
+	for (i = 0; i < V5_LAYOUT_NR; i++)
+		layout[i] = get_be32(mmap + sizeof(struct cache_header) +
+				     i * sizeof(uint32_t));
+
+	if (layout[V5_HASH_FORMAT] != the_hash_algo->format_id)
+		die(_("index file uses a different hash algorithm"));
+	if (layout[V5_NAME] < sizeof(uint32_t) ||
+	    layout[V5_NAME] < the_hash_algo->rawsz)
+		die(_("index file corrupt"));
+	for (i = V5_OID_ALGO; i < V5_LAYOUT_NR; i++)
+		if (layout[i] > layout[V5_NAME] - sizeof(uint32_t))
+			die(_("index file corrupt"));
+	if (layout[V5_OID_HASH] > layout[V5_NAME] - the_hash_algo->rawsz)
+		die(_("index file corrupt"));
+
+	table = (const unsigned char *)mmap + index_v5_table_offset();
+	entries_offset = index_v5_entries_offset(istate->cache_nr);
+	entries_size = layout[V5_ENTRIES_SIZE];
+	if (entries_offset > limit || entries_size > limit - entries_offset)
+		die(_("index file corrupt"));
+	entries = mmap + entries_offset;
+	min_size = index_v5_entry_size(layout[V5_NAME], 0);
+
+	istate->ce_mem_pool = xmalloc(sizeof(*istate->ce_mem_pool));
+	index_v5_layout(ours);
+	ours[V5_ENTRIES_SIZE] = layout[V5_ENTRIES_SIZE];
+
+	if (!memcmp(layout, ours, sizeof(ours)) &&
+	    !git_env_bool("GIT_TEST_INDEX_V5_CONVERT", 0)) {
+		if (INDEX_V5_IN_PLACE) {
+			mem_pool_init(istate->ce_mem_pool, 0);
+			mem_pool_adopt_mmap(istate->ce_mem_pool,
+					    (void *)mmap, mmap_size);
+			*keep_mmap = 1;
+			how = "in-place";
+		} else {
+			mem_pool_init(istate->ce_mem_pool, 0);
+			entries = memcpy(mem_pool_alloc(istate->ce_mem_pool,
+							entries_size),
+					 entries, entries_size);
+			how = "copied";
+		}
+		for (i = 0; i < istate->cache_nr; i++) {
+			uint32_t offset = get_be32(table + i * sizeof(uint32_t));
+
+			if ((offset & 7) || entries_size < min_size ||
+			    offset > entries_size - min_size)
+				die(_("index file corrupt"));
+			set_index_entry(istate, i,
+					index_v5_use_in_place(layout,
+							      entries + offset,
+							      entries_size - offset));
+		}
+	} else {
+		mem_pool_init(istate->ce_mem_pool,
+			      estimate_cache_size_from_compressed(istate->cache_nr));
+		for (i = 0; i < istate->cache_nr; i++) {
+			uint32_t offset = get_be32(table + i * sizeof(uint32_t));
+
+			if (offset > entries_size)
+				die(_("index file corrupt"));
+			set_index_entry(istate, i,
+					index_v5_convert(istate->ce_mem_pool, layout,
+							 entries + offset,
+							 entries_size - offset));
+		}
+		how = "converted";
+	}
+
+	/*
+	 * TODO trace2: replace "the_repository" with the actual repo instance
+	 * that is associated with the given "istate".
+	 */
+	trace2_data_string("index", the_repository, "read/v5", how);
+	return entries_offset + entries_size;
+}
+
 /* remember to discard_cache() before reading a different cache! */
 int do_read_index(struct index_state *istate, const char *path, int must_exist)
 {
@@ -2285,6 +2538,8 @@ int do_read_index(struct index_state *istate, const char *path, int must_exist)
 	size_t extension_offset = 0;
 	int nr_threads, cpus;
 	struct index_entry_offset_table *ieot = NULL;
+	struct cache_header peek;
+	int prot = PROT_READ, keep_mmap = 0;
 
 	if (istate->initialized)
 		return istate->cache_nr;
@@ -2307,7 +2562,17 @@ int do_read_index(struct index_state *istate, const char *path, int must_exist)
 	if (mmap_size < sizeof(struct cache_header) + the_hash_algo->rawsz)
 		die(_("%s: index file smaller than expected"), path);
 
-	mmap = xmmap_gently(NULL, mmap_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	/*
+	 * The entries of a version 5 index are used in place, and
+	 * modifying them must only touch our copy of the pages.
+	 */
+	if (INDEX_V5_IN_PLACE &&
+	    pread_in_full(fd, &peek, sizeof(peek), 0) == sizeof(peek) &&
+	    peek.hdr_signature == htonl(CACHE_SIGNATURE) &&
+	    peek.hdr_version == htonl(5))
+		prot |= PROT_WRITE;
+
+	mmap = xmmap_gently(NULL, mmap_size, prot, MAP_PRIVATE, fd, 0);
 	if (mmap == MAP_FAILED)
 		die_errno(_("%s: unable to map index file%s"), path,
 			mmap_os_err());
@@ -2365,7 +2630,10 @@ int do_read_index(struct index_state *istate, const char *path, int must_exist)
 	if (extension_offset && nr_threads > 1)
 		ieot = read_ieot_extension(mmap, mmap_size, extension_offset);
 
-	if (ieot) {
+	if (istate->version == 5) {
+		src_offset = load_index_v5(istate, mmap, mmap_size, &keep_mmap);
+		free(ieot);
+	} else if (ieot) {
 		src_offset += load_cache_entries_threaded(istate, mmap, mmap_size, nr_threads, ieot);
 		free(ieot);
 	} else {
@@ -2374,6 +2642,7 @@ int do_read_index(struct index_state *istate, const char *path, int must_exist)
 
 	istate->timestamp.sec = st.st_mtime;
 	istate->timestamp.nsec = ST_MTIME_NSEC(st);
+	fill_stat_data(&istate->file_stat, &st);
 
 	/* if we created a thread, join it otherwise load the extensions on the primary thread */
 	if (extension_offset) {
@@ -2384,7 +2653,8 @@ int do_read_index(struct index_state *istate, const char *path, int must_exist)
 		p.src_offset = src_offset;
 		load_index_extensions(&p);
 	}
-	munmap((void *)mmap, mmap_size);
+	if (!keep_mmap)
+		munmap((void *)mmap, mmap_size);
 
 	/*
 	 * TODO trace2: replace "the_repository" with the actual repo instance
@@ -2517,6 +2787,7 @@ int discard_index(struct index_state *istate)
 	istate->cache_changed = 0;
 	istate->timestamp.sec = 0;
 	istate->timestamp.nsec = 0;
+	memset(&istate->file_stat, 0, sizeof(istate->file_stat));
 	free_name_hash(istate);
 	cache_tree_free(&(istate->cache_tree));
 	istate->initialized = 0;
@@ -2712,7 +2983,7 @@ static void copy_cache_entry_to_ondisk(struct ondisk_cache_entry *ondisk,
 	}
 }
 
-static int ce_write_entry(struct hashfile *f, struct cache_entry *ce,
+static int ce_write_entry(struct strbuf *out, struct cache_entry *ce,
 			  struct strbuf *previous_name, struct ondisk_cache_entry *ondisk)
 {
 	int size;
@@ -2731,9 +3002,9 @@ static int ce_write_entry(struct hashfile *f, struct cache_entry *ce,
 	if (!previous_name) {
 		int len = ce_namelen(ce);
 		copy_cache_entry_to_ondisk(ondisk, ce);
-		hashwrite(f, ondisk, size);
-		hashwrite(f, ce->name, len);
-		hashwrite(f, padding, align_padding_size(size, len));
+		strbuf_add(out, ondisk, size);
+		strbuf_add(out, ce->name, len);
+		strbuf_add(out, padding, align_padding_size(size, len));
 	} else {
 		int common, to_remove, prefix_size;
 		unsigned char to_remove_vi[16];
@@ -2747,10 +3018,10 @@ static int ce_write_entry(struct hashfile *f, struct cache_entry *ce,
 		prefix_size = encode_varint(to_remove, to_remove_vi);
 
 		copy_cache_entry_to_ondisk(ondisk, ce);
-		hashwrite(f, ondisk, size);
-		hashwrite(f, to_remove_vi, prefix_size);
-		hashwrite(f, ce->name + common, ce_namelen(ce) - common);
-		hashwrite(f, padding, 1);
+		strbuf_add(out, ondisk, size);
+		strbuf_add(out, to_remove_vi, prefix_size);
+		strbuf_add(out, ce->name + common, ce_namelen(ce) - common);
+		strbuf_add(out, padding, 1);
 
 		strbuf_splice(previous_name, common, to_remove,
 			      ce->name + common, ce_namelen(ce) - common);
@@ -2763,9 +3034,89 @@ static int ce_write_entry(struct hashfile *f, struct cache_entry *ce,
 	return 0;
 }
 
+static unsigned int ce_v5_namelen(const struct cache_entry *ce)
+{
+	return (ce->ce_flags & CE_STRIP_NAME) ? 0 : ce_namelen(ce);
+}
+
+#define ce_v5_size(ce) \
+	index_v5_entry_size(offsetof(struct cache_entry, name), ce_v5_namelen(ce))
+
+/*
+ * Return the size of the entries of a version 5 index. The offset
+ * table can only address 4GB of them.
+ */
+static size_t index_v5_entries_size(struct index_state *istate)
+{
+	size_t size = 0;
+	int i;
+
+	for (i = 0; i < istate->cache_nr; i++)
+		if (!(istate->cache[i]->ce_flags & CE_REMOVE))
+			size = st_add(size, ce_v5_size(istate->cache[i]));
+	return size;
+}
+
+static void write_index_v5_table(struct hashfile *f, struct index_state *istate,
+				 int entries, size_t entries_size)
+{
+	static unsigned char padding[8] = { 0x00 };
+	uint32_t layout[V5_LAYOUT_NR];
+	uint32_t offset = 0;
+	int i;
+
+	index_v5_layout(layout);
+	layout[V5_ENTRIES_SIZE] = entries_size;
+	for (i = 0; i < V5_LAYOUT_NR; i++)
+		hashwrite_be32(f, layout[i]);
+	hashwrite(f, padding, index_v5_table_offset() -
+		  sizeof(struct cache_header) - sizeof(layout));
+
+	for (i = 0; i < istate->cache_nr; i++) {
+		struct cache_entry *ce = istate->cache[i];
+
+		if (ce->ce_flags & CE_REMOVE)
+			continue;
+		hashwrite_be32(f, offset);
+		offset += ce_v5_size(ce);
+	}
+	hashwrite(f, padding, index_v5_entries_offset(entries) -
+		  index_v5_table_offset() - st_mult(entries, sizeof(uint32_t)));
+}
+
+static void ce_write_entry_v5(struct hashfile *f, struct cache_entry *ce,
+			      struct strbuf *buf)
+{
+	unsigned int len = ce_v5_namelen(ce);
+	size_t size = ce_v5_size(ce);
+	struct cache_entry *image;
+
+	strbuf_reset(buf);
+	strbuf_grow(buf, size);
+	memset(buf->buf, 0, size);
+	image = (struct cache_entry *)buf->buf;
+
+	image->ce_stat_data = ce->ce_stat_data;
+	image->ce_mode = ce->ce_mode;
+	image->ce_flags = ce->ce_flags & CE_V5_FLAGS;
+	image->mem_pool_allocated = 1;
+	image->ce_namelen = len;
+	hashcpy(image->oid.hash, ce->oid.hash);
+	image->oid.algo = hash_algo_by_ptr(the_hash_algo);
+	memcpy(image->name, ce->name, len);
+	hashwrite(f, image, size);
+
+	ce->ce_flags &= ~CE_STRIP_NAME;
+}
+
 /*
  * This function verifies if index_state has the correct sha1 of the
  * index file.  Don't die if we have any other failure, just return 0.
+ *
+ * An index written with index.skipHash has a null trailer, which
+ * would match any other such index; compare the stat data of the file
+ * instead, so that we do not overwrite an index somebody else wrote
+ * since we read ours.
  */
 static int verify_index_from(const struct index_state *istate, const char *path)
 {
@@ -2784,6 +3135,13 @@ static int verify_index_from(const struct index_state *istate, const char *path)
 	if (fstat(fd, &st))
 		goto out;
 
+	if (is_null_oid(&istate->oid)) {
+		if (match_stat_data(&istate->file_stat, &st))
+			goto out;
+		close(fd);
+		return 1;
+	}
+
 	if (st.st_size < sizeof(struct cache_header) + the_hash_algo->rawsz)
 		goto out;
 
@@ -2861,6 +3219,208 @@ static int record_ieot(void)
 	return !git_config_get_index_threads(&val) && val != 1;
 }
 
+/*
+ * When the index is written without a trailing hash, the entries are
+ * cut into blocks recorded in the IEOT extension, at entries whose
+ * name hashes to a multiple of the block size. As the boundaries only
+ * depend on the names around them, most blocks of the index being
+ * replaced come out the same, and their bytes can be shared with the
+ * old file instead of being written again.
+ */
+#define INDEX_BLOCK_ENTRIES 1024
+
+static int index_block_boundary(const struct cache_entry *ce)
+{
+	static int block_entries;
+
+	if (!block_entries)
+		block_entries = git_env_ulong("GIT_TEST_INDEX_BLOCK_ENTRIES",
+					      INDEX_BLOCK_ENTRIES);
+	return !(memhash(ce->name, ce_namelen(ce)) % block_entries);
+}
+
+struct index_reuse {
+	int fd;
+	const char *mmap;
+	size_t mmap_size;
+	unsigned int version;
+	struct index_entry_offset_table *ieot;
+	/* the end of the last block of entries */
+	size_t entries_end;
+	/* the first block that may still match a block being written */
+	int next;
+	/* the block that starts with the same entry as the one being written */
+	int match;
+	int reused;
+	size_t reused_bytes;
+	size_t copied_bytes;
+};
+
+static size_t index_reuse_block_end(struct index_reuse *r, int block)
+{
+	if (block + 1 < r->ieot->nr)
+		return r->ieot->entries[block + 1].offset;
+	return r->entries_end;
+}
+
+static void index_reuse_close(struct index_reuse *r)
+{
+	if (!r)
+		return;
+	/*
+	 * TODO trace2: replace "the_repository" with the actual repo instance
+	 * that is associated with the given "istate".
+	 */
+	trace2_data_intmax("index", the_repository, "write/reused_blocks",
+			   r->reused);
+	trace2_data_intmax("index", the_repository, "write/reused_bytes",
+			   r->reused_bytes);
+	trace2_data_intmax("index", the_repository, "write/copied_bytes",
+			   r->copied_bytes);
+	free(r->ieot);
+	munmap((void *)r->mmap, r->mmap_size);
+	close(r->fd);
+	free(r);
+}
+
+/*
+ * Open the index at "path" to share its blocks with a new index of
+ * the given version. Returns NULL if there is nothing to share.
+ */
+static struct index_reuse *index_reuse_open(const char *path,
+					    unsigned int version)
+{
+	struct index_reuse *r;
+	const struct cache_header *hdr;
+	struct stat st;
+	int i;
+
+	CALLOC_ARRAY(r, 1);
+	r->version = version;
+	r->match = -1;
+	r->fd = open(path, O_RDONLY);
+	if (r->fd < 0) {
+		free(r);
+		return NULL;
+	}
+	if (fstat(r->fd, &st) ||
+	    st.st_size < sizeof(*hdr) + the_hash_algo->rawsz + 8) {
+		close(r->fd);
+		free(r);
+		return NULL;
+	}
+	r->mmap_size = xsize_t(st.st_size);
+	r->mmap = xmmap_gently(NULL, r->mmap_size, PROT_READ, MAP_PRIVATE,
+			       r->fd, 0);
+	if (r->mmap == MAP_FAILED) {
+		close(r->fd);
+		free(r);
+		return NULL;
+	}
+
+	hdr = (const struct cache_header *)r->mmap;
+	if (hdr->hdr_signature != htonl(CACHE_SIGNATURE) ||
+	    ntohl(hdr->hdr_version) != version)
+		goto fail;
+	r->entries_end = read_eoie_extension(r->mmap, r->mmap_size);
+	if (!r->entries_end)
+		goto fail;
+	r->ieot = read_ieot_extension(r->mmap, r->mmap_size, r->entries_end);
+	if (!r->ieot || !r->ieot->nr)
+		goto fail;
+	for (i = 0; i < r->ieot->nr; i++)
+		if (r->ieot->entries[i].offset < sizeof(*hdr) ||
+		    r->ieot->entries[i].offset >= index_reuse_block_end(r, i))
+			goto fail;
+	return r;
+
+fail:
+	index_reuse_close(r);
+	return NULL;
+}
+
+/*
+ * Compare the first entry of an old block with "ce", in the order of
+ * the index.
+ */
+static int index_reuse_compare(struct index_reuse *r, int block,
+			       const struct cache_entry *ce)
+{
+	const unsigned char *p, *end;
+	unsigned int flags;
+	const char *name;
+	size_t len;
+
+	p = (const unsigned char *)r->mmap + r->ieot->entries[block].offset;
+	end = (const unsigned char *)r->mmap + index_reuse_block_end(r, block);
+	p += offsetof(struct ondisk_cache_entry, data) + the_hash_algo->rawsz;
+	if (end - p < 2 * sizeof(uint16_t))
+		return -1;
+	flags = get_be16(p);
+	p += (flags & CE_EXTENDED) ? 2 * sizeof(uint16_t) : sizeof(uint16_t);
+	if (r->version == 4) {
+		while (p < end && (*p & 0x80))
+			p++;
+		p++;
+	}
+	if (p >= end || !memchr(p, '\0', end - p))
+		return -1;
+	name = (const char *)p;
+	len = strlen(name);
+	return cache_name_stage_compare(name, len,
+					(flags & CE_STAGEMASK) >> CE_STAGESHIFT,
+					ce->name, ce_namelen(ce), ce_stage(ce));
+}
+
+/*
+ * Find the old block that starts with "ce", the first entry of the
+ * block being written.
+ */
+static void index_reuse_start(struct index_reuse *r, const struct cache_entry *ce)
+{
+	r->match = -1;
+	while (r->next < r->ieot->nr) {
+		int cmp = index_reuse_compare(r, r->next, ce);
+
+		if (cmp > 0)
+			break;
+		if (!cmp) {
+			r->match = r->next;
+			break;
+		}
+		r->next++;
+	}
+}
+
+/*
+ * Write the "nr" entries encoded in "out", sharing the bytes of the
+ * old block that started with the same entry if they are identical.
+ */
+static void index_reuse_flush(struct index_reuse *r, struct hashfile *f,
+			      struct strbuf *out, int nr)
+{
+	if (r && r->match >= 0) {
+		int block = r->match;
+		size_t start = r->ieot->entries[block].offset;
+		size_t len = index_reuse_block_end(r, block) - start;
+
+		if (r->ieot->entries[block].nr == nr && out->len == len &&
+		    !memcmp(r->mmap + start, out->buf, len)) {
+			size_t copied = hashfile_copy_range(f, r->fd, start, len);
+
+			hashwrite(f, out->buf + copied, len - copied);
+			r->reused++;
+			r->reused_bytes += len;
+			r->copied_bytes += copied;
+			r->next = block + 1;
+			strbuf_reset(out);
+			return;
+		}
+	}
+	hashwrite(f, out->buf, out->len);
+	strbuf_reset(out);
+}
+
 /*
  * On success, `tempfile` is closed. If it is the temporary file
  * of a `struct lock_file`, we will therefore effectively perform
@@ -2869,7 +3429,8 @@ static int record_ieot(void)
  * rely on it.
  */
 static int do_write_index(struct index_state *istate, struct tempfile *tempfile,
-			  int strip_extensions, unsigned flags)
+			  int strip_extensions, const char *previous_path,
+			  unsigned flags)
 {
 	uint64_t start = getnanotime();
 	struct hashfile *f;
@@ -2887,6 +3448,11 @@ static int do_write_index(struct index_state *istate, struct tempfile *tempfile,
 	int ieot_entries = 1;
 	struct index_entry_offset_table *ieot = NULL;
 	int nr, nr_threads;
+	size_t v5_entries_size = 0;
+	struct strbuf v5_image = STRBUF_INIT;
+	struct strbuf out = STRBUF_INIT;
+	struct index_reuse *reuse = NULL;
+	int ieot_alloc = 0, skip_hash = 0;
 
 	f = hashfd(tempfile->fd, tempfile->filename.buf);
 
@@ -2909,6 +3475,13 @@ static int do_write_index(struct index_state *istate, struct tempfile *tempfile,
 	if (istate->version == 3 || istate->version == 2)
 		istate->version = extended ? 3 : 2;
 
+	/* fall back to version 4 when version 5 cannot address the entries */
+	if (istate->version == 5) {
+		v5_entries_size = index_v5_entries_size(istate);
+		if (v5_entries_size > UINT32_MAX)
+			istate->version = 4;
+	}
+
 	hdr_version = istate->version;
 
 	hdr.hdr_signature = htonl(CACHE_SIGNATURE);
@@ -2917,10 +3490,29 @@ static int do_write_index(struct index_state *istate, struct tempfile *tempfile,
 
 	hashwrite(f, &hdr, sizeof(hdr));
 
+	/*
+	 * Only the index proper goes without a hash; shared indexes are
+	 * named after theirs.
+	 */
+	if (previous_path && hdr_version != 5) {
+		struct repository *r = istate->repo ? istate->repo : the_repository;
+
+		prepare_repo_settings(r);
+		skip_hash = r->settings.index_skip_hash;
+	}
+	if (skip_hash) {
+		f->skip_hash = 1;
+		reuse = index_reuse_open(previous_path, hdr_version);
+	}
+
+	if (hdr_version == 5)
+		write_index_v5_table(f, istate, entries - removed, v5_entries_size);
+
 	if (!HAVE_THREADS || git_config_get_index_threads(&nr_threads))
 		nr_threads = 1;
 
-	if (nr_threads != 1 && record_ieot()) {
+	/* version 5 entries need no decoding, and hence no threads */
+	if (nr_threads != 1 && hdr_version != 5 && record_ieot()) {
 		int ieot_blocks, cpus;
 
 		/*
@@ -2943,12 +3535,15 @@ static int do_write_index(struct index_state *istate, struct tempfile *tempfile,
 		 * no reason to write out the IEOT extension if we don't
 		 * have enough blocks to utilize multi-threading
 		 */
-		if (ieot_blocks > 1) {
+		if (ieot_blocks > 1 && !skip_hash) {
 			ieot = xcalloc(1, sizeof(struct index_entry_offset_table)
 				+ (ieot_blocks * sizeof(struct index_entry_offset)));
+			ieot_alloc = ieot_blocks;
 			ieot_entries = DIV_ROUND_UP(entries, ieot_blocks);
 		}
 	}
+	if (skip_hash)
+		CALLOC_ARRAY(ieot, 1);
 
 	offset = hashfile_total(f);
 
@@ -2974,7 +3569,14 @@ static int do_write_index(struct index_state *istate, struct tempfile *tempfile,
 
 			drop_cache_tree = 1;
 		}
-		if (ieot && i && (i % ieot_entries == 0)) {
+		if (skip_hash ? nr && index_block_boundary(ce) :
+		    ieot && i && (i % ieot_entries == 0)) {
+			index_reuse_flush(reuse, f, &out, nr);
+			if (ieot->nr == ieot_alloc) {
+				ieot_alloc = alloc_nr(ieot_alloc);
+				ieot = xrealloc(ieot, st_add(sizeof(*ieot),
+					st_mult(ieot_alloc, sizeof(struct index_entry_offset))));
+			}
 			ieot->entries[ieot->nr].nr = nr;
 			ieot->entries[ieot->nr].offset = offset;
 			ieot->nr++;
@@ -2989,19 +3591,38 @@ static int do_write_index(struct index_state *istate, struct tempfile *tempfile,
 
 			offset = hashfile_total(f);
 		}
-		if (ce_write_entry(f, ce, previous_name, (struct ondisk_cache_entry *)&ondisk) < 0)
+		if (reuse && !nr)
+			index_reuse_start(reuse, ce);
+		if (hdr_version == 5)
+			ce_write_entry_v5(f, ce, &v5_image);
+		else if (ce_write_entry(&out, ce, previous_name, (struct ondisk_cache_entry *)&ondisk) < 0)
 			err = -1;
+		if (!skip_hash) {
+			hashwrite(f, out.buf, out.len);
+			strbuf_reset(&out);
+		}
 
 		if (err)
 			break;
 		nr++;
 	}
 	if (ieot && nr) {
+		index_reuse_flush(reuse, f, &out, nr);
+		if (ieot->nr == ieot_alloc) {
+			ieot_alloc = alloc_nr(ieot_alloc);
+			ieot = xrealloc(ieot, st_add(sizeof(*ieot),
+				st_mult(ieot_alloc, sizeof(struct index_entry_offset))));
+		}
 		ieot->entries[ieot->nr].nr = nr;
 		ieot->entries[ieot->nr].offset = offset;
 		ieot->nr++;
 	}
 	strbuf_release(&previous_name_buf);
+	strbuf_release(&v5_image);
+	strbuf_release(&out);
+	index_reuse_close(reuse);
+	if (ieot && !ieot->nr)
+		FREE_AND_NULL(ieot);
 
 	if (err) {
 		free(ieot);
@@ -3014,7 +3635,7 @@ static int do_write_index(struct index_state *istate, struct tempfile *tempfile,
 	 * The extension headers must be hashed on their own for the
 	 * EOIE extension. Create a hashfile here to compute that hash.
 	 */
-	if (offset && record_eoie()) {
+	if (offset && (skip_hash || record_eoie())) {
 		CALLOC_ARRAY(eoie_c, 1);
 		the_hash_algo->init_fn(eoie_c);
 	}
@@ -3132,6 +3753,7 @@ static int do_write_index(struct index_state *istate, struct tempfile *tempfile,
 		return -1;
 	istate->timestamp.sec = (unsigned int)st.st_mtime;
 	istate->timestamp.nsec = ST_MTIME_NSEC(st);
+	fill_stat_data(&istate->file_stat, &st);
 	trace_performance_since(start, "write index, changed mask = %x", istate->cache_changed);
 
 	/*
@@ -3164,6 +3786,7 @@ static int do_write_locked_index(struct index_state *istate, struct lock_file *l
 {
 	int ret;
 	int was_full = istate->sparse_index == INDEX_EXPANDED;
+	char *path;
 
 	ret = convert_to_sparse(istate, 0);
 
@@ -3178,7 +3801,9 @@ static int do_write_locked_index(struct index_state *istate, struct lock_file *l
 	 */
 	trace2_region_enter_printf("index", "do_write_index", the_repository,
 				   "%s", get_lock_file_path(lock));
-	ret = do_write_index(istate, lock->tempfile, 0, flags);
+	path = get_locked_file_path(lock);
+	ret = do_write_index(istate, lock->tempfile, 0, path, flags);
+	free(path);
 	trace2_region_leave_printf("index", "do_write_index", the_repository,
 				   "%s", get_lock_file_path(lock));
 
@@ -3282,7 +3907,7 @@ static int write_shared_index(struct index_state *istate,
 
 	trace2_region_enter_printf("index", "shared/do_write_index",
 				   the_repository, "%s", get_tempfile_path(*temp));
-	ret = do_write_index(si->base, *temp, 1, flags);
+	ret = do_write_index(si->base, *temp, 1, NULL, flags);
 	trace2_region_leave_printf("index", "shared/do_write_index",
 				   the_repository, "%s", get_tempfile_path(*temp));
 
@@ -20,6 +20,7 @@
 #include "commit-slab.h"
 #include "commit-graph.h"
 #include "commit-reach.h"
+#include "pack-bitmap.h"
 #include "worktree.h"
 #include "hashmap.h"
 #include "strvec.h"
@@ -2228,6 +2229,12 @@ struct ref_filter_cbdata {
 	struct ref_filter *filter;
 	struct contains_cache contains_cache;
 	struct contains_cache no_contains_cache;
+	/*
+	 * --contains is answered for all refs at once in contains_filter(),
+	 * when generation numbers or bitmaps can keep the walk short.
+	 */
+	int batch_contains;
+	struct bitmap_index *bitmap_git;
 };
 
 /*
@@ -2273,12 +2280,15 @@ static int ref_filter_handler(const char *refname, const struct object_id *oid,
 		commit = lookup_commit_reference_gently(the_repository, oid, 1);
 		if (!commit)
 			return 0;
-		/* We perform the filtering for the '--contains' option... */
-		if (filter->with_commit &&
+		/*
+		 * We perform the filtering for the '--contains' option
+		 * here, unless it is left to contains_filter()...
+		 */
+		if (!ref_cbdata->batch_contains && filter->with_commit &&
 		    !commit_contains(filter, commit, filter->with_commit, &ref_cbdata->contains_cache))
 			return 0;
 		/* ...or for the `--no-contains' option */
-		if (filter->no_commit &&
+		if (!ref_cbdata->batch_contains && filter->no_commit &&
 		    commit_contains(filter, commit, filter->no_commit, &ref_cbdata->no_contains_cache))
 			return 0;
 	}
@@ -2338,12 +2348,125 @@ void ref_array_clear(struct ref_array *array)
 
 #define EXCLUDE_REACHED 0
 #define INCLUDE_REACHED 1
+static void keep_marked_items(struct ref_array *array, unsigned int mark,
+			      int include_marked)
+{
+	int i, old_nr = array->nr;
+
+	array->nr = 0;
+	for (i = 0; i < old_nr; i++) {
+		struct ref_array_item *item = array->items[i];
+		int is_marked = !!(item->commit->object.flags & mark);
+
+		if (is_marked == include_marked)
+			array->items[array->nr++] = item;
+		else
+			free_array_item(item);
+	}
+}
+
+struct bitmap_contains_data {
+	struct bitmap_index *bitmap_git;
+	struct commit_list *want;
+	int lookups;
+};
+
+/*
+ * A reach_hint_fn telling whether "commit" can reach any of the commits in
+ * "want" from the reachability bitmap stored for it, or -1 if it has none
+ * (or the bitmaps cannot tell for some of "want").
+ */
+static int bitmap_contains(struct commit *commit, void *vdata)
+{
+	struct bitmap_contains_data *data = vdata;
+	struct commit_list *want;
+	int unknown = 0;
+
+	for (want = data->want; want; want = want->next) {
+		int ret = bitmap_commit_reaches(data->bitmap_git, commit,
+						&want->item->object.oid);
+		if (ret < 0) {
+			unknown = 1;
+			continue;
+		}
+		data->lookups++;
+		if (ret)
+			return 1;
+	}
+	return unknown ? -1 : 0;
+}
+
+static void contains_filter(struct ref_array *array,
+			    struct commit_list *want,
+			    int include_reaching,
+			    struct bitmap_index *bitmap_git)
+{
+	struct bitmap_contains_data data = { bitmap_git, want };
+	struct commit **tips;
+	int i, old_nr = array->nr;
+
+	if (!want)
+		return;
+
+	ALLOC_ARRAY(tips, old_nr);
+	for (i = 0; i < old_nr; i++)
+		tips[i] = array->items[i]->commit;
+
+	/*
+	 * The walk stops at the commits that have a bitmap, and looks the
+	 * wanted commits up in it instead.
+	 */
+	tips_reaching_commits(the_repository, tips, old_nr, want, TMP_MARK,
+			      bitmap_git ? bitmap_contains : NULL, &data);
+	if (bitmap_git)
+		trace2_data_intmax("ref-filter", the_repository,
+				   "contains/bitmap", data.lookups);
+
+	keep_marked_items(array, TMP_MARK, include_reaching);
+
+	clear_commit_marks_many(old_nr, tips, TMP_MARK);
+	free(tips);
+}
+
+/*
+ * Mark with UNINTERESTING those of the "nr" commits in "tips" that are
+ * reachable from "check_reachable", with bit lookups in the result of a
+ * bitmap walk. Returns 0 if there are no bitmaps to walk with.
+ */
+static int mark_reachable_with_bitmap(struct commit_list *check_reachable,
+				      struct commit **tips, int nr)
+{
+	struct rev_info revs;
+	struct bitmap_index *bitmap_git;
+	struct commit_list *cr;
+	int i;
+
+	repo_init_revisions(the_repository, &revs, NULL);
+	for (cr = check_reachable; cr; cr = cr->next)
+		add_pending_object(&revs, &cr->item->object, "");
+
+	bitmap_git = prepare_bitmap_walk(&revs, 0);
+	if (bitmap_git) {
+		for (i = 0; i < nr; i++)
+			if (bitmap_has_oid_in_result(bitmap_git,
+						     &tips[i]->object.oid))
+				tips[i]->object.flags |= UNINTERESTING;
+		trace2_data_intmax("ref-filter", the_repository,
+				   "merged/bitmap", nr);
+		free_bitmap_index(bitmap_git);
+		reset_revision_walk();
+	}
+
+	release_revisions(&revs);
+	return !!bitmap_git;
+}
+
 static void reach_filter(struct ref_array *array,
 			 struct commit_list *check_reachable,
 			 int include_reached)
 {
 	struct rev_info revs;
-	int i, old_nr;
+	int i, old_nr, walked = 0;
 	struct commit **to_clear;
 	struct commit_list *cr;
 
@@ -2351,13 +2474,36 @@ static void reach_filter(struct ref_array *array,
 		return;
 
 	CALLOC_ARRAY(to_clear, array->nr);
+	for (i = 0; i < array->nr; i++)
+		to_clear[i] = array->items[i]->commit;
+
+	/*
+	 * A bitmap walk from the merge commits answers for all the refs at
+	 * once. Without one, but with generation numbers, a walk from the
+	 * merge commits can stop as soon as it is below all the refs it
+	 * has not found yet.
+	 */
+	if (mark_reachable_with_bitmap(check_reachable, to_clear, array->nr))
+		walked = 1;
+	else if (generation_numbers_enabled(the_repository)) {
+		tips_reachable_from_bases(the_repository, check_reachable,
+					  to_clear, array->nr, UNINTERESTING);
+		walked = 1;
+	}
+	if (walked) {
+		old_nr = array->nr;
+		keep_marked_items(array, UNINTERESTING, include_reached);
+		clear_commit_marks_many(old_nr, to_clear, UNINTERESTING);
+		free_commit_list(check_reachable);
+		free(to_clear);
+		return;
+	}
 
 	repo_init_revisions(the_repository, &revs, NULL);
 
 	for (i = 0; i < array->nr; i++) {
 		struct ref_array_item *item = array->items[i];
 		add_pending_object(&revs, &item->commit->object, item->refname);
-		to_clear[i] = item->commit;
 	}
 
 	for (cr = check_reachable; cr; cr = cr->next) {
@@ -2371,19 +2517,7 @@ static void reach_filter(struct ref_array *array,
 		die(_("revision walk setup failed"));
 
 	old_nr = array->nr;
-	array->nr = 0;
-
-	for (i = 0; i < old_nr; i++) {
-		struct ref_array_item *item = array->items[i];
-		struct commit *commit = item->commit;
-
-		int is_merged = !!(commit->object.flags & UNINTERESTING);
-
-		if (is_merged == include_reached)
-			array->items[array->nr++] = array->items[i];
-		else
-			free_array_item(item);
-	}
+	keep_marked_items(array, UNINTERESTING, include_reached);
 
 	clear_commit_marks_many(old_nr, to_clear, ALL_REV_FLAGS);
 
@@ -2414,6 +2548,11 @@ int filter_refs(struct ref_array *array, struct ref_filter *filter, unsigned int
 
 	init_contains_cache(&ref_cbdata.contains_cache);
 	init_contains_cache(&ref_cbdata.no_contains_cache);
+	ref_cbdata.bitmap_git = NULL;
+	if (filter->with_commit || filter->no_commit)
+		ref_cbdata.bitmap_git = prepare_bitmap_git(the_repository);
+	ref_cbdata.batch_contains = ref_cbdata.bitmap_git ||
+		generation_numbers_enabled(the_repository);
 
 	/*  Simple per-ref filtering */
 	if (!filter->kind)
@@ -2441,6 +2580,13 @@ int filter_refs(struct ref_array *array, struct ref_filter *filter, unsigned int
 	clear_contains_cache(&ref_cbdata.no_contains_cache);
 
 	/*  Filters that need revision walking */
+	if (ref_cbdata.batch_contains) {
+		contains_filter(array, filter->with_commit, INCLUDE_REACHED,
+				ref_cbdata.bitmap_git);
+		contains_filter(array, filter->no_commit, EXCLUDE_REACHED,
+				ref_cbdata.bitmap_git);
+	}
+	free_bitmap_index(ref_cbdata.bitmap_git);
 	reach_filter(array, filter->reachable_from, INCLUDE_REACHED);
 	reach_filter(array, filter->unreachable_from, EXCLUDE_REACHED);
 
@@ -119,6 +119,16 @@ int is_branch(const char *refname);
 
 int refs_init_db(struct strbuf *err);
 
+/*
+ * Return the reference storage format with the given name ("files" or
+ * "reftable"), or REF_STORAGE_FORMAT_UNKNOWN if there is no such
+ * format.
+ */
+enum ref_storage_format ref_storage_format_by_name(const char *name);
+
+/* Return the name of the given reference storage format. */
+const char *ref_storage_format_to_name(enum ref_storage_format ref_storage_format);
+
 /*
  * Return the peeled value of the oid currently being iterated via
  * for_each_ref(), etc. This is equivalent to calling:
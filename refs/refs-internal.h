@@ -162,6 +162,16 @@ int refs_read_raw_ref(struct ref_store *ref_store, const char *refname,
 int ref_update_reject_duplicates(struct string_list *refnames,
 				 struct strbuf *err);
 
+/*
+ * Check whether `old_refname` can be renamed to `new_refname` without
+ * a D/F conflict with another existing reference. If there would be a
+ * conflict, emit an error message and return false; otherwise, return
+ * true.
+ */
+int refs_rename_ref_available(struct ref_store *refs,
+			      const char *old_refname,
+			      const char *new_refname);
+
 /*
  * Add a ref_update with the specified properties to transaction, and
  * return a pointer to the new object. This function does not verify
@@ -664,7 +674,6 @@ typedef int read_symbolic_ref_fn(struct ref_store *ref_store, const char *refnam
 				 struct strbuf *referent);
 
 struct ref_storage_be {
-	struct ref_storage_be *next;
 	const char *name;
 	ref_store_init_fn *init;
 	ref_init_db_fn *init_db;
@@ -694,6 +703,7 @@ struct ref_storage_be {
 };
 
 extern struct ref_storage_be refs_be_files;
+extern struct ref_storage_be refs_be_reftable;
 extern struct ref_storage_be refs_be_packed;
 
 /*
@@ -0,0 +1,2113 @@
+#include "../cache.h"
+#include "../config.h"
+#include "../dir.h"
+#include "../iterator.h"
+#include "../object.h"
+#include "../refs.h"
+#include "../reftable/reftable-error.h"
+#include "../reftable/reftable-iterator.h"
+#include "../reftable/reftable-merged.h"
+#include "../reftable/reftable-record.h"
+#include "../reftable/reftable-stack.h"
+#include "../strmap.h"
+#include "../worktree.h"
+#include "refs-internal.h"
+
+/*
+ * Used as a flag in ref_update::flags when the reference being
+ * updated is the referent of HEAD and the update was requested via
+ * HEAD itself, so that no second log-only update of HEAD is queued.
+ */
+#define REF_UPDATE_VIA_HEAD (1 << 8)
+
+struct reftable_ref_store {
+	struct ref_store base;
+
+	/*
+	 * The main stack lives in the common directory and holds all
+	 * shared references, as well as the per-worktree references of
+	 * the main worktree.
+	 */
+	struct reftable_stack *main_stack;
+
+	/*
+	 * The worktree stack lives in the gitdir of a linked worktree
+	 * and holds its per-worktree references. It is NULL when this
+	 * ref store belongs to the main worktree.
+	 */
+	struct reftable_stack *worktree_stack;
+
+	/*
+	 * Stacks of other worktrees, keyed by worktree name, opened on
+	 * demand to resolve "worktrees/<name>/<pseudoref>".
+	 */
+	struct strmap worktree_stacks;
+
+	struct reftable_write_options write_options;
+	char *gitcommondir;
+
+	unsigned int store_flags;
+	int err;
+};
+
+/*
+ * Downcast ref_store to reftable_ref_store. Die if ref_store is not
+ * a reftable_ref_store or if it does not support the capabilities in
+ * required_flags.
+ */
+static struct reftable_ref_store *reftable_be_downcast(struct ref_store *ref_store,
+						       unsigned int required_flags,
+						       const char *caller)
+{
+	struct reftable_ref_store *refs;
+
+	if (ref_store->be != &refs_be_reftable)
+		BUG("ref_store is type \"%s\" not \"reftable\" in %s",
+		    ref_store->be->name, caller);
+
+	refs = (struct reftable_ref_store *)ref_store;
+
+	if ((refs->store_flags & required_flags) != required_flags)
+		BUG("operation %s requires abilities 0x%x, but only have 0x%x",
+		    caller, required_flags, refs->store_flags);
+
+	return refs;
+}
+
+/*
+ * Return the stack that stores `refname`. If the reference name
+ * addresses another worktree ("main-worktree/HEAD" or
+ * "worktrees/<name>/HEAD"), `rewritten_ref` is set to the name of the
+ * reference within that worktree's stack, otherwise to `refname`.
+ */
+static struct reftable_stack *stack_for(struct reftable_ref_store *refs,
+					const char *refname,
+					const char **rewritten_ref)
+{
+	const char *wtname;
+	int wtname_len;
+
+	if (rewritten_ref)
+		*rewritten_ref = refname;
+
+	switch (ref_type(refname)) {
+	case REF_TYPE_PER_WORKTREE:
+	case REF_TYPE_PSEUDOREF:
+		return refs->worktree_stack ? refs->worktree_stack : refs->main_stack;
+	case REF_TYPE_MAIN_PSEUDOREF:
+		parse_worktree_ref(refname, NULL, NULL, rewritten_ref);
+		return refs->main_stack;
+	case REF_TYPE_OTHER_PSEUDOREF: {
+		struct reftable_stack *stack;
+		struct strbuf wt = STRBUF_INIT, path = STRBUF_INIT;
+		int ret;
+
+		parse_worktree_ref(refname, &wtname, &wtname_len, rewritten_ref);
+		strbuf_add(&wt, wtname, wtname_len);
+
+		stack = strmap_get(&refs->worktree_stacks, wt.buf);
+		if (!stack) {
+			strbuf_addf(&path, "%s/worktrees/%s/reftable",
+				    refs->gitcommondir, wt.buf);
+			ret = reftable_new_stack(&stack, path.buf,
+						 refs->write_options);
+			if (ret)
+				die(_("unable to open reftable stack '%s': %s"),
+				    path.buf, reftable_error_str(ret));
+			strmap_put(&refs->worktree_stacks, wt.buf, stack);
+		}
+
+		strbuf_release(&wt);
+		strbuf_release(&path);
+		return stack;
+	}
+	default:
+		return refs->main_stack;
+	}
+}
+
+static int should_write_log(struct reftable_stack *stack, const char *refname,
+			    unsigned int flags)
+{
+	struct reftable_log_record log = { NULL };
+	int ret;
+
+	if (log_all_ref_updates == LOG_REFS_UNSET)
+		log_all_ref_updates = is_bare_repository() ? LOG_REFS_NONE : LOG_REFS_NORMAL;
+
+	if ((flags & REF_FORCE_CREATE_REFLOG) ||
+	    should_autocreate_reflog(refname))
+		return 1;
+
+	ret = reftable_stack_read_log(stack, refname, &log);
+	reftable_log_record_release(&log);
+	return !ret;
+}
+
+static void fill_reftable_log_record(struct reftable_log_record *log)
+{
+	const char *info = git_committer_info(0);
+	struct ident_split split = { NULL };
+	const char *tz;
+	int sign = 1;
+
+	if (split_ident_line(&split, info, strlen(info)))
+		BUG("failed splitting committer info");
+
+	log->value_type = REFTABLE_LOG_UPDATE;
+	log->value.update.name =
+		xstrndup(split.name_begin, split.name_end - split.name_begin);
+	log->value.update.email =
+		xstrndup(split.mail_begin, split.mail_end - split.mail_begin);
+	log->value.update.time = parse_timestamp(split.date_begin, NULL, 10);
+
+	tz = split.tz_begin;
+	if (*tz == '-') {
+		sign = -1;
+		tz++;
+	} else if (*tz == '+') {
+		tz++;
+	}
+	log->value.update.tz_offset = sign * atoi(tz);
+}
+
+static int read_ref_without_reload(struct reftable_stack *stack,
+				   const char *refname,
+				   struct object_id *oid,
+				   struct strbuf *referent,
+				   unsigned int *type)
+{
+	struct reftable_ref_record ref = { NULL };
+	int ret;
+
+	ret = reftable_stack_read_ref(stack, refname, &ref);
+	if (ret)
+		goto done;
+
+	if (ref.value_type == REFTABLE_REF_SYMREF) {
+		strbuf_reset(referent);
+		strbuf_addstr(referent, ref.value.symref);
+		*type |= REF_ISSYMREF;
+	} else if (reftable_ref_record_val1(&ref)) {
+		oidread(oid, reftable_ref_record_val1(&ref));
+	} else {
+		/* We got a tombstone, which should not happen. */
+		BUG("unhandled reference value type %d", ref.value_type);
+	}
+
+done:
+	assert(ret != REFTABLE_API_ERROR);
+	reftable_ref_record_release(&ref);
+	return ret;
+}
+
+/*
+ * Read all reflog entries of `refname`, newest first, into `logs`.
+ * Returns 0 on success or a negative reftable error code.
+ */
+static int read_log_records(struct reftable_stack *stack, const char *refname,
+			    struct reftable_log_record **logs,
+			    size_t *logs_nr)
+{
+	struct reftable_merged_table *mt = reftable_stack_merged_table(stack);
+	struct reftable_iterator it = { NULL };
+	size_t logs_alloc = 0;
+	int ret;
+
+	*logs = NULL;
+	*logs_nr = 0;
+
+	ret = reftable_merged_table_seek_log(mt, &it, refname);
+	while (!ret) {
+		struct reftable_log_record log = { NULL };
+
+		ret = reftable_iterator_next_log(&it, &log);
+		if (ret || strcmp(log.refname, refname)) {
+			reftable_log_record_release(&log);
+			break;
+		}
+
+		ALLOC_GROW(*logs, *logs_nr + 1, logs_alloc);
+		(*logs)[(*logs_nr)++] = log;
+	}
+	reftable_iterator_destroy(&it);
+
+	if (ret < 0) {
+		size_t i;
+		for (i = 0; i < *logs_nr; i++)
+			reftable_log_record_release(&(*logs)[i]);
+		FREE_AND_NULL(*logs);
+		*logs_nr = 0;
+		return ret;
+	}
+	return 0;
+}
+
+static void free_log_records(struct reftable_log_record *logs, size_t logs_nr)
+{
+	size_t i;
+	for (i = 0; i < logs_nr; i++)
+		reftable_log_record_release(&logs[i]);
+	free(logs);
+}
+
+static struct ref_store *reftable_be_init(struct repository *repo,
+					  const char *gitdir,
+					  unsigned int store_flags)
+{
+	struct reftable_ref_store *refs = xcalloc(1, sizeof(*refs));
+	struct strbuf path = STRBUF_INIT;
+	mode_t mask;
+
+	mask = umask(0);
+	umask(mask);
+
+	base_ref_store_init(&refs->base, repo, gitdir, &refs_be_reftable);
+	strmap_init(&refs->worktree_stacks);
+	refs->store_flags = store_flags;
+	refs->write_options.block_size = 4096;
+	refs->write_options.hash_id = repo->hash_algo->format_id;
+	refs->write_options.default_permissions = calc_shared_perm(0666 & ~mask);
+	/*
+	 * Name conflicts are checked by refs_verify_refname_available()
+	 * while preparing a transaction, and reflog messages have
+	 * already been normalized by the generic refs code.
+	 */
+	refs->write_options.skip_name_check = 1;
+	refs->write_options.exact_log_message = 1;
+
+	get_common_dir_noenv(&path, gitdir);
+	refs->gitcommondir = strbuf_detach(&path, NULL);
+
+	strbuf_addf(&path, "%s/reftable", refs->gitcommondir);
+	refs->err = reftable_new_stack(&refs->main_stack, path.buf,
+				       refs->write_options);
+	if (refs->err)
+		goto done;
+
+	/*
+	 * A linked worktree keeps its per-worktree references in a
+	 * separate stack inside its own gitdir.
+	 */
+	if (strcmp(gitdir, refs->gitcommondir)) {
+		strbuf_reset(&path);
+		strbuf_addf(&path, "%s/reftable", gitdir);
+		if (mkdir(path.buf, 0777) < 0 && errno != EEXIST) {
+			refs->err = REFTABLE_IO_ERROR;
+			goto done;
+		}
+		adjust_shared_perm(path.buf);
+
+		refs->err = reftable_new_stack(&refs->worktree_stack, path.buf,
+					       refs->write_options);
+		if (refs->err)
+			goto done;
+	}
+
+done:
+	if (refs->err)
+		error(_("unable to open reftable stack '%s': %s"),
+		      path.buf, reftable_error_str(refs->err));
+	strbuf_release(&path);
+	return &refs->base;
+}
+
+static int reftable_be_init_db(struct ref_store *ref_store, struct strbuf *err)
+{
+	struct reftable_ref_store *refs =
+		reftable_be_downcast(ref_store, REF_STORE_WRITE, "init_db");
+	struct strbuf sb = STRBUF_INIT;
+
+	strbuf_addf(&sb, "%s/reftable", refs->base.gitdir);
+	safe_create_dir(sb.buf, 1);
+	strbuf_reset(&sb);
+
+	/*
+	 * Older versions of Git need a HEAD file and a "refs/" directory
+	 * to recognize this as a repository at all. Point HEAD at an
+	 * invalid branch and make "refs/heads" a file so that they fail
+	 * loudly instead of silently using an empty files backend.
+	 */
+	strbuf_addf(&sb, "%s/HEAD", refs->base.gitdir);
+	write_file(sb.buf, "ref: refs/heads/.invalid");
+	adjust_shared_perm(sb.buf);
+	strbuf_reset(&sb);
+
+	strbuf_addf(&sb, "%s/refs", refs->base.gitdir);
+	safe_create_dir(sb.buf, 1);
+	strbuf_reset(&sb);
+
+	strbuf_addf(&sb, "%s/refs/heads", refs->base.gitdir);
+	if (!file_exists(sb.buf)) {
+		write_file(sb.buf, "this repository uses the reftable format");
+		adjust_shared_perm(sb.buf);
+	}
+
+	strbuf_release(&sb);
+	return 0;
+}
+
+struct reftable_ref_iterator {
+	struct ref_iterator base;
+	struct reftable_ref_store *refs;
+	struct reftable_iterator iter;
+	struct reftable_ref_record ref;
+	struct object_id oid;
+
+	char *prefix;
+	size_t prefix_len;
+	unsigned int flags;
+	int err;
+};
+
+static int reftable_ref_iterator_advance(struct ref_iterator *ref_iterator)
+{
+	struct reftable_ref_iterator *iter =
+		(struct reftable_ref_iterator *)ref_iterator;
+
+	while (!iter->err) {
+		int flags = 0;
+
+		iter->err = reftable_iterator_next_ref(&iter->iter, &iter->ref);
+		if (iter->err)
+			break;
+
+		/*
+		 * References are sorted, so once we are past the prefix
+		 * there is nothing left for us to yield.
+		 */
+		if (strncmp(iter->ref.refname, iter->prefix, iter->prefix_len)) {
+			iter->err = 1;
+			break;
+		}
+
+		/*
+		 * Like the files backend, only yield references in
+		 * "refs/" and leave out HEAD and other pseudorefs.
+		 */
+		if (!starts_with(iter->ref.refname, "refs/"))
+			continue;
+
+		if (iter->flags & DO_FOR_EACH_PER_WORKTREE_ONLY &&
+		    ref_type(iter->ref.refname) != REF_TYPE_PER_WORKTREE)
+			continue;
+
+		switch (iter->ref.value_type) {
+		case REFTABLE_REF_VAL1:
+			oidread(&iter->oid, iter->ref.value.val1);
+			break;
+		case REFTABLE_REF_VAL2:
+			oidread(&iter->oid, iter->ref.value.val2.value);
+			break;
+		case REFTABLE_REF_SYMREF:
+			if (!refs_resolve_ref_unsafe(&iter->refs->base, iter->ref.refname,
+						     RESOLVE_REF_READING, &iter->oid, &flags))
+				oidclr(&iter->oid);
+			flags |= REF_ISSYMREF;
+			break;
+		default:
+			BUG("unhandled reference value type %d", iter->ref.value_type);
+		}
+
+		if (is_null_oid(&iter->oid))
+			flags |= REF_ISBROKEN;
+
+		if (check_refname_format(iter->ref.refname, REFNAME_ALLOW_ONELEVEL)) {
+			if (!refname_is_safe(iter->ref.refname))
+				die(_("refname is dangerous: %s"), iter->ref.refname);
+			oidclr(&iter->oid);
+			flags |= REF_BAD_NAME | REF_ISBROKEN;
+		}
+
+		if (iter->flags & DO_FOR_EACH_OMIT_DANGLING_SYMREFS &&
+		    flags & REF_ISSYMREF &&
+		    flags & REF_ISBROKEN)
+			continue;
+
+		if (!(iter->flags & DO_FOR_EACH_INCLUDE_BROKEN) &&
+		    !ref_resolves_to_object(iter->ref.refname, iter->refs->base.repo,
+					    &iter->oid, flags))
+			continue;
+
+		iter->base.refname = iter->ref.refname;
+		iter->base.oid = &iter->oid;
+		iter->base.flags = flags;
+		return ITER_OK;
+	}
+
+	if (iter->err > 0)
+		return ref_iterator_abort(ref_iterator);
+
+	ref_iterator_abort(ref_iterator);
+	return ITER_ERROR;
+}
+
+static int reftable_ref_iterator_peel(struct ref_iterator *ref_iterator,
+				      struct object_id *peeled)
+{
+	struct reftable_ref_iterator *iter =
+		(struct reftable_ref_iterator *)ref_iterator;
+
+	/*
+	 * Tags are always written together with their peeled value, so a
+	 * reference that does not carry one does not point to a tag.
+	 */
+	if (iter->ref.value_type == REFTABLE_REF_VAL2) {
+		oidread(peeled, iter->ref.value.val2.target_value);
+		return 0;
+	}
+
+	return -1;
+}
+
+static int reftable_ref_iterator_abort(struct ref_iterator *ref_iterator)
+{
+	struct reftable_ref_iterator *iter =
+		(struct reftable_ref_iterator *)ref_iterator;
+
+	reftable_ref_record_release(&iter->ref);
+	reftable_iterator_destroy(&iter->iter);
+	free(iter->prefix);
+	base_ref_iterator_free(ref_iterator);
+	return ITER_DONE;
+}
+
+static struct ref_iterator_vtable reftable_ref_iterator_vtable = {
+	.advance = reftable_ref_iterator_advance,
+	.peel = reftable_ref_iterator_peel,
+	.abort = reftable_ref_iterator_abort
+};
+
+static struct ref_iterator *ref_iterator_for_stack(struct reftable_ref_store *refs,
+						   struct reftable_stack *stack,
+						   const char *prefix,
+						   unsigned int flags)
+{
+	struct reftable_ref_iterator *iter;
+	int ret;
+
+	CALLOC_ARRAY(iter, 1);
+	base_ref_iterator_init(&iter->base, &reftable_ref_iterator_vtable, 1);
+	iter->refs = refs;
+	iter->prefix = xstrdup(prefix ? prefix : "");
+	iter->prefix_len = strlen(iter->prefix);
+	iter->flags = flags;
+
+	ret = refs->err;
+	if (ret)
+		goto done;
+
+	ret = reftable_stack_reload(stack);
+	if (ret)
+		goto done;
+
+	ret = reftable_merged_table_seek_ref(reftable_stack_merged_table(stack),
+					     &iter->iter, iter->prefix);
+
+done:
+	iter->err = ret;
+	return &iter->base;
+}
+
+static enum iterator_selection iterator_select(struct ref_iterator *iter_worktree,
+					       struct ref_iterator *iter_common,
+					       void *cb_data)
+{
+	if (iter_worktree && !iter_common)
+		return ITER_SELECT_0;
+
+	if (iter_common) {
+		/*
+		 * Yield pending worktree and common refs in order.
+		 * Worktree refs shadow common refs of the same name.
+		 */
+		if (iter_worktree) {
+			int cmp = strcmp(iter_worktree->refname,
+					 iter_common->refname);
+			if (cmp < 0)
+				return ITER_SELECT_0;
+			else if (!cmp)
+				return ITER_SELECT_0_SKIP_1;
+		}
+
+		/*
+		 * The main stack also contains the per-worktree refs
+		 * of the main worktree, which we must not yield here.
+		 */
+		if (ref_type(iter_common->refname) == REF_TYPE_NORMAL)
+			return ITER_SELECT_1;
+		return ITER_SKIP_1;
+	}
+
+	return ITER_SELECT_DONE;
+}
+
+static struct ref_iterator *reftable_be_iterator_begin(struct ref_store *ref_store,
+						       const char *prefix,
+						       unsigned int flags)
+{
+	struct reftable_ref_store *refs;
+	unsigned int required_flags = REF_STORE_READ;
+	struct ref_iterator *worktree_iter, *main_iter;
+
+	if (!(flags & DO_FOR_EACH_INCLUDE_BROKEN))
+		required_flags |= REF_STORE_ODB;
+	refs = reftable_be_downcast(ref_store, required_flags, "ref_iterator_begin");
+
+	if (!refs->worktree_stack)
+		return ref_iterator_for_stack(refs, refs->main_stack, prefix, flags);
+
+	worktree_iter = ref_iterator_for_stack(refs, refs->worktree_stack,
+					       prefix, flags);
+	if (flags & DO_FOR_EACH_PER_WORKTREE_ONLY)
+		return worktree_iter;
+
+	main_iter = ref_iterator_for_stack(refs, refs->main_stack, prefix, flags);
+	return merge_ref_iterator_begin(1, worktree_iter, main_iter,
+					iterator_select, NULL);
+}
+
+static int reftable_be_read_raw_ref(struct ref_store *ref_store,
+				    const char *refname,
+				    struct object_id *oid,
+				    struct strbuf *referent,
+				    unsigned int *type,
+				    int *failure_errno)
+{
+	struct reftable_ref_store *refs =
+		reftable_be_downcast(ref_store, REF_STORE_READ, "read_raw_ref");
+	struct reftable_stack *stack;
+	int ret;
+
+	*type = 0;
+
+	if (refs->err < 0)
+		return refs->err;
+
+	stack = stack_for(refs, refname, &refname);
+	ret = reftable_stack_reload(stack);
+	if (ret)
+		return ret;
+
+	ret = read_ref_without_reload(stack, refname, oid, referent, type);
+	if (ret < 0)
+		return ret;
+	if (ret > 0) {
+		*failure_errno = ENOENT;
+		return -1;
+	}
+
+	return 0;
+}
+
+static int reftable_be_read_symbolic_ref(struct ref_store *ref_store,
+					 const char *refname,
+					 struct strbuf *referent)
+{
+	struct reftable_ref_store *refs =
+		reftable_be_downcast(ref_store, REF_STORE_READ, "read_symbolic_ref");
+	struct reftable_ref_record ref = { NULL };
+	struct reftable_stack *stack;
+	int ret;
+
+	if (refs->err < 0)
+		return refs->err;
+
+	stack = stack_for(refs, refname, &refname);
+	ret = reftable_stack_reload(stack);
+	if (ret)
+		return ret;
+
+	ret = reftable_stack_read_ref(stack, refname, &ref);
+	if (ret == 0 && ref.value_type == REFTABLE_REF_SYMREF)
+		strbuf_addstr(referent, ref.value.symref);
+	else
+		ret = -1;
+
+	reftable_ref_record_release(&ref);
+	return ret;
+}
+
+/*
+ * A pending update of a single reference, together with the value the
+ * reference had when the transaction was prepared.
+ */
+struct reftable_transaction_update {
+	struct ref_update *update;
+	struct object_id current_oid;
+};
+
+/*
+ * All updates of a transaction that go into the same stack. They are
+ * written as a single new table.
+ */
+struct write_transaction_table_arg {
+	struct reftable_ref_store *refs;
+	struct reftable_stack *stack;
+	struct reftable_addition *addition;
+	struct reftable_transaction_update *updates;
+	size_t updates_nr;
+	size_t updates_alloc;
+};
+
+struct reftable_transaction_data {
+	struct write_transaction_table_arg *args;
+	size_t args_nr, args_alloc;
+};
+
+static void free_transaction_data(struct reftable_transaction_data *tx_data)
+{
+	size_t i;
+
+	if (!tx_data)
+		return;
+	for (i = 0; i < tx_data->args_nr; i++) {
+		reftable_addition_destroy(tx_data->args[i].addition);
+		free(tx_data->args[i].updates);
+	}
+	free(tx_data->args);
+	free(tx_data);
+}
+
+static const char *original_update_refname(struct ref_update *update)
+{
+	while (update->parent_update)
+		update = update->parent_update;
+	return update->refname;
+}
+
+
+/*
+ * Lock the stack for writing unless this transaction already holds
+ * its lock. The stack is reloaded first so that the addition is based
+ * on its latest state.
+ */
+static int prepare_transaction_stack(struct reftable_ref_store *refs,
+				     struct reftable_transaction_data *tx_data,
+				     struct reftable_stack *stack,
+				     struct write_transaction_table_arg **out,
+				     struct strbuf *err)
+{
+	struct write_transaction_table_arg *arg;
+	size_t i;
+	int ret;
+
+	for (i = 0; i < tx_data->args_nr; i++) {
+		if (tx_data->args[i].stack == stack) {
+			*out = &tx_data->args[i];
+			return 0;
+		}
+	}
+
+	ALLOC_GROW(tx_data->args, tx_data->args_nr + 1, tx_data->args_alloc);
+	arg = &tx_data->args[tx_data->args_nr];
+	memset(arg, 0, sizeof(*arg));
+	arg->refs = refs;
+	arg->stack = stack;
+
+	ret = reftable_stack_reload(stack);
+	if (!ret)
+		ret = reftable_stack_new_addition(&arg->addition, stack);
+	if (ret) {
+		if (ret == REFTABLE_LOCK_ERROR)
+			strbuf_addstr(err, "cannot lock references");
+		else
+			strbuf_addf(err, "cannot lock references: %s",
+				    reftable_error_str(ret));
+		return TRANSACTION_GENERIC_ERROR;
+	}
+
+	tx_data->args_nr++;
+	*out = arg;
+	return 0;
+}
+
+static int queue_transaction_update(struct reftable_ref_store *refs,
+				    struct reftable_transaction_data *tx_data,
+				    struct ref_update *update,
+				    struct object_id *current_oid,
+				    struct strbuf *err)
+{
+	struct write_transaction_table_arg *arg;
+	int ret;
+
+	ret = prepare_transaction_stack(refs, tx_data,
+					stack_for(refs, update->refname, NULL),
+					&arg, err);
+	if (ret)
+		return ret;
+
+	ALLOC_GROW(arg->updates, arg->updates_nr + 1, arg->updates_alloc);
+	arg->updates[arg->updates_nr].update = update;
+	oidcpy(&arg->updates[arg->updates_nr].current_oid, current_oid);
+	arg->updates_nr++;
+
+	return 0;
+}
+
+static int reftable_be_transaction_prepare(struct ref_store *ref_store,
+					   struct ref_transaction *transaction,
+					   struct strbuf *err)
+{
+	struct reftable_ref_store *refs =
+		reftable_be_downcast(ref_store, REF_STORE_WRITE|REF_STORE_MAIN, "ref_transaction_prepare");
+	struct string_list affected_refnames = STRING_LIST_INIT_NODUP;
+	struct strbuf referent = STRBUF_INIT, head_referent = STRBUF_INIT;
+	struct reftable_transaction_data *tx_data = NULL;
+	struct write_transaction_table_arg *arg;
+	struct object_id head_oid;
+	unsigned int head_type = 0;
+	size_t i;
+	int ret;
+
+	ret = refs->err;
+	if (ret < 0)
+		goto done;
+
+	CALLOC_ARRAY(tx_data, 1);
+
+	/*
+	 * Lock all stacks that the initial updates of this transaction
+	 * touch before reading any reference from them, so that our
+	 * checks cannot race with concurrent writers.
+	 */
+	for (i = 0; i < transaction->nr; i++) {
+		struct ref_update *u = transaction->updates[i];
+
+		ret = prepare_transaction_stack(refs, tx_data,
+						stack_for(refs, u->refname, NULL),
+						&arg, err);
+		if (ret)
+			goto done;
+
+		string_list_append(&affected_refnames, u->refname);
+	}
+
+	string_list_sort(&affected_refnames);
+	if (ref_update_reject_duplicates(&affected_refnames, err)) {
+		ret = TRANSACTION_GENERIC_ERROR;
+		goto done;
+	}
+
+	ret = read_ref_without_reload(stack_for(refs, "HEAD", NULL), "HEAD",
+				      &head_oid, &head_referent, &head_type);
+	if (ret < 0)
+		goto done;
+	ret = 0;
+
+	/*
+	 * Note that the loop may append more updates to the transaction
+	 * while we are iterating over it.
+	 */
+	for (i = 0; i < transaction->nr; i++) {
+		struct ref_update *u = transaction->updates[i];
+		struct object_id current_oid = { 0 };
+		struct reftable_stack *stack;
+		const char *rewritten_ref;
+
+		stack = stack_for(refs, u->refname, &rewritten_ref);
+
+		/* Verify that the new object ID is valid. */
+		if ((u->flags & REF_HAVE_NEW) && !is_null_oid(&u->new_oid) &&
+		    !(u->flags & REF_SKIP_OID_VERIFICATION) &&
+		    !(u->flags & REF_LOG_ONLY)) {
+			struct object *o = parse_object(refs->base.repo, &u->new_oid);
+			if (!o) {
+				strbuf_addf(err,
+					    "trying to write ref '%s' with nonexistent object %s",
+					    u->refname, oid_to_hex(&u->new_oid));
+				ret = TRANSACTION_GENERIC_ERROR;
+				goto done;
+			}
+
+			if (o->type != OBJ_COMMIT && is_branch(u->refname)) {
+				strbuf_addf(err,
+					    "trying to write non-commit object %s to branch '%s'",
+					    oid_to_hex(&u->new_oid), u->refname);
+				ret = TRANSACTION_GENERIC_ERROR;
+				goto done;
+			}
+		}
+
+		/*
+		 * If the reference that HEAD points to is updated
+		 * directly, then logically the HEAD reflog should be
+		 * updated too; see split_head_update() in the files
+		 * backend.
+		 */
+		if (head_type & REF_ISSYMREF &&
+		    !(u->flags & REF_LOG_ONLY) &&
+		    !(u->flags & REF_UPDATE_VIA_HEAD) &&
+		    !strcmp(rewritten_ref, head_referent.buf)) {
+			struct ref_update *new_update;
+
+			if (string_list_has_string(&affected_refnames, "HEAD")) {
+				strbuf_addf(err,
+					    "multiple updates for 'HEAD' (including one "
+					    "via its referent '%s') are not allowed",
+					    u->refname);
+				ret = TRANSACTION_NAME_CONFLICT;
+				goto done;
+			}
+
+			new_update = ref_transaction_add_update(
+					transaction, "HEAD",
+					u->flags | REF_LOG_ONLY | REF_NO_DEREF,
+					&u->new_oid, &u->old_oid, u->msg);
+			string_list_insert(&affected_refnames, new_update->refname);
+		}
+
+		ret = read_ref_without_reload(stack, rewritten_ref,
+					      &current_oid, &referent, &u->type);
+		if (ret < 0)
+			goto done;
+		if (ret > 0 && (!(u->flags & REF_HAVE_OLD) || is_null_oid(&u->old_oid))) {
+			/*
+			 * The reference does not exist, and we either have
+			 * no old object ID or expect it not to exist. We
+			 * still need to verify that there is no conflicting
+			 * reference so that we can give a proper error.
+			 */
+			ret = refs_verify_refname_available(ref_store, u->refname,
+							    &affected_refnames, NULL, err);
+			if (ret) {
+				ret = TRANSACTION_NAME_CONFLICT;
+				goto done;
+			}
+
+			/* Deleting a reference that does not exist is a no-op. */
+			if (u->flags & REF_HAVE_NEW && !is_null_oid(&u->new_oid)) {
+				ret = queue_transaction_update(refs, tx_data, u,
+							       &current_oid, err);
+				if (ret)
+					goto done;
+			}
+
+			continue;
+		}
+		if (ret > 0) {
+			/* The reference does not exist, but we expected it to. */
+			strbuf_addf(err, "cannot lock ref '%s': "
+				    "unable to resolve reference '%s'",
+				    original_update_refname(u), u->refname);
+			ret = TRANSACTION_GENERIC_ERROR;
+			goto done;
+		}
+
+		if (u->type & REF_ISSYMREF) {
+			/*
+			 * The stacks are locked at this point, so we can
+			 * resolve the symref without racing other writers.
+			 */
+			const char *resolved = refs_resolve_ref_unsafe(&refs->base, u->refname, 0,
+								       &current_oid, NULL);
+
+			if (u->flags & REF_NO_DEREF) {
+				if (u->flags & REF_HAVE_OLD && !resolved) {
+					strbuf_addf(err, "cannot lock ref '%s': "
+						    "error reading reference", u->refname);
+					ret = TRANSACTION_GENERIC_ERROR;
+					goto done;
+				}
+			} else {
+				struct ref_update *new_update;
+				int new_flags;
+
+				new_flags = u->flags;
+				if (!strcmp(rewritten_ref, "HEAD"))
+					new_flags |= REF_UPDATE_VIA_HEAD;
+
+				if (string_list_has_string(&affected_refnames, referent.buf)) {
+					strbuf_addf(err,
+						    "multiple updates for '%s' (including one "
+						    "via symref '%s') are not allowed",
+						    referent.buf, u->refname);
+					ret = TRANSACTION_NAME_CONFLICT;
+					goto done;
+				}
+
+				/*
+				 * Update the referent of the symref instead,
+				 * and only log the update for the symref
+				 * itself. Its old value is checked when the
+				 * new update is processed.
+				 */
+				new_update = ref_transaction_add_update(
+						transaction, referent.buf, new_flags,
+						&u->new_oid, &u->old_oid, u->msg);
+				new_update->parent_update = u;
+				string_list_insert(&affected_refnames, new_update->refname);
+
+				u->flags |= REF_LOG_ONLY | REF_NO_DEREF;
+				u->flags &= ~REF_HAVE_OLD;
+			}
+		}
+
+		/*
+		 * Verify that the old object matches our expectations.
+		 * The messages match those of the files backend even
+		 * though we never lock individual references.
+		 */
+		if (u->flags & REF_HAVE_OLD && !oideq(&current_oid, &u->old_oid)) {
+			if (is_null_oid(&u->old_oid))
+				strbuf_addf(err, "cannot lock ref '%s': "
+					    "reference already exists",
+					    original_update_refname(u));
+			else if (is_null_oid(&current_oid))
+				strbuf_addf(err, "cannot lock ref '%s': "
+					    "reference is missing but expected %s",
+					    original_update_refname(u),
+					    oid_to_hex(&u->old_oid));
+			else
+				strbuf_addf(err, "cannot lock ref '%s': "
+					    "is at %s but expected %s",
+					    original_update_refname(u),
+					    oid_to_hex(&current_oid),
+					    oid_to_hex(&u->old_oid));
+			ret = TRANSACTION_GENERIC_ERROR;
+			goto done;
+		}
+
+		/*
+		 * Skip updates that would not change anything, unless
+		 * we are about to overwrite a symref or write a log-only
+		 * entry. This also avoids writing needless reflog
+		 * entries.
+		 */
+		if ((u->type & REF_ISSYMREF) ||
+		    (u->flags & REF_LOG_ONLY) ||
+		    (u->flags & REF_HAVE_NEW && !oideq(&current_oid, &u->new_oid))) {
+			ret = queue_transaction_update(refs, tx_data, u,
+						       &current_oid, err);
+			if (ret)
+				goto done;
+		}
+	}
+
+	transaction->backend_data = tx_data;
+	transaction->state = REF_TRANSACTION_PREPARED;
+
+done:
+	assert(ret != REFTABLE_API_ERROR);
+	if (ret) {
+		free_transaction_data(tx_data);
+		transaction->state = REF_TRANSACTION_CLOSED;
+		if (!err->len)
+			strbuf_addf(err, "reftable: transaction prepare: %s",
+				    reftable_error_str(ret));
+		if (ret < 0 && ret != TRANSACTION_GENERIC_ERROR &&
+		    ret != TRANSACTION_NAME_CONFLICT)
+			ret = TRANSACTION_GENERIC_ERROR;
+	}
+	string_list_clear(&affected_refnames, 0);
+	strbuf_release(&referent);
+	strbuf_release(&head_referent);
+
+	return ret;
+}
+
+static int reftable_be_transaction_abort(struct ref_store *ref_store,
+					 struct ref_transaction *transaction,
+					 struct strbuf *err)
+{
+	free_transaction_data(transaction->backend_data);
+	transaction->backend_data = NULL;
+	transaction->state = REF_TRANSACTION_CLOSED;
+	return 0;
+}
+
+static int transaction_update_cmp(const void *a, const void *b)
+{
+	return strcmp(((struct reftable_transaction_update *)a)->update->refname,
+		      ((struct reftable_transaction_update *)b)->update->refname);
+}
+
+/*
+ * Append tombstones for all reflog entries of `refname` to `logs`.
+ */
+static int tombstone_reflog(struct reftable_stack *stack, const char *refname,
+			    struct reftable_log_record **logs, size_t *logs_nr,
+			    size_t *logs_alloc)
+{
+	struct reftable_log_record *existing;
+	size_t existing_nr, i;
+	int ret;
+
+	ret = read_log_records(stack, refname, &existing, &existing_nr);
+	if (ret < 0)
+		return ret;
+
+	for (i = 0; i < existing_nr; i++) {
+		struct reftable_log_record *tombstone;
+
+		ALLOC_GROW(*logs, *logs_nr + 1, *logs_alloc);
+		tombstone = &(*logs)[(*logs_nr)++];
+		memset(tombstone, 0, sizeof(*tombstone));
+		tombstone->refname = xstrdup(refname);
+		tombstone->update_index = existing[i].update_index;
+		tombstone->value_type = REFTABLE_LOG_DELETION;
+	}
+
+	free_log_records(existing, existing_nr);
+	return 0;
+}
+
+static int write_transaction_table(struct reftable_writer *writer, void *cb_data)
+{
+	struct write_transaction_table_arg *arg = cb_data;
+	uint64_t ts = reftable_stack_next_update_index(arg->stack);
+	struct reftable_log_record *logs = NULL;
+	size_t logs_nr = 0, logs_alloc = 0, i;
+	int ret = 0;
+
+	QSORT(arg->updates, arg->updates_nr, transaction_update_cmp);
+
+	reftable_writer_set_limits(writer, ts, ts);
+
+	for (i = 0; i < arg->updates_nr; i++) {
+		struct reftable_transaction_update *tx_update = &arg->updates[i];
+		struct ref_update *u = tx_update->update;
+		const char *refname;
+
+		stack_for(arg->refs, u->refname, &refname);
+
+		if (u->flags & REF_LOG_ONLY) {
+			/* Nothing to do for the reference itself. */
+		} else if (u->flags & REF_HAVE_NEW && is_null_oid(&u->new_oid)) {
+			struct reftable_ref_record ref = {
+				.refname = (char *)refname,
+				.update_index = ts,
+				.value_type = REFTABLE_REF_DELETION,
+			};
+
+			ret = reftable_writer_add_ref(writer, &ref);
+			if (ret < 0)
+				goto done;
+
+			/*
+			 * Like the files backend, drop the reflog of the
+			 * reference together with the reference itself.
+			 */
+			ret = tombstone_reflog(arg->stack, refname, &logs,
+					       &logs_nr, &logs_alloc);
+			if (ret < 0)
+				goto done;
+			continue;
+		} else if (u->flags & REF_HAVE_NEW) {
+			struct reftable_ref_record ref = {
+				.refname = (char *)refname,
+				.update_index = ts,
+			};
+			struct object_id peeled;
+
+			if (peel_object(&u->new_oid, &peeled) == PEEL_PEELED) {
+				ref.value_type = REFTABLE_REF_VAL2;
+				ref.value.val2.value = u->new_oid.hash;
+				ref.value.val2.target_value = peeled.hash;
+			} else {
+				ref.value_type = REFTABLE_REF_VAL1;
+				ref.value.val1 = u->new_oid.hash;
+			}
+
+			ret = reftable_writer_add_ref(writer, &ref);
+			if (ret < 0)
+				goto done;
+		}
+
+		if (u->flags & REF_HAVE_NEW &&
+		    should_write_log(arg->stack, refname, u->flags)) {
+			struct reftable_log_record *log;
+
+			ALLOC_GROW(logs, logs_nr + 1, logs_alloc);
+			log = &logs[logs_nr++];
+			memset(log, 0, sizeof(*log));
+
+			fill_reftable_log_record(log);
+			log->refname = xstrdup(refname);
+			log->update_index = ts;
+			log->value.update.message = xstrfmt("%s\n", u->msg ? u->msg : "");
+			log->value.update.old_hash =
+				xmemdupz(tx_update->current_oid.hash, GIT_MAX_RAWSZ);
+			log->value.update.new_hash =
+				xmemdupz(u->new_oid.hash, GIT_MAX_RAWSZ);
+		}
+	}
+
+	ret = reftable_writer_add_logs(writer, logs, logs_nr);
+
+done:
+	assert(ret != REFTABLE_API_ERROR);
+	free_log_records(logs, logs_nr);
+	return ret;
+}
+
+static int reftable_be_transaction_finish(struct ref_store *ref_store,
+					  struct ref_transaction *transaction,
+					  struct strbuf *err)
+{
+	struct reftable_transaction_data *tx_data = transaction->backend_data;
+	size_t i;
+	int ret = 0;
+
+	for (i = 0; i < tx_data->args_nr; i++) {
+		struct write_transaction_table_arg *arg = &tx_data->args[i];
+
+		if (!arg->updates_nr)
+			continue;
+
+		ret = reftable_addition_add(arg->addition,
+					    write_transaction_table, arg);
+		if (ret < 0)
+			goto done;
+
+		ret = reftable_addition_commit(arg->addition);
+		if (ret < 0)
+			goto done;
+
+		/*
+		 * Keep the number of tables logarithmic in the number of
+		 * updates. Failing to compact, e.g. because a concurrent
+		 * process holds the lock, is not fatal.
+		 */
+		ret = reftable_stack_auto_compact(arg->stack);
+		if (ret < 0 && ret != REFTABLE_LOCK_ERROR)
+			goto done;
+		ret = 0;
+	}
+
+done:
+	assert(ret != REFTABLE_API_ERROR);
+	free_transaction_data(tx_data);
+	transaction->backend_data = NULL;
+	transaction->state = REF_TRANSACTION_CLOSED;
+
+	if (ret) {
+		strbuf_addf(err, "reftable: transaction failure: %s",
+			    reftable_error_str(ret));
+		return TRANSACTION_GENERIC_ERROR;
+	}
+	return ret;
+}
+
+static int reftable_be_initial_transaction_commit(struct ref_store *ref_store,
+						  struct ref_transaction *transaction,
+						  struct strbuf *err)
+{
+	int ret = reftable_be_transaction_prepare(ref_store, transaction, err);
+	if (ret)
+		return ret;
+	return reftable_be_transaction_finish(ref_store, transaction, err);
+}
+
+/*
+ * Write a single new table to `stack` with the given callback while
+ * holding the lock of the stack, and compact the stack afterwards.
+ */
+static int commit_to_stack(struct reftable_stack *stack,
+			   int (*write_table)(struct reftable_writer *, void *),
+			   void *arg)
+{
+	struct reftable_addition *addition = NULL;
+	int ret;
+
+	ret = reftable_stack_reload(stack);
+	if (ret)
+		goto done;
+
+	ret = reftable_stack_new_addition(&addition, stack);
+	if (ret)
+		goto done;
+
+	ret = reftable_addition_add(addition, write_table, arg);
+	if (ret < 0)
+		goto done;
+
+	ret = reftable_addition_commit(addition);
+	if (ret < 0)
+		goto done;
+
+	ret = reftable_stack_auto_compact(stack);
+	if (ret == REFTABLE_LOCK_ERROR)
+		ret = 0;
+
+done:
+	reftable_addition_destroy(addition);
+	return ret;
+}
+
+static int reftable_be_pack_refs(struct ref_store *ref_store, unsigned int flags)
+{
+	struct reftable_ref_store *refs =
+		reftable_be_downcast(ref_store, REF_STORE_WRITE | REF_STORE_ODB, "pack_refs");
+	int ret;
+
+	if (refs->err)
+		return refs->err;
+
+	ret = reftable_stack_compact_all(refs->main_stack, NULL);
+	if (!ret && refs->worktree_stack)
+		ret = reftable_stack_compact_all(refs->worktree_stack, NULL);
+	if (!ret)
+		ret = reftable_stack_clean(refs->main_stack);
+	if (ret)
+		return error(_("unable to compact stack: %s"),
+			     reftable_error_str(ret));
+
+	return 0;
+}
+
+struct write_create_symref_arg {
+	struct reftable_ref_store *refs;
+	struct reftable_stack *stack;
+	const char *refname;
+	const char *target;
+	const char *logmsg;
+};
+
+static int write_create_symref_table(struct reftable_writer *writer, void *cb_data)
+{
+	struct write_create_symref_arg *create = cb_data;
+	uint64_t ts = reftable_stack_next_update_index(create->stack);
+	struct reftable_ref_record ref = {
+		.refname = (char *)create->refname,
+		.value_type = REFTABLE_REF_SYMREF,
+		.value.symref = (char *)create->target,
+		.update_index = ts,
+	};
+	struct reftable_log_record log = { NULL };
+	struct object_id new_oid, old_oid;
+	int ret;
+
+	/*
+	 * Resolve the old value before writing anything. It is only
+	 * needed for the reflog, which we only write when the new
+	 * target resolves, like the files backend does.
+	 */
+	if (!refs_resolve_ref_unsafe(&create->refs->base, create->refname,
+				     RESOLVE_REF_READING, &old_oid, NULL))
+		oidclr(&old_oid);
+
+	reftable_writer_set_limits(writer, ts, ts);
+
+	ret = reftable_writer_add_ref(writer, &ref);
+	if (ret)
+		return ret;
+
+	if (!create->logmsg ||
+	    !refs_resolve_ref_unsafe(&create->refs->base, create->target,
+				     RESOLVE_REF_READING, &new_oid, NULL) ||
+	    !should_write_log(create->stack, create->refname, 0))
+		return 0;
+
+	fill_reftable_log_record(&log);
+	log.refname = xstrdup(create->refname);
+	log.update_index = ts;
+	log.value.update.message = xstrfmt("%s\n", create->logmsg);
+	log.value.update.old_hash = xmemdupz(old_oid.hash, GIT_MAX_RAWSZ);
+	log.value.update.new_hash = xmemdupz(new_oid.hash, GIT_MAX_RAWSZ);
+
+	ret = reftable_writer_add_log(writer, &log);
+	reftable_log_record_release(&log);
+	return ret;
+}
+
+static int reftable_be_create_symref(struct ref_store *ref_store,
+				     const char *refname,
+				     const char *target,
+				     const char *logmsg)
+{
+	struct reftable_ref_store *refs =
+		reftable_be_downcast(ref_store, REF_STORE_WRITE, "create_symref");
+	struct reftable_stack *stack = stack_for(refs, refname, &refname);
+	struct write_create_symref_arg arg = {
+		.refs = refs,
+		.stack = stack,
+		.refname = refname,
+		.target = target,
+		.logmsg = logmsg,
+	};
+	int ret;
+
+	ret = refs->err;
+	if (ret < 0)
+		goto done;
+
+	ret = commit_to_stack(stack, write_create_symref_table, &arg);
+
+done:
+	assert(ret != REFTABLE_API_ERROR);
+	if (ret)
+		error("unable to write symref for %s: %s", refname,
+		      reftable_error_str(ret));
+	return ret;
+}
+
+static int reftable_be_delete_refs(struct ref_store *ref_store,
+				   const char *msg,
+				   struct string_list *refnames,
+				   unsigned int flags)
+{
+	struct ref_transaction *transaction;
+	struct strbuf err = STRBUF_INIT;
+	struct string_list_item *item;
+	int ret = 0;
+
+	if (!refnames->nr)
+		return 0;
+
+	transaction = ref_store_transaction_begin(ref_store, &err);
+	if (!transaction) {
+		ret = error("%s", err.buf);
+		goto out;
+	}
+
+	for_each_string_list_item(item, refnames) {
+		if (ref_transaction_delete(transaction, item->string, NULL,
+					   flags, msg, &err)) {
+			warning(_("could not delete reference %s: %s"),
+				item->string, err.buf);
+			strbuf_reset(&err);
+		}
+	}
+
+	if (ref_transaction_commit(transaction, &err)) {
+		if (refnames->nr == 1)
+			ret = error(_("could not delete reference %s: %s"),
+				    refnames->items[0].string, err.buf);
+		else
+			ret = error(_("could not delete references: %s"), err.buf);
+	}
+
+out:
+	ref_transaction_free(transaction);
+	strbuf_release(&err);
+	return ret;
+}
+
+struct write_copy_arg {
+	struct reftable_ref_store *refs;
+	struct reftable_stack *stack;
+	const char *oldname;
+	const char *newname;
+	const struct object_id *oid;
+	const char *logmsg;
+	int delete_old;
+};
+
+static int has_update_index(struct reftable_log_record *logs, size_t logs_nr,
+			    uint64_t update_index)
+{
+	size_t i;
+	for (i = 0; i < logs_nr; i++)
+		if (logs[i].update_index == update_index)
+			return 1;
+	return 0;
+}
+
+static int write_copy_table(struct reftable_writer *writer, void *cb_data)
+{
+	struct write_copy_arg *arg = cb_data;
+	uint64_t ts = reftable_stack_next_update_index(arg->stack);
+	struct reftable_ref_record refs[2] = { { NULL } };
+	struct reftable_log_record *old_logs = NULL, *new_logs = NULL;
+	size_t old_logs_nr = 0, new_logs_nr = 0, logs_nr = 0, logs_alloc = 0, i;
+	struct reftable_log_record *logs = NULL, *log;
+	struct object_id peeled;
+	size_t refs_nr = 0;
+	int ret;
+
+	reftable_writer_set_limits(writer, ts, ts);
+
+	if (arg->delete_old) {
+		refs[refs_nr].refname = (char *)arg->oldname;
+		refs[refs_nr].update_index = ts;
+		refs[refs_nr].value_type = REFTABLE_REF_DELETION;
+		refs_nr++;
+	}
+
+	refs[refs_nr].refname = (char *)arg->newname;
+	refs[refs_nr].update_index = ts;
+	if (peel_object(arg->oid, &peeled) == PEEL_PEELED) {
+		refs[refs_nr].value_type = REFTABLE_REF_VAL2;
+		refs[refs_nr].value.val2.value = (uint8_t *)arg->oid->hash;
+		refs[refs_nr].value.val2.target_value = peeled.hash;
+	} else {
+		refs[refs_nr].value_type = REFTABLE_REF_VAL1;
+		refs[refs_nr].value.val1 = (uint8_t *)arg->oid->hash;
+	}
+	refs_nr++;
+
+	ret = reftable_writer_add_refs(writer, refs, refs_nr);
+	if (ret < 0)
+		goto done;
+
+	ret = read_log_records(arg->stack, arg->oldname, &old_logs, &old_logs_nr);
+	if (ret < 0)
+		goto done;
+	ret = read_log_records(arg->stack, arg->newname, &new_logs, &new_logs_nr);
+	if (ret < 0)
+		goto done;
+
+	/*
+	 * Drop the reflog the new reference might have had before. Its
+	 * entries are replaced by the ones of the old reference, which
+	 * keep their update indices.
+	 */
+	for (i = 0; i < new_logs_nr; i++) {
+		if (has_update_index(old_logs, old_logs_nr, new_logs[i].update_index))
+			continue;
+
+		ALLOC_GROW(logs, logs_nr + 1, logs_alloc);
+		log = &logs[logs_nr++];
+		memset(log, 0, sizeof(*log));
+		log->refname = xstrdup(arg->newname);
+		log->update_index = new_logs[i].update_index;
+		log->value_type = REFTABLE_LOG_DELETION;
+	}
+
+	for (i = 0; i < old_logs_nr; i++) {
+		if (old_logs[i].value_type != REFTABLE_LOG_UPDATE)
+			continue;
+
+		if (arg->delete_old) {
+			ALLOC_GROW(logs, logs_nr + 1, logs_alloc);
+			log = &logs[logs_nr++];
+			memset(log, 0, sizeof(*log));
+			log->refname = xstrdup(arg->oldname);
+			log->update_index = old_logs[i].update_index;
+			log->value_type = REFTABLE_LOG_DELETION;
+		}
+
+		ALLOC_GROW(logs, logs_nr + 1, logs_alloc);
+		log = &logs[logs_nr++];
+		*log = old_logs[i];
+		memset(&old_logs[i], 0, sizeof(old_logs[i]));
+		free(log->refname);
+		log->refname = xstrdup(arg->newname);
+	}
+
+	if (logs_nr || should_write_log(arg->stack, arg->newname, 0)) {
+		ALLOC_GROW(logs, logs_nr + 1, logs_alloc);
+		log = &logs[logs_nr++];
+		memset(log, 0, sizeof(*log));
+		fill_reftable_log_record(log);
+		log->refname = xstrdup(arg->newname);
+		log->update_index = ts;
+		log->value.update.message = xstrfmt("%s\n", arg->logmsg ? arg->logmsg : "");
+		log->value.update.old_hash = xmemdupz(arg->oid->hash, GIT_MAX_RAWSZ);
+		log->value.update.new_hash = xmemdupz(arg->oid->hash, GIT_MAX_RAWSZ);
+	}
+
+	ret = reftable_writer_add_logs(writer, logs, logs_nr);
+
+done:
+	assert(ret != REFTABLE_API_ERROR);
+	free_log_records(old_logs, old_logs_nr);
+	free_log_records(new_logs, new_logs_nr);
+	free_log_records(logs, logs_nr);
+	return ret;
+}
+
+static int reftable_be_copy_or_rename_ref(struct ref_store *ref_store,
+					  const char *oldrefname,
+					  const char *newrefname,
+					  const char *logmsg, int copy)
+{
+	struct reftable_ref_store *refs =
+		reftable_be_downcast(ref_store, REF_STORE_WRITE, "rename_ref");
+	struct reftable_stack *stack = stack_for(refs, newrefname, &newrefname);
+	struct write_copy_arg arg = {
+		.refs = refs,
+		.stack = stack,
+		.newname = newrefname,
+		.logmsg = logmsg,
+		.delete_old = !copy,
+	};
+	struct object_id orig_oid;
+	int flag = 0;
+	int ret;
+
+	if (refs->err < 0)
+		return refs->err;
+
+	if (stack_for(refs, oldrefname, &oldrefname) != stack)
+		return error(_("cannot move references between worktrees: '%s' to '%s'"),
+			     oldrefname, newrefname);
+	arg.oldname = oldrefname;
+	arg.oid = &orig_oid;
+	if (!strcmp(oldrefname, newrefname))
+		arg.delete_old = 0;
+
+	if (!refs_resolve_ref_unsafe(&refs->base, oldrefname,
+				     RESOLVE_REF_READING | RESOLVE_REF_NO_RECURSE,
+				     &orig_oid, &flag))
+		return error("refname %s not found", oldrefname);
+
+	if (flag & REF_ISSYMREF) {
+		if (copy)
+			return error("refname %s is a symbolic ref, copying it is not supported",
+				     oldrefname);
+		return error("refname %s is a symbolic ref, renaming it is not supported",
+			     oldrefname);
+	}
+
+	if (!refs_rename_ref_available(&refs->base, oldrefname, newrefname))
+		return 1;
+
+	ret = commit_to_stack(stack, write_copy_table, &arg);
+	if (ret) {
+		assert(ret != REFTABLE_API_ERROR);
+		if (copy)
+			error("unable to copy '%s' to '%s': %s", oldrefname,
+			      newrefname, reftable_error_str(ret));
+		else
+			error("unable to rename '%s' to '%s': %s", oldrefname,
+			      newrefname, reftable_error_str(ret));
+		return 1;
+	}
+
+	return 0;
+}
+
+static int reftable_be_rename_ref(struct ref_store *ref_store,
+				  const char *oldrefname,
+				  const char *newrefname,
+				  const char *logmsg)
+{
+	return reftable_be_copy_or_rename_ref(ref_store, oldrefname, newrefname,
+					      logmsg, 0);
+}
+
+static int reftable_be_copy_ref(struct ref_store *ref_store,
+				const char *oldrefname,
+				const char *newrefname,
+				const char *logmsg)
+{
+	return reftable_be_copy_or_rename_ref(ref_store, oldrefname, newrefname,
+					      logmsg, 1);
+}
+
+struct reftable_reflog_iterator {
+	struct ref_iterator base;
+	struct reftable_ref_store *refs;
+	struct reftable_iterator iter;
+	struct reftable_log_record log;
+	struct strbuf last_name;
+	struct object_id oid;
+	int err;
+};
+
+static int reftable_reflog_iterator_advance(struct ref_iterator *ref_iterator)
+{
+	struct reftable_reflog_iterator *iter =
+		(struct reftable_reflog_iterator *)ref_iterator;
+
+	while (!iter->err) {
+		int flags;
+
+		iter->err = reftable_iterator_next_log(&iter->iter, &iter->log);
+		if (iter->err)
+			break;
+
+		/*
+		 * Log records are sorted by reference name, so we only
+		 * need to remember the name we have yielded last to
+		 * produce every reference exactly once.
+		 */
+		if (!strcmp(iter->log.refname, iter->last_name.buf))
+			continue;
+		strbuf_reset(&iter->last_name);
+		strbuf_addstr(&iter->last_name, iter->log.refname);
+
+		if (!refs_resolve_ref_unsafe(&iter->refs->base, iter->log.refname,
+					     0, &iter->oid, &flags)) {
+			error(_("bad ref for %s"), iter->log.refname);
+			continue;
+		}
+
+		iter->base.refname = iter->last_name.buf;
+		iter->base.oid = &iter->oid;
+		iter->base.flags = flags;
+		return ITER_OK;
+	}
+
+	if (iter->err > 0)
+		return ref_iterator_abort(ref_iterator);
+
+	ref_iterator_abort(ref_iterator);
+	return ITER_ERROR;
+}
+
+static int reftable_reflog_iterator_peel(struct ref_iterator *ref_iterator,
+					 struct object_id *peeled)
+{
+	BUG("reftable reflog iterator cannot be peeled");
+	return -1;
+}
+
+static int reftable_reflog_iterator_abort(struct ref_iterator *ref_iterator)
+{
+	struct reftable_reflog_iterator *iter =
+		(struct reftable_reflog_iterator *)ref_iterator;
+
+	reftable_log_record_release(&iter->log);
+	reftable_iterator_destroy(&iter->iter);
+	strbuf_release(&iter->last_name);
+	base_ref_iterator_free(ref_iterator);
+	return ITER_DONE;
+}
+
+static struct ref_iterator_vtable reftable_reflog_iterator_vtable = {
+	.advance = reftable_reflog_iterator_advance,
+	.peel = reftable_reflog_iterator_peel,
+	.abort = reftable_reflog_iterator_abort
+};
+
+static struct ref_iterator *reflog_iterator_for_stack(struct reftable_ref_store *refs,
+						      struct reftable_stack *stack)
+{
+	struct reftable_reflog_iterator *iter;
+	int ret;
+
+	CALLOC_ARRAY(iter, 1);
+	base_ref_iterator_init(&iter->base, &reftable_reflog_iterator_vtable, 1);
+	strbuf_init(&iter->last_name, 0);
+	iter->refs = refs;
+
+	ret = refs->err;
+	if (ret)
+		goto done;
+
+	ret = reftable_stack_reload(stack);
+	if (ret < 0)
+		goto done;
+
+	ret = reftable_merged_table_seek_log(reftable_stack_merged_table(stack),
+					     &iter->iter, "");
+
+done:
+	iter->err = ret;
+	return &iter->base;
+}
+
+static struct ref_iterator *reftable_be_reflog_iterator_begin(struct ref_store *ref_store)
+{
+	struct reftable_ref_store *refs =
+		reftable_be_downcast(ref_store, REF_STORE_READ, "reflog_iterator_begin");
+	struct ref_iterator *main_iter, *worktree_iter;
+
+	main_iter = reflog_iterator_for_stack(refs, refs->main_stack);
+	if (!refs->worktree_stack)
+		return main_iter;
+
+	worktree_iter = reflog_iterator_for_stack(refs, refs->worktree_stack);
+
+	return merge_ref_iterator_begin(1, worktree_iter, main_iter,
+					iterator_select, NULL);
+}
+
+static int yield_log_record(struct reftable_log_record *log,
+			    each_reflog_ent_fn fn,
+			    void *cb_data)
+{
+	struct object_id old_oid, new_oid;
+	struct strbuf committer = STRBUF_INIT;
+	int ret;
+
+	if (log->value_type != REFTABLE_LOG_UPDATE)
+		return 0;
+
+	oidread(&old_oid, log->value.update.old_hash);
+	oidread(&new_oid, log->value.update.new_hash);
+
+	/*
+	 * An entry with both the old and the new object ID being null
+	 * only marks the existence of the reflog, see
+	 * reftable_be_create_reflog(). It is not a real entry.
+	 */
+	if (is_null_oid(&old_oid) && is_null_oid(&new_oid))
+		return 0;
+
+	strbuf_addf(&committer, "%s <%s>", log->value.update.name,
+		    log->value.update.email);
+	ret = fn(&old_oid, &new_oid, committer.buf,
+		 log->value.update.time, log->value.update.tz_offset,
+		 log->value.update.message, cb_data);
+	strbuf_release(&committer);
+	return ret;
+}
+
+static int for_each_reflog_ent_1(struct ref_store *ref_store,
+				 const char *refname,
+				 each_reflog_ent_fn fn,
+				 void *cb_data, int reverse,
+				 const char *caller)
+{
+	struct reftable_ref_store *refs =
+		reftable_be_downcast(ref_store, REF_STORE_READ, caller);
+	struct reftable_stack *stack = stack_for(refs, refname, &refname);
+	struct reftable_log_record *logs = NULL;
+	size_t logs_nr = 0, i;
+	int ret;
+
+	if (refs->err < 0)
+		return refs->err;
+
+	ret = reftable_stack_reload(stack);
+	if (ret < 0)
+		return ret;
+
+	ret = read_log_records(stack, refname, &logs, &logs_nr);
+	if (ret < 0)
+		return ret;
+
+	/* The records are stored newest first. */
+	for (i = 0; !ret && i < logs_nr; i++)
+		ret = yield_log_record(&logs[reverse ? i : logs_nr - i - 1],
+				       fn, cb_data);
+
+	free_log_records(logs, logs_nr);
+	return ret;
+}
+
+static int reftable_be_for_each_reflog_ent(struct ref_store *ref_store,
+					   const char *refname,
+					   each_reflog_ent_fn fn,
+					   void *cb_data)
+{
+	return for_each_reflog_ent_1(ref_store, refname, fn, cb_data, 0,
+				     "for_each_reflog_ent");
+}
+
+static int reftable_be_for_each_reflog_ent_reverse(struct ref_store *ref_store,
+						   const char *refname,
+						   each_reflog_ent_fn fn,
+						   void *cb_data)
+{
+	return for_each_reflog_ent_1(ref_store, refname, fn, cb_data, 1,
+				     "for_each_reflog_ent_reverse");
+}
+
+static int reftable_be_reflog_exists(struct ref_store *ref_store,
+				     const char *refname)
+{
+	struct reftable_ref_store *refs =
+		reftable_be_downcast(ref_store, REF_STORE_READ, "reflog_exists");
+	struct reftable_stack *stack = stack_for(refs, refname, &refname);
+	struct reftable_log_record log = { NULL };
+	int ret;
+
+	if (refs->err < 0)
+		return 0;
+
+	if (reftable_stack_reload(stack) < 0)
+		return 0;
+
+	ret = reftable_stack_read_log(stack, refname, &log);
+	reftable_log_record_release(&log);
+	return !ret;
+}
+
+struct write_reflog_arg {
+	struct reftable_stack *stack;
+	const char *refname;
+};
+
+static int write_reflog_existence_table(struct reftable_writer *writer,
+					void *cb_data)
+{
+	struct write_reflog_arg *arg = cb_data;
+	uint64_t ts = reftable_stack_next_update_index(arg->stack);
+	struct reftable_log_record log = { NULL };
+	int ret;
+
+	ret = reftable_stack_read_log(arg->stack, arg->refname, &log);
+	reftable_log_record_release(&log);
+	if (ret <= 0)
+		return ret;
+
+	reftable_writer_set_limits(writer, ts, ts);
+
+	/*
+	 * A reflog without any entries is represented by a single
+	 * entry whose old and new object IDs are both null.
+	 */
+	log.refname = xstrdup(arg->refname);
+	log.update_index = ts;
+	log.value_type = REFTABLE_LOG_UPDATE;
+	log.value.update.old_hash = xcalloc(1, GIT_MAX_RAWSZ);
+	log.value.update.new_hash = xcalloc(1, GIT_MAX_RAWSZ);
+
+	ret = reftable_writer_add_log(writer, &log);
+	reftable_log_record_release(&log);
+	return ret;
+}
+
+static int reftable_be_create_reflog(struct ref_store *ref_store,
+				     const char *refname,
+				     struct strbuf *err)
+{
+	struct reftable_ref_store *refs =
+		reftable_be_downcast(ref_store, REF_STORE_WRITE, "create_reflog");
+	struct reftable_stack *stack = stack_for(refs, refname, &refname);
+	struct write_reflog_arg arg = {
+		.stack = stack,
+		.refname = refname,
+	};
+	int ret;
+
+	ret = refs->err;
+	if (!ret)
+		ret = commit_to_stack(stack, write_reflog_existence_table, &arg);
+	if (ret) {
+		strbuf_addf(err, "unable to create reflog for '%s': %s",
+			    refname, reftable_error_str(ret));
+		return -1;
+	}
+	return 0;
+}
+
+static int write_reflog_delete_table(struct reftable_writer *writer, void *cb_data)
+{
+	struct write_reflog_arg *arg = cb_data;
+	uint64_t ts = reftable_stack_next_update_index(arg->stack);
+	struct reftable_log_record *logs = NULL;
+	size_t logs_nr = 0, logs_alloc = 0;
+	int ret;
+
+	reftable_writer_set_limits(writer, ts, ts);
+
+	ret = tombstone_reflog(arg->stack, arg->refname, &logs, &logs_nr,
+			       &logs_alloc);
+	if (!ret)
+		ret = reftable_writer_add_logs(writer, logs, logs_nr);
+
+	free_log_records(logs, logs_nr);
+	return ret;
+}
+
+static int reftable_be_delete_reflog(struct ref_store *ref_store,
+				     const char *refname)
+{
+	struct reftable_ref_store *refs =
+		reftable_be_downcast(ref_store, REF_STORE_WRITE, "delete_reflog");
+	struct reftable_stack *stack = stack_for(refs, refname, &refname);
+	struct write_reflog_arg arg = {
+		.stack = stack,
+		.refname = refname,
+	};
+
+	if (refs->err < 0)
+		return refs->err;
+
+	return commit_to_stack(stack, write_reflog_delete_table, &arg);
+}
+
+struct write_reflog_expiry_arg {
+	struct reftable_stack *stack;
+	const char *refname;
+	struct reftable_log_record *logs;
+	size_t logs_nr;
+	const struct object_id *update_oid;
+};
+
+static int write_reflog_expiry_table(struct reftable_writer *writer, void *cb_data)
+{
+	struct write_reflog_expiry_arg *arg = cb_data;
+	uint64_t ts = reftable_stack_next_update_index(arg->stack);
+	int ret;
+
+	reftable_writer_set_limits(writer, ts, ts);
+
+	if (arg->update_oid) {
+		struct reftable_ref_record ref = {
+			.refname = (char *)arg->refname,
+			.update_index = ts,
+		};
+		struct object_id peeled;
+
+		if (peel_object(arg->update_oid, &peeled) == PEEL_PEELED) {
+			ref.value_type = REFTABLE_REF_VAL2;
+			ref.value.val2.value = (uint8_t *)arg->update_oid->hash;
+			ref.value.val2.target_value = peeled.hash;
+		} else {
+			ref.value_type = REFTABLE_REF_VAL1;
+			ref.value.val1 = (uint8_t *)arg->update_oid->hash;
+		}
+
+		ret = reftable_writer_add_ref(writer, &ref);
+		if (ret < 0)
+			return ret;
+	}
+
+	return reftable_writer_add_logs(writer, arg->logs, arg->logs_nr);
+}
+
+static int reftable_be_reflog_expire(struct ref_store *ref_store,
+				     const char *refname,
+				     unsigned int flags,
+				     reflog_expiry_prepare_fn prepare_fn,
+				     reflog_expiry_should_prune_fn should_prune_fn,
+				     reflog_expiry_cleanup_fn cleanup_fn,
+				     void *policy_cb_data)
+{
+	struct reftable_ref_store *refs =
+		reftable_be_downcast(ref_store, REF_STORE_WRITE, "reflog_expire");
+	struct reftable_stack *stack = stack_for(refs, refname, &refname);
+	struct reftable_log_record *logs = NULL, *rewritten = NULL;
+	size_t logs_nr = 0, rewritten_nr = 0, rewritten_alloc = 0, i;
+	struct reftable_addition *add = NULL;
+	struct object_id oid, last_kept_oid = { 0 };
+	struct write_reflog_expiry_arg arg = { 0 };
+	struct strbuf committer = STRBUF_INIT;
+	int ret;
+
+	if (refs->err < 0)
+		return refs->err;
+
+	/*
+	 * Lock the stack for the whole operation so that neither the
+	 * reflog nor the reference can change underneath us.
+	 */
+	ret = reftable_stack_reload(stack);
+	if (ret)
+		goto done;
+	ret = reftable_stack_new_addition(&add, stack);
+	if (ret)
+		goto done;
+
+	ret = read_log_records(stack, refname, &logs, &logs_nr);
+	if (ret < 0)
+		goto done;
+	if (!logs_nr)
+		goto done;
+
+	if (!refs_resolve_ref_unsafe(&refs->base, refname, 0, &oid, NULL))
+		oidclr(&oid);
+
+	prepare_fn(refname, &oid, policy_cb_data);
+
+	/* The records are stored newest first, but we expire oldest first. */
+	for (i = logs_nr; i > 0; i--) {
+		struct reftable_log_record *log = &logs[i - 1];
+		struct object_id old_oid, new_oid, *ooid = &old_oid;
+
+		if (log->value_type != REFTABLE_LOG_UPDATE)
+			continue;
+
+		oidread(&old_oid, log->value.update.old_hash);
+		oidread(&new_oid, log->value.update.new_hash);
+
+		/* Keep the existence marker, see reftable_be_create_reflog(). */
+		if (is_null_oid(&old_oid) && is_null_oid(&new_oid))
+			continue;
+
+		if (flags & EXPIRE_REFLOGS_REWRITE)
+			ooid = &last_kept_oid;
+
+		strbuf_reset(&committer);
+		strbuf_addf(&committer, "%s <%s>", log->value.update.name,
+			    log->value.update.email);
+
+		if (should_prune_fn(ooid, &new_oid, committer.buf,
+				    log->value.update.time,
+				    log->value.update.tz_offset,
+				    log->value.update.message, policy_cb_data)) {
+			struct reftable_log_record *tombstone;
+
+			ALLOC_GROW(rewritten, rewritten_nr + 1, rewritten_alloc);
+			tombstone = &rewritten[rewritten_nr++];
+			memset(tombstone, 0, sizeof(*tombstone));
+			tombstone->refname = xstrdup(refname);
+			tombstone->update_index = log->update_index;
+			tombstone->value_type = REFTABLE_LOG_DELETION;
+			continue;
+		}
+
+		/*
+		 * Entries that we keep only need to be rewritten when
+		 * their old object ID changes.
+		 */
+		if (!oideq(ooid, &old_oid)) {
+			ALLOC_GROW(rewritten, rewritten_nr + 1, rewritten_alloc);
+			rewritten[rewritten_nr] = *log;
+			memset(log, 0, sizeof(*log));
+			memcpy(rewritten[rewritten_nr].value.update.old_hash,
+			       ooid->hash, the_hash_algo->rawsz);
+			rewritten_nr++;
+		}
+
+		oidcpy(&last_kept_oid, &new_oid);
+	}
+
+	cleanup_fn(policy_cb_data);
+
+	if (flags & EXPIRE_REFLOGS_DRY_RUN)
+		goto done;
+
+	arg.stack = stack;
+	arg.refname = refname;
+	arg.logs = rewritten;
+	arg.logs_nr = rewritten_nr;
+
+	/*
+	 * It doesn't make sense to adjust a reference pointed to by a
+	 * symbolic ref based on expiring entries in the symbolic
+	 * reference's reflog. Nor can we update a reference if there are
+	 * no remaining reflog entries.
+	 */
+	if (flags & EXPIRE_REFLOGS_UPDATE_REF && !is_null_oid(&last_kept_oid)) {
+		int type;
+
+		if (refs_resolve_ref_unsafe(&refs->base, refname,
+					    RESOLVE_REF_NO_RECURSE, NULL, &type) &&
+		    !(type & REF_ISSYMREF))
+			arg.update_oid = &last_kept_oid;
+	}
+
+	if (!arg.logs_nr && !arg.update_oid)
+		goto done;
+
+	ret = reftable_addition_add(add, write_reflog_expiry_table, &arg);
+	if (ret < 0)
+		goto done;
+	ret = reftable_addition_commit(add);
+
+done:
+	reftable_addition_destroy(add);
+	free_log_records(logs, logs_nr);
+	free_log_records(rewritten, rewritten_nr);
+	strbuf_release(&committer);
+	if (ret)
+		return error(_("unable to expire reflog of '%s': %s"), refname,
+			     reftable_error_str(ret));
+	return 0;
+}
+
+struct ref_storage_be refs_be_reftable = {
+	.name = "reftable",
+	.init = reftable_be_init,
+	.init_db = reftable_be_init_db,
+	.transaction_prepare = reftable_be_transaction_prepare,
+	.transaction_finish = reftable_be_transaction_finish,
+	.transaction_abort = reftable_be_transaction_abort,
+	.initial_transaction_commit = reftable_be_initial_transaction_commit,
+
+	.pack_refs = reftable_be_pack_refs,
+	.create_symref = reftable_be_create_symref,
+	.delete_refs = reftable_be_delete_refs,
+	.rename_ref = reftable_be_rename_ref,
+	.copy_ref = reftable_be_copy_ref,
+
+	.iterator_begin = reftable_be_iterator_begin,
+	.read_raw_ref = reftable_be_read_raw_ref,
+	.read_symbolic_ref = reftable_be_read_symbolic_ref,
+
+	.reflog_iterator_begin = reftable_be_reflog_iterator_begin,
+	.for_each_reflog_ent = reftable_be_for_each_reflog_ent,
+	.for_each_reflog_ent_reverse = reftable_be_for_each_reflog_ent_reverse,
+	.reflog_exists = reftable_be_reflog_exists,
+	.create_reflog = reftable_be_create_reflog,
+	.delete_reflog = reftable_be_delete_reflog,
+	.reflog_expire = reftable_be_reflog_expire
+};
@@ -489,7 +489,8 @@ static int reftable_stack_init_addition(struct reftable_addition *add,
 	if (err < 0)
 		goto done;
 
-	if (err > 1) {
+	/* somebody else added to the stack since we last read it */
+	if (err > 0) {
 		err = REFTABLE_LOCK_ERROR;
 		goto done;
 	}
@@ -245,6 +245,47 @@ static void test_reftable_stack_uptodate(void)
 	clear_dir(dir);
 }
 
+static void test_reftable_stack_new_addition_outdated(void)
+{
+	struct reftable_write_options cfg = { 0 };
+	struct reftable_stack *st1 = NULL;
+	struct reftable_stack *st2 = NULL;
+	struct reftable_addition *add = NULL;
+	char *dir = get_tmp_dir(__LINE__);
+	int err;
+	struct reftable_ref_record ref = {
+		.refname = "HEAD",
+		.update_index = 1,
+		.value_type = REFTABLE_REF_SYMREF,
+		.value.symref = "master",
+	};
+
+	err = reftable_new_stack(&st1, dir, cfg);
+	EXPECT_ERR(err);
+
+	err = reftable_new_stack(&st2, dir, cfg);
+	EXPECT_ERR(err);
+
+	err = reftable_stack_add(st1, &write_test_ref, &ref);
+	EXPECT_ERR(err);
+
+	/* st2 has not seen the table added through st1 */
+	err = reftable_stack_new_addition(&add, st2);
+	EXPECT(err == REFTABLE_LOCK_ERROR);
+	EXPECT(!add);
+
+	err = reftable_stack_reload(st2);
+	EXPECT_ERR(err);
+
+	err = reftable_stack_new_addition(&add, st2);
+	EXPECT_ERR(err);
+	reftable_addition_destroy(add);
+
+	reftable_stack_destroy(st1);
+	reftable_stack_destroy(st2);
+	clear_dir(dir);
+}
+
 static void test_reftable_stack_transaction_api(void)
 {
 	char *dir = get_tmp_dir(__LINE__);
@@ -965,6 +1006,7 @@ int stack_test_main(int argc, const char *argv[])
 	RUN_TEST(test_reftable_stack_hash_id);
 	RUN_TEST(test_reftable_stack_lock_failure);
 	RUN_TEST(test_reftable_stack_log_normalize);
+	RUN_TEST(test_reftable_stack_new_addition_outdated);
 	RUN_TEST(test_reftable_stack_tombstone);
 	RUN_TEST(test_reftable_stack_transaction_api);
 	RUN_TEST(test_reftable_stack_update_index_check);
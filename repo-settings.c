@@ -2,6 +2,7 @@
 #include "config.h"
 #include "repository.h"
 #include "midx.h"
+#include "thread-utils.h"
 #include "compat/fsmonitor/fsm-listen.h"
 
 static void repo_cfg_bool(struct repository *r, const char *key, int *dest,
@@ -50,6 +51,11 @@ void prepare_repo_settings(struct repository *r)
 	repo_cfg_bool(r, "pack.usesparse", &r->settings.pack_use_sparse, 1);
 	repo_cfg_bool(r, "core.multipackindex", &r->settings.core_multi_pack_index, 1);
 	repo_cfg_bool(r, "index.sparse", &r->settings.sparse_index, 0);
+	repo_cfg_bool(r, "index.skiphash", &r->settings.index_skip_hash, 0);
+	repo_cfg_bool(r, "core.iouring", &r->settings.core_io_uring, 0);
+	repo_cfg_bool(r, "core.looseobjectindex",
+		      &r->settings.core_loose_object_index,
+		      git_env_bool("GIT_TEST_LOOSE_OBJECT_INDEX", 0));
 
 	/*
 	 * The GIT_TEST_MULTI_PACK_INDEX variable is special in that
@@ -81,6 +87,15 @@ void prepare_repo_settings(struct repository *r)
 		free(strval);
 	}
 
+	if (!repo_config_get_int(r, "core.untrackedthreads", &value)) {
+		if (value < 0)
+			die(_("invalid value for '%s': %d"),
+			    "core.untrackedThreads", value);
+		r->settings.core_untracked_threads = value ? value : online_cpus();
+	} else {
+		r->settings.core_untracked_threads = 1;
+	}
+
 	if (!repo_config_get_string(r, "fetch.negotiationalgorithm", &strval)) {
 		int fetch_default = r->settings.fetch_negotiation_algorithm;
 		if (!strcasecmp(strval, "skipping"))
@@ -0,0 +1,132 @@
+#include "test-tool.h"
+#include "cache.h"
+#include "object.h"
+#include "parse-options.h"
+#include "strbuf.h"
+#include "thread-utils.h"
+
+/*
+ * Look up (creating as needed) the objects listed on stdin as
+ * "<oid> <type>" lines, e.g. from "git cat-file --batch-all-objects
+ * --batch-check='%(objectname) %(objecttype)'", from several threads at
+ * once, and make sure that every thread ended up with the same object.
+ */
+
+struct entry {
+	struct object_id oid;
+	enum object_type type;
+};
+
+static struct entry *entries;
+static size_t entries_nr, entries_alloc;
+static int count = 1;
+
+struct lookup_data {
+	pthread_t thread;
+	size_t start;
+	struct object **found;
+};
+
+static void *lookup_all(void *arg)
+{
+	struct lookup_data *d = arg;
+	int round;
+	size_t i;
+
+	/*
+	 * Threads start at different places in the list, so that they
+	 * race each other to create the same objects.
+	 */
+	for (round = 0; round < count; round++) {
+		for (i = 0; i < entries_nr; i++) {
+			size_t pos = (d->start + i) % entries_nr;
+			struct entry *e = &entries[pos];
+
+			d->found[pos] = lookup_object_by_type(the_repository,
+							      &e->oid, e->type);
+		}
+	}
+	return NULL;
+}
+
+int cmd__object_lookup(int argc, const char **argv)
+{
+	const char *usage[] = {
+		"test-tool object-lookup [--threads=<n>] [--count=<n>]",
+		NULL
+	};
+	int nr_threads = 1;
+	struct option options[] = {
+		OPT_INTEGER(0, "threads", &nr_threads,
+			    "look up objects from <n> threads at once"),
+		OPT_INTEGER(0, "count", &count,
+			    "look up all objects <n> times"),
+		OPT_END(),
+	};
+	struct strbuf buf = STRBUF_INIT;
+	struct lookup_data *data;
+	unsigned int i, nr = 0;
+	size_t j;
+	int t;
+
+	setup_git_directory();
+	argc = parse_options(argc, argv, NULL, options, usage, 0);
+	if (argc || nr_threads < 1)
+		usage_with_options(usage, options);
+
+	while (strbuf_getline(&buf, stdin) != EOF) {
+		const char *p;
+		struct entry *e;
+
+		ALLOC_GROW(entries, entries_nr + 1, entries_alloc);
+		e = &entries[entries_nr++];
+		if (parse_oid_hex(buf.buf, &e->oid, &p) || *p++ != ' ')
+			die("invalid line: %s", buf.buf);
+		e->type = type_from_string(p);
+	}
+	strbuf_release(&buf);
+	if (!entries_nr)
+		die("no objects given");
+
+	CALLOC_ARRAY(data, nr_threads);
+	for (t = 0; t < nr_threads; t++) {
+		data[t].start = t * entries_nr / nr_threads;
+		CALLOC_ARRAY(data[t].found, entries_nr);
+	}
+
+	if (nr_threads == 1) {
+		lookup_all(&data[0]);
+	} else {
+		begin_concurrent_object_lookup(the_repository);
+		for (t = 0; t < nr_threads; t++)
+			if (pthread_create(&data[t].thread, NULL,
+					   lookup_all, &data[t]))
+				die("unable to create thread");
+		for (t = 0; t < nr_threads; t++)
+			pthread_join(data[t].thread, NULL);
+		end_concurrent_object_lookup(the_repository);
+	}
+
+	for (j = 0; j < entries_nr; j++) {
+		struct object *obj = lookup_object(the_repository,
+						   &entries[j].oid);
+
+		if (!obj || obj->type != entries[j].type)
+			die("lost object %s", oid_to_hex(&entries[j].oid));
+		for (t = 0; t < nr_threads; t++)
+			if (data[t].found[j] != obj)
+				die("duplicate object %s",
+				    oid_to_hex(&entries[j].oid));
+	}
+
+	for (i = 0; i < get_max_object_index(); i++)
+		if (get_indexed_object(i))
+			nr++;
+	printf("%u objects\n", nr);
+
+	for (t = 0; t < nr_threads; t++)
+		free(data[t].found);
+	free(data);
+	free(entries);
+	return 0;
+}
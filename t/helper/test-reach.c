@@ -164,6 +164,24 @@ int cmd__reach(int ac, const char **av)
 			die(_("too many commits marked reachable"));
 
 		print_sorted_commit_ids(list);
+	} else if (!strcmp(av[1], "tips_reaching_commits") ||
+		   !strcmp(av[1], "tips_reachable_from_bases")) {
+		const int mark = 1;
+		int i;
+		struct commit_list *list = NULL;
+
+		if (!strcmp(av[1], "tips_reaching_commits"))
+			tips_reaching_commits(r, X_array, X_nr, Y, mark,
+					      NULL, NULL);
+		else
+			tips_reachable_from_bases(r, Y, X_array, X_nr, mark);
+
+		printf("%s(X,Y)\n", av[1]);
+		for (i = 0; i < X_nr; i++)
+			if (X_array[i]->object.flags & mark)
+				commit_list_insert(X_array[i], &list);
+		print_sorted_commit_ids(list);
+		free_commit_list(list);
 	}
 
 	return 0;
@@ -53,6 +53,24 @@ test_full_bitmap () {
 	'
 }
 
+# Small queries which only need the bitmap of a single commit. Without a
+# lookup table, these pay for reading every bitmap when opening the index.
+test_bitmap_lookup () {
+	state="$1"
+
+	test_perf "count single tip ($state)" '
+		git rev-list --use-bitmap-index --count HEAD >/dev/null
+	'
+
+	test_perf "simulated small fetch ($state)" '
+		have=$(git rev-list HEAD~1 -1) &&
+		{
+			echo HEAD &&
+			echo ^$have
+		} | git pack-objects --revs --stdout >/dev/null
+	'
+}
+
 test_partial_bitmap () {
 	test_perf 'clone (partial bitmap)' '
 		git pack-objects --stdout --all </dev/null >/dev/null
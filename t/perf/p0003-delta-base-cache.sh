@@ -3,7 +3,9 @@
 test_description='Test operations that emphasize the delta base cache.
 
 We look at both "log --raw", which should put only trees into the delta cache,
-and "log -Sfoo --raw", which should look at both trees and blobs.
+and "log -Sfoo --raw", which should look at both trees and blobs. "log -p"
+and "grep" in a revision read blobs too, the latter from several threads
+sharing the cache.
 
 Any effects will be emphasized if the test repository is fully packed (loose
 objects obviously do not use the delta base cache at all). It is also
@@ -28,4 +30,25 @@ test_perf 'log -S' '
 	git log --raw -Sfoo >/dev/null
 '
 
+test_perf 'log -p' '
+	git log -p -100 >/dev/null
+'
+
+test_expect_success 'set up thread-counting tests' '
+	t=$(test-tool online-cpus) &&
+	threads= &&
+	while test $t -gt 0
+	do
+		threads="$t $threads" &&
+		t=$((t / 2)) || return 1
+	done
+'
+
+for t in $threads
+do
+	test_perf "grep HEAD~10 ($t threads)" "
+		git grep --threads=$t -c -e foo HEAD~10 >/dev/null || :
+	"
+done
+
 test_done
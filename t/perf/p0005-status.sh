@@ -46,4 +46,9 @@ test_perf "read-tree status br_ballast ($nr_files)" '
 	git status
 '
 
+test_perf "read-tree status br_ballast, core.ioUring ($nr_files)" '
+	git read-tree HEAD &&
+	git -c core.ioUring=true status
+'
+
 test_done
@@ -0,0 +1,23 @@
+#!/bin/sh
+
+test_description='Tests concurrent object lookup'
+. ./perf-lib.sh
+
+test_perf_large_repo
+
+test_expect_success 'setup' '
+	git cat-file --batch-all-objects \
+		--batch-check="%(objectname) %(objecttype)" >objects &&
+	threads=$(test-tool online-cpus) &&
+	export threads
+'
+
+test_perf 'single-threaded lookup' '
+	test-tool object-lookup --count=3 <objects
+'
+
+test_perf "lookup with $threads threads" '
+	test-tool object-lookup --threads=$threads --count=3 <objects
+'
+
+test_done
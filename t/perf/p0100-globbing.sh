@@ -40,4 +40,30 @@ do
 	'
 done
 
+test_expect_success 'setup large .gitignore' '
+	for i in $(test_seq 1 5000)
+	do
+		echo "generated$i" &&
+		echo "*.ext$i" &&
+		echo "/out/dir$i" &&
+		echo "src$i/*.gen" || return 1
+	done >.gitignore &&
+	echo "!keep.ext1" >>.gitignore &&
+	mkdir -p untracked/a untracked/b/c &&
+	for i in $(test_seq 1 1000)
+	do
+		>untracked/a/file$i.c &&
+		>untracked/b/file$i.ext$i &&
+		>untracked/b/c/generated$i || return 1
+	done
+'
+
+test_perf 'ls-files -o against a 20000 line .gitignore' '
+	git ls-files -o --exclude-standard >/dev/null
+'
+
+test_perf 'check-ignore against a 20000 line .gitignore' '
+	git ls-files -o untracked | git check-ignore --stdin >/dev/null
+'
+
 test_done
@@ -9,4 +9,24 @@ test_perf 'cat-file --batch-check' '
 	git cat-file --batch-all-objects --batch-check
 '
 
+test_perf 'cat-file --batch-all-objects --batch --unordered' '
+	git cat-file --batch-all-objects --batch --buffer --unordered >/dev/null
+'
+
+test_expect_success 'list objects to read' '
+	git cat-file --batch-all-objects --batch-check="%(objectname)" >objects
+'
+
+test_perf 'cat-file --batch' '
+	git cat-file --batch --buffer <objects >/dev/null
+'
+
+test_perf 'cat-file --batch --threads=4' '
+	git cat-file --batch --buffer --threads=4 <objects >/dev/null
+'
+
+test_perf 'cat-file --batch --threads=4 --unordered' '
+	git cat-file --batch --buffer --threads=4 --unordered <objects >/dev/null
+'
+
 test_done
@@ -17,17 +17,25 @@ test_expect_success "setup" '
 	done >instructions
 '
 
-test_perf "update-ref" '
-	for i in $(test_seq 1000)
-	do
-		git update-ref refs/heads/branch PRE &&
-		git update-ref refs/heads/branch POST PRE &&
-		git update-ref -d refs/heads/branch || return 1
-	done
-'
+for format in files reftable
+do
+	test_expect_success "setup $format repository" '
+		git init --ref-format=$format $format &&
+		git -C $format fetch -q .. PRE:refs/tags/PRE POST:refs/tags/POST
+	'
 
-test_perf "update-ref --stdin" '
-	git update-ref --stdin <instructions >/dev/null
-'
+	test_perf "update-ref ($format)" '
+		for i in $(test_seq 1000)
+		do
+			git -C $format update-ref refs/heads/branch PRE &&
+			git -C $format update-ref refs/heads/branch POST PRE &&
+			git -C $format update-ref -d refs/heads/branch || return 1
+		done
+	'
+
+	test_perf "update-ref --stdin ($format)" '
+		git -C $format update-ref --stdin <instructions >/dev/null
+	'
+done
 
 test_done
@@ -26,4 +26,28 @@ test_perf 'log -p -3000 --patience' '
 	git log -p -3000 --patience >/dev/null
 '
 
+test_expect_success 'set up large generated files' '
+	test_seq 1 500000 |
+	sed "s/.*/entry & of a large generated file, padded to a typical width/" >large.1 &&
+	sed "s/^\(entry [0-9]*37 \)/\1changed /" large.1 >large.2 &&
+	test_seq 1 1000000 |
+	awk "{ printf \"%s,\", \$0; if (NR % 400 == 0) print \"\" }" >long.1 &&
+	sed "s/^\(.*,\)\(9[0-9]*3\),/\1x\2,/" long.1 >long.2
+'
+
+for algo in myers histogram patience
+do
+	test_perf "diff --$algo, large file" "
+		git diff --no-index --$algo large.1 large.2 >/dev/null || :
+	"
+done
+
+test_perf 'diff, large file with long lines' '
+	git diff --no-index long.1 long.2 >/dev/null || :
+'
+
+test_perf 'diff -w, large file' '
+	git diff --no-index -w large.1 large.2 >/dev/null || :
+'
+
 test_done
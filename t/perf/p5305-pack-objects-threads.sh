@@ -0,0 +1,39 @@
+#!/bin/sh
+
+test_description='Tests pack-objects write performance with threads'
+
+. ./perf-lib.sh
+
+test_perf_large_repo
+
+test_expect_success 'setup' '
+	git rev-list --objects --all >objects
+'
+
+# Count down from the number of CPUs, halving each time, so that the
+# last test uses all of them (see p5302).
+test_expect_success 'set up thread-counting tests' '
+	t=$(test-tool online-cpus) &&
+	threads= &&
+	while test $t -gt 0
+	do
+		threads="$t $threads" &&
+		t=$((t / 2)) || return 1
+	done
+'
+
+# Without a delta search window, the time is spent deflating the
+# objects while writing the pack.
+for t in $threads
+do
+	test_perf "pack-objects --window=0 --no-reuse-object ($t threads)" "
+		git pack-objects --stdout --window=0 --no-reuse-object \
+			--threads=$t <objects >/dev/null
+	"
+done
+
+test_perf "repack -adf ($t threads)" "
+	git -c pack.threads=$t repack -adf
+"
+
+test_done
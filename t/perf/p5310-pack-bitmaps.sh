@@ -28,6 +28,14 @@ test_perf 'repack to disk' '
 
 test_full_bitmap
 
+test_bitmap_lookup 'without lookup table'
+
+test_perf 'repack to disk (lookup table)' '
+	git -c pack.writeBitmapLookupTable=true repack -ad
+'
+
+test_bitmap_lookup 'with lookup table'
+
 test_expect_success 'create partial bitmap state' '
 	# pick a commit to represent the repo tip in the past
 	cutoff=$(git rev-list HEAD~100 -1) &&
@@ -0,0 +1,35 @@
+#!/bin/sh
+
+test_description='Tests writing changed-path Bloom filters with threads'
+
+. ./perf-lib.sh
+
+test_perf_large_repo
+
+# Count down from the number of CPUs, halving each time, so that the
+# last test uses all of them (see p5302).
+test_expect_success 'set up thread-counting tests' '
+	t=$(test-tool online-cpus) &&
+	threads= &&
+	while test $t -gt 0
+	do
+		threads="$t $threads" &&
+		t=$((t / 2)) || return 1
+	done
+'
+
+test_perf 'write commit-graph without Bloom filters' '
+	rm -f .git/objects/info/commit-graph &&
+	git commit-graph write --reachable --no-changed-paths
+'
+
+for t in $threads
+do
+	test_perf "write commit-graph --changed-paths ($t threads)" "
+		rm -f .git/objects/info/commit-graph &&
+		git -c commitGraph.threads=$t commit-graph write \
+			--reachable --changed-paths
+	"
+done
+
+test_done
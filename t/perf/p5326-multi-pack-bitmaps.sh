@@ -26,6 +26,14 @@ test_expect_success 'drop pack bitmap' '
 
 test_full_bitmap
 
+test_bitmap_lookup 'without lookup table'
+
+test_perf 'setup multi-pack index (lookup table)' '
+	git -c pack.writeBitmapLookupTable=true multi-pack-index write --bitmap
+'
+
+test_bitmap_lookup 'with lookup table'
+
 test_expect_success 'create partial bitmap state' '
 	# pick a commit to represent the repo tip in the past
 	cutoff=$(git rev-list HEAD~100 -1) &&
@@ -0,0 +1,35 @@
+#!/bin/sh
+
+test_description='abbreviated names among many loose objects'
+. ./perf-lib.sh
+
+test_perf_fresh_repo
+
+test_expect_success 'create loose objects' '
+	perl -e "
+		for (1..20000) {
+			print \"blob\ndata <<EOF\n\$_\nEOF\n\";
+		}
+	" >input &&
+	git fast-import <input &&
+	mv .git/objects/pack/pack-*.pack objects.pack &&
+	rm -f .git/objects/pack/* &&
+	git unpack-objects <objects.pack &&
+	git cat-file --batch-all-objects --batch-check="%(objectname)" |
+		cut -c1-12 >prefixes &&
+	test-tool chmtime =-60 .git/objects/??
+'
+
+test_perf 'rev-parse abbreviated names (core.looseObjectIndex=false)' '
+	git -c core.looseObjectIndex=false rev-parse $(cat prefixes) >/dev/null
+'
+
+test_expect_success 'write the loose object index' '
+	git -c core.looseObjectIndex=true rev-parse $(cat prefixes) >/dev/null
+'
+
+test_perf 'rev-parse abbreviated names (core.looseObjectIndex=true)' '
+	git -c core.looseObjectIndex=true rev-parse $(cat prefixes) >/dev/null
+'
+
+test_done
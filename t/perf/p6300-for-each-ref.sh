@@ -0,0 +1,47 @@
+#!/bin/sh
+
+test_description="Tests performance of reading many references"
+
+. ./perf-lib.sh
+
+test_perf_fresh_repo
+
+test_expect_success "setup" '
+	test_commit base &&
+	for i in $(test_seq 10000)
+	do
+		printf "create refs/heads/branch-%d base\n" $i &&
+		printf "create refs/tags/tag-%d base\n" $i || return 1
+	done >instructions
+'
+
+for format in files reftable
+do
+	test_expect_success "setup $format repository" '
+		git init --ref-format=$format $format &&
+		git -C $format fetch -q .. base:refs/tags/base &&
+		git -C $format update-ref --stdin <instructions &&
+		git -C $format pack-refs --all
+	'
+
+	test_perf "for-each-ref ($format)" '
+		git -C $format for-each-ref >/dev/null
+	'
+
+	test_perf "for-each-ref with prefix ($format)" '
+		git -C $format for-each-ref refs/tags/ >/dev/null
+	'
+
+	test_perf "rev-parse single ref ($format)" '
+		for i in $(test_seq 100)
+		do
+			git -C $format rev-parse --verify branch-$i >/dev/null || return 1
+		done
+	'
+
+	test_perf "ls-remote ($format)" '
+		git ls-remote ./$format >/dev/null
+	'
+done
+
+test_done
@@ -0,0 +1,80 @@
+#!/bin/sh
+
+test_description='Tests performance of reachability filters over many tags'
+
+. ./perf-lib.sh
+
+test_perf_fresh_repo
+
+# A history of 20000 commits on 100 interleaved lines of development,
+# some of which are merges, with a tag on every other commit.
+test_expect_success 'setup' '
+	for i in $(test_seq 20000)
+	do
+		echo "commit refs/heads/line-$(($i % 100))" &&
+		echo "mark :$i" &&
+		echo "committer C O Mitter <committer@example.com> $((1600000000 + $i * 60)) +0000" &&
+		echo "data <<EOF" &&
+		echo "commit $i" &&
+		echo "EOF" &&
+		if test $i -gt 100
+		then
+			echo "from :$(($i - 100))"
+		fi &&
+		if test $(($i % 7)) = 0 && test $i -gt 1
+		then
+			echo "merge :$(($i - 1))"
+		fi &&
+		echo &&
+		if test $(($i % 2)) = 0
+		then
+			echo "reset refs/tags/tag-$i" &&
+			echo "from :$i" &&
+			echo
+		fi || return 1
+	done >input &&
+	git fast-import --quiet <input &&
+	git commit-graph write --reachable
+'
+
+test_perf 'for-each-ref --contains (old commit)' '
+	git for-each-ref --contains tag-200 >/dev/null
+'
+
+test_perf 'for-each-ref --contains (recent commit)' '
+	git for-each-ref --contains tag-19000 >/dev/null
+'
+
+test_perf 'for-each-ref --no-contains' '
+	git for-each-ref --no-contains tag-10000 >/dev/null
+'
+
+test_perf 'for-each-ref --merged' '
+	git for-each-ref --merged tag-15000 >/dev/null
+'
+
+test_perf 'for-each-ref --no-merged' '
+	git for-each-ref --no-merged tag-15000 >/dev/null
+'
+
+test_perf 'tag --contains' '
+	git tag --contains tag-10000 >/dev/null
+'
+
+test_expect_success 'write reachability bitmaps' '
+	git repack -a -d -b
+'
+
+test_perf 'for-each-ref --contains (bitmaps)' '
+	git for-each-ref --contains tag-200 >/dev/null
+'
+
+test_perf 'for-each-ref --contains (bitmaps, no commit-graph)' '
+	git -c core.commitGraph=false for-each-ref --contains tag-200 >/dev/null
+'
+
+test_perf 'for-each-ref --merged (bitmaps)' '
+	git for-each-ref --merged tag-15000 >/dev/null
+'
+
+test_done
@@ -32,4 +32,30 @@ test_perf 'ls-files -o' '
 	git ls-files -o
 '
 
+test_expect_success 'setup deep untracked directory tree' '
+	rm -rf deep_tree level &&
+	mkdir level &&
+	touch level/file1 level/file2 level/file3 &&
+	for depth in $(test_seq 1 7)
+	do
+		mkdir next &&
+		for i in $(test_seq 1 4)
+		do
+			cp -r level next/dir$i || return $?
+		done &&
+		touch next/file1 next/file2 &&
+		rm -rf level &&
+		mv next level || return $?
+	done &&
+	mv level deep_tree
+'
+
+test_perf 'ls-files -o deep tree, 1 thread' '
+	git -c core.untrackedThreads=1 ls-files -o deep_tree/
+'
+
+test_perf 'ls-files -o deep tree, 8 threads' '
+	git -c core.untrackedThreads=8 ls-files -o deep_tree/
+'
+
 test_done
@@ -221,6 +221,34 @@ test_have_prereq UNTRACKED_CACHE && uc_values="false true"
 
 fsm_values="false true"
 
+# On Linux, the daemon needs one inotify watch for every directory in
+# the worktree.  Skip the daemon cases if the per-user limit is too
+# low rather than measuring a daemon that fails to start.
+#
+if test -r /proc/sys/fs/inotify/max_user_watches
+then
+	nr_dirs=$(find $REPO -type d -not -path "*/.git/*" | wc -l)
+	max_watches=$(cat /proc/sys/fs/inotify/max_user_watches)
+	if test $max_watches -lt $nr_dirs
+	then
+		say "fs.inotify.max_user_watches ($max_watches) < $nr_dirs dirs; skipping fsmonitor cases"
+		fsm_values="false"
+	fi
+fi
+
+# Time how long it takes for the daemon to start and be ready to
+# answer requests.  On platforms without recursive watches (Linux),
+# this includes crawling the worktree to add a watch to each directory.
+#
+case " $fsm_values " in
+*" true "*)
+	test_perf "fsmonitor--daemon start and stop" "
+		git -C $REPO fsmonitor--daemon start &&
+		git -C $REPO fsmonitor--daemon stop
+	"
+	;;
+esac
+
 for uc_val in $uc_values
 do
 	for fsm_val in $fsm_values
@@ -0,0 +1,29 @@
+#!/bin/sh
+
+test_description="git-grep over committed trees with a trigram index"
+
+. ./perf-lib.sh
+
+test_perf_large_repo
+
+test_expect_success 'write grep-index' '
+	git maintenance run --task=grep-index --quiet
+'
+
+for index in false true
+do
+	test_perf "grep HEAD, fixed string (grep.trigramIndex=$index)" "
+		git -c grep.trigramIndex=$index grep -F some_nonexistent_string HEAD || :
+	"
+	test_perf "grep HEAD, fixed string -i (grep.trigramIndex=$index)" "
+		git -c grep.trigramIndex=$index grep -F -i some_nonexistent_string HEAD || :
+	"
+	test_perf "grep HEAD, regex (grep.trigramIndex=$index)" "
+		git -c grep.trigramIndex=$index grep -E 'some_[a-z]+_string\(' HEAD || :
+	"
+	test_perf "grep HEAD~10, expensive regex (grep.trigramIndex=$index)" "
+		git -c grep.trigramIndex=$index grep '^.* *some_nonexistent_string$' HEAD~10 || :
+	"
+done
+
+test_done
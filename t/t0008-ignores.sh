@@ -909,6 +909,65 @@ test_expect_success 'info/exclude trumps core.excludesfile' '
 	test_cmp expect actual
 '
 
+test_expect_success 'long ignore files are matched in the same way' '
+	test_when_finished "rm -rf long-ignore" &&
+	git init long-ignore &&
+	(
+		cd long-ignore &&
+		for i in $(test_seq 1 40)
+		do
+			echo "filler$i" || return 1
+		done >.gitignore &&
+		cat >>.gitignore <<-\EOF &&
+		*.o
+		!keep.o
+		/top
+		build/
+		doc/*.html
+		!doc/index.html
+		x*y
+		sub/deep/*.txt
+		EOF
+		mkdir -p build sub/build doc sub/deep &&
+		cat >paths <<-\EOF &&
+		a.o
+		keep.o
+		sub/keep.o
+		top
+		sub/top
+		build
+		sub/build
+		doc/a.html
+		doc/index.html
+		sub/doc/a.html
+		sub/xay
+		sub/deep/a.txt
+		filler7
+		sub/filler40
+		other
+		EOF
+		cat >expect <<-\EOF &&
+		.gitignore:41:*.o	a.o
+		.gitignore:42:!keep.o	keep.o
+		.gitignore:42:!keep.o	sub/keep.o
+		.gitignore:43:/top	top
+		::	sub/top
+		.gitignore:44:build/	build
+		.gitignore:44:build/	sub/build
+		.gitignore:45:doc/*.html	doc/a.html
+		.gitignore:46:!doc/index.html	doc/index.html
+		::	sub/doc/a.html
+		.gitignore:47:x*y	sub/xay
+		.gitignore:48:sub/deep/*.txt	sub/deep/a.txt
+		.gitignore:7:filler7	filler7
+		.gitignore:40:filler40	sub/filler40
+		::	other
+		EOF
+		git check-ignore -v -n --stdin <paths >actual &&
+		test_cmp expect actual
+	)
+'
+
 test_expect_success SYMLINKS 'set up ignore file for symlink tests' '
 	echo "*" >ignore &&
 	rm -f .gitignore .git/info/exclude
@@ -0,0 +1,31 @@
+#!/bin/sh
+
+test_description='concurrent object lookup'
+
+. ./test-lib.sh
+
+test_expect_success 'setup' '
+	test_commit_bulk --id=file 32 &&
+	git tag -a -m tagged annotated HEAD~16 &&
+	git cat-file --batch-all-objects \
+		--batch-check="%(objectname) %(objecttype)" >objects &&
+	nr=$(wc -l <objects) &&
+	echo "$(($nr)) objects" >expect
+'
+
+test_expect_success 'single-threaded lookup creates every object once' '
+	test-tool object-lookup <objects >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success PTHREADS 'threads share the objects they create' '
+	test-tool object-lookup --threads=8 --count=4 <objects >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success PTHREADS 'objects are looked up by many more threads' '
+	test-tool object-lookup --threads=64 <objects >actual &&
+	test_cmp expect actual
+'
+
+test_done
@@ -0,0 +1,248 @@
+#!/bin/sh
+
+test_description='reftable reference backend'
+
+GIT_TEST_DEFAULT_INITIAL_BRANCH_NAME=main
+export GIT_TEST_DEFAULT_INITIAL_BRANCH_NAME
+
+. ./test-lib.sh
+
+INVALID_OID=$(test_oid 001)
+
+test_expect_success 'init: creates basic reftable structures' '
+	test_when_finished "rm -rf repo" &&
+	git init --ref-format=reftable repo &&
+	test_path_is_dir repo/.git/reftable &&
+	test_path_is_file repo/.git/reftable/tables.list &&
+	echo reftable >expect &&
+	git -C repo config extensions.refstorage >actual &&
+	test_cmp expect actual &&
+	echo 1 >expect &&
+	git -C repo config core.repositoryformatversion >actual &&
+	test_cmp expect actual &&
+	echo refs/heads/main >expect &&
+	git -C repo symbolic-ref HEAD >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'init: respects GIT_DEFAULT_REF_FORMAT' '
+	test_when_finished "rm -rf repo" &&
+	GIT_DEFAULT_REF_FORMAT=reftable git init repo &&
+	test_path_is_dir repo/.git/reftable &&
+	echo reftable >expect &&
+	git -C repo config extensions.refstorage >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'init: rejects unknown formats' '
+	test_when_finished "rm -rf repo" &&
+	test_must_fail git init --ref-format=garbage repo 2>err &&
+	grep "unknown ref storage format ${SQ}garbage${SQ}" err
+'
+
+test_expect_success 'init: refuses to switch formats on reinit' '
+	test_when_finished "rm -rf repo" &&
+	git init --ref-format=reftable repo &&
+	test_must_fail git init --ref-format=files repo 2>err &&
+	grep "different reference storage format" err &&
+	git init repo
+'
+
+test_expect_success 'setup repository' '
+	git init --ref-format=reftable repo &&
+	test_commit -C repo A &&
+	test_commit -C repo B
+'
+
+test_expect_success 'update-ref: create, update and delete' '
+	git -C repo update-ref refs/heads/topic A &&
+	git -C repo rev-parse A >expect &&
+	git -C repo rev-parse topic >actual &&
+	test_cmp expect actual &&
+
+	git -C repo update-ref refs/heads/topic B A &&
+	git -C repo rev-parse B >expect &&
+	git -C repo rev-parse topic >actual &&
+	test_cmp expect actual &&
+
+	git -C repo update-ref -d refs/heads/topic B &&
+	test_must_fail git -C repo rev-parse --verify topic
+'
+
+test_expect_success 'update-ref: verifies old object ID' '
+	git -C repo update-ref refs/heads/topic A &&
+	test_must_fail git -C repo update-ref refs/heads/topic B B 2>err &&
+	grep "but expected" err &&
+	test_must_fail git -C repo update-ref refs/heads/new B A 2>err &&
+	grep "unable to resolve reference" err &&
+	git -C repo update-ref -d refs/heads/topic
+'
+
+test_expect_success 'update-ref: rejects missing objects' '
+	test_must_fail git -C repo update-ref refs/heads/topic $INVALID_OID 2>err &&
+	grep "nonexistent object" err
+'
+
+test_expect_success 'update-ref: detects directory/file conflicts' '
+	git -C repo update-ref refs/heads/dir/file A &&
+	test_must_fail git -C repo update-ref refs/heads/dir B 2>err &&
+	grep "${SQ}refs/heads/dir/file${SQ} exists" err &&
+	git -C repo update-ref -d refs/heads/dir/file
+'
+
+test_expect_success 'update-ref: stdin transaction' '
+	cat >input <<-EOF &&
+	start
+	create refs/heads/one $(git -C repo rev-parse A)
+	create refs/heads/two $(git -C repo rev-parse B)
+	prepare
+	commit
+	EOF
+	git -C repo update-ref --stdin <input &&
+	git -C repo for-each-ref --format="%(refname) %(objectname)" \
+		refs/heads/one refs/heads/two >actual &&
+	cat >expect <<-EOF &&
+	refs/heads/one $(git -C repo rev-parse A)
+	refs/heads/two $(git -C repo rev-parse B)
+	EOF
+	test_cmp expect actual &&
+	git -C repo update-ref -d refs/heads/one &&
+	git -C repo update-ref -d refs/heads/two
+'
+
+test_expect_success 'for-each-ref: lists refs in order' '
+	git -C repo tag -a -m annotated C &&
+	cat >expect <<-EOF &&
+	$(git -C repo rev-parse main) commit	refs/heads/main
+	$(git -C repo rev-parse A) commit	refs/tags/A
+	$(git -C repo rev-parse B) commit	refs/tags/B
+	$(git -C repo rev-parse C) tag	refs/tags/C
+	EOF
+	git -C repo for-each-ref >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'peeled tags are stored and read back' '
+	git -C repo rev-parse main >expect &&
+	git -C repo rev-parse C^{} >actual &&
+	test_cmp expect actual &&
+	git -C repo show-ref -d C >actual &&
+	test_line_count = 2 actual
+'
+
+test_expect_success 'symbolic-ref: create and read' '
+	git -C repo symbolic-ref refs/heads/sym refs/heads/main &&
+	echo refs/heads/main >expect &&
+	git -C repo symbolic-ref refs/heads/sym >actual &&
+	test_cmp expect actual &&
+	git -C repo symbolic-ref -d refs/heads/sym
+'
+
+test_expect_success 'reflog: records updates via HEAD' '
+	test_commit -C repo D &&
+	cat >expect <<-EOF &&
+	$(git -C repo rev-parse D) HEAD@{0}: commit: D
+	$(git -C repo rev-parse B) HEAD@{1}: commit: B
+	$(git -C repo rev-parse A) HEAD@{2}: commit (initial): A
+	EOF
+	git -C repo reflog --format="%H %gD: %gs" >actual &&
+	test_cmp expect actual &&
+	git -C repo reflog --format="%H %gD: %gs" main >actual &&
+	sed "s/HEAD/main/" expect >expect.main &&
+	test_cmp expect.main actual
+'
+
+test_expect_success 'reflog: deleting a ref deletes its reflog' '
+	git -C repo branch topic &&
+	git -C repo reflog exists refs/heads/topic &&
+	git -C repo branch -D topic &&
+	test_must_fail git -C repo reflog exists refs/heads/topic
+'
+
+test_expect_success 'branch: rename and copy carry the reflog' '
+	git -C repo branch topic A &&
+	git -C repo branch -m topic renamed &&
+	test_must_fail git -C repo rev-parse --verify topic &&
+	test_must_fail git -C repo reflog exists refs/heads/topic &&
+	git -C repo branch -c renamed copied &&
+	git -C repo reflog --format=%gs renamed >renamed &&
+	git -C repo reflog --format=%gs copied >copied &&
+	test_line_count = 2 renamed &&
+	test_line_count = 3 copied &&
+	head -n1 copied >actual &&
+	echo "Branch: copied refs/heads/renamed to refs/heads/copied" >expect &&
+	test_cmp expect actual &&
+	git -C repo branch -D renamed copied
+'
+
+test_expect_success 'reflog expire: prunes entries' '
+	git -C repo reflog expire --expire=all refs/heads/main &&
+	git -C repo reflog main >actual &&
+	test_must_be_empty actual &&
+	git -C repo rev-parse --verify main
+'
+
+test_expect_success 'pack-refs: compacts the stack' '
+	test_commit -C repo E &&
+	test_line_count -gt 1 repo/.git/reftable/tables.list &&
+	git -C repo pack-refs &&
+	test_line_count = 1 repo/.git/reftable/tables.list &&
+	git -C repo rev-parse E >expect &&
+	git -C repo rev-parse main >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'fsck: repository is consistent' '
+	git -C repo fsck
+'
+
+test_expect_success 'clone: uses the requested format' '
+	test_when_finished "rm -rf clone" &&
+	git clone --ref-format=reftable repo clone &&
+	echo reftable >expect &&
+	git -C clone config extensions.refstorage >actual &&
+	test_cmp expect actual &&
+	git -C repo rev-parse main >expect &&
+	git -C clone rev-parse origin/main >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'clone: files repository from reftable repository' '
+	test_when_finished "rm -rf clone" &&
+	git clone --ref-format=files repo clone &&
+	test_path_is_missing clone/.git/reftable &&
+	git -C clone for-each-ref refs/tags >actual &&
+	test_line_count = 5 actual
+'
+
+test_expect_success 'worktree: per-worktree refs are separate' '
+	test_when_finished "rm -rf wt && git -C repo worktree prune" &&
+	git -C repo worktree add ../wt -b wt-branch A &&
+	test_path_is_dir repo/.git/worktrees/wt/reftable &&
+	git -C wt rev-parse A >expect &&
+	git -C wt rev-parse HEAD >actual &&
+	test_cmp expect actual &&
+	git -C repo rev-parse main >expect &&
+	git -C repo rev-parse HEAD >actual &&
+	test_cmp expect actual &&
+	git -C repo rev-parse worktrees/wt/HEAD >actual &&
+	git -C wt rev-parse HEAD >expect &&
+	test_cmp expect actual &&
+	git -C wt update-ref refs/bisect/wt HEAD &&
+	test_must_fail git -C repo rev-parse --verify refs/bisect/wt &&
+	git -C wt for-each-ref refs/bisect >actual &&
+	test_line_count = 1 actual
+'
+
+test_expect_success 'worktree: shared refs are visible from all worktrees' '
+	test_when_finished "rm -rf wt && git -C repo worktree prune" &&
+	git -C repo worktree add ../wt -b wt-shared A &&
+	test_commit -C wt F &&
+	git -C wt rev-parse HEAD >expect &&
+	git -C repo rev-parse wt-shared >actual &&
+	test_cmp expect actual &&
+	git -C repo rev-parse F >actual &&
+	test_cmp expect actual
+'
+
+test_done
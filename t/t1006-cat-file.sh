@@ -970,6 +970,35 @@ test_expect_success 'cat-file --unordered works' '
 	test_cmp expect actual
 '
 
+test_expect_success 'cat-file --unordered --batch resolves delta chains' '
+	git init deltas &&
+	test_seq 1000 >deltas/file &&
+	git -C deltas add file &&
+	git -C deltas commit -m base &&
+	for i in $(test_seq 20)
+	do
+		echo "change $i" >>deltas/file &&
+		git -C deltas commit -q -a -m "change $i" || return 1
+	done &&
+	git -C deltas repack -a -d -f --depth=10 &&
+	git -C deltas cat-file --batch-all-objects --batch-check="%(deltabase)" >bases &&
+	grep -v "^$ZERO_OID" bases &&
+	echo "change 20" >>deltas/file &&
+	git -C deltas add file &&
+	for format in "%(objectname) %(objecttype) %(objectsize)" \
+		      "%(objectname) %(deltabase) %(objectsize:disk)"
+	do
+		git -C deltas cat-file --batch-all-objects --batch="$format" \
+			>expect.raw &&
+		git -C deltas -c core.deltaBaseCacheLimit=1 cat-file \
+			--batch-all-objects --batch="$format" --unordered \
+			>actual.raw &&
+		sort expect.raw >expect &&
+		sort actual.raw >actual &&
+		test_cmp expect actual || return 1
+	done
+'
+
 test_expect_success 'set up object list for --batch-all-objects tests' '
 	git -C all-two cat-file --batch-all-objects --batch-check="%(objectname)" >objects
 '
@@ -1057,6 +1086,68 @@ test_expect_success 'cat-file --batch-all-objects --batch-check ignores replace'
 	echo "$orig commit $orig_size" >expect &&
 	test_cmp expect actual
 '
+test_expect_success 'cat-file --threads matches the unthreaded output' '
+	{
+		git rev-list --objects --all | cut -d" " -f1 &&
+		echo "HEAD tag-head" &&
+		echo "$orig replaced" &&
+		echo "HEAD^{tree}" &&
+		echo "does-not-exist missing"
+	} >input &&
+	for args in --batch --batch-check "--batch=%(objectname) %(rest)"
+	do
+		git cat-file "$args" <input >expect &&
+		git cat-file "$args" --buffer --threads=4 <input >actual &&
+		test_cmp expect actual &&
+		git -c core.bigFileThreshold=1 cat-file "$args" --buffer \
+			--threads=4 <input >actual &&
+		test_cmp expect actual &&
+		sort expect >expect.sorted &&
+		git cat-file "$args" --buffer --threads=4 --unordered \
+			<input >actual &&
+		sort actual >actual.sorted &&
+		test_cmp expect.sorted actual.sorted || return 1
+	done
+'
+
+test_expect_success 'cat-file --threads output is identical with many objects' '
+	test_when_finished "rm -rf many" &&
+	git init many &&
+	(
+		cd many &&
+		for i in $(test_seq 3000)
+		do
+			echo "blob" &&
+			echo "data <<EOF" &&
+			echo "$i" &&
+			echo "EOF" || return 1
+		done >input &&
+		git fast-import <input &&
+		git cat-file --batch-all-objects --batch-check="%(objectname)" \
+			>objects &&
+		test_line_count = 3000 objects &&
+		for args in --batch-check --batch \
+			"--batch-check=%(objectname) %(objecttype) %(deltabase)"
+		do
+			git cat-file "$args" <objects >expect &&
+			git cat-file "$args" --buffer --threads=8 \
+				<objects >actual &&
+			test_cmp expect actual || return 1
+		done
+	)
+'
+
+test_expect_success 'cat-file --threads needs --buffer and stdin' '
+	test_must_fail git cat-file --batch --threads=2 </dev/null 2>err &&
+	grep "requires .--buffer." err &&
+	test_must_fail git cat-file --batch-check --batch-all-objects \
+		--threads=2 2>err &&
+	grep "cannot be used together" err &&
+	test_must_fail git cat-file --batch-command --buffer --threads=2 \
+		</dev/null 2>err &&
+	grep "cannot be used together" err
+'
+
 test_expect_success 'batch-command empty command' '
 	echo "" >cmd &&
 	test_expect_code 128 git cat-file --batch-command <cmd 2>err &&
@@ -103,4 +103,141 @@ test_expect_success 'index version config precedence' '
 	test_index_version 0 true 2 2
 '
 
+test_expect_success 'index version 5 round trip' '
+	test_when_finished "rm -rf v5" &&
+	git init v5 &&
+	(
+		cd v5 &&
+		mkdir -p dir/sub &&
+		test_write_lines 1 2 3 >dir/sub/file &&
+		echo one >one &&
+		echo two >two &&
+		git add . &&
+		git update-index --chmod=+x one &&
+		git update-index --skip-worktree two &&
+		git ls-files -s -v >expect &&
+		git update-index --index-version 5 &&
+		echo 5 >expect.version &&
+		test-tool index-version <.git/index >actual.version &&
+		test_cmp expect.version actual.version &&
+
+		rm -f trace.txt &&
+		GIT_TRACE2_EVENT="$(pwd)/trace.txt" git ls-files -s -v >actual &&
+		test_cmp expect actual &&
+		grep "\"key\":\"read/v5\",\"value\":\"in-place\"" trace.txt &&
+
+		rm -f trace.txt &&
+		GIT_TRACE2_EVENT="$(pwd)/trace.txt" GIT_TEST_INDEX_V5_CONVERT=1 \
+			git ls-files -s -v >actual &&
+		test_cmp expect actual &&
+		grep "\"key\":\"read/v5\",\"value\":\"converted\"" trace.txt &&
+
+		echo changed >>one &&
+		git add one &&
+		git ls-files -s -v >expect &&
+		test-tool index-version <.git/index >actual.version &&
+		test_cmp expect.version actual.version &&
+		git update-index --index-version 4 &&
+		git ls-files -s -v >actual &&
+		test_cmp expect actual &&
+		git diff --exit-code
+	)
+'
+
+test_expect_success 'corrupt index version 5 entries are rejected' '
+	test_when_finished "rm -rf v5" &&
+	git init v5 &&
+	(
+		cd v5 &&
+		echo one >one &&
+		git add one &&
+		git update-index --index-version 5 &&
+		git ls-files >expect &&
+		git ls-files >actual &&
+		test_cmp expect actual &&
+
+		# clear the "allocated from a memory pool" marker of the
+		# only entry, which starts after the 12-byte header, the
+		# 20-number layout and the offset table
+		perl -e "
+			open(my \$fh, \"+<\", \".git/index\") or die;
+			binmode \$fh;
+			seek(\$fh, 12 + 17 * 4, 0);
+			read(\$fh, my \$off, 4);
+			seek(\$fh, 104 + unpack(\"N\", \$off), 0);
+			print \$fh pack(\"L\", 0);
+		" &&
+		test_must_fail git ls-files 2>err &&
+		test_i18ngrep "index file corrupt" err &&
+		test_must_fail env GIT_TEST_INDEX_V5_CONVERT=1 git ls-files 2>err &&
+		test_i18ngrep "index file corrupt" err
+	)
+'
+
+test_expect_success 'index.skipHash writes blocks reused by later writes' '
+	test_when_finished "rm -rf skip" &&
+	git init skip &&
+	(
+		cd skip &&
+		# version 5 neither skips the hash nor reuses blocks
+		sane_unset GIT_INDEX_VERSION &&
+		git config index.skipHash true &&
+		for i in $(test_seq 1 50)
+		do
+			echo $i >file$i || return 1
+		done &&
+		GIT_TEST_INDEX_BLOCK_ENTRIES=4 git add . &&
+		git fsck --no-dangling &&
+		git ls-files -s >expect &&
+		git -c index.threads=2 ls-files -s >actual &&
+		test_cmp expect actual &&
+
+		echo changed >file25 &&
+		rm -f trace.txt &&
+		GIT_TEST_INDEX_BLOCK_ENTRIES=4 GIT_TRACE2_EVENT="$(pwd)/trace.txt" \
+			git add file25 &&
+		grep "\"key\":\"write/reused_blocks\",\"value\":\"[1-9]" trace.txt &&
+		git ls-files -s >expect &&
+		git -c index.threads=2 ls-files -s >actual &&
+		test_cmp expect actual &&
+		git fsck --no-dangling &&
+
+		git config index.skipHash false &&
+		git add file25 &&
+		git ls-files -s >actual &&
+		test_cmp expect actual
+	)
+'
+
+test_expect_success 'index.skipHash does not overwrite a newer index' '
+	test_when_finished "rm -rf concurrent" &&
+	git init concurrent &&
+	(
+		cd concurrent &&
+		sane_unset GIT_INDEX_VERSION &&
+		git config index.skipHash true &&
+		echo one >one &&
+		echo two >two &&
+		git add one two &&
+		git ls-files >expect &&
+		mv .git/index .git/newer-index &&
+		git add one &&
+		test-tool chmtime =-60 one &&
+
+		# the hook runs after "git status" has read the index and
+		# before it refreshes it, like a "git add" racing with it
+		write_script .git/fsmonitor <<-\EOF &&
+		if test -f .git/newer-index
+		then
+			mv .git/newer-index .git/index
+		fi
+		exit 1
+		EOF
+		git -c core.fsmonitor=.git/fsmonitor status &&
+		test_path_is_missing .git/newer-index &&
+		git ls-files >actual &&
+		test_cmp expect actual
+	)
+'
+
 test_done
@@ -36,6 +36,12 @@ test_expect_success 'setup' '
 
 	base_v4 sha1:508851a7f0dfa8691e9f69c7f055865389012491
 	base_v4 sha256:3177d4adfdd4b6904f7e921d91d715a471c0dde7cf6a4bba574927f02b699508
+
+	own_v5 sha1:cd7ee0227bd5409217c38c202424bc95d8d0428c
+	own_v5 sha256:c4abe82bdca95c3e3122980b40bcc1bb68e88f23d3be557d79c980e15b7d0e98
+
+	base_v5 sha1:42edc8b8cb25fd804e53cf49e263fbf3994fae61
+	base_v5 sha256:451d97c5ce7e2e2beb7e4a70c6404b8bd40b9efdd52d28fa29d3651aef12d7e4
 	EOF
 '
 
@@ -50,6 +56,10 @@ test_expect_success 'enable split index' '
 	then
 		own=$(test_oid own_v4) &&
 		base=$(test_oid base_v4)
+	elif test "$indexversion" = "5"
+	then
+		own=$(test_oid own_v5) &&
+		base=$(test_oid base_v5)
 	else
 		own=$(test_oid own_v3) &&
 		base=$(test_oid base_v3)
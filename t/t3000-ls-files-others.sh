@@ -230,4 +230,47 @@ test_expect_success 'ls-files -o avoids listing untracked non-matching gitdir' '
 	)
 '
 
+test_expect_success 'reading directories ahead does not change the results' '
+	git init threads &&
+	(
+		cd threads &&
+		mkdir -p a/b/c d/e ign/f tracked/g &&
+		touch a/1 a/b/2 a/b/c/3 d/e/4 ign/f/5 tracked/6 tracked/g/7 top &&
+		echo ign >.gitignore &&
+		echo "*.o" >a/.gitignore &&
+		touch a/b/x.o a/b/c/y.o &&
+		git add .gitignore tracked/6 &&
+		git commit -m tracked &&
+
+		for args in "-o" "-o --exclude-standard" \
+			    "-o --directory --exclude-standard" \
+			    "-o -i --exclude-standard" \
+			    "-o -i --directory --exclude-standard"
+		do
+			git ls-files $args >../expect &&
+			git -c core.untrackedThreads=4 ls-files $args >../actual &&
+			test_cmp ../expect ../actual || return 1
+		done &&
+		git status --porcelain --ignored >../expect &&
+		git -c core.untrackedThreads=4 status --porcelain --ignored >../actual &&
+		test_cmp ../expect ../actual &&
+		git status --porcelain -uall >../expect &&
+		git -c core.untrackedThreads=4 status --porcelain -uall >../actual &&
+		test_cmp ../expect ../actual
+	)
+'
+
+test_expect_success PTHREADS 'directories are read ahead on worker threads' '
+	(
+		cd threads &&
+		rm -f trace.txt &&
+		GIT_TRACE2_EVENT="$(pwd)/trace.txt" \
+			git -c core.untrackedThreads=2 ls-files -o >/dev/null &&
+		grep "\"key\":\"prefetch/hits\"" trace.txt &&
+		rm -f trace.txt &&
+		GIT_TRACE2_EVENT="$(pwd)/trace.txt" git ls-files -o >/dev/null &&
+		! grep "\"key\":\"prefetch/" trace.txt
+	)
+'
+
 test_done
@@ -368,6 +368,45 @@ test_expect_success '--max-new-filters overrides configuration' '
 	)
 '
 
+test_expect_success PTHREADS 'Bloom filters do not depend on commitGraph.threads' '
+	git init threads &&
+	test_when_finished "rm -fr threads" &&
+	(
+		cd threads &&
+		for i in $(test_seq 1 20)
+		do
+			mkdir -p dir$(($i % 3))/sub dir$(($i % 2)) &&
+			echo $i >dir$(($i % 3))/sub/file$i &&
+			echo $i >>dir$(($i % 2))/common &&
+			git add . &&
+			test_tick &&
+			git commit -q -m "$i" || return 1
+		done &&
+		git rm -q -r dir0 &&
+		echo file >dir0 &&
+		git add dir0 &&
+		git commit -q -m "replace dir0 with a file" &&
+
+		git -c commitGraph.threads=1 commit-graph write --reachable \
+			--changed-paths &&
+		mv .git/objects/info/commit-graph expect &&
+		rm -f trace.event &&
+		GIT_TRACE2_EVENT="$(pwd)/trace.event" \
+			git -c commitGraph.threads=4 commit-graph write \
+				--reachable --changed-paths &&
+		test_filter_computed 21 trace.event &&
+		test_cmp_bin expect .git/objects/info/commit-graph &&
+
+		rm -f .git/objects/info/commit-graph &&
+		rm -f trace.event &&
+		GIT_TRACE2_EVENT="$(pwd)/trace.event" \
+			git -c commitGraph.threads=4 commit-graph write \
+				--reachable --changed-paths --max-new-filters=5 &&
+		test_filter_computed 5 trace.event &&
+		test_filter_not_computed 16 trace.event
+	)
+'
+
 test_expect_success 'Bloom generation backfills empty commits' '
 	git init empty &&
 	test_when_finished "rm -fr empty" &&
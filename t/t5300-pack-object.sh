@@ -218,6 +218,21 @@ test_expect_success 'compare delta flavors' '
 	'\'' test-2-$packname_2.pack test-3-$packname_3.pack
 '
 
+test_expect_success PTHREADS 'threaded writing does not change the pack' '
+	git pack-objects --window=0 --no-reuse-object --threads=1 \
+		--stdout <obj-list >single.pack &&
+	git pack-objects --window=0 --no-reuse-object --threads=4 \
+		--stdout <obj-list >threaded.pack &&
+	test_cmp_bin single.pack threaded.pack
+'
+
+test_expect_success PTHREADS 'threaded writing with deltas' '
+	packname_12=$(git pack-objects --no-reuse-object --threads=4 \
+			--delta-base-offset test-12 <obj-list) &&
+	git verify-pack test-12-$packname_12.pack &&
+	check_unpack test-12-$packname_12 obj-list
+'
+
 check_use_objects () {
 	test_when_finished "rm -rf git2" &&
 	git init --bare git2 &&
@@ -66,6 +66,15 @@ test_expect_success 'index-pack results should match pack-objects ones' '
 	cmp "test-2-${pack2}.idx" "2.idx"
 '
 
+test_expect_success PTHREADS 'threaded index-pack reloads evicted delta bases' '
+	# A tiny base cache forces threads to reconstruct bases of the
+	# deep deltas outside of the work mutex.
+	GIT_FORCE_THREADS=1 git -c core.deltaBaseCacheLimit=1 \
+		index-pack --threads=4 --index-version=2 -o threads.idx \
+		"test-1-${pack1}.pack" &&
+	cmp "test-2-${pack2}.idx" threads.idx
+'
+
 test_expect_success 'index-pack --verify on index version 1' '
 	git index-pack --verify "test-1-${pack1}.pack"
 '
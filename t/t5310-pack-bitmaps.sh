@@ -425,4 +425,49 @@ test_expect_success 'complains about multiple pack bitmaps' '
 	)
 '
 
+test_expect_success 'setup bitmaps with lookup table' '
+	git config pack.writeBitmapLookupTable true &&
+	git repack -adb &&
+	bitmap=$(ls .git/objects/pack/*.bitmap) &&
+	# the options field is the 16-bit value at offset 6
+	test_copy_bytes 8 <$bitmap | tail -c 2 | test-tool hexdump >actual &&
+	echo "00 15 " >expect &&
+	test_cmp expect actual &&
+
+	# restore the blob expected by the tests in basic_bitmap_tests
+	blob=$(git rev-parse tagged-blob)
+'
+
+test_expect_success 'lookup table lists the same commits' '
+	test-tool bitmap list-commits | sort >actual &&
+	GIT_TEST_READ_COMMIT_TABLE=0 \
+		test-tool bitmap list-commits | sort >expect &&
+	test_cmp expect actual
+'
+
+test_expect_success 'lookup table traversals match eager loading' '
+	for tip in second other HEAD
+	do
+		GIT_TEST_READ_COMMIT_TABLE=0 \
+			git rev-list --use-bitmap-index --objects $tip >expect &&
+		git rev-list --use-bitmap-index --objects $tip >actual &&
+		test_cmp expect actual || return 1
+	done
+'
+
+basic_bitmap_tests
+
+test_expect_success 'truncated bitmap fails gracefully (lookup table)' '
+	test_config pack.writebitmaphashcache false &&
+	git repack -adb &&
+	git rev-list --use-bitmap-index --count --all >expect &&
+	bitmap=$(ls .git/objects/pack/*.bitmap) &&
+	test_when_finished "rm -f $bitmap" &&
+	test_copy_bytes 512 <$bitmap >$bitmap.tmp &&
+	mv -f $bitmap.tmp $bitmap &&
+	git rev-list --use-bitmap-index --count --all >actual 2>stderr &&
+	test_cmp expect actual &&
+	test_i18ngrep corrupted.bitmap.index stderr
+'
+
 test_done
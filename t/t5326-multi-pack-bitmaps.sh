@@ -307,4 +307,37 @@ test_expect_success 'graceful fallback when missing reverse index' '
 	)
 '
 
+test_expect_success 'multi-pack bitmap with lookup table' '
+	rm -fr repo &&
+	git init repo &&
+	test_when_finished "rm -fr repo" &&
+	(
+		cd repo &&
+		git config pack.writeBitmapLookupTable true &&
+
+		test_commit_bulk 128 &&
+		git repack -d &&
+		test_commit_bulk --id=other 64 &&
+		git repack -d &&
+
+		git multi-pack-index write --bitmap &&
+		test_path_is_file $midx-$(midx_checksum $objdir).bitmap &&
+
+		git rev-list --test-bitmap HEAD &&
+
+		test-tool bitmap list-commits | sort >actual &&
+		GIT_TEST_READ_COMMIT_TABLE=0 \
+			test-tool bitmap list-commits | sort >expect &&
+		test_cmp expect actual &&
+
+		for tip in HEAD HEAD~32 HEAD~100
+		do
+			GIT_TEST_READ_COMMIT_TABLE=0 \
+				git rev-list --use-bitmap-index --objects $tip >expect &&
+			git rev-list --use-bitmap-index --objects $tip >actual &&
+			test_cmp expect actual || return 1
+		done
+	)
+'
+
 test_done
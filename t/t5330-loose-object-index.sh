@@ -0,0 +1,64 @@
+#!/bin/sh
+
+test_description='core.looseObjectIndex'
+. ./test-lib.sh
+
+test_expect_success 'setup' '
+	git config core.looseObjectIndex true &&
+	blob=$(echo content | git hash-object -w --stdin) &&
+	dir=$(echo $blob | cut -c1-2) &&
+	prefix=$(echo $blob | cut -c1-7) &&
+	echo $blob >expect
+'
+
+test_expect_success 'abbreviation lookup writes the index' '
+	test-tool chmtime =-10 .git/objects/$dir &&
+	git rev-parse --disambiguate=$prefix >actual &&
+	test_cmp expect actual &&
+	test_path_is_file .git/objects/info/loose-index/$dir
+'
+
+test_expect_success 'index is used while its directory is unchanged' '
+	mtime=$(test-tool chmtime --get .git/objects/$dir) &&
+	mv .git/objects/$dir/${blob#$dir} saved &&
+	test-tool chmtime =$mtime .git/objects/$dir &&
+	git rev-parse --disambiguate=$prefix >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'index is not trusted once its directory changes' '
+	test-tool chmtime =-5 .git/objects/$dir &&
+	git rev-parse --disambiguate=$prefix >actual &&
+	test_must_be_empty actual &&
+	test_must_fail git rev-parse --verify --quiet $prefix
+'
+
+test_expect_success 'new loose objects are found' '
+	echo content | git hash-object -w --stdin &&
+	git rev-parse --disambiguate=$prefix >actual &&
+	test_cmp expect actual &&
+	git rev-parse --verify $prefix >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'index is not written for a directory changed just now' '
+	rm -rf .git/objects/info/loose-index &&
+	test-tool chmtime =+10 .git/objects/$dir &&
+	git rev-parse --disambiguate=$prefix >actual &&
+	test_cmp expect actual &&
+	test_path_is_missing .git/objects/info/loose-index/$dir
+'
+
+test_expect_success 'index is ignored without core.looseObjectIndex' '
+	test-tool chmtime =-10 .git/objects/$dir &&
+	git rev-parse --disambiguate=$prefix &&
+	test_path_is_file .git/objects/info/loose-index/$dir &&
+	mtime=$(test-tool chmtime --get .git/objects/$dir) &&
+	rm .git/objects/$dir/${blob#$dir} &&
+	test-tool chmtime =$mtime .git/objects/$dir &&
+	git -c core.looseObjectIndex=false rev-parse \
+		--disambiguate=$prefix >actual &&
+	test_must_be_empty actual
+'
+
+test_done
@@ -0,0 +1,90 @@
+#!/bin/sh
+
+test_description='pack-objects multi-pack reuse'
+
+. ./test-lib.sh
+. "$TEST_DIRECTORY"/lib-bitmap.sh
+
+# We'll be writing our own midx and bitmaps, so avoid getting confused by the
+# automatic ones.
+GIT_TEST_MULTI_PACK_INDEX=0
+GIT_TEST_MULTI_PACK_INDEX_WRITE_BITMAP=0
+
+objects_nr () {
+	git -C "$1" cat-file --batch-all-objects --batch-check="%(objectname)" >objects &&
+	wc -l <objects
+}
+
+test_packs_reused () {
+	grep "\"key\":\"pack-reused-packs\",\"value\":\"$1\"" trace2.txt
+}
+
+# Create a pack of everything, recording a trace in trace2.txt, and
+# verify that the objects in it can be read back.
+check_reuse () {
+	: >trace2.txt &&
+	GIT_TRACE2_EVENT="$PWD/trace2.txt" \
+		git pack-objects --stdout --revs --all "$@" </dev/null >got.pack &&
+	rm -fr clone.git &&
+	git init --bare clone.git &&
+	git -C clone.git index-pack --strict --stdin <got.pack &&
+	git rev-list --objects --all >expect.raw &&
+	test_line_count = $(objects_nr clone.git) expect.raw
+}
+
+test_expect_success 'setup disjoint packs' '
+	git config pack.allowPackReuse multi &&
+	for i in 1 2 3
+	do
+		for j in $(test_seq 1 16)
+		do
+			test_seq $(($i * 100 + $j)) >file.$j || return 1
+		done &&
+		git add . &&
+		test_tick &&
+		git commit -m "commit $i" &&
+		git repack -d || return 1
+	done &&
+	ls .git/objects/pack/*.pack >packs &&
+	test_line_count = 3 packs &&
+	git multi-pack-index write --bitmap
+'
+
+test_expect_success 'pack.allowPackReuse=single only reuses one pack' '
+	: >trace2.txt &&
+	GIT_TRACE2_EVENT="$PWD/trace2.txt" \
+		git -c pack.allowPackReuse=single pack-objects --stdout \
+		--revs --all --delta-base-offset </dev/null >/dev/null &&
+	test_packs_reused 1
+'
+
+test_expect_success 'objects are reused from all disjoint packs' '
+	check_reuse --delta-base-offset &&
+	test_packs_reused 3 &&
+
+	count=$(git rev-list --objects --all --count) &&
+	GIT_PROGRESS_DELAY=0 \
+		git pack-objects --all --stdout --progress --delta-base-offset \
+		</dev/null >/dev/null 2>stderr &&
+	grep "pack-reused $count" stderr
+'
+
+test_expect_success 'reused deltas are converted to REF_DELTA' '
+	check_reuse &&
+	test_packs_reused 3
+'
+
+test_expect_success 'packs with objects selected from elsewhere are skipped' '
+	# The new pack duplicates the objects of the first two packs,
+	# and wins all ties as the preferred pack, so only the pack of
+	# the last commit remains to be reused from besides it.
+	git rev-list --objects HEAD~1 >dup.list &&
+	dup=$(git pack-objects .git/objects/pack/pack <dup.list) &&
+	rm -f .git/objects/pack/multi-pack-index* &&
+	git multi-pack-index write --bitmap --preferred-pack=pack-$dup.idx &&
+
+	check_reuse --delta-base-offset &&
+	test_packs_reused 2
+'
+
+test_done
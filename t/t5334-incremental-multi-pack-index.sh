@@ -0,0 +1,143 @@
+#!/bin/sh
+
+test_description='incremental multi-pack-index'
+. ./test-lib.sh
+
+GIT_TEST_MULTI_PACK_INDEX=0
+GIT_TEST_MULTI_PACK_INDEX_WRITE_BITMAP=0
+
+packdir=.git/objects/pack
+midxdir=$packdir/multi-pack-index.d
+midx_chain=$midxdir/multi-pack-index-chain
+
+# Commit <n> new files named <prefix>.<i>, and pack the new objects on
+# their own.
+commit_and_pack () {
+	for i in $(test_seq $2)
+	do
+		echo "$1 $i" >$1.$i || return 1
+	done &&
+	git add $1.* &&
+	test_tick &&
+	git commit -q -m "$1" &&
+	git repack -d -q
+}
+
+test_midx_layers () {
+	test_line_count = $1 $midx_chain &&
+	ls $midxdir/multi-pack-index-*.midx >layers &&
+	test_line_count = $1 layers
+}
+
+test_midx_sees_everything () {
+	git -c core.multiPackIndex=false cat-file --batch-all-objects \
+		--batch-check="%(objectname) %(objecttype)" >expect &&
+	git cat-file --batch-all-objects \
+		--batch-check="%(objectname) %(objecttype)" >actual &&
+	test_cmp expect actual &&
+
+	git -c core.multiPackIndex=false log --oneline --raw --all >expect &&
+	git log --oneline --raw --all >actual &&
+	test_cmp expect actual &&
+
+	git multi-pack-index verify
+}
+
+test_expect_success 'setup' '
+	git config core.multiPackIndex true &&
+	commit_and_pack base 20
+'
+
+test_expect_success 'write an incremental multi-pack-index' '
+	git multi-pack-index write --incremental &&
+	test_path_is_missing $packdir/multi-pack-index &&
+	test_midx_layers 1 &&
+	test_midx_sees_everything &&
+	git count-objects -v >out &&
+	grep "^garbage: 0" out
+'
+
+test_expect_success 'nothing to do without new packs' '
+	cp $midx_chain chain.before &&
+	git multi-pack-index write --incremental &&
+	test_cmp chain.before $midx_chain
+'
+
+test_expect_success 'a small pack gets a layer of its own' '
+	commit_and_pack one 1 &&
+	git multi-pack-index write --incremental &&
+	test_midx_layers 2 &&
+	head -n 1 chain.before >expect &&
+	head -n 1 $midx_chain >actual &&
+	test_cmp expect actual &&
+	test_midx_sees_everything
+'
+
+test_expect_success 'layers of similar size are merged' '
+	commit_and_pack two 1 &&
+	git multi-pack-index write --incremental &&
+	test_midx_layers 2 &&
+	test_midx_sees_everything &&
+
+	commit_and_pack big 40 &&
+	git multi-pack-index write --incremental &&
+	test_midx_layers 1 &&
+	test_midx_sees_everything
+'
+
+test_expect_success 'objects already in a lower layer are not indexed again' '
+	git rev-parse HEAD >dup.list &&
+	git pack-objects -q $packdir/pack <dup.list &&
+	git multi-pack-index write --incremental &&
+	test_midx_layers 2 &&
+	test_midx_sees_everything &&
+
+	GIT_TRACE2_EVENT="$(pwd)/trace.txt" git cat-file -p HEAD &&
+	grep "\"key\":\"load/num_objects\",\"value\":\"0\"" trace.txt
+'
+
+test_expect_success 'the chain is read up to the first bad layer' '
+	cp $midx_chain chain.good &&
+	echo $(test_oid zero) >>$midx_chain &&
+	git cat-file -p HEAD 2>err &&
+	test_i18ngrep "unable to find all multi-pack-index layers" err &&
+	cp chain.good $midx_chain
+'
+
+test_expect_success 'incremental write is incompatible with bitmaps' '
+	test_must_fail git multi-pack-index write --incremental --bitmap 2>err &&
+	test_i18ngrep "cannot be used together" err &&
+	test_must_fail git multi-pack-index write --incremental \
+		--stdin-packs </dev/null 2>err &&
+	test_i18ngrep "cannot be used together" err
+'
+
+test_expect_success 'expire and repack refuse incremental multi-pack-indexes' '
+	test_must_fail git multi-pack-index expire 2>err &&
+	test_i18ngrep "incremental multi-pack-index" err &&
+	test_must_fail git multi-pack-index repack 2>err &&
+	test_i18ngrep "incremental multi-pack-index" err
+'
+
+test_expect_success 'a full write replaces the chain' '
+	git multi-pack-index write &&
+	test_path_is_file $packdir/multi-pack-index &&
+	test_path_is_missing $midxdir &&
+	test_midx_sees_everything
+'
+
+test_expect_success 'an incremental write replaces a full multi-pack-index' '
+	commit_and_pack four 1 &&
+	git multi-pack-index write --incremental &&
+	test_path_is_missing $packdir/multi-pack-index &&
+	test_midx_layers 1 &&
+	test_midx_sees_everything
+'
+
+test_expect_success 'repack removes the chain along with deleted packs' '
+	git repack -adq &&
+	test_path_is_missing $midxdir &&
+	git cat-file -p HEAD
+'
+
+test_done
@@ -110,6 +110,52 @@ test_expect_success 'filtering with --contains and --no-contains' '
 	test_cmp expect actual
 '
 
+test_expect_success 'filtering with reachability bitmaps' '
+	test_when_finished "rm -rf bitmaps.git" &&
+	git clone --mirror --no-local . bitmaps.git &&
+	(
+		cd bitmaps.git &&
+		git repack -a -d -b &&
+		git commit-graph write --reachable &&
+		five=$(git commit-tree -p side -m five side^{tree}) &&
+		git update-ref refs/heads/unpacked $five &&
+
+		for filter in --contains=two --no-contains=two \
+			      --contains=four --contains=unpacked \
+			      "--contains=two --no-contains=side" \
+			      --merged=side --no-merged=side \
+			      --merged=unpacked --merged=two
+		do
+			for graph in true false
+			do
+				git -c core.commitGraph=$graph for-each-ref \
+					$filter --format="%(refname)" \
+					>"../actual $filter $graph" || return 1
+			done
+		done &&
+
+		GIT_TRACE2_EVENT="$(pwd)/../trace.contains" \
+			git for-each-ref --contains=two >/dev/null &&
+		grep "\"key\":\"contains/bitmap\"" ../trace.contains &&
+		GIT_TRACE2_EVENT="$(pwd)/../trace.merged" \
+			git for-each-ref --merged=side >/dev/null &&
+		grep "\"key\":\"merged/bitmap\"" ../trace.merged &&
+
+		rm objects/pack/*.bitmap &&
+		for filter in --contains=two --no-contains=two \
+			      --contains=four --contains=unpacked \
+			      "--contains=two --no-contains=side" \
+			      --merged=side --no-merged=side \
+			      --merged=unpacked --merged=two
+		do
+			git -c core.commitGraph=false for-each-ref $filter \
+				--format="%(refname)" >../expect &&
+			test_cmp ../expect "../actual $filter true" &&
+			test_cmp ../expect "../actual $filter false" || return 1
+		done
+	)
+'
+
 test_expect_success '%(color) must fail' '
 	test_must_fail git for-each-ref --format="%(color)%(refname)"
 '
@@ -307,6 +307,78 @@ test_expect_success 'commit_contains:miss' '
 	test_all_modes commit_contains --tag
 '
 
+test_expect_success 'tips_reaching_commits:some' '
+	cat >input <<-\EOF &&
+	X:commit-9-1
+	X:commit-8-3
+	X:commit-7-5
+	X:commit-5-6
+	X:commit-5-6
+	X:commit-1-7
+	Y:commit-4-4
+	Y:commit-1-7
+	EOF
+	(
+		echo "tips_reaching_commits(X,Y)" &&
+		git rev-parse commit-1-7 \
+			      commit-7-5 \
+			      commit-5-6 \
+			      commit-5-6 | sort
+	) >expect &&
+	test_all_modes tips_reaching_commits
+'
+
+test_expect_success 'tips_reaching_commits:none' '
+	cat >input <<-\EOF &&
+	X:commit-9-1
+	X:commit-8-3
+	X:commit-2-9
+	Y:commit-3-4
+	Y:commit-8-6
+	EOF
+	echo "tips_reaching_commits(X,Y)" >expect &&
+	test_all_modes tips_reaching_commits
+'
+
+test_expect_success 'tips_reachable_from_bases:some' '
+	cat >input <<-\EOF &&
+	X:commit-1-1
+	X:commit-3-3
+	X:commit-3-3
+	X:commit-9-1
+	X:commit-5-7
+	X:commit-6-6
+	X:commit-7-7
+	Y:commit-6-8
+	Y:commit-8-2
+	EOF
+	(
+		echo "tips_reachable_from_bases(X,Y)" &&
+		git rev-parse commit-1-1 \
+			      commit-3-3 \
+			      commit-3-3 \
+			      commit-5-7 \
+			      commit-6-6 | sort
+	) >expect &&
+	test_all_modes tips_reachable_from_bases
+'
+
+test_expect_success 'tips_reachable_from_bases:all' '
+	cat >input <<-\EOF &&
+	X:commit-1-1
+	X:commit-4-2
+	X:commit-2-9
+	Y:commit-9-9
+	EOF
+	(
+		echo "tips_reachable_from_bases(X,Y)" &&
+		git rev-parse commit-1-1 \
+			      commit-4-2 \
+			      commit-2-9 | sort
+	) >expect &&
+	test_all_modes tips_reachable_from_bases
+'
+
 test_expect_success 'rev-list: basic topo-order' '
 	git rev-parse \
 		commit-6-6 commit-5-6 commit-4-6 commit-3-6 commit-2-6 commit-1-6 \
@@ -1676,4 +1676,26 @@ test_expect_success 'racy timestamps will be fixed for dirty worktree' '
 	! test_is_magic_mtime .git/index
 '
 
+test_expect_success 'status is the same with core.ioUring' '
+	test_when_finished "git reset --hard" &&
+	for i in $(test_seq 1 100)
+	do
+		echo $i >batch-$i || return 1
+	done &&
+	git add batch-* &&
+	git commit -m "many files" &&
+	echo changed >batch-3 &&
+	rm batch-7 &&
+	test_chmod +x batch-11 &&
+	git status --porcelain -uno >expect &&
+	rm -f trace.txt &&
+	GIT_TEST_PRELOAD_INDEX=1 GIT_TRACE2_EVENT="$(pwd)/trace.txt" \
+		git -c core.ioUring=true status --porcelain -uno >actual &&
+	test_cmp expect actual &&
+	if test_have_prereq IO_URING
+	then
+		grep "\"key\":\"preload/sum_batched_lstat\"" trace.txt
+	fi
+'
+
 test_done
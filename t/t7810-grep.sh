@@ -1091,6 +1091,56 @@ do
 	"
 done
 
+test_expect_success 'threaded grep shares the delta base cache' '
+	git init deltas &&
+	for i in $(test_seq 1 10)
+	do
+		for f in a b c d
+		do
+			test_seq $i 200 >deltas/$f &&
+			echo "$f line $i" >>deltas/$f || return 1
+		done &&
+		git -C deltas add . &&
+		git -C deltas commit -q -m "commit $i" || return 1
+	done &&
+	git -C deltas repack -adf --depth=10 &&
+	git -C deltas grep --threads=1 -e line HEAD~9 >expect &&
+	GIT_TRACE2_EVENT="$PWD/trace2.txt" \
+		git -C deltas -c core.deltaBaseCacheLimit=1 \
+		grep --threads=4 -e line HEAD~9 >actual &&
+	test_cmp expect actual &&
+	grep "\"key\":\"delta-base-cache/misses\"" trace2.txt &&
+	grep "\"key\":\"delta-base-cache/evictions\"" trace2.txt
+'
+
+test_expect_success PTHREADS 'grep worker threads report object read lock waits' '
+	rm -f trace2.txt &&
+	GIT_TRACE2_EVENT="$PWD/trace2.txt" \
+		git -C deltas grep --threads=2 --cached -e line >actual &&
+	test_line_count = 4 actual &&
+	for th in th01:grep th02:grep
+	do
+		grep "\"region_enter\".*\"thread\":\"$th\".*\"label\":\"worker\"" trace2.txt &&
+		grep "\"thread\":\"$th\".*\"key\":\"obj_read_lock/wait_ns\"" trace2.txt ||
+		return 1
+	done
+'
+
+test_expect_success PTHREADS 'grep worker threads unpack blobs without the object read lock' '
+	git -C deltas rev-list HEAD >revs &&
+	git -C deltas grep --threads=1 -e line $(cat revs) >expect &&
+	rm -f trace2.txt &&
+	GIT_TRACE2_EVENT="$PWD/trace2.txt" \
+		git -C deltas -c core.packedGitWindowSize=4k \
+		grep --threads=4 -e line $(cat revs) >actual &&
+	test_cmp expect actual &&
+	grep "\"key\":\"unlocked_reads\",\"value\":\"[1-9]" trace2.txt &&
+
+	git -C deltas -c repack.useDeltaBaseOffset=false repack -adf --depth=10 &&
+	git -C deltas grep --threads=4 -e line $(cat revs) >actual &&
+	test_cmp expect actual
+'
+
 test_expect_success !PTHREADS,!FAIL_PREREQS \
 	'grep --threads=N or pack.threads=N warns when no pthreads' '
 	git grep --threads=2 Hello hello_world 2>err &&
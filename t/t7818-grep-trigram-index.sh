@@ -0,0 +1,153 @@
+#!/bin/sh
+
+test_description='git grep with a trigram index'
+
+. ./test-lib.sh
+
+index=.git/objects/info/grep-index
+
+# Run "git grep" with and without the grep index, and make sure the
+# results are the same.
+test_grep_index () {
+	test_might_fail git -c grep.trigramIndex=false grep "$@" >expect &&
+	test_might_fail git grep "$@" >actual &&
+	test_cmp expect actual
+}
+
+# Check how many blobs "git grep <args>" skips.
+test_grep_skipped () {
+	skipped=$1 &&
+	shift &&
+	rm -f trace.txt &&
+	GIT_TRACE2_EVENT="$(pwd)/trace.txt" git grep "$@" >/dev/null &&
+	grep "\"key\":\"skipped\",\"value\":\"$skipped\"" trace.txt
+}
+
+# Check that "git grep <args>" does not use the index.
+test_grep_not_pruned () {
+	rm -f trace.txt &&
+	GIT_TRACE2_EVENT="$(pwd)/trace.txt" git grep "$@" >/dev/null &&
+	! grep "\"category\":\"grep-index\"" trace.txt
+}
+
+test_expect_success 'setup' '
+	echo "the quick brown fox" >fox &&
+	echo "jumps over the lazy dog" >dog &&
+	echo "Hello World" >hello &&
+	printf "line one\nline two\n" >lines &&
+	echo "KELVIN" >kelvin &&
+	git add . &&
+	git commit -m initial &&
+	git maintenance run --task=grep-index --quiet &&
+	test_path_is_file $index
+'
+
+test_expect_success 'grep-index task does not touch packs or the work tree' '
+	git count-objects -v >out &&
+	grep "^garbage: 0" out &&
+	git status --porcelain --untracked-files=no >out &&
+	test_must_be_empty out
+'
+
+test_expect_success 'fixed strings' '
+	test_grep_index -F quick HEAD &&
+	test_grep_index -F "lazy dog" HEAD &&
+	test_grep_index -F nomatch HEAD &&
+	test_grep_skipped 4 -F quick HEAD
+'
+
+test_expect_success 'basic and extended regexes' '
+	test_grep_index "qu.ck" HEAD &&
+	test_grep_index "br[aeiou]wn f" HEAD &&
+	test_grep_index -E "jumps+ over" HEAD &&
+	test_grep_index "l\(ine\) two" HEAD &&
+	test_grep_index -E "(hello|quick) brown" HEAD &&
+	test_grep_index -E "x{1,3}yz" HEAD &&
+	test_grep_index "ov\{1,2\}er" HEAD &&
+	test_grep_skipped 4 -E "jumps+ over" HEAD
+'
+
+test_expect_success 'alternation is not pruned' '
+	test_grep_index -E "quick|lazy" HEAD &&
+	test_grep_index "quick\|lazy" HEAD &&
+	test_grep_not_pruned -E "quick|lazy" HEAD
+'
+
+test_expect_success PCRE 'perl regexes' '
+	test_grep_index -P "qu\w+k bro" HEAD &&
+	test_grep_index -P "\x71uick" HEAD &&
+	test_grep_index -P "(?i)QUICK" HEAD &&
+	test_grep_index -P "lazy\s+dog" HEAD
+'
+
+test_expect_success 'ignore case' '
+	test_grep_index -i "HELLO world" HEAD &&
+	test_grep_index -i -F "THE QUICK" HEAD &&
+	test_grep_index -i kelvin HEAD &&
+	test_grep_skipped 4 -i "HELLO world" HEAD
+'
+
+test_expect_success 'multiple patterns' '
+	test_grep_index -e quick -e lazy HEAD &&
+	test_grep_index -e quick --and -e brown HEAD &&
+	test_grep_index -e quick --and --not -e brown HEAD &&
+	test_grep_index --all-match -e quick -e brown HEAD &&
+	test_grep_skipped 3 -e quick -e lazy HEAD
+'
+
+test_expect_success 'options that need every blob are not pruned' '
+	test_grep_index -v quick HEAD &&
+	test_grep_index -L quick HEAD &&
+	test_grep_index -c quick HEAD &&
+	test_grep_not_pruned -L quick HEAD &&
+	test_grep_not_pruned -v quick HEAD
+'
+
+test_expect_success 'blobs given on the command line' '
+	test_grep_index quick HEAD:fox HEAD:dog &&
+	test_grep_skipped 1 quick HEAD:fox HEAD:dog
+'
+
+test_expect_success 'blobs written after the index are searched' '
+	echo "a quick new blob" >new &&
+	git add new &&
+	git commit -m new &&
+	test_grep_index quick HEAD &&
+	git grep quick HEAD >actual &&
+	grep "^HEAD:new:" actual
+'
+
+test_expect_success 'the index is not used for the work tree' '
+	echo "quick but untracked" >untracked &&
+	git grep --untracked quick >actual &&
+	grep "^untracked:" actual &&
+	git grep quick >actual &&
+	grep "^fox:" actual
+'
+
+test_expect_success 'grep.trigramIndex=false disables the index' '
+	rm -f trace.txt &&
+	GIT_TRACE2_EVENT="$(pwd)/trace.txt" \
+		git -c grep.trigramIndex=false grep quick HEAD &&
+	! grep "\"category\":\"grep-index\"" trace.txt
+'
+
+test_expect_success 'a corrupt index is ignored' '
+	test_when_finished "rm -f $index" &&
+	printf "junk" >$index &&
+	test_grep_index quick HEAD 2>err &&
+	echo "not a grep index at all" >$index &&
+	test_grep_index quick HEAD
+'
+
+test_expect_success 'blobs that do not fit in the index are searched' '
+	test_when_finished "rm -f $index" &&
+	GIT_TEST_GREP_INDEX_MAX_POSTINGS=50 \
+		git maintenance run --task=grep-index 2>err &&
+	test_i18ngrep "grep-index is full" err &&
+	test_grep_index -F quick HEAD &&
+	test_grep_index -F "lazy dog" HEAD &&
+	test_grep_index -i "HELLO world" HEAD
+'
+
+test_done
@@ -129,6 +129,45 @@ test_expect_success '--exclude-promisor-objects does not BUG-crash' '
 	test_must_fail git blame --exclude-promisor-objects one
 '
 
+test_expect_success 'blame.threads does not change the result' '
+	for opt in "" -w --first-parent -M -C --line-porcelain "-L 3,5"
+	do
+		git blame $opt file >expect &&
+		git -c blame.threads=4 blame $opt file >actual &&
+		test_cmp expect actual || return 1
+	done
+'
+
+test_expect_success PTHREADS 'blame.threads computes diffs ahead of time' '
+	GIT_TRACE2_EVENT="$(pwd)/trace.txt" \
+		git -c blame.threads=4 blame file >/dev/null &&
+	grep "\"key\":\"prefetch/used\",\"value\":\"[1-9]" trace.txt
+'
+
+test_expect_success 'blame.threads with skewed commit dates' '
+	git init skew &&
+	(
+		cd skew &&
+		test_seq 30000 >f &&
+		git add f &&
+		for c in W:50:100 X:300:10000 Y:100:20000 O:500:29000
+		do
+			name=${c%%:*} &&
+			rest=${c#*:} &&
+			date=${rest%:*} &&
+			line=${rest#*:} &&
+			sed "${line}s/\$/ $name/" f >f.new &&
+			mv f.new f &&
+			GIT_AUTHOR_DATE="@$date +0000" \
+			GIT_COMMITTER_DATE="@$date +0000" \
+				git commit -q -a -m $name || return 1
+		done &&
+		git blame -s HEAD -- f >expect &&
+		git -c blame.threads=2 blame -s HEAD -- f >actual &&
+		test_cmp expect actual
+	)
+'
+
 test_expect_success 'blame with uncommitted edits in partial clone does not crash' '
 	git init server &&
 	echo foo >server/file.txt &&
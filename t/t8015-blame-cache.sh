@@ -0,0 +1,163 @@
+#!/bin/sh
+
+test_description='git blame with a blame cache'
+. ./test-lib.sh
+
+# Blame with and without the cache, and make sure the results are the
+# same.
+test_blame_cache () {
+	git blame "$@" >expect &&
+	git -c blame.cache=true blame "$@" >actual &&
+	test_cmp expect actual
+}
+
+# Check how many of the origins "git blame <args>" dug through were
+# found in the cache.
+test_blame_cache_hits () {
+	hits=$1 &&
+	shift &&
+	rm -f trace.txt &&
+	GIT_TRACE2_EVENT="$(pwd)/trace.txt" \
+		git -c blame.cache=true blame "$@" >/dev/null &&
+	grep "\"key\":\"cache/hits\",\"value\":\"$hits\"" trace.txt
+}
+
+test_blame_cache_unused () {
+	rm -f trace.txt &&
+	GIT_TRACE2_EVENT="$(pwd)/trace.txt" \
+		git -c blame.cache=true blame "$@" >/dev/null &&
+	! grep "\"key\":\"cache/" trace.txt
+}
+
+test_expect_success 'setup' '
+	test_write_lines one two three four five six >file &&
+	git add file &&
+	test_tick &&
+	git commit -m A &&
+	git tag A &&
+
+	test_write_lines one TWO three four five six seven >file &&
+	test_tick &&
+	git commit -a -m B &&
+	git tag B &&
+
+	git mv file renamed &&
+	test_tick &&
+	git commit -m C &&
+	git tag C &&
+
+	git checkout -b side B &&
+	test_write_lines one TWO three four FIVE six seven >file &&
+	test_tick &&
+	git commit -a -m side &&
+	git checkout - &&
+	test_tick &&
+	git merge -m D side &&
+	git tag D
+'
+
+test_expect_success 'the cache is off by default' '
+	GIT_TRACE2_EVENT="$(pwd)/trace.txt" git blame D -- renamed &&
+	! grep "\"key\":\"cache/" trace.txt &&
+	test_must_fail git rev-parse --verify -q refs/notes/blame-cache
+'
+
+test_expect_success 'blaming a whole file fills the cache' '
+	test_blame_cache B -- file &&
+	git rev-parse --verify refs/notes/blame-cache &&
+	test_blame_cache_hits 1 B -- file
+'
+
+test_expect_success 'descendants are blamed from the nearest cached commit' '
+	test_blame_cache C -- renamed &&
+	test_blame_cache -p C -- renamed &&
+	test_blame_cache_hits 1 C -- renamed &&
+	test_blame_cache D -- renamed &&
+	test_blame_cache --line-porcelain D -- renamed &&
+	test_blame_cache -f -n -s D -- renamed &&
+	test_blame_cache_hits 1 D -- renamed
+'
+
+test_expect_success 'line ranges use the cache but do not fill it' '
+	git update-ref -d refs/notes/blame-cache &&
+	test_blame_cache -L 2,3 C -- renamed &&
+	test_must_fail git rev-parse --verify -q refs/notes/blame-cache &&
+	git -c blame.cache=true blame B -- file &&
+	test_blame_cache -L 2,3 C -- renamed &&
+	test_blame_cache_hits 1 -L 2,3 C -- renamed
+'
+
+test_expect_success 'boundaries and --root' '
+	test_blame_cache -b D -- renamed &&
+	test_blame_cache --root D -- renamed
+'
+
+test_expect_success 'whitespace options are cached separately' '
+	git -c blame.cache=true blame -w D -- renamed &&
+	test_blame_cache_hits 1 -w D -- renamed &&
+	test_blame_cache_hits 1 D -- renamed &&
+	test_blame_cache -w D -- renamed
+'
+
+test_expect_success 'the work tree is blamed on top of the cache' '
+	test_when_finished "git checkout renamed" &&
+	echo eight >>renamed &&
+	# -s, as the uncommitted line is dated with the current time
+	test_blame_cache -s renamed &&
+	test_blame_cache_hits 1 renamed
+'
+
+test_expect_success 'the cache is not used where it cannot help' '
+	test_blame_cache_unused -M D -- renamed &&
+	test_blame_cache_unused -C D -- renamed &&
+	test_blame_cache_unused --reverse A..D -- file &&
+	test_blame_cache_unused A..D -- renamed &&
+	test_blame_cache_unused --ignore-rev B D -- renamed &&
+	test_blame_cache_unused --first-parent D -- renamed
+'
+
+test_expect_success 'the cache is not used with a shallow history' '
+	test_when_finished "rm -rf shallow" &&
+	git clone --depth 1 "file://$(pwd)" shallow &&
+	(
+		cd shallow &&
+		test_blame_cache_unused HEAD -- renamed &&
+		test_must_fail git rev-parse --verify -q refs/notes/blame-cache &&
+		git fetch --unshallow &&
+		test_blame_cache HEAD -- renamed &&
+		test_blame_cache_hits 1 HEAD -- renamed
+	)
+'
+
+test_expect_success 'the cache is not used with replaced commits' '
+	test_when_finished "git replace -d C" &&
+	git replace --graft C A &&
+	test_blame_cache_unused D -- renamed &&
+	test_blame_cache_unused C -- renamed
+'
+
+test_expect_success 'a broken cache entry is ignored' '
+	git update-ref -d refs/notes/blame-cache &&
+	git -c blame.cache=true blame B -- file &&
+	note=$(git notes --ref=blame-cache list) &&
+	echo "junk" >junk &&
+	blob=$(git hash-object -w junk) &&
+	git notes --ref=blame-cache add -f -C $blob ${note#* } &&
+	git update-ref refs/notes/blame-cache \
+		$(git commit-tree -m "blame cache v1" refs/notes/blame-cache^{tree}) &&
+	test_blame_cache D -- renamed &&
+	test_blame_cache_hits 0 B -- file
+'
+
+test_expect_success 'blame does not fail without an identity' '
+	git update-ref -d refs/notes/blame-cache &&
+	(
+		sane_unset GIT_AUTHOR_NAME GIT_AUTHOR_EMAIL &&
+		sane_unset GIT_COMMITTER_NAME GIT_COMMITTER_EMAIL &&
+		git -c user.useConfigOnly=true -c blame.cache=true \
+			blame D -- renamed
+	) &&
+	test_must_fail git rev-parse --verify -q refs/notes/blame-cache
+'
+
+test_done
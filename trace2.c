@@ -1,6 +1,7 @@
 #include "cache.h"
 #include "config.h"
 #include "json-writer.h"
+#include "packfile.h"
 #include "quote.h"
 #include "run-command.h"
 #include "sigchain.h"
@@ -213,6 +214,7 @@ void trace2_cmd_exit_fl(const char *file, int line, int code)
 		return;
 
 	trace_git_fsync_stats();
+	trace_delta_base_cache_stats();
 	trace2_collect_process_info(TRACE2_PROCESS_INFO_EXIT);
 
 	tr2main_exit_code = code;
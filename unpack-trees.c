@@ -1835,6 +1835,7 @@ int unpack_trees(unsigned len, struct tree_desc *t, struct unpack_trees_options
 		o->result.split_index = init_split_index(&o->result);
 	}
 	oidcpy(&o->result.oid, &o->src_index->oid);
+	o->result.file_stat = o->src_index->file_stat;
 	o->merge_size = len;
 	mark_all_ce_unused(o->src_index);
 